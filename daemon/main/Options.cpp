@@ -87,9 +87,11 @@ static const char* OPTION_PARCHECK				= "ParCheck";
 static const char* OPTION_PARREPAIR				= "ParRepair";
 static const char* OPTION_PARSCAN				= "ParScan";
 static const char* OPTION_PARQUICK				= "ParQuick";
+static const char* OPTION_PARINCREMENTAL		= "ParIncremental";
 static const char* OPTION_PARRENAME				= "ParRename";
 static const char* OPTION_PARBUFFER				= "ParBuffer";
 static const char* OPTION_PARTHREADS			= "ParThreads";
+static const char* OPTION_PARVERIFYTHREADS		= "ParVerifyThreads";
 static const char* OPTION_HEALTHCHECK			= "HealthCheck";
 static const char* OPTION_SCANSCRIPT			= "ScanScript";
 static const char* OPTION_QUEUESCRIPT			= "QueueScript";
@@ -102,6 +104,8 @@ static const char* OPTION_CURSESGROUP			= "CursesGroup";
 static const char* OPTION_CRCCHECK				= "CrcCheck";
 static const char* OPTION_DIRECTWRITE			= "DirectWrite";
 static const char* OPTION_WRITEBUFFER			= "WriteBuffer";
+static const char* OPTION_MAPPEDWRITE			= "MappedWrite";
+static const char* OPTION_FILEALLOCATION		= "FileAllocation";
 static const char* OPTION_NZBDIRINTERVAL		= "NzbDirInterval";
 static const char* OPTION_NZBDIRFILEAGE			= "NzbDirFileAge";
 static const char* OPTION_DISKSPACE				= "DiskSpace";
@@ -111,8 +115,10 @@ static const char* OPTION_SCRIPTPAUSEQUEUE		= "ScriptPauseQueue";
 static const char* OPTION_NZBCLEANUPDISK		= "NzbCleanupDisk";
 static const char* OPTION_PARTIMELIMIT			= "ParTimeLimit";
 static const char* OPTION_KEEPHISTORY			= "KeepHistory";
+static const char* OPTION_RECENTHISTORY		= "RecentHistory";
 static const char* OPTION_ACCURATERATE			= "AccurateRate";
 static const char* OPTION_UNPACK				= "Unpack";
+static const char* OPTION_DIRECTUNPACK			= "DirectUnpack";
 static const char* OPTION_UNPACKCLEANUPDISK		= "UnpackCleanupDisk";
 static const char* OPTION_UNRARCMD				= "UnrarCmd";
 static const char* OPTION_SEVENZIPCMD			= "SevenZipCmd";
@@ -132,6 +138,10 @@ static const char* OPTION_SHELLOVERRIDE			= "ShellOverride";
 static const char* OPTION_MONTHLYQUOTA			= "MonthlyQuota";
 static const char* OPTION_QUOTASTARTDAY			= "QuotaStartDay";
 static const char* OPTION_DAILYQUOTA			= "DailyQuota";
+static const char* OPTION_POSTCPUJOBS			= "PostCpuJobs";
+static const char* OPTION_POSTDISKJOBS			= "PostDiskJobs";
+static const char* OPTION_POSTSCRIPTJOBS		= "PostScriptJobs";
+static const char* OPTION_POSTVOLUMEJOBS		= "PostVolumeJobs";
 
 // obsolete options
 static const char* OPTION_POSTLOGKIND			= "PostLogKind";
@@ -332,6 +342,7 @@ void Options::Init(const char* exeName, const char* configFilename, bool noConfi
 	InitCategories();
 	InitScheduler();
 	InitFeeds();
+	InitParVerifyThreads();
 }
 
 Options::~Options()
@@ -444,9 +455,11 @@ void Options::InitDefaults()
 	SetOption(OPTION_PARREPAIR, "yes");
 	SetOption(OPTION_PARSCAN, "extended");
 	SetOption(OPTION_PARQUICK, "yes");
+	SetOption(OPTION_PARINCREMENTAL, "no");
 	SetOption(OPTION_PARRENAME, "yes");
 	SetOption(OPTION_PARBUFFER, "16");
 	SetOption(OPTION_PARTHREADS, "1");
+	SetOption(OPTION_PARVERIFYTHREADS, "1");
 	SetOption(OPTION_HEALTHCHECK, "none");
 	SetOption(OPTION_SCRIPTORDER, "");
 	SetOption(OPTION_POSTSCRIPT, "");
@@ -462,6 +475,8 @@ void Options::InitDefaults()
 	SetOption(OPTION_CRCCHECK, "yes");
 	SetOption(OPTION_DIRECTWRITE, "yes");
 	SetOption(OPTION_WRITEBUFFER, "0");
+	SetOption(OPTION_MAPPEDWRITE, "no");
+	SetOption(OPTION_FILEALLOCATION, "auto");
 	SetOption(OPTION_NZBDIRINTERVAL, "5");
 	SetOption(OPTION_NZBDIRFILEAGE, "60");
 	SetOption(OPTION_DISKSPACE, "250");
@@ -471,8 +486,10 @@ void Options::InitDefaults()
 	SetOption(OPTION_NZBCLEANUPDISK, "no");
 	SetOption(OPTION_PARTIMELIMIT, "0");
 	SetOption(OPTION_KEEPHISTORY, "7");
+	SetOption(OPTION_RECENTHISTORY, "100");
 	SetOption(OPTION_ACCURATERATE, "no");
 	SetOption(OPTION_UNPACK, "no");
+	SetOption(OPTION_DIRECTUNPACK, "no");
 	SetOption(OPTION_UNPACKCLEANUPDISK, "no");
 #ifdef WIN32
 	SetOption(OPTION_UNRARCMD, "unrar.exe");
@@ -495,6 +512,10 @@ void Options::InitDefaults()
 	SetOption(OPTION_MONTHLYQUOTA, "0");
 	SetOption(OPTION_QUOTASTARTDAY, "1");
 	SetOption(OPTION_DAILYQUOTA, "0");
+	SetOption(OPTION_POSTCPUJOBS, "1");
+	SetOption(OPTION_POSTDISKJOBS, "1");
+	SetOption(OPTION_POSTSCRIPTJOBS, "1");
+	SetOption(OPTION_POSTVOLUMEJOBS, "0");
 }
 
 void Options::InitOptFile()
@@ -684,6 +705,7 @@ void Options::InitOptions()
 	m_diskSpace				= ParseIntValue(OPTION_DISKSPACE, 10);
 	m_parTimeLimit			= ParseIntValue(OPTION_PARTIMELIMIT, 10);
 	m_keepHistory			= ParseIntValue(OPTION_KEEPHISTORY, 10);
+	m_recentHistory			= ParseIntValue(OPTION_RECENTHISTORY, 10);
 	m_feedHistory			= ParseIntValue(OPTION_FEEDHISTORY, 10);
 	m_timeCorrection		= ParseIntValue(OPTION_TIMECORRECTION, 10);
 	if (-24 <= m_timeCorrection && m_timeCorrection <= 24)
@@ -699,6 +721,10 @@ void Options::InitOptions()
 	m_monthlyQuota			= ParseIntValue(OPTION_MONTHLYQUOTA, 10);
 	m_quotaStartDay			= ParseIntValue(OPTION_QUOTASTARTDAY, 10);
 	m_dailyQuota			= ParseIntValue(OPTION_DAILYQUOTA, 10);
+	m_postCpuJobs			= ParseIntValue(OPTION_POSTCPUJOBS, 10);
+	m_postDiskJobs			= ParseIntValue(OPTION_POSTDISKJOBS, 10);
+	m_postScriptJobs		= ParseIntValue(OPTION_POSTSCRIPTJOBS, 10);
+	m_postVolumeJobs		= ParseIntValue(OPTION_POSTVOLUMEJOBS, 10);
 
 	m_brokenLog				= (bool)ParseEnumValue(OPTION_BROKENLOG, BoolCount, BoolNames, BoolValues);
 	m_nzbLog				= (bool)ParseEnumValue(OPTION_NZBLOG, BoolCount, BoolNames, BoolValues);
@@ -709,6 +735,7 @@ void Options::InitOptions()
 	m_dupeCheck				= (bool)ParseEnumValue(OPTION_DUPECHECK, BoolCount, BoolNames, BoolValues);
 	m_parRepair				= (bool)ParseEnumValue(OPTION_PARREPAIR, BoolCount, BoolNames, BoolValues);
 	m_parQuick				= (bool)ParseEnumValue(OPTION_PARQUICK, BoolCount, BoolNames, BoolValues);
+	m_parIncremental		= (bool)ParseEnumValue(OPTION_PARINCREMENTAL, BoolCount, BoolNames, BoolValues);
 	m_parRename				= (bool)ParseEnumValue(OPTION_PARRENAME, BoolCount, BoolNames, BoolValues);
 	m_reloadQueue			= (bool)ParseEnumValue(OPTION_RELOADQUEUE, BoolCount, BoolNames, BoolValues);
 	m_cursesNzbName			= (bool)ParseEnumValue(OPTION_CURSESNZBNAME, BoolCount, BoolNames, BoolValues);
@@ -716,6 +743,7 @@ void Options::InitOptions()
 	m_cursesGroup			= (bool)ParseEnumValue(OPTION_CURSESGROUP, BoolCount, BoolNames, BoolValues);
 	m_crcCheck				= (bool)ParseEnumValue(OPTION_CRCCHECK, BoolCount, BoolNames, BoolValues);
 	m_directWrite			= (bool)ParseEnumValue(OPTION_DIRECTWRITE, BoolCount, BoolNames, BoolValues);
+	m_mappedWrite			= (bool)ParseEnumValue(OPTION_MAPPEDWRITE, BoolCount, BoolNames, BoolValues);
 	m_decode				= (bool)ParseEnumValue(OPTION_DECODE, BoolCount, BoolNames, BoolValues);
 	m_dumpCore				= (bool)ParseEnumValue(OPTION_DUMPCORE, BoolCount, BoolNames, BoolValues);
 	m_parPauseQueue			= (bool)ParseEnumValue(OPTION_PARPAUSEQUEUE, BoolCount, BoolNames, BoolValues);
@@ -724,6 +752,7 @@ void Options::InitOptions()
 	m_accurateRate			= (bool)ParseEnumValue(OPTION_ACCURATERATE, BoolCount, BoolNames, BoolValues);
 	m_secureControl			= (bool)ParseEnumValue(OPTION_SECURECONTROL, BoolCount, BoolNames, BoolValues);
 	m_unpack				= (bool)ParseEnumValue(OPTION_UNPACK, BoolCount, BoolNames, BoolValues);
+	m_directUnpack			= (bool)ParseEnumValue(OPTION_DIRECTUNPACK, BoolCount, BoolNames, BoolValues);
 	m_unpackCleanupDisk		= (bool)ParseEnumValue(OPTION_UNPACKCLEANUPDISK, BoolCount, BoolNames, BoolValues);
 	m_unpackPauseQueue		= (bool)ParseEnumValue(OPTION_UNPACKPAUSEQUEUE, BoolCount, BoolNames, BoolValues);
 	m_urlForce				= (bool)ParseEnumValue(OPTION_URLFORCE, BoolCount, BoolNames, BoolValues);
@@ -748,6 +777,11 @@ void Options::InitOptions()
 	const int HealthCheckCount = 4;
 	m_healthCheck = (EHealthCheck)ParseEnumValue(OPTION_HEALTHCHECK, HealthCheckCount, HealthCheckNames, HealthCheckValues);
 
+	const char* FileAllocationNames[] = { "auto", "sparse", "full", "ahead" };
+	const int FileAllocationValues[] = { faAuto, faSparse, faFull, faAhead };
+	const int FileAllocationCount = 4;
+	m_fileAllocation = (EFileAllocation)ParseEnumValue(OPTION_FILEALLOCATION, FileAllocationCount, FileAllocationNames, FileAllocationValues);
+
 	const char* TargetNames[] = { "screen", "log", "both", "none" };
 	const int TargetValues[] = { mtScreen, mtLog, mtBoth, mtNone };
 	const int TargetCount = 4;
@@ -1058,6 +1092,56 @@ void Options::InitCategories()
 	}
 }
 
+/*
+ * Entries are "<threads>" or "<directory>=<threads>", the directory may contain '='.
+ */
+void Options::InitParVerifyThreads()
+{
+	const int MAX_VERIFY_THREADS = 99;
+
+	m_parVerifyThreads.clear();
+
+	const char* option = GetOption(OPTION_PARVERIFYTHREADS);
+	if (!option)
+	{
+		return;
+	}
+
+	Tokenizer tok(option, ",;");
+	while (char* entry = tok.Next())
+	{
+		CString directory;
+		char* value = entry;
+		char* separator = strrchr(entry, '=');
+		if (separator)
+		{
+			if (separator > entry)
+			{
+				directory.Set(entry, (int)(separator - entry));
+				directory.TrimRight();
+			}
+			value = Util::Trim(separator + 1);
+			if (directory.Empty())
+			{
+				ConfigError("Invalid value for option \"%s\": %s. Directory missing, entry ignored",
+					OPTION_PARVERIFYTHREADS, entry);
+				continue;
+			}
+		}
+
+		char* end;
+		long threads = strtol(value, &end, 10);
+		if (end == value || *end != '\0' || threads < 0 || threads > MAX_VERIFY_THREADS)
+		{
+			ConfigError("Invalid value for option \"%s\": %s. Number of threads must be 0-%i, entry ignored",
+				OPTION_PARVERIFYTHREADS, entry, MAX_VERIFY_THREADS);
+			continue;
+		}
+
+		m_parVerifyThreads.emplace_back(directory, (int)threads);
+	}
+}
+
 void Options::InitFeeds()
 {
 	int n = 1;
@@ -1666,6 +1750,11 @@ void Options::CheckOptions()
 		m_directWrite = false;
 	}
 
+	if (!m_directWrite)
+	{
+		m_mappedWrite = false;
+	}
+
 	// if option "ConfigTemplate" is not set, use "WebDir" as default location for template
 	// (for compatibility with versions 9 and 10).
 	if (m_configTemplate.Empty() && !m_noDiskAccess)
@@ -1699,6 +1788,29 @@ void Options::CheckOptions()
 		m_parBuffer = 400;
 	}
 
+	if (m_postCpuJobs < 1)
+	{
+		ConfigError("Invalid value for option \"%s\": %i. Changed to 1", OPTION_POSTCPUJOBS, m_postCpuJobs);
+		m_postCpuJobs = 1;
+	}
+
+	if (m_postDiskJobs < 1)
+	{
+		ConfigError("Invalid value for option \"%s\": %i. Changed to 1", OPTION_POSTDISKJOBS, m_postDiskJobs);
+		m_postDiskJobs = 1;
+	}
+
+	if (m_postScriptJobs < 1)
+	{
+		ConfigError("Invalid value for option \"%s\": %i. Changed to 1", OPTION_POSTSCRIPTJOBS, m_postScriptJobs);
+		m_postScriptJobs = 1;
+	}
+
+	if (m_postVolumeJobs < 0)
+	{
+		m_postVolumeJobs = 0;
+	}
+
 	if (!m_unpackPassFile.Empty() && !FileSystem::FileExists(m_unpackPassFile))
 	{
 		ConfigError("Invalid value for option \"UnpackPassFile\": %s. File not found", *m_unpackPassFile);
@@ -70,6 +70,13 @@ public:
 		hcPark,
 		hcNone
 	};
+	enum EFileAllocation
+	{
+		faAuto,
+		faSparse,
+		faFull,
+		faAhead
+	};
 	enum ESchedulerCommand
 	{
 		scPauseDownload,
@@ -150,6 +157,21 @@ public:
 		Category* FindCategory(const char* name, bool searchAliases);
 	};
 
+	class VerifyThreads
+	{
+	public:
+		VerifyThreads(const char* directory, int threads) : m_directory(directory), m_threads(threads) {}
+		/* Empty for the default entry */
+		const char* GetDirectory() { return m_directory; }
+		int GetThreads() { return m_threads; }
+
+	private:
+		CString m_directory;
+		int m_threads;
+	};
+
+	typedef std::vector<VerifyThreads> VerifyThreadsList;
+
 	class Extender
 	{
 	public:
@@ -231,9 +253,11 @@ public:
 	bool GetParRepair() { return m_parRepair; }
 	EParScan GetParScan() { return m_parScan; }
 	bool GetParQuick() { return m_parQuick; }
+	bool GetParIncremental() { return m_parIncremental; }
 	bool GetParRename() { return m_parRename; }
 	int GetParBuffer() { return m_parBuffer; }
 	int GetParThreads() { return m_parThreads; }
+	VerifyThreadsList* GetParVerifyThreads() { return &m_parVerifyThreads; }
 	EHealthCheck GetHealthCheck() { return m_healthCheck; }
 	const char* GetScriptOrder() { return m_scriptOrder; }
 	const char* GetPostScript() { return m_postScript; }
@@ -248,6 +272,8 @@ public:
 	bool GetCrcCheck() { return m_crcCheck; }
 	bool GetDirectWrite() { return m_directWrite; }
 	int GetWriteBuffer() { return m_writeBuffer; }
+	bool GetMappedWrite() { return m_mappedWrite; }
+	EFileAllocation GetFileAllocation() { return m_fileAllocation; }
 	int GetNzbDirInterval() { return m_nzbDirInterval; }
 	int GetNzbDirFileAge() { return m_nzbDirFileAge; }
 	int GetDiskSpace() { return m_diskSpace; }
@@ -258,8 +284,10 @@ public:
 	bool GetNzbCleanupDisk() { return m_nzbCleanupDisk; }
 	int GetParTimeLimit() { return m_parTimeLimit; }
 	int GetKeepHistory() { return m_keepHistory; }
+	int GetRecentHistory() { return m_recentHistory; }
 	bool GetAccurateRate() { return m_accurateRate; }
 	bool GetUnpack() { return m_unpack; }
+	bool GetDirectUnpack() { return m_directUnpack; }
 	bool GetUnpackCleanupDisk() { return m_unpackCleanupDisk; }
 	const char* GetUnrarCmd() { return m_unrarCmd; }
 	const char* GetSevenZipCmd() { return m_sevenZipCmd; }
@@ -277,6 +305,10 @@ public:
 	int GetMonthlyQuota() { return m_monthlyQuota; }
 	int GetQuotaStartDay() { return m_quotaStartDay; }
 	int GetDailyQuota() { return m_dailyQuota; }
+	int GetPostCpuJobs() { return m_postCpuJobs; }
+	int GetPostDiskJobs() { return m_postDiskJobs; }
+	int GetPostScriptJobs() { return m_postScriptJobs; }
+	int GetPostVolumeJobs() { return m_postVolumeJobs; }
 
 	Categories* GetCategories() { return &m_categories; }
 	Category* FindCategory(const char* name, bool searchAliases) { return m_categories.FindCategory(name, searchAliases); }
@@ -374,6 +406,7 @@ private:
 	bool m_parRepair = false;
 	EParScan m_parScan = psLimited;
 	bool m_parQuick = true;
+	bool m_parIncremental = false;
 	bool m_parRename = false;
 	int m_parBuffer = 0;
 	int m_parThreads = 0;
@@ -391,6 +424,8 @@ private:
 	bool m_crcCheck = false;
 	bool m_directWrite = false;
 	int m_writeBuffer = 0;
+	bool m_mappedWrite = false;
+	EFileAllocation m_fileAllocation = faAuto;
 	int m_nzbDirInterval = 0;
 	int m_nzbDirFileAge = 0;
 	int m_diskSpace = 0;
@@ -401,8 +436,10 @@ private:
 	bool m_nzbCleanupDisk = false;
 	int m_parTimeLimit = 0;
 	int m_keepHistory = 0;
+	int m_recentHistory = 0;
 	bool m_accurateRate = false;
 	bool m_unpack = false;
+	bool m_directUnpack = false;
 	bool m_unpackCleanupDisk = false;
 	CString m_unrarCmd;
 	CString m_sevenZipCmd;
@@ -410,6 +447,7 @@ private:
 	bool m_unpackPauseQueue;
 	CString m_extCleanupDisk;
 	CString m_parIgnoreExt;
+	VerifyThreadsList m_parVerifyThreads;
 	int m_feedHistory = 0;
 	bool m_urlForce = false;
 	int m_timeCorrection = 0;
@@ -420,6 +458,10 @@ private:
 	int m_monthlyQuota = 0;
 	int m_quotaStartDay = 0;
 	int m_dailyQuota = 0;
+	int m_postCpuJobs = 1;
+	int m_postDiskJobs = 1;
+	int m_postScriptJobs = 1;
+	int m_postVolumeJobs = 0;
 
 	// Current state
 	bool m_serverMode = false;
@@ -444,6 +486,7 @@ private:
 	void InitCategories();
 	void InitScheduler();
 	void InitFeeds();
+	void InitParVerifyThreads();
 	void InitCommandLineOptions(CmdOptList* commandLineOptions);
 	void CheckOptions();
 	int ParseEnumValue(const char* OptName, int argc, const char* argn[], const int argv[]);
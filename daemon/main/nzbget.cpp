@@ -589,6 +589,7 @@ void NZBGet::DoMainLoop()
 #ifdef WIN32
 	m_winConsole->Start();
 #endif
+	m_diskState->StartWriter();
 	m_queueCoordinator->Start();
 	m_urlCoordinator->Start();
 	m_prePostProcessor->Start();
@@ -644,6 +645,12 @@ void NZBGet::DoMainLoop()
 		usleep(100 * 1000);
 	}
 
+	// write pending diskstate files, other threads may have changed the queue
+	// after the queue coordinator has stopped
+	m_queueCoordinator->SaveQueueChanges();
+	m_diskState->StopStateLoader();
+	m_diskState->StopWriter();
+
 	debug("Main program loop terminated");
 }
 
@@ -150,7 +150,9 @@ using namespace MSXML;
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/statvfs.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
+#include <poll.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <stdint.h>
@@ -166,6 +168,10 @@ using namespace MSXML;
 #include <sys/prctl.h>
 #endif
 
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
 #ifdef HAVE_BACKTRACE
 #include <execinfo.h>
 #endif
@@ -191,6 +197,7 @@ using namespace MSXML;
 #include <list>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <iterator>
 #include <algorithm>
 #include <iostream>
@@ -26,6 +26,16 @@
 #include "Util.h"
 #include "FileSystem.h"
 
+// preallocation window in front of the download position (option FileAllocation=ahead)
+static const int64 ALLOCATE_AHEAD_SIZE = 32 * 1024 * 1024;
+
+// average time (microseconds) of writing one article, above which the disk is considered overloaded
+static const int64 DISK_BOUND_LATENCY = 200 * 1000;
+
+// cache fill levels (percent) for entering and leaving disk bound state
+static const int DISK_BOUND_CACHE_HIGH = 80;
+static const int DISK_BOUND_CACHE_LOW = 60;
+
 CachedSegmentData::~CachedSegmentData()
 {
 	g_ArticleCache->Free(this);
@@ -65,6 +75,7 @@ bool ArticleWriter::Start(Decoder::EFormat format, const char* filename, int64 f
 	m_articleOffset = articleOffset;
 	m_articleSize = articleSize ? articleSize : m_articleInfo->GetSize();
 	m_articlePtr = 0;
+	m_writeTime = 0;
 
 	// prepare file for writing
 	if (m_format == Decoder::efYenc)
@@ -102,11 +113,22 @@ bool ArticleWriter::Start(Decoder::EFormat format, const char* filename, int64 f
 				}
 				m_fileInfo->SetOutputInitialized(true);
 			}
+
+			if (g_Options->GetFileAllocation() == Options::faAhead)
+			{
+				AllocateAhead(fileSize);
+			}
 		}
 	}
 
+	m_outMapping = nullptr;
+	if (g_Options->GetMappedWrite() && m_format == Decoder::efYenc)
+	{
+		m_outMapping = MapOutputFile();
+	}
+
 	// allocate cache buffer
-	if (g_Options->GetArticleCache() > 0 && g_Options->GetDecode() &&
+	if (!m_outMapping && g_Options->GetArticleCache() > 0 && g_Options->GetDecode() &&
 		(!g_Options->GetDirectWrite() || m_format == Decoder::efYenc))
 	{
 		m_articleData = g_ArticleCache->Alloc(m_articleSize);
@@ -123,8 +145,9 @@ bool ArticleWriter::Start(Decoder::EFormat format, const char* filename, int64 f
 		}
 	}
 
-	if (!m_articleData.GetData())
+	if (!m_articleData.GetData() && !m_outMapping)
 	{
+		int64 startTicks = Util::GetCurrentTicks();
 		bool directWrite = (g_Options->GetDirectWrite() || m_fileInfo->GetForceDirectWrite()) && m_format == Decoder::efYenc;
 		const char* filename = directWrite ? m_outputFilename : m_tempFilename;
 		if (!m_outFile.Open(filename, directWrite ? DiskFile::omReadWrite : DiskFile::omWrite))
@@ -140,6 +163,7 @@ bool ArticleWriter::Start(Decoder::EFormat format, const char* filename, int64 f
 		{
 			m_outFile.Seek(m_articleOffset);
 		}
+		m_writeTime += Util::GetCurrentTicks() - startTicks;
 	}
 
 	return true;
@@ -163,12 +187,35 @@ bool ArticleWriter::Write(char* buffer, int len)
 		return true;
 	}
 
-	return m_outFile.Write(buffer, len) > 0;
+	if (g_Options->GetDecode() && m_outMapping)
+	{
+		if (m_articleOffset + m_articlePtr > m_outMapping->GetSize())
+		{
+			detail("Decoding %s failed: article size mismatch", *m_infoName);
+			return false;
+		}
+		// page faults make the copying as slow as writing when the disk is busy
+		int64 startTicks = Util::GetCurrentTicks();
+		memcpy(m_outMapping->GetData() + m_articleOffset + m_articlePtr - len, buffer, len);
+		m_writeTime += Util::GetCurrentTicks() - startTicks;
+		return true;
+	}
+
+	int64 startTicks = Util::GetCurrentTicks();
+	bool ok = m_outFile.Write(buffer, len) > 0;
+	m_writeTime += Util::GetCurrentTicks() - startTicks;
+	return ok;
 }
 
 void ArticleWriter::Finish(bool success)
 {
-	m_outFile.Close();
+	if (m_outFile.Active())
+	{
+		int64 startTicks = Util::GetCurrentTicks();
+		m_outFile.Close();
+		m_writeTime += Util::GetCurrentTicks() - startTicks;
+		g_ArticleCache->AddWriteLatency(m_writeTime);
+	}
 
 	if (!success)
 	{
@@ -208,6 +255,14 @@ void ArticleWriter::Finish(bool success)
 			m_articleInfo->SetSegmentOffset(m_articleOffset);
 			m_articleInfo->SetSegmentSize(m_articlePtr);
 		}
+
+		if (m_outMapping)
+		{
+			int64 startTicks = Util::GetCurrentTicks();
+			m_outMapping->Flush(m_articleOffset, m_articlePtr);
+			m_writeTime += Util::GetCurrentTicks() - startTicks;
+			g_ArticleCache->AddWriteLatency(m_writeTime);
+		}
 	}
 	else
 	{
@@ -224,10 +279,34 @@ void ArticleWriter::Finish(bool success)
 /* creates output file and subdirectores */
 bool ArticleWriter::CreateOutputFile(int64 size)
 {
+	// auto-mode keeps the behavior of earlier versions: the files are preallocated
+	// only when the article cache is active
+	bool sparse = g_Options->GetFileAllocation() == Options::faSparse ||
+		g_Options->GetFileAllocation() == Options::faAhead ||
+		(g_Options->GetFileAllocation() == Options::faAuto && g_Options->GetArticleCache() == 0);
+
+	CString errmsg;
+
 	if (g_Options->GetDirectWrite() && FileSystem::FileExists(m_outputFilename) &&
 		FileSystem::FileSize(m_outputFilename) == size)
 	{
-		// keep existing old file from previous program session
+		// keep existing old file from previous program session; it may have been created
+		// sparse or by an older version, the disk space of the parts not yet written
+		// is allocated now so that the file can be mapped
+		if (!sparse)
+		{
+			FileSystem::EAllocMethod allocMethod;
+			if (FileSystem::AllocateFileRange(m_outputFilename, 0, size, errmsg, &allocMethod))
+			{
+				detail("Allocated existing file %s (%s)", *m_outputFilename, FileSystem::AllocMethodName(allocMethod));
+				m_fileInfo->SetAllocatedSize(size);
+				m_fileInfo->SetOutputPreallocated(true);
+			}
+			else
+			{
+				detail("Could not allocate disk space for existing file %s: %s", *m_outputFilename, *errmsg);
+			}
+		}
 		return true;
 	}
 
@@ -237,7 +316,6 @@ bool ArticleWriter::CreateOutputFile(int64 size)
 	// ensure the directory exist
 	BString<1024> destDir;
 	destDir.Set(m_outputFilename, FileSystem::BaseFileName(m_outputFilename) - m_outputFilename);
-	CString errmsg;
 
 	if (!FileSystem::ForceDirectories(destDir, errmsg))
 	{
@@ -246,16 +324,80 @@ bool ArticleWriter::CreateOutputFile(int64 size)
 		return false;
 	}
 
-	if (!FileSystem::AllocateFile(m_outputFilename, size, g_Options->GetArticleCache() == 0, errmsg))
+	FileSystem::EAllocMethod allocMethod;
+	if (!FileSystem::AllocateFile(m_outputFilename, size, sparse, errmsg, &allocMethod))
 	{
 		m_fileInfo->GetNzbInfo()->PrintMessage(Message::mkError,
 			"Could not create file %s: %s", *m_outputFilename, *errmsg);
 		return false;
 	}
 
+	if (!sparse)
+	{
+		detail("Allocated file %s (%s)", *m_outputFilename, FileSystem::AllocMethodName(allocMethod));
+	}
+
+	m_fileInfo->SetAllocatedSize(allocMethod == FileSystem::amSparse ? 0 : size);
+	m_fileInfo->SetOutputPreallocated(allocMethod != FileSystem::amSparse);
+
 	return true;
 }
 
+/* allocates disk space ahead of the current article, must be called under output file guard */
+void ArticleWriter::AllocateAhead(int64 fileSize)
+{
+	int64 allocatedSize = m_fileInfo->GetAllocatedSize();
+	int64 articleEnd = std::min(m_articleOffset + m_articleSize, fileSize);
+	if (allocatedSize >= articleEnd)
+	{
+		return;
+	}
+
+	// extending the allocated area always from its end keeps the file contiguous
+	// even if the articles are not downloaded in order
+	int64 allocateEnd = std::min(articleEnd + ALLOCATE_AHEAD_SIZE, fileSize);
+	CString errmsg;
+	FileSystem::EAllocMethod allocMethod;
+	if (FileSystem::AllocateFileRange(m_outputFilename, allocatedSize, allocateEnd - allocatedSize, errmsg, &allocMethod))
+	{
+		debug("Allocated %s up to %lli (%s)", *m_outputFilename, allocateEnd, FileSystem::AllocMethodName(allocMethod));
+		m_fileInfo->SetAllocatedSize(allocateEnd);
+	}
+	else
+	{
+		// preallocation isn't supported by file system, continue writing into sparse file
+		detail("Could not allocate disk space for %s: %s", *m_outputFilename, *errmsg);
+		m_fileInfo->SetAllocatedSize(fileSize);
+	}
+}
+
+/* maps output file into memory, the mapping is shared by all writers of the file */
+MappedFile* ArticleWriter::MapOutputFile()
+{
+	Guard guard = m_fileInfo->GuardOutputFile();
+
+	if (!m_fileInfo->GetOutputMapping())
+	{
+		// the mapping is attempted only once per file; if it fails the inactive
+		// mapping object remains attached to the file to prevent further attempts
+		std::unique_ptr<MappedFile> mapping = std::make_unique<MappedFile>();
+		if (!m_fileInfo->GetOutputPreallocated())
+		{
+			// writing into a page of a sparse file on a full disk raises SIGBUS instead of
+			// returning an error, only files with allocated disk space can be mapped
+			debug("File %s isn't preallocated, using regular writes", *m_outputFilename);
+		}
+		else if (!mapping->Open(m_outputFilename, FileSystem::FileSize(m_outputFilename)))
+		{
+			detail("Could not map file %s into memory, using regular writes", *m_outputFilename);
+		}
+		m_fileInfo->SetOutputMapping(std::move(mapping));
+	}
+
+	MappedFile* mapping = m_fileInfo->GetOutputMapping();
+	return mapping->Active() ? mapping : nullptr;
+}
+
 void ArticleWriter::BuildOutputFilename()
 {
 	BString<1024> filename("%s%c%i.%03i", g_Options->GetTempDir(), PATH_SEPARATOR,
@@ -290,6 +432,13 @@ void ArticleWriter::CompleteFileParts()
 
 	bool directWrite = (g_Options->GetDirectWrite() || m_fileInfo->GetForceDirectWrite()) && m_fileInfo->GetOutputInitialized();
 
+	if (m_fileInfo->GetOutputMapping())
+	{
+		// all articles are written, the output file is going to be renamed
+		Guard guard = m_fileInfo->GuardOutputFile();
+		m_fileInfo->SetOutputMapping(nullptr);
+	}
+
 	BString<1024> nzbName;
 	BString<1024> nzbDestDir;
 
@@ -619,6 +768,8 @@ void ArticleWriter::FlushCache()
 				needBufFile = false;
 			}
 
+			int64 startTicks = Util::GetCurrentTicks();
+
 			if (directWrite)
 			{
 				outfile.Seek(pa->GetSegmentOffset());
@@ -642,6 +793,8 @@ void ArticleWriter::FlushCache()
 						*FileSystem::GetLastErrorMessage());
 				}
 			}
+
+			g_ArticleCache->AddWriteLatency(Util::GetCurrentTicks() - startTicks);
 		}
 
 		outfile.Close();
@@ -893,6 +1046,52 @@ bool ArticleCache::CheckFlush(bool flushEverything)
 	return false;
 }
 
+void ArticleCache::AddWriteLatency(int64 usec)
+{
+	Guard guard(m_latencyMutex);
+	m_writeTime += usec;
+	m_writeCount++;
+}
+
+/*
+ * Evaluates the write latency and the fill level of the cache collected since
+ * the last check. The disk is considered overloaded if writing of articles
+ * takes too long or if the cache is close to be full; in that case downloads
+ * must be slowed down before the cache overflows and the articles go into
+ * temporary files, which would put even more load on the disk.
+ */
+void ArticleCache::CheckDiskLoad()
+{
+	{
+		Guard guard(m_latencyMutex);
+		int64 latency = m_writeCount > 0 ? m_writeTime / m_writeCount : 0;
+		// moving average smooths out single slow writes
+		m_writeLatency = (m_writeLatency * 3 + latency) / 4;
+		m_writeTime = 0;
+		m_writeCount = 0;
+	}
+
+	size_t cacheSize = (size_t)g_Options->GetArticleCache() * 1024 * 1024;
+	int fillLevel = cacheSize > 0 ? (int)(m_allocated * 100 / cacheSize) : 0;
+
+	bool diskBound = EvaluateDiskBound(m_diskBound, fillLevel, m_writeLatency);
+	if (diskBound != m_diskBound)
+	{
+		debug("Disk %s, write latency: %i ms, cache fill level: %i%%",
+			diskBound ? "overloaded" : "relieved", (int)(m_writeLatency / 1000), fillLevel);
+		m_diskBound = diskBound;
+	}
+}
+
+bool ArticleCache::EvaluateDiskBound(bool diskBound, int fillLevel, int64 writeLatency)
+{
+	bool overloaded = fillLevel >= DISK_BOUND_CACHE_HIGH || writeLatency >= DISK_BOUND_LATENCY;
+	bool relieved = fillLevel < DISK_BOUND_CACHE_LOW && writeLatency < DISK_BOUND_LATENCY / 2;
+
+	// hysteresis: between the thresholds the current state is kept
+	return overloaded || (diskBound && !relieved);
+}
+
 ArticleCache::FlushGuard::FlushGuard(Mutex& mutex) : m_guard(&mutex)
 {
 	g_ArticleCache->m_flushing = true;
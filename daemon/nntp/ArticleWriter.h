@@ -67,6 +67,7 @@ private:
 	FileInfo* m_fileInfo;
 	ArticleInfo* m_articleInfo;
 	DiskFile m_outFile;
+	MappedFile* m_outMapping = nullptr;
 	CString m_tempFilename;
 	CString m_outputFilename;
 	const char* m_resultFilename = nullptr;
@@ -75,10 +76,13 @@ private:
 	int64 m_articleOffset;
 	int m_articleSize;
 	int m_articlePtr;
+	int64 m_writeTime = 0;
 	bool m_duplicate = false;
 	CString m_infoName;
 
 	bool CreateOutputFile(int64 size);
+	MappedFile* MapOutputFile();
+	void AllocateAhead(int64 fileSize);
 	void BuildOutputFilename();
 	void SetWriteBuffer(DiskFile& outFile, int recSize);
 };
@@ -107,6 +111,14 @@ public:
 	size_t GetAllocated() { return m_allocated; }
 	bool FileBusy(FileInfo* fileInfo) { return fileInfo == m_fileInfo; }
 
+	// disk backpressure
+	void AddWriteLatency(int64 usec);
+	void CheckDiskLoad();
+	bool GetDiskBound() { return m_diskBound; }
+	int GetWriteLatency() { return (int)(m_writeLatency / 1000); }
+	/* Returns new disk bound state for given cache fill level (percent) and write latency (microseconds) */
+	static bool EvaluateDiskBound(bool diskBound, int fillLevel, int64 writeLatency);
+
 private:
 	size_t m_allocated = 0;
 	bool m_flushing = false;
@@ -114,6 +126,11 @@ private:
 	Mutex m_flushMutex;
 	Mutex m_contentMutex;
 	FileInfo* m_fileInfo = nullptr;
+	Mutex m_latencyMutex;
+	int64 m_writeTime = 0;
+	int m_writeCount = 0;
+	int64 m_writeLatency = 0;
+	bool m_diskBound = false;
 
 	bool CheckFlush(bool flushEverything);
 };
@@ -0,0 +1,497 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2013-2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "nzbget.h"
+#include "DirectUnpack.h"
+#include "Log.h"
+#include "Util.h"
+#include "FileSystem.h"
+#include "ParParser.h"
+#include "Options.h"
+
+// unrar output is passed to the nzb log in batches, each batch locks the queue only once
+static const int MESSAGE_BATCH_SIZE = 50;
+static const int MESSAGE_BATCH_SECONDS = 1;
+
+void DirectUnpack::StartJob(NzbInfo* nzbInfo)
+{
+	if (nzbInfo->GetDirectUnpackStatus() != NzbInfo::nsNone ||
+		nzbInfo->GetDeleteStatus() != NzbInfo::dsNone ||
+		nzbInfo->GetPostInfo())
+	{
+		return;
+	}
+
+	NzbParameter* parameter = nzbInfo->GetParameters()->Find("*Unpack:", false);
+	if (parameter && !strcasecmp(parameter->GetValue(), "no"))
+	{
+		return;
+	}
+
+	std::unique_ptr<DirectUnpack> directUnpack = std::make_unique<DirectUnpack>();
+
+	for (CompletedFile& completedFile : nzbInfo->GetCompletedFiles())
+	{
+		if (completedFile.GetStatus() != CompletedFile::cfSuccess)
+		{
+			if (!ParParser::ParseParFilename(completedFile.GetFileName(), nullptr, nullptr))
+			{
+				// damaged files must be repaired before unpacking
+				return;
+			}
+			continue;
+		}
+		directUnpack->AddDownloadedFile(completedFile.GetFileName());
+	}
+
+	if (directUnpack->m_archives.empty())
+	{
+		return;
+	}
+
+	directUnpack->m_nzbId = nzbInfo->GetId();
+	directUnpack->m_name = nzbInfo->GetName();
+	directUnpack->m_destDir = nzbInfo->GetDestDir();
+	directUnpack->m_infoName.Format("direct unpack for %s", nzbInfo->GetName());
+	directUnpack->m_infoNameUp.Format("Direct unpack for %s", nzbInfo->GetName()); // first letter in upper case
+
+	parameter = nzbInfo->GetParameters()->Find("*Unpack:Password", false);
+	if (parameter)
+	{
+		directUnpack->m_password = parameter->GetValue();
+	}
+
+	directUnpack->SetAutoDestroy(true);
+	nzbInfo->SetDirectUnpackStatus(NzbInfo::nsRunning);
+	nzbInfo->SetDirectUnpack(directUnpack.get());
+
+	directUnpack.release()->Start();
+}
+
+/**
+ * Returns true for the first volume of a rar-archive, which is either
+ * "name.part01.rar" (new naming scheme) or "name.rar" (old naming scheme,
+ * further volumes are "name.r00", "name.r01", etc.).
+ */
+bool DirectUnpack::IsArchiveFilename(const char* filename)
+{
+	RegEx regExRar(".*\\.rar$", 0);
+	RegEx regExRarPart(".*\\.part[0-9]+\\.rar$", 0);
+	RegEx regExRarFirstPart(".*\\.part0*1\\.rar$", 0);
+
+	return regExRar.Match(filename) &&
+		(!regExRarPart.Match(filename) || regExRarFirstPart.Match(filename));
+}
+
+void DirectUnpack::AddDownloadedFile(const char* filename)
+{
+	Guard guard(m_volumeMutex);
+
+	m_downloadedFiles.emplace_back(filename);
+	if (IsArchiveFilename(filename))
+	{
+		m_archives.emplace_back(filename);
+	}
+	m_volumeCond.NotifyAll();
+}
+
+void DirectUnpack::FileDownloaded(DownloadQueue* downloadQueue, FileInfo* fileInfo)
+{
+	const char* filename = FileSystem::BaseFileName(fileInfo->GetOutputFilename());
+
+	if (fileInfo->GetSuccessArticles() < fileInfo->GetTotalArticles() && !fileInfo->GetParFile())
+	{
+		fileInfo->GetNzbInfo()->PrintMessage(Message::mkWarning,
+			"Cancelling %s due to damaged file %s", *m_infoName, filename);
+		Stop();
+		return;
+	}
+
+	AddDownloadedFile(filename);
+}
+
+void DirectUnpack::NzbDownloaded(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
+{
+	Guard guard(m_volumeMutex);
+	m_nzbCompleted = true;
+	m_volumeCond.NotifyAll();
+}
+
+void DirectUnpack::NzbDeleted(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
+{
+	nzbInfo->SetDirectUnpack(nullptr);
+	nzbInfo->SetDirectUnpackStatus(NzbInfo::nsFailure);
+	Stop();
+}
+
+void DirectUnpack::Run()
+{
+	debug("Entering DirectUnpack-loop for %i", m_nzbId);
+
+	m_unpackDir.Format("%s%c%s", *m_destDir, PATH_SEPARATOR, "_unpack");
+
+	SetInfoName(m_infoName);
+	SetWorkingDir(m_destDir);
+
+	PrintMessage(Message::mkInfo, "Directly unpacking %s", *m_name);
+
+	CString errmsg;
+	if (FileSystem::DirectoryExists(m_unpackDir))
+	{
+		FileSystem::DeleteDirectoryWithContent(m_unpackDir, errmsg);
+	}
+	m_unpackOk = FileSystem::ForceDirectories(m_unpackDir, errmsg);
+	if (!m_unpackOk)
+	{
+		PrintMessage(Message::mkError, "Could not create directory %s: %s", *m_unpackDir, *errmsg);
+	}
+
+	while (m_unpackOk && !IsStopped())
+	{
+		CString archiveName;
+		{
+			Guard guard(m_volumeMutex);
+			while (m_archives.empty() && !m_nzbCompleted && !IsStopped())
+			{
+				m_volumeCond.Wait(m_volumeMutex);
+			}
+
+			if (!m_archives.empty())
+			{
+				archiveName = std::move(m_archives.front());
+				m_archives.pop_front();
+			}
+		}
+
+		if (!archiveName)
+		{
+			break;
+		}
+
+		ExecuteUnrar(archiveName);
+	}
+
+	Completed();
+
+	debug("Exiting DirectUnpack-loop for %i", m_nzbId);
+}
+
+void DirectUnpack::ExecuteUnrar(const char* archiveName)
+{
+	// Format:
+	//   unrar x -y -p- -o+ -vp archive.part01.rar ./_unpack/
+
+	ArgList params;
+	if (FileSystem::FileExists(g_Options->GetUnrarCmd()))
+	{
+		params.emplace_back(g_Options->GetUnrarCmd());
+	}
+	else
+	{
+		params = Util::SplitCommandLine(g_Options->GetUnrarCmd());
+	}
+
+	if (params.empty())
+	{
+		PrintMessage(Message::mkError, "Could not start unrar, failed to parse command line: %s",
+			g_Options->GetUnrarCmd());
+		m_unpackOk = false;
+		return;
+	}
+
+	auto exists = [&params](const char* param)
+	{
+		return std::find(params.begin(), params.end(), param) != params.end();
+	};
+
+	if (!exists("x") && !exists("e"))
+	{
+		params.emplace_back("x");
+	}
+
+	params.emplace_back("-y");
+
+	if (!m_password.Empty())
+	{
+		params.push_back(CString::FormatStr("-p%s", *m_password));
+	}
+	else
+	{
+		params.emplace_back("-p-");
+	}
+
+	if (!exists("-o+") && !exists("-o-"))
+	{
+		params.emplace_back("-o+");
+	}
+
+	// pause before each volume, unrar is resumed via stdin when the volume is downloaded
+	params.emplace_back("-vp");
+
+	params.emplace_back(archiveName);
+	params.push_back(FileSystem::MakeExtendedPath(BString<1024>("%s%c", *m_unpackDir, PATH_SEPARATOR), true));
+	SetArgs(std::move(params));
+	SetLogPrefix("Unrar");
+	SetNeedWrite(true);
+	ResetEnv();
+
+	m_allOkMessageReceived = false;
+	m_unrarRunning = true;
+
+	int exitCode = Execute();
+	FlushMessages();
+
+	m_unrarRunning = false;
+	SetLogPrefix(nullptr);
+
+	m_unpackOk = exitCode == 0 && m_allOkMessageReceived && !GetTerminated();
+
+	if (!m_unpackOk && exitCode > 0)
+	{
+		PrintMessage(Message::mkWarning, "Unrar error code: %i", exitCode);
+	}
+}
+
+/**
+ * Waits until the volume requested by unrar is downloaded.
+ * Returns false if the volume isn't in the download or the job was cancelled.
+ */
+bool DirectUnpack::WaitNextVolume(const char* filename)
+{
+	const char* baseName = FileSystem::BaseFileName(filename);
+	debug("Waiting for volume %s", baseName);
+
+	bool nzbCompleted = false;
+	{
+		Guard guard(m_volumeMutex);
+		while (!IsStopped() && !nzbCompleted)
+		{
+			for (CString& downloadedFile : m_downloadedFiles)
+			{
+				if (!strcasecmp(downloadedFile, baseName))
+				{
+					return true;
+				}
+			}
+
+			nzbCompleted = m_nzbCompleted;
+			if (!nzbCompleted)
+			{
+				m_volumeCond.Wait(m_volumeMutex);
+			}
+		}
+	}
+
+	// the message is printed outside of the volume lock, printing locks the queue
+	if (nzbCompleted)
+	{
+		ScriptController::PrintMessage(Message::mkWarning, "Could not find volume %s", baseName);
+	}
+
+	return false;
+}
+
+void DirectUnpack::Completed()
+{
+	bool success = m_unpackOk && !IsStopped();
+
+	if (success)
+	{
+		PrintMessage(Message::mkInfo, "%s successful", *m_infoNameUp);
+	}
+	else
+	{
+		PrintMessage(Message::mkWarning, "%s failed, the archives will be unpacked in post-processing",
+			*m_infoNameUp);
+
+		CString errmsg;
+		if (!FileSystem::DeleteDirectoryWithContent(m_unpackDir, errmsg))
+		{
+			PrintMessage(Message::mkError, "Could not delete temporary directory %s: %s", *m_unpackDir, *errmsg);
+		}
+	}
+
+	FlushMessages();
+
+	GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+	NzbInfo* nzbInfo = downloadQueue->GetQueue()->Find(m_nzbId);
+	if (nzbInfo && nzbInfo->GetDirectUnpack() == this)
+	{
+		nzbInfo->SetDirectUnpackStatus(success ? NzbInfo::nsSuccess : NzbInfo::nsFailure);
+		nzbInfo->SetDirectUnpack(nullptr);
+	}
+}
+
+void DirectUnpack::Stop()
+{
+	debug("Stopping direct unpack for %i", m_nzbId);
+	Thread::Stop();
+	{
+		// wake up the job waiting for a volume
+		Guard guard(m_volumeMutex);
+		m_volumeCond.NotifyAll();
+	}
+	if (m_unrarRunning)
+	{
+		Terminate();
+	}
+}
+
+/**
+ * Unrar prints the prompt for the next volume without a line break, the line is
+ * returned as soon as the prompt is complete. Progress information, which unrar
+ * updates in place using backspace control characters, is dropped.
+ */
+bool DirectUnpack::ReadLine(char* buf, int bufSize, FILE* stream)
+{
+	int len = 0;
+
+	while (len < bufSize - 1)
+	{
+		int ch = fgetc(stream);
+		if (ch == EOF)
+		{
+			break;
+		}
+
+		if (ch == '\b')
+		{
+			len -= len > 0 ? 1 : 0;
+			continue;
+		}
+
+		buf[len++] = (char)ch;
+
+		if (ch == '\n' ||
+			(len >= 19 && !strncmp(buf + len - 19, "[C]ontinue, [Q]uit ", 19)))
+		{
+			break;
+		}
+	}
+
+	buf[len] = '\0';
+
+	return len > 0;
+}
+
+/**
+ * Unrar asks for the next volume with (on one or two lines):
+ *   Insert disk with archive.part02.rar
+ *   [C]ontinue, [Q]uit
+ */
+bool DirectUnpack::ParseVolumePrompt(const char* text, CString& volume)
+{
+	if (!strncmp(text, "Unrar: Insert disk with ", 24))
+	{
+		volume = text + 24;
+		char* prompt = strstr(volume, " [C]ontinue, [Q]uit");
+		if (prompt)
+		{
+			*prompt = '\0';
+		}
+	}
+
+	return strstr(text, "[C]ontinue, [Q]uit") != nullptr;
+}
+
+void DirectUnpack::AddMessage(Message::EKind kind, const char* text)
+{
+	if (ParseVolumePrompt(text, m_waitingFile))
+	{
+		FlushMessages();
+		if (WaitNextVolume(m_waitingFile))
+		{
+			Write("C\n");
+		}
+		else
+		{
+			m_unpackOk = false;
+			Write("Q\n");
+		}
+		return;
+	}
+
+	if (!strncmp(text, "Unrar: All OK", 13))
+	{
+		m_allOkMessageReceived = true;
+	}
+
+	int len = strlen(text);
+	bool cancel = !IsStopped() &&
+		(strstr(text, " : packed data CRC failed in volume") ||
+		 strstr(text, " : packed data checksum error in volume") ||
+		 (len > 13 && !strncmp(text + len - 13, " - CRC failed", 13)) ||
+		 (len > 18 && !strncmp(text + len - 18, " - checksum failed", 18)) ||
+		 !strncmp(text, "Unrar: Checksum error in the encrypted file", 42) ||
+		 !strncmp(text, "Unrar: CRC failed in the encrypted file", 39) ||
+		 !strncmp(text, "Unrar: The specified password is incorrect.", 43) ||
+		 !strncmp(text, "Unrar: WARNING: You need to start extraction from a previous volume", 67));
+
+	if (m_messages.empty())
+	{
+		m_messageTime = Util::CurrentTime();
+	}
+	m_messages.emplace_back(0, kind, 0, text);
+	if (cancel)
+	{
+		m_messages.emplace_back(0, Message::mkWarning, 0, BString<1024>("Cancelling %s due to errors", *m_infoName));
+	}
+
+	if (cancel ||
+		(int)m_messages.size() >= MESSAGE_BATCH_SIZE ||
+		Util::CurrentTime() - m_messageTime >= MESSAGE_BATCH_SECONDS)
+	{
+		FlushMessages();
+	}
+
+	if (cancel)
+	{
+		m_unpackOk = false;
+		Stop();
+	}
+}
+
+/**
+ * Passes buffered output of unrar to the log of the nzb. Messages are only added
+ * by the job's own thread, the buffer needs no lock.
+ */
+void DirectUnpack::FlushMessages()
+{
+	if (m_messages.empty())
+	{
+		return;
+	}
+
+	GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+	NzbInfo* nzbInfo = downloadQueue->GetQueue()->Find(m_nzbId);
+	for (Message& message : m_messages)
+	{
+		if (nzbInfo)
+		{
+			nzbInfo->AddMessage(message.GetKind(), message.GetText());
+		}
+		else
+		{
+			ScriptController::AddMessage(message.GetKind(), message.GetText());
+		}
+	}
+
+	m_messages.clear();
+}
@@ -0,0 +1,86 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2013-2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef DIRECTUNPACK_H
+#define DIRECTUNPACK_H
+
+#include "Log.h"
+#include "Thread.h"
+#include "DownloadInfo.h"
+#include "Script.h"
+
+/*
+ * Unpacks rar-archives while the nzb is still being downloaded.
+ * Unrar is started as soon as the first volume of an archive is completed; it is
+ * paused before each next volume (switch "-vp") and is resumed once that volume
+ * is downloaded. If a damaged file is detected the direct unpack is cancelled
+ * and the archives are unpacked as usual during post-processing.
+ */
+class DirectUnpack : public Thread, public ScriptController
+{
+public:
+	virtual void Run();
+	virtual void Stop();
+	/* Starts a job for the nzb if its downloaded files contain the first volume of an archive.
+	   DownloadQueue must be locked prior to call of this function. */
+	static void StartJob(NzbInfo* nzbInfo);
+	void FileDownloaded(DownloadQueue* downloadQueue, FileInfo* fileInfo);
+	void NzbDownloaded(DownloadQueue* downloadQueue, NzbInfo* nzbInfo);
+	void NzbDeleted(DownloadQueue* downloadQueue, NzbInfo* nzbInfo);
+	static bool IsArchiveFilename(const char* filename);
+	/* Checks an output line of unrar for the prompt asking for the next volume.
+	   The requested volume, if the line names it, is stored in "volume". */
+	static bool ParseVolumePrompt(const char* text, CString& volume);
+
+protected:
+	virtual bool ReadLine(char* buf, int bufSize, FILE* stream);
+	virtual void AddMessage(Message::EKind kind, const char* text);
+
+private:
+	typedef std::deque<CString> ArchiveList;
+	typedef std::vector<CString> FileList;
+
+	int m_nzbId = 0;
+	CString m_name;
+	CString m_infoName;
+	CString m_infoNameUp;
+	CString m_destDir;
+	CString m_unpackDir;
+	CString m_password;
+	CString m_waitingFile;
+	Mutex m_volumeMutex;
+	ConditionVar m_volumeCond;
+	ArchiveList m_archives;
+	FileList m_downloadedFiles;
+	bool m_nzbCompleted = false;
+	bool m_unpackOk = false;
+	bool m_allOkMessageReceived = false;
+	bool m_unrarRunning = false;
+	MessageList m_messages;
+	time_t m_messageTime = 0;
+
+	void ExecuteUnrar(const char* archiveName);
+	bool WaitNextVolume(const char* filename);
+	void Completed();
+	void AddDownloadedFile(const char* filename);
+	void FlushMessages();
+};
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2013-2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "nzbget.h"
+
+#ifndef DISABLE_PARCHECK
+
+#include "par2cmdline.h"
+#include "par2repairer.h"
+
+#include "IncrementalParChecker.h"
+#include "FileSystem.h"
+
+class IncrementalRepairer : public Par2::Par2Repairer
+{
+public:
+	friend class IncrementalParChecker;
+};
+
+bool IncrementalParChecker::Load(const char* parFilename)
+{
+	IncrementalRepairer repairer;
+	// loaded in a worker thread while the par-checker may have redirected Par2::cout
+	repairer.noiselevel = Par2::CommandLine::nlSilent;
+
+	if (!repairer.LoadPacketsFromFile(parFilename) || !repairer.mainpacket)
+	{
+		return false;
+	}
+
+	m_parFilename = parFilename;
+	m_blockSize = repairer.mainpacket->BlockSize();
+	m_sourceFiles.clear();
+	m_missingBlocks = 0;
+	m_requestedBlocks = 0;
+
+	for (std::pair<const Par2::MD5Hash, Par2::Par2RepairerSourceFile*>& entry : repairer.sourcefilemap)
+	{
+		Par2::Par2RepairerSourceFile* sourceFile = entry.second;
+		if (sourceFile && sourceFile->GetDescriptionPacket())
+		{
+			std::string filename = Par2::DiskFile::TranslateFilename(sourceFile->GetDescriptionPacket()->FileName());
+			m_sourceFiles.emplace_back(filename.c_str(), sourceFile->GetDescriptionPacket()->FileSize());
+
+			Par2::VerificationPacket* packet = sourceFile->GetVerificationPacket();
+			if (packet)
+			{
+				BlockChecksums* blockChecksums = m_sourceFiles.back().GetBlockChecksums();
+				blockChecksums->resize(packet->BlockCount());
+				for (uint32 i = 0; i < packet->BlockCount(); i++)
+				{
+					const Par2::FILEVERIFICATIONENTRY* entry = packet->VerificationEntry(i);
+					blockChecksums->at(i).m_crc = entry->crc;
+					memcpy(blockChecksums->at(i).m_hash, entry->hash.hash, sizeof(entry->hash.hash));
+				}
+			}
+		}
+	}
+
+	return m_blockSize > 0;
+}
+
+bool IncrementalParChecker::AddDataFile(const char* filename, bool complete, SegmentList* segments)
+{
+	for (SourceFile& sourceFile : m_sourceFiles)
+	{
+		if (!strcasecmp(sourceFile.GetFilename(), filename))
+		{
+			if (!sourceFile.GetChecked())
+			{
+				sourceFile.SetChecked(true);
+				if (!complete)
+				{
+					sourceFile.SetMissingBlocks(CalcMissingBlocks(segments, sourceFile.GetSize(), m_blockSize));
+					m_missingBlocks += sourceFile.GetMissingBlocks();
+				}
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+IncrementalParChecker::BlockChecksums* IncrementalParChecker::GetBlockChecksums(const char* filename, int64* fileSize)
+{
+	for (SourceFile& sourceFile : m_sourceFiles)
+	{
+		if (!strcasecmp(sourceFile.GetFilename(), filename))
+		{
+			if (sourceFile.GetVerified() || sourceFile.GetBlockChecksums()->empty())
+			{
+				return nullptr;
+			}
+			*fileSize = sourceFile.GetSize();
+			return sourceFile.GetBlockChecksums();
+		}
+	}
+
+	return nullptr;
+}
+
+void IncrementalParChecker::DataFileVerified(const char* filename, int damagedBlocks)
+{
+	for (SourceFile& sourceFile : m_sourceFiles)
+	{
+		if (!strcasecmp(sourceFile.GetFilename(), filename))
+		{
+			if (sourceFile.GetChecked() && !sourceFile.GetVerified())
+			{
+				m_missingBlocks += damagedBlocks - sourceFile.GetMissingBlocks();
+				sourceFile.SetMissingBlocks(damagedBlocks);
+				sourceFile.SetVerified(true);
+			}
+			return;
+		}
+	}
+}
+
+void IncrementalParChecker::GetVerifiedFiles(FileList* fileList)
+{
+	for (SourceFile& sourceFile : m_sourceFiles)
+	{
+		if (sourceFile.GetVerified() && sourceFile.GetMissingBlocks() == 0)
+		{
+			fileList->push_back(sourceFile.GetFilename());
+		}
+	}
+}
+
+int IncrementalParChecker::CalcMissingBlocks(SegmentList* segments, int64 fileSize, int64 blockSize)
+{
+	int blockCount = (int)((fileSize + blockSize - 1) / blockSize);
+
+	SegmentList good;
+	for (Segment& segment : *segments)
+	{
+		if (segment.GetSuccess() && segment.GetSize() > 0)
+		{
+			good.push_back(segment);
+		}
+	}
+
+	std::sort(good.begin(), good.end(),
+		[](Segment& segment1, Segment& segment2)
+		{
+			return segment1.GetOffset() < segment2.GetOffset();
+		});
+
+	// join adjacent segments into ranges and count blocks lying completely within a range
+	int goodBlocks = 0;
+	for (SegmentList::iterator it = good.begin(); it != good.end(); )
+	{
+		int64 rangeStart = it->GetOffset();
+		int64 rangeEnd = rangeStart + it->GetSize();
+		for (it++; it != good.end() && it->GetOffset() <= rangeEnd; it++)
+		{
+			rangeEnd = std::max(rangeEnd, it->GetOffset() + it->GetSize());
+		}
+
+		for (int64 block = (rangeStart + blockSize - 1) / blockSize; block < blockCount; block++)
+		{
+			int64 blockEnd = std::min((block + 1) * blockSize, fileSize);
+			if (blockEnd > rangeEnd)
+			{
+				break;
+			}
+			goodBlocks++;
+		}
+	}
+
+	return blockCount - goodBlocks;
+}
+
+int IncrementalParChecker::VerifyBlocks(const char* filename, int64 fileSize, int64 blockSize,
+	BlockChecksums* blockChecksums, Thread* thread)
+{
+	DiskFile file;
+	if (!file.Open(filename, DiskFile::omRead))
+	{
+		return -1;
+	}
+
+	// the last block is padded with zeros to the full block size
+	CharBuffer buffer((int)blockSize);
+	int damagedBlocks = 0;
+	int64 offset = 0;
+	for (BlockChecksum& blockChecksum : *blockChecksums)
+	{
+		if (thread && thread->IsStopped())
+		{
+			return -1;
+		}
+
+		int64 size = std::min(blockSize, fileSize - offset);
+		if (size <= 0 || file.Read(buffer, size) != size)
+		{
+			// the file is shorter than expected
+			damagedBlocks++;
+			continue;
+		}
+		memset(buffer + size, 0, (size_t)(blockSize - size));
+		offset += size;
+
+		Par2::u32 crc = ~0 ^ Par2::CRCUpdateBlock(~0, (size_t)blockSize, buffer);
+		if (crc != blockChecksum.m_crc)
+		{
+			damagedBlocks++;
+			continue;
+		}
+
+		Par2::MD5Context context;
+		context.Update(buffer, (size_t)blockSize);
+		Par2::MD5Hash hash;
+		context.Final(hash);
+		if (memcmp(hash.hash, blockChecksum.m_hash, sizeof(hash.hash)))
+		{
+			damagedBlocks++;
+		}
+	}
+
+	return damagedBlocks;
+}
+
+#endif
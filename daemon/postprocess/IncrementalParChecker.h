@@ -0,0 +1,132 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2013-2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef INCREMENTALPARCHECKER_H
+#define INCREMENTALPARCHECKER_H
+
+#ifndef DISABLE_PARCHECK
+
+#include "NString.h"
+#include "Thread.h"
+
+/*
+ * Keeps a running count of missing blocks of a par-set while the nzb is still downloading.
+ * The main par2-file is loaded as soon as it is downloaded; each data file is checked
+ * against the file list of the par-set when it completes, using the download status of
+ * its articles to estimate damaged blocks. The estimate is then replaced with the result
+ * of the verification of the file against the block checksums of the par-set.
+ */
+class IncrementalParChecker
+{
+public:
+	class Segment
+	{
+	public:
+		Segment(bool success, int64 offset, int size) :
+			m_success(success), m_offset(offset), m_size(size) {}
+		bool GetSuccess() { return m_success; }
+		int64 GetOffset() { return m_offset; }
+		int GetSize() { return m_size; }
+
+	private:
+		bool m_success;
+		int64 m_offset;
+		int m_size;
+	};
+
+	typedef std::vector<Segment> SegmentList;
+
+	struct BlockChecksum
+	{
+		uint32 m_crc;
+		uchar m_hash[16];
+	};
+
+	typedef std::vector<BlockChecksum> BlockChecksums;
+	typedef std::vector<CString> FileList;
+
+	bool Load(const char* parFilename);
+	const char* GetParFilename() { return m_parFilename; }
+	int64 GetBlockSize() { return m_blockSize; }
+	int GetMissingBlocks() { return m_missingBlocks; }
+	int GetRequestedBlocks() { return m_requestedBlocks; }
+	void SetRequestedBlocks(int requestedBlocks) { m_requestedBlocks = requestedBlocks; }
+
+	/* Checks a completed data file; returns false if the file doesn't belong to the par-set.
+	   Files downloaded without errors are passed with "complete = true", for other files
+	   the segments with download status of articles are required. */
+	bool AddDataFile(const char* filename, bool complete, SegmentList* segments);
+
+	/* Returns block checksums of a file of the par-set or nullptr if the file doesn't belong
+	   to the par-set or was already verified */
+	BlockChecksums* GetBlockChecksums(const char* filename, int64* fileSize);
+
+	/* Replaces the estimated number of missing blocks of a file with the verification result */
+	void DataFileVerified(const char* filename, int damagedBlocks);
+
+	/* Files verified without damaged blocks */
+	void GetVerifiedFiles(FileList* fileList);
+
+	/* Number of blocks not completely covered by successfully downloaded segments */
+	static int CalcMissingBlocks(SegmentList* segments, int64 fileSize, int64 blockSize);
+
+	/* Reads a data file block by block and compares the blocks with their checksums;
+	   returns the number of damaged blocks or -1 if the file couldn't be read or the
+	   thread was stopped */
+	static int VerifyBlocks(const char* filename, int64 fileSize, int64 blockSize,
+		BlockChecksums* blockChecksums, Thread* thread);
+
+private:
+	class SourceFile
+	{
+	public:
+		SourceFile(const char* filename, int64 size) :
+			m_filename(filename), m_size(size) {}
+		const char* GetFilename() { return m_filename; }
+		int64 GetSize() { return m_size; }
+		bool GetChecked() { return m_checked; }
+		void SetChecked(bool checked) { m_checked = checked; }
+		bool GetVerified() { return m_verified; }
+		void SetVerified(bool verified) { m_verified = verified; }
+		int GetMissingBlocks() { return m_missingBlocks; }
+		void SetMissingBlocks(int missingBlocks) { m_missingBlocks = missingBlocks; }
+		BlockChecksums* GetBlockChecksums() { return &m_blockChecksums; }
+
+	private:
+		CString m_filename;
+		int64 m_size;
+		bool m_checked = false;
+		bool m_verified = false;
+		int m_missingBlocks = 0;
+		BlockChecksums m_blockChecksums;
+	};
+
+	typedef std::vector<SourceFile> SourceFileList;
+
+	CString m_parFilename;
+	int64 m_blockSize = 0;
+	SourceFileList m_sourceFiles;
+	int m_missingBlocks = 0;
+	int m_requestedBlocks = 0;
+};
+
+#endif
+
+#endif
@@ -42,15 +42,8 @@ const char* Par2CmdLineErrStr[] = { "OK",
 	"internal error occurred",
 	"out of memory" };
 
-// Sleep interval for synchronisation (microseconds)
-#ifdef WIN32
-// Windows doesn't allow sleep intervals less than one millisecond
-#define SYNC_SLEEP_INTERVAL 1000
-#else
-#define SYNC_SLEEP_INTERVAL 100
-#endif
-
 class RepairThread;
+class VerifyThread;
 
 class Repairer : public Par2::Par2Repairer, public ParChecker::AbstractRepairer
 {
@@ -61,16 +54,20 @@ public:
 	virtual Repairer* GetRepairer() { return this; }
 
 protected:
-	virtual void sig_filename(std::string filename) { m_owner->signal_filename(filename); }
-	virtual void sig_progress(int progress) { m_owner->signal_progress(progress); }
-	virtual void sig_done(std::string filename, int available, int total) { m_owner->signal_done(filename, available, total); }
+	virtual void sig_filename(std::string filename);
+	virtual void sig_progress(int progress);
+	virtual void sig_scanprogress(std::string filename, int progress);
+	virtual void sig_done(std::string filename, int available, int total);
 
 	virtual bool ScanDataFile(Par2::DiskFile *diskfile, Par2::Par2RepairerSourceFile* &sourcefile,
 		Par2::MatchType &matchtype, Par2::MD5Hash &hashfull, Par2::MD5Hash &hash16k, Par2::u32 &count);
-	virtual bool RepairData(Par2::u32 inputindex, size_t blocklength);
+	virtual bool RepairData(Par2::u32 inputindex, Par2::u32 inputcount, size_t blocklength);
+	virtual void UpdateRepairProgress(Par2::u64 processed);
+	virtual bool VerifyFiles(const vector<Par2::VerifyFileEntry>& files);
 
 private:
 	typedef vector<Thread*> Threads;
+	typedef std::map<std::string, int> ScanProgress;
 
 	Par2::CommandLine commandLine;
 	ParChecker* m_owner;
@@ -78,30 +75,58 @@ private:
 	bool m_parallel;
 	Mutex progresslock;
 
+	// Repair rounds: each call of RepairData starts a new round, which
+	// all threads work on and which ends when all of them are finished
+	Mutex m_roundMutex;
+	ConditionVar m_roundCond;
+	int m_round = 0;
+	int m_pendingThreads = 0;
+	int m_runningThreads = 0;
+	Par2::u32 m_roundInputIndex;
+	Par2::u32 m_roundInputCount;
+	size_t m_roundBlockLength;
+
+	// Parallel verification: threads take files from the list until it is
+	// exhausted; progress of files being scanned is guarded by "verifymutex"
+	const vector<Par2::VerifyFileEntry>* m_verifyFiles;
+	size_t m_nextVerifyFile;
+	bool m_verifyResult;
+	ScanProgress m_scanProgress;
+
 	virtual void BeginRepair();
 	virtual void EndRepair();
-	void RepairBlock(Par2::u32 inputindex, Par2::u32 outputindex, size_t blocklength);
+	void RepairPart(int partNum, Par2::u32 inputindex, Par2::u32 inputcount, size_t blocklength);
+	int GetVerifyThreads();
+	void VerifyNextFiles();
 
 	friend class ParChecker;
 	friend class RepairThread;
+	friend class VerifyThread;
 };
 
 class RepairThread : public Thread
 {
 public:
-	RepairThread(Repairer* owner) : m_owner(owner) {}
-	void RepairBlock(Par2::u32 inputindex, Par2::u32 outputindex, size_t blocklength);
-	bool IsWorking() { return m_working; }
+	RepairThread(Repairer* owner, int partNum) : m_owner(owner), m_partNum(partNum) {}
+
+protected:
+	virtual void Run();
+
+private:
+	Repairer* m_owner;
+	int m_partNum;
+};
+
+class VerifyThread : public Thread
+{
+public:
+	VerifyThread(Repairer* owner) : m_owner(owner) {}
 
 protected:
 	virtual void Run();
 
 private:
 	Repairer* m_owner;
-	Par2::u32 m_inputindex;
-	Par2::u32 m_outputindex;
-	size_t m_blocklength;
-	volatile bool m_working = false;
 };
 
 Par2::Result Repairer::PreProcess(const char *parFilename)
@@ -147,11 +172,12 @@ Par2::Result Repairer::Process(bool dorepair)
 bool Repairer::ScanDataFile(Par2::DiskFile *diskfile, Par2::Par2RepairerSourceFile* &sourcefile,
 	Par2::MatchType &matchtype, Par2::MD5Hash &hashfull, Par2::MD5Hash &hash16k, Par2::u32 &count)
 {
-	if (m_owner->GetParQuick() && sourcefile)
+	string path;
+	string name;
+	Par2::DiskFile::SplitFilename(diskfile->FileName(), path, name);
+
+	if ((m_owner->GetParQuick() || m_owner->IsVerifiedFile(name.c_str())) && sourcefile)
 	{
-		string path;
-		string name;
-		Par2::DiskFile::SplitFilename(diskfile->FileName(), path, name);
 
 		sig_filename(name);
 
@@ -165,6 +191,7 @@ bool Repairer::ScanDataFile(Par2::DiskFile *diskfile, Par2::Par2RepairerSourceFi
 				sig_progress(1000);
 				matchtype = fileStatus == ParChecker::fsSuccess ? Par2::eFullMatch :
 					fileStatus == ParChecker::fsPartial ? Par2::ePartialMatch : Par2::eNoMatch;
+				Guard guard(verifymutex);
 				m_owner->SetParFull(false);
 				return true;
 			}
@@ -174,6 +201,142 @@ bool Repairer::ScanDataFile(Par2::DiskFile *diskfile, Par2::Par2RepairerSourceFi
 	return Par2Repairer::ScanDataFile(diskfile, sourcefile, matchtype, hashfull, hash16k, count);
 }
 
+/*
+ * The signals may come from several threads verifying files at the same time.
+ * They are serialized using the mutex guarding the verification results,
+ * which also protects the state of ParChecker changed by the signals.
+ */
+void Repairer::sig_filename(std::string filename)
+{
+	Guard guard(verifymutex);
+	m_owner->signal_filename(filename);
+}
+
+void Repairer::sig_progress(int progress)
+{
+	Guard guard(verifymutex);
+	m_owner->signal_progress(progress);
+}
+
+void Repairer::sig_scanprogress(std::string filename, int progress)
+{
+	Guard guard(verifymutex);
+
+	if (progress < 1000)
+	{
+		m_scanProgress[filename] = progress;
+	}
+	else
+	{
+		m_scanProgress.erase(filename);
+	}
+
+	// stage progress accounts for all files being scanned
+	m_owner->m_scanProgress = 0;
+	for (ScanProgress::value_type& fileProgress : m_scanProgress)
+	{
+		m_owner->m_scanProgress += fileProgress.second;
+	}
+
+	m_owner->signal_progress(progress);
+}
+
+void Repairer::sig_done(std::string filename, int available, int total)
+{
+	Guard guard(verifymutex);
+	m_owner->signal_done(filename, available, total);
+}
+
+/*
+ * Number of files to verify at the same time, determined by option "ParVerifyThreads"
+ * for the device of the destination directory.
+ */
+int Repairer::GetVerifyThreads()
+{
+	int threads = 1;
+	int64 destVolume = FileSystem::VolumeId(m_owner->m_destDir);
+
+	for (Options::VerifyThreads& entry : g_Options->GetParVerifyThreads())
+	{
+		if (Util::EmptyStr(entry.GetDirectory()))
+		{
+			threads = entry.GetThreads();
+		}
+		else if (destVolume != -1 && FileSystem::VolumeId(entry.GetDirectory()) == destVolume)
+		{
+			// entry of the device has precedence over the default entries
+			threads = entry.GetThreads();
+			break;
+		}
+	}
+
+	if (threads == 0)
+	{
+		threads = Util::NumberOfCpuCores();
+	}
+
+	return threads > 0 ? threads : 1;
+}
+
+bool Repairer::VerifyFiles(const vector<Par2::VerifyFileEntry>& files)
+{
+	int threads = GetVerifyThreads();
+	threads = threads > (int)files.size() ? (int)files.size() : threads;
+
+	if (threads <= 1)
+	{
+		return Par2Repairer::VerifyFiles(files);
+	}
+
+	m_owner->PrintMessage(Message::mkInfo, "Using %i thread(s) to verify %i file(s) for %s",
+		threads, (int)files.size(), *m_owner->m_nzbName);
+
+	m_verifyFiles = &files;
+	m_nextVerifyFile = 0;
+	m_verifyResult = true;
+
+	// the calling thread verifies files too
+	m_runningThreads = threads - 1;
+	for (int i = 0; i < threads - 1; i++)
+	{
+		VerifyThread* verifyThread = new VerifyThread(this);
+		verifyThread->SetAutoDestroy(true);
+		verifyThread->Start();
+	}
+
+	VerifyNextFiles();
+
+	// wait until all threads have exited, they access member variables
+	Guard guard(m_roundMutex);
+	while (m_runningThreads > 0)
+	{
+		m_roundCond.Wait(m_roundMutex);
+	}
+
+	return m_verifyResult && !cancelled;
+}
+
+void Repairer::VerifyNextFiles()
+{
+	while (true)
+	{
+		const Par2::VerifyFileEntry* entry;
+		{
+			Guard guard(m_roundMutex);
+			if (m_nextVerifyFile == m_verifyFiles->size())
+			{
+				break;
+			}
+			entry = &(*m_verifyFiles)[m_nextVerifyFile++];
+		}
+
+		bool result = VerifyFile(*entry);
+
+		Guard guard(m_roundMutex);
+		m_verifyResult &= result;
+	}
+}
+
 void Repairer::BeginRepair()
 {
 	int maxThreads = g_Options->GetParThreads() > 0 ? g_Options->GetParThreads() : Util::NumberOfCpuCores();
@@ -188,17 +351,17 @@ void Repairer::BeginRepair()
 
 	if (m_parallel)
 	{
-		for (int i = 0; i < threads; i++)
+		// new threads wait for round 1, rounds of a previous repair must not count
+		m_round = 0;
+		// the thread calling RepairData works on the last part itself
+		m_runningThreads = threads - 1;
+		for (int i = 0; i < threads - 1; i++)
 		{
-			RepairThread* repairThread = new RepairThread(this);
+			RepairThread* repairThread = new RepairThread(this, i);
 			m_threads.push_back(repairThread);
 			repairThread->SetAutoDestroy(true);
 			repairThread->Start();
 		}
-
-#ifdef WIN32
-		timeBeginPeriod(1);
-#endif
 	}
 }
 
@@ -211,73 +374,65 @@ void Repairer::EndRepair()
 			thread->Stop();
 		}
 
-#ifdef WIN32
-		timeEndPeriod(1);
-#endif
+		// wait until all threads have exited, they access member variables
+		Guard guard(m_roundMutex);
+		m_roundCond.NotifyAll();
+		while (m_runningThreads > 0)
+		{
+			m_roundCond.Wait(m_roundMutex);
+		}
+
+		m_threads.clear();
 	}
 }
 
-bool Repairer::RepairData(Par2::u32 inputindex, size_t blocklength)
+/**
+ * Each thread (including the calling one) processes the input blocks against
+ * its own range of output blocks. Returns when all threads are finished.
+ */
+bool Repairer::RepairData(Par2::u32 inputindex, Par2::u32 inputcount, size_t blocklength)
 {
 	if (!m_parallel)
 	{
 		return false;
 	}
 
-	for (Par2::u32 outputindex = 0; outputindex < missingblockcount; )
 	{
-		bool jobAdded = false;
-		for (Thread* thread : m_threads)
-		{
-			RepairThread* repairThread = (RepairThread*)thread;
-			if (!repairThread->IsWorking())
-			{
-				repairThread->RepairBlock(inputindex, outputindex, blocklength);
-				outputindex++;
-				jobAdded = true;
-				break;
-			}
-		}
-
-		if (cancelled)
-		{
-			break;
-		}
-
-		if (!jobAdded)
-		{
-			usleep(SYNC_SLEEP_INTERVAL);
-		}
+		Guard guard(m_roundMutex);
+		m_roundInputIndex = inputindex;
+		m_roundInputCount = inputcount;
+		m_roundBlockLength = blocklength;
+		m_pendingThreads = (int)m_threads.size();
+		m_round++;
+		m_roundCond.NotifyAll();
 	}
 
-	// Wait until all m_Threads complete their jobs
-	bool working = true;
-	while (working)
+	RepairPart((int)m_threads.size(), inputindex, inputcount, blocklength);
+
+	Guard guard(m_roundMutex);
+	while (m_pendingThreads > 0)
 	{
-		working = false;
-		for (Thread* thread : m_threads)
-		{
-			RepairThread* repairThread = (RepairThread*)thread;
-			if (repairThread->IsWorking())
-			{
-				working = true;
-				usleep(SYNC_SLEEP_INTERVAL);
-				break;
-			}
-		}
+		m_roundCond.Wait(m_roundMutex);
 	}
 
 	return true;
 }
 
-void Repairer::RepairBlock(Par2::u32 inputindex, Par2::u32 outputindex, size_t blocklength)
+void Repairer::RepairPart(int partNum, Par2::u32 inputindex, Par2::u32 inputcount, size_t blocklength)
 {
-	// Select the appropriate part of the output buffer
-	void *outbuf = &((Par2::u8*)outputbuffer)[chunksize * outputindex];
+	// split output blocks evenly into contiguous ranges
+	Par2::u32 partCount = (Par2::u32)m_threads.size() + 1;
+	Par2::u32 firstOutput = (Par2::u32)((Par2::u64)missingblockcount * partNum / partCount);
+	Par2::u32 lastOutput = (Par2::u32)((Par2::u64)missingblockcount * (partNum + 1) / partCount);
 
-	// Process the data
-	rs.Process(blocklength, inputindex, inputbuffer, outputindex, outbuf);
+	if (lastOutput > firstOutput)
+	{
+		RepairTiles(inputindex, inputcount, firstOutput, lastOutput - firstOutput, blocklength);
+	}
+}
 
+void Repairer::UpdateRepairProgress(Par2::u64 processed)
+{
 	if (noiselevel > Par2::CommandLine::nlQuiet)
 	{
 		// Update a progress indicator
@@ -287,7 +442,7 @@ void Repairer::RepairBlock(Par2::u32 inputindex, Par2::u32 outputindex, size_t b
 		{
 			Guard guard(progresslock);
 			oldfraction = (Par2::u32)(1000 * progress / totaldata);
-			progress += blocklength;
+			progress += processed;
 			newfraction = (Par2::u32)(1000 * progress / totaldata);
 		}
 
@@ -298,30 +453,55 @@ void Repairer::RepairBlock(Par2::u32 inputindex, Par2::u32 outputindex, size_t b
 	}
 }
 
+void VerifyThread::Run()
+{
+	m_owner->VerifyNextFiles();
+
+	Guard guard(m_owner->m_roundMutex);
+	m_owner->m_runningThreads--;
+	m_owner->m_roundCond.NotifyAll();
+}
+
 void RepairThread::Run()
 {
-	while (!IsStopped())
+	int round = 0;
+
+	while (true)
 	{
-		if (m_working)
+		Par2::u32 inputindex;
+		Par2::u32 inputcount;
+		size_t blocklength;
+
 		{
-			m_owner->RepairBlock(m_inputindex, m_outputindex, m_blocklength);
-			m_working = false;
+			Guard guard(m_owner->m_roundMutex);
+			while (m_owner->m_round == round && !IsStopped())
+			{
+				m_owner->m_roundCond.Wait(m_owner->m_roundMutex);
+			}
+
+			if (IsStopped())
+			{
+				m_owner->m_runningThreads--;
+				m_owner->m_roundCond.NotifyAll();
+				break;
+			}
+
+			round = m_owner->m_round;
+			inputindex = m_owner->m_roundInputIndex;
+			inputcount = m_owner->m_roundInputCount;
+			blocklength = m_owner->m_roundBlockLength;
 		}
-		else
+
+		m_owner->RepairPart(m_partNum, inputindex, inputcount, blocklength);
+
 		{
-			usleep(SYNC_SLEEP_INTERVAL);
+			Guard guard(m_owner->m_roundMutex);
+			m_owner->m_pendingThreads--;
+			m_owner->m_roundCond.NotifyAll();
 		}
 	}
 }
 
-void RepairThread::RepairBlock(Par2::u32 inputindex, Par2::u32 outputindex, size_t blocklength)
-{
-	m_inputindex = inputindex;
-	m_outputindex = outputindex;
-	m_blocklength = blocklength;
-	m_working = true;
-}
-
 
 int ParChecker::StreamBuf::overflow(int ch)
 {
@@ -466,6 +646,7 @@ ParChecker::EStatus ParChecker::RunParCheck(const char* parFilename)
 
 	m_progressLabel.Format("Verifying %s", *m_infoName);
 	m_fileProgress = 0;
+	m_scanProgress = 0;
 	m_stageProgress = 0;
 	UpdateProgress();
 
@@ -1102,14 +1283,8 @@ void ParChecker::signal_progress(int progress)
 
 		if (totalFiles > 0)
 		{
-			if (m_fileProgress < 1000)
-			{
-				m_stageProgress = (processedFiles * 1000 + m_fileProgress) / totalFiles;
-			}
-			else
-			{
-				m_stageProgress = processedFiles * 1000 / totalFiles;
-			}
+			// files may be verified in parallel, "m_scanProgress" sums up their progress
+			m_stageProgress = (processedFiles * 1000 + m_scanProgress) / totalFiles;
 		}
 		else
 		{
@@ -1339,17 +1514,26 @@ ParChecker::EFileStatus ParChecker::VerifyDataFile(void* diskfile, void* sourcef
 		return fsFailure;
 	}
 
+	// files verified against the block checksums during download don't need to be verified again
+	bool verifiedFile = IsVerifiedFile(FileSystem::BaseFileName(filename)) &&
+		FileSystem::FileSize(filename) == (int64)sourceFile->GetDescriptionPacket()->FileSize();
+	if (!verifiedFile && !m_parQuick)
+	{
+		return fsUnknown;
+	}
+
 	// find file status and CRC computed during download
 	uint32 downloadCrc;
 	SegmentList segments;
-	EFileStatus	fileStatus = FindFileCrc(FileSystem::BaseFileName(filename), &downloadCrc, &segments);
+	EFileStatus	fileStatus = verifiedFile ? fsSuccess :
+		FindFileCrc(FileSystem::BaseFileName(filename), &downloadCrc, &segments);
 	ValidBlocks validBlocks;
 
 	if (fileStatus == fsFailure || fileStatus == fsUnknown)
 	{
 		return fileStatus;
 	}
-	else if ((fileStatus == fsSuccess && !VerifySuccessDataFile(diskfile, sourcefile, downloadCrc)) ||
+	else if (!verifiedFile && (fileStatus == fsSuccess && !VerifySuccessDataFile(diskfile, sourcefile, downloadCrc)) ||
 		(fileStatus == fsPartial && !VerifyPartialDataFile(diskfile, sourcefile, &segments, &validBlocks)))
 	{
 		PrintMessage(Message::mkWarning, "Quick verification failed for %s file %s, performing full verification instead",
@@ -1357,7 +1541,9 @@ ParChecker::EFileStatus ParChecker::VerifyDataFile(void* diskfile, void* sourcef
 		return fsUnknown; // let libpar2 do the full verification of the file
 	}
 
-	// attach verification blocks to the file
+	// attach verification blocks to the file;
+	// other files may be verified at the same time
+	Guard guard(GetRepairer()->verifymutex);
 	*availableBlocks = 0;
 	Par2::u64 blocksize = GetRepairer()->mainpacket->BlockSize();
 	std::deque<const Par2::VerificationHashEntry*> undoList;
@@ -1387,8 +1573,16 @@ ParChecker::EFileStatus ParChecker::VerifyDataFile(void* diskfile, void* sourcef
 	}
 
 	m_quickFiles++;
-	PrintMessage(Message::mkDetail, "Quickly verified %s file %s",
-		fileStatus == fsSuccess ? "good" : "damaged", FileSystem::BaseFileName(filename));
+	if (verifiedFile)
+	{
+		PrintMessage(Message::mkDetail, "Skipped verification of good file %s, verified during download",
+			FileSystem::BaseFileName(filename));
+	}
+	else
+	{
+		PrintMessage(Message::mkDetail, "Quickly verified %s file %s",
+			fileStatus == fsSuccess ? "good" : "damaged", FileSystem::BaseFileName(filename));
+	}
 
 	return fileStatus;
 }
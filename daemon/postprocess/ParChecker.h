@@ -133,6 +133,7 @@ protected:
 	virtual void PrintMessage(Message::EKind kind, const char* format, ...) PRINTF_SYNTAX(3) {}
 	virtual void RegisterParredFile(const char* filename) {}
 	virtual bool IsParredFile(const char* filename) { return false; }
+	virtual bool IsVerifiedFile(const char* filename) { return false; }
 	virtual EFileStatus FindFileCrc(const char* filename, uint32* crc, SegmentList* segments) { return fsUnknown; }
 	virtual void RequestDupeSources(DupeSourceList* dupeSourceList) {}
 	virtual void StatDupeSources(DupeSourceList* dupeSourceList) {}
@@ -175,6 +176,7 @@ private:
 	bool m_verifyingExtraFiles;
 	CString m_progressLabel;
 	int m_fileProgress;
+	int m_scanProgress;
 	int m_stageProgress;
 	bool m_cancelled;
 	SourceList m_sourceFiles;
@@ -67,6 +67,18 @@ bool ParCoordinator::PostParChecker::IsParredFile(const char* filename)
 	return false;
 }
 
+bool ParCoordinator::PostParChecker::IsVerifiedFile(const char* filename)
+{
+	for (CString& verifiedFile : m_postInfo->GetVerifiedFiles())
+	{
+		if (!strcasecmp(verifiedFile, filename))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 ParChecker::EFileStatus ParCoordinator::PostParChecker::FindFileCrc(const char* filename,
 	uint32* crc, SegmentList* segments)
 {
@@ -154,13 +166,10 @@ void ParCoordinator::PostParChecker::StatDupeSources(DupeSourceList* dupeSourceL
 	{
 		if (dupeSource.GetUsedBlocks() > 0)
 		{
-			for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
+			HistoryInfo* historyInfo = downloadQueue->GetHistory()->Find(dupeSource.GetId());
+			if (historyInfo && historyInfo->GetKind() == HistoryInfo::hkNzb)
 			{
-				if (historyInfo->GetKind() == HistoryInfo::hkNzb &&
-					historyInfo->GetNzbInfo()->GetId() == dupeSource.GetId())
-				{
-					historyInfo->GetNzbInfo()->SetExtraParBlocks(historyInfo->GetNzbInfo()->GetExtraParBlocks() - dupeSource.GetUsedBlocks());
-				}
+				historyInfo->GetNzbInfo()->SetExtraParBlocks(historyInfo->GetNzbInfo()->GetExtraParBlocks() - dupeSource.GetUsedBlocks());
 			}
 		}
 		totalExtraParBlocks += dupeSource.GetUsedBlocks();
@@ -242,6 +251,19 @@ void ParCoordinator::Stop()
 
 	m_stopped = true;
 
+	for (IncrementalParLoader* loader : m_incrementalParLoaders)
+	{
+		loader->Stop();
+	}
+	m_incrementalParLoaders.clear();
+
+	if (m_activeFileVerifier)
+	{
+		m_activeFileVerifier->Stop();
+		m_activeFileVerifier = nullptr;
+	}
+	m_incrementalFileVerifiers.clear();
+
 	if (m_parChecker.IsRunning())
 	{
 		m_parChecker.Stop();
@@ -275,6 +297,18 @@ void ParCoordinator::PausePars(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
  */
 void ParCoordinator::StartParCheckJob(PostInfo* postInfo)
 {
+	// pass files verified during download to the par-checker unless full verification was requested
+	postInfo->GetVerifiedFiles()->clear();
+	IncrementalParCheckerMap::iterator parSets = m_incrementalParCheckers.find(postInfo->GetNzbInfo()->GetId());
+	if (parSets != m_incrementalParCheckers.end() && !postInfo->GetForceParFull() && !postInfo->GetForceRepair())
+	{
+		for (std::unique_ptr<IncrementalParChecker>& incrementalParChecker : parSets->second)
+		{
+			incrementalParChecker->GetVerifiedFiles(postInfo->GetVerifiedFiles());
+		}
+	}
+	DiscardIncrementalCheck(postInfo->GetNzbInfo());
+
 	m_currentJob = jkParCheck;
 	m_parChecker.SetPostInfo(postInfo);
 	m_parChecker.SetDestDir(postInfo->GetNzbInfo()->GetDestDir());
@@ -353,6 +387,383 @@ bool ParCoordinator::AddPar(FileInfo* fileInfo, bool deleted)
 	return sameCollection;
 }
 
+/**
+ * Checks a file of an nzb which is still being downloaded for missing par-blocks.
+ * DownloadQueue must be locked prior to call of this function.
+ */
+void ParCoordinator::CheckCompletedFile(DownloadQueue* downloadQueue, FileInfo* fileInfo)
+{
+	if (!g_Options->GetParIncremental() || g_Options->GetParCheck() != Options::pcAuto)
+	{
+		return;
+	}
+
+	NzbInfo* nzbInfo = fileInfo->GetNzbInfo();
+	const char* filename = FileSystem::BaseFileName(fileInfo->GetOutputFilename());
+
+	int blockCount = 0;
+	if (ParParser::ParseParFilename(filename, nullptr, &blockCount))
+	{
+		if (blockCount == 0 && fileInfo->GetSuccessArticles() > 0)
+		{
+			LoadIncrementalParFile(downloadQueue, nzbInfo, filename);
+		}
+		return;
+	}
+
+	IncrementalParCheckerMap::iterator parSets = m_incrementalParCheckers.find(nzbInfo->GetId());
+	if (parSets == m_incrementalParCheckers.end())
+	{
+		return;
+	}
+
+	bool complete = fileInfo->GetSuccessArticles() == fileInfo->GetTotalArticles();
+	IncrementalParChecker::SegmentList segments;
+	if (!complete)
+	{
+		for (ArticleInfo* pa : fileInfo->GetArticles())
+		{
+			segments.emplace_back(pa->GetStatus() == ArticleInfo::aiFinished,
+				pa->GetSegmentOffset(), pa->GetSegmentSize());
+		}
+	}
+
+	for (std::unique_ptr<IncrementalParChecker>& incrementalParChecker : parSets->second)
+	{
+		if (incrementalParChecker->AddDataFile(filename, complete, &segments))
+		{
+			VerifyIncrementalFile(nzbInfo, incrementalParChecker.get(), filename);
+			RequestIncrementalPars(downloadQueue, nzbInfo, incrementalParChecker.get());
+			break;
+		}
+	}
+}
+
+void ParCoordinator::LoadIncrementalParFile(DownloadQueue* downloadQueue, NzbInfo* nzbInfo, const char* filename)
+{
+	for (std::unique_ptr<IncrementalParChecker>& incrementalParChecker : m_incrementalParCheckers[nzbInfo->GetId()])
+	{
+		if (ParParser::SameParCollection(FileSystem::BaseFileName(incrementalParChecker->GetParFilename()), filename))
+		{
+			return;
+		}
+	}
+
+	for (IncrementalParLoader* loader : m_incrementalParLoaders)
+	{
+		if (loader->m_nzbId == nzbInfo->GetId() && ParParser::SameParCollection(loader->m_filename, filename))
+		{
+			return;
+		}
+	}
+
+	BString<1024> fullFilename("%s%c%s", nzbInfo->GetDestDir(), (int)PATH_SEPARATOR, filename);
+	IncrementalParLoader* loader = new IncrementalParLoader(this, nzbInfo->GetId(), filename, fullFilename);
+
+	for (CompletedFile& completedFile : nzbInfo->GetCompletedFiles())
+	{
+		if (completedFile.GetStatus() == CompletedFile::cfPartial && completedFile.GetId() > 0 &&
+			!ParParser::ParseParFilename(completedFile.GetFileName(), nullptr, nullptr))
+		{
+			loader->GetPartialFiles()->push_back(completedFile.GetId());
+		}
+	}
+
+	m_incrementalParLoaders.push_back(loader);
+	loader->SetAutoDestroy(true);
+	loader->Start();
+}
+
+void ParCoordinator::IncrementalParLoader::Run()
+{
+	std::unique_ptr<IncrementalParChecker> incrementalParChecker = std::make_unique<IncrementalParChecker>();
+	FileStates fileStates;
+
+	if (incrementalParChecker->Load(m_fullFilename))
+	{
+		for (int id : m_partialFiles)
+		{
+			std::unique_ptr<FileInfo> fileInfo = std::make_unique<FileInfo>(id);
+			if (!IsStopped() && g_DiskState->LoadFileState(fileInfo.get(), nullptr, true))
+			{
+				fileStates[id] = std::move(fileInfo);
+			}
+		}
+	}
+	else
+	{
+		incrementalParChecker.reset();
+	}
+
+	GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+	m_owner->IncrementalParLoaded(downloadQueue, this, std::move(incrementalParChecker), &fileStates);
+}
+
+/**
+ * Called by the loader thread with the queue locked. The loader may have been discarded
+ * in the meantime if the nzb was downloaded or deleted.
+ */
+void ParCoordinator::IncrementalParLoaded(DownloadQueue* downloadQueue, IncrementalParLoader* loader,
+	std::unique_ptr<IncrementalParChecker> incrementalParChecker, FileStates* fileStates)
+{
+	IncrementalParLoaders::iterator pos = std::find(m_incrementalParLoaders.begin(), m_incrementalParLoaders.end(), loader);
+	if (pos == m_incrementalParLoaders.end())
+	{
+		return;
+	}
+	m_incrementalParLoaders.erase(pos);
+
+	NzbInfo* nzbInfo = downloadQueue->GetQueue()->Find(loader->m_nzbId);
+	if (m_stopped || !nzbInfo)
+	{
+		return;
+	}
+
+	if (!incrementalParChecker)
+	{
+		nzbInfo->PrintMessage(Message::mkWarning, "Could not load par2-file %s for incremental par-check", *loader->m_filename);
+		return;
+	}
+
+	// check files downloaded before the par2-file
+	for (CompletedFile& completedFile : nzbInfo->GetCompletedFiles())
+	{
+		if (ParParser::ParseParFilename(completedFile.GetFileName(), nullptr, nullptr))
+		{
+			continue;
+		}
+
+		IncrementalParChecker::SegmentList segments;
+		if (completedFile.GetStatus() == CompletedFile::cfSuccess)
+		{
+			if (incrementalParChecker->AddDataFile(completedFile.GetFileName(), true, nullptr))
+			{
+				VerifyIncrementalFile(nzbInfo, incrementalParChecker.get(), completedFile.GetFileName());
+			}
+		}
+		else if (completedFile.GetStatus() == CompletedFile::cfFailure)
+		{
+			incrementalParChecker->AddDataFile(completedFile.GetFileName(), false, &segments);
+		}
+		else if (completedFile.GetStatus() == CompletedFile::cfPartial && completedFile.GetId() > 0)
+		{
+			// files completed while the loader was running haven't been read by it
+			FileStates::iterator state = fileStates->find(completedFile.GetId());
+			std::unique_ptr<FileInfo> fileInfo;
+			if (state != fileStates->end())
+			{
+				fileInfo = std::move(state->second);
+			}
+			else
+			{
+				fileInfo = std::make_unique<FileInfo>(completedFile.GetId());
+				if (!g_DiskState->LoadFileState(fileInfo.get(), nullptr, true))
+				{
+					continue;
+				}
+			}
+
+			for (ArticleInfo* pa : fileInfo->GetArticles())
+			{
+				segments.emplace_back(pa->GetStatus() == ArticleInfo::aiFinished,
+					pa->GetSegmentOffset(), pa->GetSegmentSize());
+			}
+			if (incrementalParChecker->AddDataFile(completedFile.GetFileName(), false, &segments))
+			{
+				VerifyIncrementalFile(nzbInfo, incrementalParChecker.get(), completedFile.GetFileName());
+			}
+		}
+	}
+
+	nzbInfo->PrintMessage(Message::mkDetail, "Loaded par2-file %s for incremental par-check", *loader->m_filename);
+
+	RequestIncrementalPars(downloadQueue, nzbInfo, incrementalParChecker.get());
+	m_incrementalParCheckers[nzbInfo->GetId()].push_back(std::move(incrementalParChecker));
+}
+
+/**
+ * Unpauses par2-files as soon as damaged blocks are found, so that they are downloaded
+ * together with the remaining files of the nzb instead of after the par-check.
+ */
+void ParCoordinator::RequestIncrementalPars(DownloadQueue* downloadQueue, NzbInfo* nzbInfo,
+	IncrementalParChecker* incrementalParChecker)
+{
+	int missingBlocks = incrementalParChecker->GetMissingBlocks();
+	if (missingBlocks <= incrementalParChecker->GetRequestedBlocks())
+	{
+		return;
+	}
+	incrementalParChecker->SetRequestedBlocks(missingBlocks);
+
+	const char* parFilename = FileSystem::BaseFileName(incrementalParChecker->GetParFilename());
+
+	// count par-blocks which are already downloaded or being downloaded
+	int availableBlocks = 0;
+	int blockCount = 0;
+	for (CompletedFile& completedFile : nzbInfo->GetCompletedFiles())
+	{
+		if (completedFile.GetStatus() == CompletedFile::cfSuccess &&
+			ParParser::ParseParFilename(completedFile.GetFileName(), nullptr, &blockCount) &&
+			ParParser::SameParCollection(completedFile.GetFileName(), parFilename))
+		{
+			availableBlocks += blockCount;
+		}
+	}
+	for (FileInfo* fileInfo : nzbInfo->GetFileList())
+	{
+		if (!fileInfo->GetPaused() &&
+			ParParser::ParseParFilename(fileInfo->GetFilename(), nullptr, &blockCount) &&
+			ParParser::SameParCollection(fileInfo->GetFilename(), parFilename))
+		{
+			availableBlocks += blockCount;
+		}
+	}
+
+	if (missingBlocks > availableBlocks)
+	{
+		nzbInfo->PrintMessage(Message::mkInfo, "Found %i damaged block(s) in %s during download, need %i more par-block(s)",
+			missingBlocks, nzbInfo->GetName(), missingBlocks - availableBlocks);
+		UnpausePars(downloadQueue, nzbInfo, incrementalParChecker->GetParFilename(),
+			missingBlocks - availableBlocks, true, nullptr);
+	}
+}
+
+/**
+ * Queues a completed data file for verification against the block checksums of its par-set.
+ */
+void ParCoordinator::VerifyIncrementalFile(NzbInfo* nzbInfo, IncrementalParChecker* incrementalParChecker,
+	const char* filename)
+{
+	int64 fileSize = 0;
+	IncrementalParChecker::BlockChecksums* blockChecksums = incrementalParChecker->GetBlockChecksums(filename, &fileSize);
+	if (!blockChecksums)
+	{
+		return;
+	}
+
+	if (m_activeFileVerifier && m_activeFileVerifier->m_nzbId == nzbInfo->GetId() &&
+		!strcasecmp(m_activeFileVerifier->m_filename, filename))
+	{
+		return;
+	}
+
+	for (std::unique_ptr<IncrementalFileVerifier>& verifier : m_incrementalFileVerifiers)
+	{
+		if (verifier->m_nzbId == nzbInfo->GetId() && !strcasecmp(verifier->m_filename, filename))
+		{
+			return;
+		}
+	}
+
+	BString<1024> fullFilename("%s%c%s", nzbInfo->GetDestDir(), (int)PATH_SEPARATOR, filename);
+	m_incrementalFileVerifiers.push_back(std::make_unique<IncrementalFileVerifier>(this, nzbInfo->GetId(),
+		incrementalParChecker->GetParFilename(), filename, fullFilename, fileSize,
+		incrementalParChecker->GetBlockSize(), blockChecksums));
+
+	StartIncrementalFileVerifier();
+}
+
+void ParCoordinator::StartIncrementalFileVerifier()
+{
+	if (m_activeFileVerifier || m_incrementalFileVerifiers.empty() || m_stopped)
+	{
+		return;
+	}
+
+	// the verifier thread deletes itself when finished
+	m_activeFileVerifier = m_incrementalFileVerifiers.front().release();
+	m_incrementalFileVerifiers.pop_front();
+	m_activeFileVerifier->SetAutoDestroy(true);
+	m_activeFileVerifier->Start();
+}
+
+void ParCoordinator::IncrementalFileVerifier::Run()
+{
+	m_damagedBlocks = IncrementalParChecker::VerifyBlocks(m_fullFilename, m_fileSize, m_blockSize,
+		&m_blockChecksums, this);
+
+	GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+	m_owner->IncrementalFileVerified(downloadQueue, this);
+}
+
+/**
+ * Called by the verifier thread with the queue locked. The verifier may have been discarded
+ * in the meantime if the nzb was deleted or its par-check has started.
+ */
+void ParCoordinator::IncrementalFileVerified(DownloadQueue* downloadQueue, IncrementalFileVerifier* verifier)
+{
+	if (verifier != m_activeFileVerifier)
+	{
+		return;
+	}
+	m_activeFileVerifier = nullptr;
+
+	NzbInfo* nzbInfo = downloadQueue->GetQueue()->Find(verifier->m_nzbId);
+	IncrementalParCheckerMap::iterator parSets = m_incrementalParCheckers.find(verifier->m_nzbId);
+	if (nzbInfo && parSets != m_incrementalParCheckers.end() && verifier->m_damagedBlocks >= 0)
+	{
+		for (std::unique_ptr<IncrementalParChecker>& incrementalParChecker : parSets->second)
+		{
+			if (!strcmp(incrementalParChecker->GetParFilename(), verifier->m_parFilename))
+			{
+				incrementalParChecker->DataFileVerified(verifier->m_filename, verifier->m_damagedBlocks);
+				nzbInfo->PrintMessage(Message::mkDetail, "Verified %s file %s during download",
+					verifier->m_damagedBlocks > 0 ? "damaged" : "good", *verifier->m_filename);
+
+				// no more par-files are requested once the nzb is in post-processing
+				if (!nzbInfo->GetPostInfo())
+				{
+					RequestIncrementalPars(downloadQueue, nzbInfo, incrementalParChecker.get());
+				}
+				break;
+			}
+		}
+	}
+
+	StartIncrementalFileVerifier();
+}
+
+/**
+ * Stops loading of par2-files for an nzb which has been completely downloaded. Already
+ * loaded par-sets and verification of completed files are kept for the par-check.
+ */
+void ParCoordinator::FinishIncrementalCheck(NzbInfo* nzbInfo)
+{
+	// the loader threads delete themselves when finished
+	m_incrementalParLoaders.erase(std::remove_if(m_incrementalParLoaders.begin(), m_incrementalParLoaders.end(),
+		[nzbInfo](IncrementalParLoader* loader)
+		{
+			if (loader->m_nzbId == nzbInfo->GetId())
+			{
+				loader->Stop();
+				return true;
+			}
+			return false;
+		}),
+		m_incrementalParLoaders.end());
+}
+
+void ParCoordinator::DiscardIncrementalCheck(NzbInfo* nzbInfo)
+{
+	FinishIncrementalCheck(nzbInfo);
+
+	m_incrementalParCheckers.erase(nzbInfo->GetId());
+
+	m_incrementalFileVerifiers.erase(std::remove_if(m_incrementalFileVerifiers.begin(), m_incrementalFileVerifiers.end(),
+		[nzbInfo](std::unique_ptr<IncrementalFileVerifier>& verifier)
+		{
+			return verifier->m_nzbId == nzbInfo->GetId();
+		}),
+		m_incrementalFileVerifiers.end());
+
+	if (m_activeFileVerifier && m_activeFileVerifier->m_nzbId == nzbInfo->GetId())
+	{
+		m_activeFileVerifier->Stop();
+		m_activeFileVerifier = nullptr;
+		StartIncrementalFileVerifier();
+	}
+}
+
 void ParCoordinator::ParCheckCompleted()
 {
 	GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
@@ -387,7 +798,7 @@ void ParCoordinator::ParCheckCompleted()
 	postInfo->SetWorking(false);
 	postInfo->SetStage(PostInfo::ptQueued);
 
-	downloadQueue->Save();
+	downloadQueue->SaveChanged(postInfo->GetNzbInfo()->GetId());
 }
 
 /**
@@ -400,22 +811,30 @@ void ParCoordinator::ParCheckCompleted()
 bool ParCoordinator::RequestMorePars(NzbInfo* nzbInfo, const char* parFilename, int blockNeeded, int* blockFoundOut)
 {
 	GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+	return UnpausePars(downloadQueue, nzbInfo, parFilename, blockNeeded, false, blockFoundOut);
+}
 
+/**
+ * DownloadQueue must be locked prior to call of this function.
+ */
+bool ParCoordinator::UnpausePars(DownloadQueue* downloadQueue, NzbInfo* nzbInfo, const char* parFilename,
+	int blockNeeded, bool pausedOnly, int* blockFoundOut)
+{
 	Blocks blocks;
 	blocks.clear();
 	int blockFound = 0;
 	int curBlockFound = 0;
 
-	FindPars(downloadQueue, nzbInfo, parFilename, blocks, true, true, &curBlockFound);
+	FindPars(downloadQueue, nzbInfo, parFilename, blocks, true, true, pausedOnly, &curBlockFound);
 	blockFound += curBlockFound;
 	if (blockFound < blockNeeded)
 	{
-		FindPars(downloadQueue, nzbInfo, parFilename, blocks, true, false, &curBlockFound);
+		FindPars(downloadQueue, nzbInfo, parFilename, blocks, true, false, pausedOnly, &curBlockFound);
 		blockFound += curBlockFound;
 	}
 	if (blockFound < blockNeeded)
 	{
-		FindPars(downloadQueue, nzbInfo, parFilename, blocks, false, false, &curBlockFound);
+		FindPars(downloadQueue, nzbInfo, parFilename, blocks, false, false, pausedOnly, &curBlockFound);
 		blockFound += curBlockFound;
 	}
 
@@ -443,7 +862,7 @@ bool ParCoordinator::RequestMorePars(NzbInfo* nzbInfo, const char* parFilename,
 			{
 				if (bestBlockInfo->m_fileInfo->GetPaused())
 				{
-					m_parChecker.PrintMessage(Message::mkInfo, "Unpausing %s%c%s for par-recovery", nzbInfo->GetName(), (int)PATH_SEPARATOR, bestBlockInfo->m_fileInfo->GetFilename());
+					nzbInfo->PrintMessage(Message::mkInfo, "Unpausing %s%c%s for par-recovery", nzbInfo->GetName(), (int)PATH_SEPARATOR, bestBlockInfo->m_fileInfo->GetFilename());
 					bestBlockInfo->m_fileInfo->SetPaused(false);
 					bestBlockInfo->m_fileInfo->SetExtraPriority(true);
 				}
@@ -466,7 +885,7 @@ bool ParCoordinator::RequestMorePars(NzbInfo* nzbInfo, const char* parFilename,
 			BlockInfo& blockInfo = blocks.front();
 			if (blockInfo.m_fileInfo->GetPaused())
 			{
-				m_parChecker.PrintMessage(Message::mkInfo, "Unpausing %s%c%s for par-recovery", nzbInfo->GetName(), (int)PATH_SEPARATOR, blockInfo.m_fileInfo->GetFilename());
+				nzbInfo->PrintMessage(Message::mkInfo, "Unpausing %s%c%s for par-recovery", nzbInfo->GetName(), (int)PATH_SEPARATOR, blockInfo.m_fileInfo->GetFilename());
 				blockInfo.m_fileInfo->SetPaused(false);
 				blockInfo.m_fileInfo->SetExtraPriority(true);
 			}
@@ -495,7 +914,7 @@ bool ParCoordinator::RequestMorePars(NzbInfo* nzbInfo, const char* parFilename,
 }
 
 void ParCoordinator::FindPars(DownloadQueue* downloadQueue, NzbInfo* nzbInfo, const char* parFilename,
-	Blocks& blocks, bool strictParName, bool exactParName, int* blockFound)
+	Blocks& blocks, bool strictParName, bool exactParName, bool pausedOnly, int* blockFound)
 {
 	*blockFound = 0;
 
@@ -516,7 +935,7 @@ void ParCoordinator::FindPars(DownloadQueue* downloadQueue, NzbInfo* nzbInfo, co
 	{
 		int blockCount = 0;
 		if (ParParser::ParseParFilename(fileInfo->GetFilename(), nullptr, &blockCount) &&
-			blockCount > 0)
+			blockCount > 0 && (!pausedOnly || fileInfo->GetPaused()))
 		{
 			bool useFile = true;
 
@@ -683,7 +1102,7 @@ void ParCoordinator::ParRenameCompleted()
 	postInfo->SetWorking(false);
 	postInfo->SetStage(PostInfo::ptQueued);
 
-	downloadQueue->Save();
+	downloadQueue->SaveChanged(postInfo->GetNzbInfo()->GetId());
 }
 
 void ParCoordinator::UpdateParRenameProgress()
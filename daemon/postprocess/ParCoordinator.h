@@ -27,6 +27,7 @@
 #include "ParChecker.h"
 #include "ParRenamer.h"
 #include "DupeMatcher.h"
+#include "IncrementalParChecker.h"
 #endif
 
 class ParCoordinator
@@ -38,6 +39,9 @@ public:
 
 #ifndef DISABLE_PARCHECK
 	bool AddPar(FileInfo* fileInfo, bool deleted);
+	void CheckCompletedFile(DownloadQueue* downloadQueue, FileInfo* fileInfo);
+	void FinishIncrementalCheck(NzbInfo* nzbInfo);
+	void DiscardIncrementalCheck(NzbInfo* nzbInfo);
 	void StartParCheckJob(PostInfo* postInfo);
 	void StartParRenameJob(PostInfo* postInfo);
 	void Stop();
@@ -70,6 +74,7 @@ private:
 		virtual void PrintMessage(Message::EKind kind, const char* format, ...) PRINTF_SYNTAX(3);
 		virtual void RegisterParredFile(const char* filename);
 		virtual bool IsParredFile(const char* filename);
+		virtual bool IsVerifiedFile(const char* filename);
 		virtual EFileStatus FindFileCrc(const char* filename, uint32* crc, SegmentList* segments);
 		virtual void RequestDupeSources(DupeSourceList* dupeSourceList);
 		virtual void StatDupeSources(DupeSourceList* dupeSourceList);
@@ -124,6 +129,66 @@ private:
 
 	typedef std::deque<BlockInfo> Blocks;
 
+	typedef std::vector<std::unique_ptr<IncrementalParChecker>> IncrementalParCheckers;
+	typedef std::map<int, IncrementalParCheckers> IncrementalParCheckerMap;
+	typedef std::map<int, std::unique_ptr<FileInfo>> FileStates;
+
+	/*
+	 * Parses the main par2-file of a par-set and reads the article states of partially
+	 * downloaded files without holding the queue lock, see ParCoordinator::IncrementalParLoaded.
+	 */
+	class IncrementalParLoader : public Thread
+	{
+	public:
+		IncrementalParLoader(ParCoordinator* owner, int nzbId, const char* filename, const char* fullFilename) :
+			m_owner(owner), m_nzbId(nzbId), m_filename(filename), m_fullFilename(fullFilename) {}
+		IdList* GetPartialFiles() { return &m_partialFiles; }
+	protected:
+		virtual void Run();
+	private:
+		ParCoordinator* m_owner;
+		int m_nzbId;
+		CString m_filename;
+		CString m_fullFilename;
+		IdList m_partialFiles;
+
+		friend class ParCoordinator;
+	};
+
+	typedef std::vector<IncrementalParLoader*> IncrementalParLoaders;
+
+	/*
+	 * Verifies a completed data file against the block checksums of its par-set without
+	 * holding the queue lock, see ParCoordinator::IncrementalFileVerified. Only one file
+	 * is verified at a time, other files wait in the queue of verifiers.
+	 */
+	class IncrementalFileVerifier : public Thread
+	{
+	public:
+		IncrementalFileVerifier(ParCoordinator* owner, int nzbId, const char* parFilename,
+			const char* filename, const char* fullFilename, int64 fileSize, int64 blockSize,
+			IncrementalParChecker::BlockChecksums* blockChecksums) :
+			m_owner(owner), m_nzbId(nzbId), m_parFilename(parFilename), m_filename(filename),
+			m_fullFilename(fullFilename), m_fileSize(fileSize), m_blockSize(blockSize),
+			m_blockChecksums(*blockChecksums) {}
+	protected:
+		virtual void Run();
+	private:
+		ParCoordinator* m_owner;
+		int m_nzbId;
+		CString m_parFilename;
+		CString m_filename;
+		CString m_fullFilename;
+		int64 m_fileSize;
+		int64 m_blockSize;
+		IncrementalParChecker::BlockChecksums m_blockChecksums;
+		int m_damagedBlocks = -1;
+
+		friend class ParCoordinator;
+	};
+
+	typedef std::deque<std::unique_ptr<IncrementalFileVerifier>> IncrementalFileVerifiers;
+
 	enum EJobKind
 	{
 		jkParCheck,
@@ -134,9 +199,24 @@ private:
 	bool m_stopped = false;
 	PostParRenamer m_parRenamer;
 	EJobKind m_currentJob;
+	IncrementalParCheckerMap m_incrementalParCheckers;
+	IncrementalParLoaders m_incrementalParLoaders;
+	IncrementalFileVerifiers m_incrementalFileVerifiers;
+	IncrementalFileVerifier* m_activeFileVerifier = nullptr;
 
 	void FindPars(DownloadQueue* downloadQueue, NzbInfo* nzbInfo, const char* parFilename,
-		Blocks& blocks, bool strictParName, bool exactParName, int* blockFound);
+		Blocks& blocks, bool strictParName, bool exactParName, bool pausedOnly, int* blockFound);
+	bool UnpausePars(DownloadQueue* downloadQueue, NzbInfo* nzbInfo, const char* parFilename,
+		int blockNeeded, bool pausedOnly, int* blockFoundOut);
+	void LoadIncrementalParFile(DownloadQueue* downloadQueue, NzbInfo* nzbInfo, const char* filename);
+	void IncrementalParLoaded(DownloadQueue* downloadQueue, IncrementalParLoader* loader,
+		std::unique_ptr<IncrementalParChecker> incrementalParChecker, FileStates* fileStates);
+	void RequestIncrementalPars(DownloadQueue* downloadQueue, NzbInfo* nzbInfo,
+		IncrementalParChecker* incrementalParChecker);
+	void VerifyIncrementalFile(NzbInfo* nzbInfo, IncrementalParChecker* incrementalParChecker,
+		const char* filename);
+	void StartIncrementalFileVerifier();
+	void IncrementalFileVerified(DownloadQueue* downloadQueue, IncrementalFileVerifier* verifier);
 #endif
 };
 
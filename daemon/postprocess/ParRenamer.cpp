@@ -193,11 +193,17 @@ void ParRenamer::CheckFiles(const char* destDir, bool renamePars)
 				}
 				else
 				{
-					CheckRegularFile(destDir, fullFilename);
+					m_hashFiles.emplace_back(fullFilename);
+					if ((int)m_hashFiles.size() >= Par2::MD5Lanes())
+					{
+						CheckRegularFiles(destDir);
+					}
 				}
 			}
 		}
 	}
+
+	CheckRegularFiles(destDir);
 }
 
 void ParRenamer::CheckMissing()
@@ -239,40 +245,76 @@ bool ParRenamer::IsSplittedFragment(const char* filename, const char* correctNam
 	return splittedFragement;
 }
 
-void ParRenamer::CheckRegularFile(const char* destDir, const char* filename)
+/*
+ * Computes 16k-hashes of the collected files. The hashes of several files are
+ * computed at once using multi-buffer MD5.
+ */
+void ParRenamer::CheckRegularFiles(const char* destDir)
 {
-	debug("Computing hash for %s", filename);
+	static const int blockSize = 16*1024;
+	int count = (int)m_hashFiles.size();
 
-	DiskFile file;
-	if (!file.Open(filename, DiskFile::omRead))
+	// load first 16K of each file into buffer
+	CharBuffer buffer(blockSize * count);
+	std::vector<Par2::MD5Context> contexts(count);
+	std::vector<Par2::MD5Context*> contextList;
+	std::vector<const void*> bufferList;
+	std::vector<size_t> lengthList;
+	std::vector<CString> filenameList;
+
+	for (int i = 0; i < count; i++)
 	{
-		PrintMessage(Message::mkError, "Could not open file %s", filename);
-		return;
+		const char* filename = m_hashFiles[i];
+		char* fileBuffer = buffer + i * blockSize;
+
+		debug("Computing hash for %s", filename);
+
+		DiskFile file;
+		if (!file.Open(filename, DiskFile::omRead))
+		{
+			PrintMessage(Message::mkError, "Could not open file %s", filename);
+			continue;
+		}
+
+		int readBytes = (int)file.Read(fileBuffer, blockSize);
+		if (readBytes != blockSize && file.Error())
+		{
+			PrintMessage(Message::mkError, "Could not read file %s", filename);
+			continue;
+		}
+
+		file.Close();
+
+		contextList.push_back(&contexts[i]);
+		bufferList.push_back(fileBuffer);
+		lengthList.push_back(readBytes);
+		filenameList.push_back(filename);
 	}
 
-	// load first 16K of the file into buffer
-	static const int blockSize = 16*1024;
-	CharBuffer buffer(blockSize);
+	m_hashFiles.clear();
 
-	int readBytes = (int)file.Read(buffer, buffer.Size());
-	if (readBytes != buffer.Size() && file.Error())
+	if (contextList.empty())
 	{
-		PrintMessage(Message::mkError, "Could not read file %s", filename);
 		return;
 	}
 
-	file.Close();
+	Par2::MD5UpdateMulti(contextList.data(), bufferList.data(), lengthList.data(), (int)contextList.size());
 
-	Par2::MD5Hash hash16k;
-	Par2::MD5Context context;
-	context.Update(buffer, readBytes);
-	context.Final(hash16k);
+	for (int i = 0; i < (int)contextList.size(); i++)
+	{
+		Par2::MD5Hash hash16k;
+		contextList[i]->Final(hash16k);
+		CheckRegularFile(destDir, filenameList[i], hash16k.print().c_str());
+	}
+}
 
-	debug("file: %s; hash16k: %s", FileSystem::BaseFileName(filename), hash16k.print().c_str());
+void ParRenamer::CheckRegularFile(const char* destDir, const char* filename, const char* hash16k)
+{
+	debug("file: %s; hash16k: %s", FileSystem::BaseFileName(filename), hash16k);
 
 	for (FileHash& fileHash : m_fileHashList)
 	{
-		if (!strcmp(fileHash.GetHash(), hash16k.print().c_str()))
+		if (!strcmp(fileHash.GetHash(), hash16k))
 		{
 			debug("Found correct filename: %s", fileHash.GetFilename());
 			fileHash.SetFileExists(true);
@@ -74,6 +74,7 @@ private:
 
 	typedef std::deque<FileHash> FileHashList;
 	typedef std::deque<CString> DirList;
+	typedef std::deque<CString> FileList;
 
 	CString m_infoName;
 	CString m_destDir;
@@ -83,6 +84,7 @@ private:
 	bool m_cancelled;
 	DirList m_dirList;
 	FileHashList m_fileHashList;
+	FileList m_hashFiles;
 	int m_fileCount;
 	int m_curFile;
 	int m_renamedCount;
@@ -94,7 +96,8 @@ private:
 	void LoadParFiles(const char* destDir);
 	void LoadParFile(const char* parFilename);
 	void CheckFiles(const char* destDir, bool renamePars);
-	void CheckRegularFile(const char* destDir, const char* filename);
+	void CheckRegularFiles(const char* destDir);
+	void CheckRegularFile(const char* destDir, const char* filename, const char* hash16k);
 	void CheckParFile(const char* destDir, const char* filename);
 	bool IsSplittedFragment(const char* filename, const char* correctName);
 	void CheckMissing();
@@ -28,6 +28,7 @@
 #include "Util.h"
 #include "FileSystem.h"
 #include "Unpack.h"
+#include "DirectUnpack.h"
 #include "Cleanup.h"
 #include "NzbFile.h"
 #include "QueueScript.h"
@@ -63,7 +64,7 @@ void PrePostProcessor::Run()
 			CheckPostQueue();
 		}
 
-		Util::SetStandByMode(!m_curJob);
+		Util::SetStandByMode(m_runningJobs.empty());
 
 		usleep(200 * 1000);
 	}
@@ -80,15 +81,31 @@ void PrePostProcessor::Stop()
 	m_parCoordinator.Stop();
 #endif
 
-	if (m_curJob && m_curJob->GetPostInfo() &&
-		(m_curJob->GetPostInfo()->GetStage() == PostInfo::ptUnpacking ||
-		 m_curJob->GetPostInfo()->GetStage() == PostInfo::ptExecutingScript) &&
-		m_curJob->GetPostInfo()->GetPostThread())
+	for (RunningJob& job : m_runningJobs)
 	{
-		Thread* postThread = m_curJob->GetPostInfo()->GetPostThread();
-		m_curJob->GetPostInfo()->SetPostThread(nullptr);
-		postThread->SetAutoDestroy(true);
-		postThread->Stop();
+		if (job.m_directUnpack)
+		{
+			continue;
+		}
+
+		PostInfo* postInfo = job.m_nzbInfo->GetPostInfo();
+		if ((postInfo->GetStage() == PostInfo::ptUnpacking ||
+			 postInfo->GetStage() == PostInfo::ptExecutingScript) &&
+			postInfo->GetPostThread())
+		{
+			Thread* postThread = postInfo->GetPostThread();
+			postInfo->SetPostThread(nullptr);
+			postThread->SetAutoDestroy(true);
+			postThread->Stop();
+		}
+	}
+
+	for (NzbInfo* nzbInfo : guard->GetQueue())
+	{
+		if (nzbInfo->GetDirectUnpack())
+		{
+			nzbInfo->GetDirectUnpack()->Stop();
+		}
 	}
 }
 
@@ -125,6 +142,7 @@ void PrePostProcessor::DownloadQueueUpdate(Subject* Caller, void* Aspect)
 		if (queueAspect->action == DownloadQueue::eaFileCompleted && !queueAspect->nzbInfo->GetPostInfo())
 		{
 			g_QueueScriptCoordinator->EnqueueScript(queueAspect->nzbInfo, QueueScriptCoordinator::qeFileDownloaded);
+			CheckDirectUnpack(queueAspect->downloadQueue, queueAspect->fileInfo);
 		}
 
 #ifndef DISABLE_PARCHECK
@@ -132,6 +150,11 @@ void PrePostProcessor::DownloadQueueUpdate(Subject* Caller, void* Aspect)
 		{
 			return;
 		}
+
+		if (queueAspect->action == DownloadQueue::eaFileCompleted && !queueAspect->nzbInfo->GetPostInfo())
+		{
+			m_parCoordinator.CheckCompletedFile(queueAspect->downloadQueue, queueAspect->fileInfo);
+		}
 #endif
 
 		if ((queueAspect->action == DownloadQueue::eaFileCompleted ||
@@ -188,6 +211,16 @@ void PrePostProcessor::NzbAdded(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
 
 void PrePostProcessor::NzbDownloaded(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
 {
+#ifndef DISABLE_PARCHECK
+	m_parCoordinator.FinishIncrementalCheck(nzbInfo);
+#endif
+
+	if (nzbInfo->GetDirectUnpack())
+	{
+		nzbInfo->GetDirectUnpack()->NzbDownloaded(downloadQueue, nzbInfo);
+	}
+	m_waitingDirectUnpacks.erase(nzbInfo->GetId());
+
 	if (nzbInfo->GetDeleteStatus() == NzbInfo::dsHealth ||
 		nzbInfo->GetDeleteStatus() == NzbInfo::dsBad)
 	{
@@ -213,7 +246,7 @@ void PrePostProcessor::NzbDownloaded(DownloadQueue* downloadQueue, NzbInfo* nzbI
 			nzbInfo->SetRenameStatus(NzbInfo::rsSkipped);
 		}
 
-		downloadQueue->Save();
+		downloadQueue->SaveChanged(nzbInfo->GetId());
 	}
 	else
 	{
@@ -229,6 +262,14 @@ void PrePostProcessor::NzbDeleted(DownloadQueue* downloadQueue, NzbInfo* nzbInfo
 	}
 	nzbInfo->SetDeleting(false);
 
+	if (nzbInfo->GetDirectUnpack())
+	{
+		nzbInfo->GetDirectUnpack()->NzbDeleted(downloadQueue, nzbInfo);
+	}
+	m_waitingDirectUnpacks.erase(nzbInfo->GetId());
+	// the nzb may be destroyed when it is not added to history
+	RemoveDirectUnpackJob(nzbInfo);
+
 	DeleteCleanup(nzbInfo);
 
 	if (nzbInfo->GetDeleteStatus() == NzbInfo::dsHealth ||
@@ -244,6 +285,10 @@ void PrePostProcessor::NzbDeleted(DownloadQueue* downloadQueue, NzbInfo* nzbInfo
 
 void PrePostProcessor::NzbCompleted(DownloadQueue* downloadQueue, NzbInfo* nzbInfo, bool saveQueue)
 {
+#ifndef DISABLE_PARCHECK
+	m_parCoordinator.DiscardIncrementalCheck(nzbInfo);
+#endif
+
 	bool addToHistory = g_Options->GetKeepHistory() > 0 && !nzbInfo->GetAvoidHistory();
 	if (addToHistory)
 	{
@@ -283,6 +328,61 @@ void PrePostProcessor::NzbCompleted(DownloadQueue* downloadQueue, NzbInfo* nzbIn
 	}
 }
 
+/**
+ * Passes a downloaded file to the running direct unpack of the nzb
+ * or starts direct unpack when the first volume of an archive is downloaded.
+ */
+void PrePostProcessor::CheckDirectUnpack(DownloadQueue* downloadQueue, FileInfo* fileInfo)
+{
+	NzbInfo* nzbInfo = fileInfo->GetNzbInfo();
+
+	if (nzbInfo->GetDirectUnpack())
+	{
+		nzbInfo->GetDirectUnpack()->FileDownloaded(downloadQueue, fileInfo);
+	}
+	else if (g_Options->GetDirectUnpack() && g_Options->GetDecode() &&
+		fileInfo->GetSuccessArticles() == fileInfo->GetTotalArticles() &&
+		(DirectUnpack::IsArchiveFilename(FileSystem::BaseFileName(fileInfo->GetOutputFilename())) ||
+		 m_waitingDirectUnpacks.count(nzbInfo->GetId()) > 0))
+	{
+		StartDirectUnpack(downloadQueue, nzbInfo);
+	}
+}
+
+/**
+ * Direct unpack writes into the download directory and takes a disk-job slot
+ * on that volume. If no slot is free the start is retried when the next file
+ * of the nzb is downloaded.
+ */
+void PrePostProcessor::StartDirectUnpack(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
+{
+	int64 volumeId = g_Options->GetPostVolumeJobs() > 0 ? FileSystem::VolumeId(nzbInfo->GetDestDir()) : -1;
+	if (!CanStartJob(&m_runningJobs, rcDisk, false, volumeId,
+		g_Options->GetPostDiskJobs(), g_Options->GetPostVolumeJobs()))
+	{
+		m_waitingDirectUnpacks.insert(nzbInfo->GetId());
+		return;
+	}
+
+	m_waitingDirectUnpacks.erase(nzbInfo->GetId());
+	DirectUnpack::StartJob(nzbInfo);
+
+	if (nzbInfo->GetDirectUnpack())
+	{
+		m_runningJobs.emplace_back(nzbInfo, rcDisk, false, volumeId, false, "direct unpack", true);
+	}
+}
+
+void PrePostProcessor::RemoveDirectUnpackJob(NzbInfo* nzbInfo)
+{
+	m_runningJobs.erase(std::remove_if(m_runningJobs.begin(), m_runningJobs.end(),
+		[nzbInfo](RunningJob& job)
+		{
+			return job.m_directUnpack && job.m_nzbInfo == nzbInfo;
+		}),
+		m_runningJobs.end());
+}
+
 void PrePostProcessor::DeleteCleanup(NzbInfo* nzbInfo)
 {
 	if (nzbInfo->GetCleanupDisk() ||
@@ -324,92 +424,135 @@ void PrePostProcessor::CheckPostQueue()
 {
 	GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
 
-	if (!m_curJob && m_jobCount > 0)
-	{
-		m_curJob = GetNextJob(downloadQueue);
-	}
+	// release the slots of jobs which have completed their current stage
+	m_runningJobs.erase(std::remove_if(m_runningJobs.begin(), m_runningJobs.end(),
+		[](RunningJob& job)
+		{
+			return job.m_directUnpack ?
+				job.m_nzbInfo->GetDirectUnpackStatus() != NzbInfo::nsRunning :
+				!job.m_nzbInfo->GetPostInfo()->GetWorking();
+		}),
+		m_runningJobs.end());
 
-	if (m_curJob)
+	if (m_jobCount > 0)
 	{
-		PostInfo* postInfo = m_curJob->GetPostInfo();
-		if (!postInfo->GetWorking() && !IsNzbFileDownloading(m_curJob))
+		for (NzbInfo* nzbInfo : GetPostJobs(downloadQueue))
 		{
-#ifndef DISABLE_PARCHECK
-			if (postInfo->GetRequestParCheck() &&
-				(postInfo->GetNzbInfo()->GetParStatus() <= NzbInfo::psSkipped ||
-				 (postInfo->GetForceRepair() && !postInfo->GetNzbInfo()->GetParFull())) &&
-				g_Options->GetParCheck() != Options::pcManual)
+			if (CheckPostJob(downloadQueue, nzbInfo))
 			{
-				postInfo->SetForceParFull(postInfo->GetNzbInfo()->GetParStatus() > NzbInfo::psSkipped);
-				postInfo->GetNzbInfo()->SetParStatus(NzbInfo::psNone);
-				postInfo->SetRequestParCheck(false);
-				postInfo->SetStage(PostInfo::ptQueued);
-				postInfo->GetNzbInfo()->GetScriptStatuses()->clear();
-				DeletePostThread(postInfo);
+				// the job was completed and removed from post-queue;
+				// other jobs are checked on the next iteration
+				break;
 			}
-			else if (postInfo->GetRequestParCheck() && postInfo->GetNzbInfo()->GetParStatus() <= NzbInfo::psSkipped &&
-				g_Options->GetParCheck() == Options::pcManual)
-			{
-				postInfo->SetRequestParCheck(false);
-				postInfo->GetNzbInfo()->SetParStatus(NzbInfo::psManual);
-				DeletePostThread(postInfo);
+		}
+	}
 
-				if (!postInfo->GetNzbInfo()->GetFileList()->empty())
-				{
-					postInfo->GetNzbInfo()->PrintMessage(Message::mkInfo,
-						"Downloading all remaining files for manual par-check for %s", postInfo->GetNzbInfo()->GetName());
-					downloadQueue->EditEntry(postInfo->GetNzbInfo()->GetId(), DownloadQueue::eaGroupResume, 0, nullptr);
-					postInfo->SetStage(PostInfo::ptFinished);
-				}
-				else
-				{
-					postInfo->GetNzbInfo()->PrintMessage(Message::mkInfo,
-						"There are no par-files remain for download for %s", postInfo->GetNzbInfo()->GetName());
-					postInfo->SetStage(PostInfo::ptQueued);
-				}
-			}
+	UpdatePauseState();
+}
 
-#endif
-			if (postInfo->GetDeleted())
-			{
-				postInfo->SetStage(PostInfo::ptFinished);
-			}
+/**
+ * Advances the job to its next stage if the job is not busy and the resources
+ * required for the stage are available.
+ * Returns true if the job was completed.
+ */
+bool PrePostProcessor::CheckPostJob(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
+{
+	PostInfo* postInfo = nzbInfo->GetPostInfo();
+	if (postInfo->GetWorking() || IsNzbFileDownloading(nzbInfo))
+	{
+		return false;
+	}
 
-			if (postInfo->GetStage() == PostInfo::ptQueued &&
-				(!g_Options->GetPausePostProcess() || postInfo->GetNzbInfo()->GetForcePriority()))
-			{
-				DeletePostThread(postInfo);
-				StartJob(downloadQueue, postInfo);
-			}
-			else if (postInfo->GetStage() == PostInfo::ptFinished)
-			{
-				UpdatePauseState(false, nullptr);
-				JobCompleted(downloadQueue, postInfo);
-			}
-			else if (!g_Options->GetPausePostProcess())
-			{
-				error("Internal error: invalid state in post-processor");
-				// TODO: cancel (delete) current job
-			}
+#ifndef DISABLE_PARCHECK
+	if (postInfo->GetRequestParCheck() &&
+		(postInfo->GetNzbInfo()->GetParStatus() <= NzbInfo::psSkipped ||
+		 (postInfo->GetForceRepair() && !postInfo->GetNzbInfo()->GetParFull())) &&
+		g_Options->GetParCheck() != Options::pcManual)
+	{
+		postInfo->SetForceParFull(postInfo->GetNzbInfo()->GetParStatus() > NzbInfo::psSkipped);
+		postInfo->GetNzbInfo()->SetParStatus(NzbInfo::psNone);
+		postInfo->SetRequestParCheck(false);
+		postInfo->SetStage(PostInfo::ptQueued);
+		postInfo->GetNzbInfo()->GetScriptStatuses()->clear();
+		DeletePostThread(postInfo);
+	}
+	else if (postInfo->GetRequestParCheck() && postInfo->GetNzbInfo()->GetParStatus() <= NzbInfo::psSkipped &&
+		g_Options->GetParCheck() == Options::pcManual)
+	{
+		postInfo->SetRequestParCheck(false);
+		postInfo->GetNzbInfo()->SetParStatus(NzbInfo::psManual);
+		DeletePostThread(postInfo);
+
+		if (!postInfo->GetNzbInfo()->GetFileList()->empty())
+		{
+			postInfo->GetNzbInfo()->PrintMessage(Message::mkInfo,
+				"Downloading all remaining files for manual par-check for %s", postInfo->GetNzbInfo()->GetName());
+			downloadQueue->EditEntry(postInfo->GetNzbInfo()->GetId(), DownloadQueue::eaGroupResume, 0, nullptr);
+			postInfo->SetStage(PostInfo::ptFinished);
 		}
+		else
+		{
+			postInfo->GetNzbInfo()->PrintMessage(Message::mkInfo,
+				"There are no par-files remain for download for %s", postInfo->GetNzbInfo()->GetName());
+			postInfo->SetStage(PostInfo::ptQueued);
+		}
+	}
+
+#endif
+	if (postInfo->GetDeleted())
+	{
+		postInfo->SetStage(PostInfo::ptFinished);
+	}
+
+	if (postInfo->GetStage() == PostInfo::ptQueued &&
+		(!g_Options->GetPausePostProcess() || postInfo->GetNzbInfo()->GetForcePriority()))
+	{
+		DeletePostThread(postInfo);
+		StartJob(downloadQueue, postInfo);
+	}
+	else if (postInfo->GetStage() == PostInfo::ptFinished)
+	{
+		JobCompleted(downloadQueue, postInfo);
+		return true;
+	}
+	else if (!g_Options->GetPausePostProcess())
+	{
+		error("Internal error: invalid state in post-processor");
+		// TODO: cancel (delete) current job
 	}
+
+	return false;
 }
 
-NzbInfo* PrePostProcessor::GetNextJob(DownloadQueue* downloadQueue)
+/**
+ * Returns post-jobs ordered by priority; the jobs with higher priority
+ * get free slots first. Jobs which haven't been started yet are not
+ * included if queue-scripts are still running for them or if the
+ * post-processing is paused.
+ */
+RawNzbList PrePostProcessor::GetPostJobs(DownloadQueue* downloadQueue)
 {
-	NzbInfo* nzbInfo = nullptr;
+	RawNzbList jobs;
 
-	for (NzbInfo* nzbInfo1: downloadQueue->GetQueue())
+	for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
 	{
-		if (nzbInfo1->GetPostInfo() && !g_QueueScriptCoordinator->HasJob(nzbInfo1->GetId(), nullptr) &&
-			(!nzbInfo || nzbInfo1->GetPriority() > nzbInfo->GetPriority()) &&
-			(!g_Options->GetPausePostProcess() || nzbInfo1->GetForcePriority()))
+		PostInfo* postInfo = nzbInfo->GetPostInfo();
+		if (postInfo &&
+			(postInfo->GetStartTime() > 0 ||
+			 (!g_QueueScriptCoordinator->HasJob(nzbInfo->GetId(), nullptr) &&
+			  (!g_Options->GetPausePostProcess() || nzbInfo->GetForcePriority()))))
 		{
-			nzbInfo = nzbInfo1;
+			jobs.push_back(nzbInfo);
 		}
 	}
 
-	return nzbInfo;
+	std::stable_sort(jobs.begin(), jobs.end(),
+		[](NzbInfo* nzbInfo1, NzbInfo* nzbInfo2)
+		{
+			return nzbInfo1->GetPriority() > nzbInfo2->GetPriority();
+		});
+
+	return jobs;
 }
 
 /**
@@ -447,25 +590,35 @@ void PrePostProcessor::DeletePostThread(PostInfo* postInfo)
 
 void PrePostProcessor::StartJob(DownloadQueue* downloadQueue, PostInfo* postInfo)
 {
-	if (!postInfo->GetStartTime())
+	if (postInfo->GetNzbInfo()->GetDirectUnpackStatus() == NzbInfo::nsRunning)
 	{
-		postInfo->SetStartTime(Util::CurrentTime());
+		// direct unpack reads the downloaded files, wait until it is finished
+		postInfo->SetProgressLabel("Waiting for direct unpack");
+		return;
 	}
 
 #ifndef DISABLE_PARCHECK
 	if (postInfo->GetNzbInfo()->GetRenameStatus() == NzbInfo::rsNone &&
 		postInfo->GetNzbInfo()->GetDeleteStatus() == NzbInfo::dsNone)
 	{
-		UpdatePauseState(g_Options->GetParPauseQueue(), "par-rename");
-		m_parCoordinator.StartParRenameJob(postInfo);
+		if (CanStartJob(postInfo, rcCpu, true))
+		{
+			AddRunningJob(postInfo, rcCpu, true, g_Options->GetParPauseQueue(), "par-rename");
+			m_parCoordinator.StartParRenameJob(postInfo);
+		}
 		return;
 	}
 	else if (postInfo->GetNzbInfo()->GetParStatus() == NzbInfo::psNone &&
 		postInfo->GetNzbInfo()->GetDeleteStatus() == NzbInfo::dsNone)
 	{
+		if (!CanStartJob(postInfo, rcCpu, true))
+		{
+			return;
+		}
+
 		if (ParParser::FindMainPars(postInfo->GetNzbInfo()->GetDestDir(), nullptr))
 		{
-			UpdatePauseState(g_Options->GetParPauseQueue(), "par-check");
+			AddRunningJob(postInfo, rcCpu, true, g_Options->GetParPauseQueue(), "par-check");
 			m_parCoordinator.StartParCheckJob(postInfo);
 		}
 		else
@@ -565,34 +718,42 @@ void PrePostProcessor::StartJob(DownloadQueue* downloadQueue, PostInfo* postInfo
 		return;
 	}
 
+	EResourceClass resourceClass = unpack || cleanup || moveInter ? rcDisk : rcScript;
+	if (!CanStartJob(postInfo, resourceClass, false))
+	{
+		return;
+	}
+
 	postInfo->SetProgressLabel(unpack ? "Unpacking" : moveInter ? "Moving" : "Executing post-process-script");
 	postInfo->SetWorking(true);
 	postInfo->SetStage(unpack ? PostInfo::ptUnpacking : moveInter ? PostInfo::ptMoving : PostInfo::ptExecutingScript);
 	postInfo->SetFileProgress(0);
 	postInfo->SetStageProgress(0);
 
-	downloadQueue->Save();
+	downloadQueue->SaveChanged(postInfo->GetNzbInfo()->GetId());
 
 	postInfo->SetStageTime(Util::CurrentTime());
 
 	if (unpack)
 	{
-		UpdatePauseState(g_Options->GetUnpackPauseQueue(), "unpack");
+		AddRunningJob(postInfo, resourceClass, false, g_Options->GetUnpackPauseQueue(), "unpack");
 		UnpackController::StartJob(postInfo);
 	}
 	else if (cleanup)
 	{
-		UpdatePauseState(g_Options->GetUnpackPauseQueue() || g_Options->GetScriptPauseQueue(), "cleanup");
+		AddRunningJob(postInfo, resourceClass, false,
+			g_Options->GetUnpackPauseQueue() || g_Options->GetScriptPauseQueue(), "cleanup");
 		CleanupController::StartJob(postInfo);
 	}
 	else if (moveInter)
 	{
-		UpdatePauseState(g_Options->GetUnpackPauseQueue() || g_Options->GetScriptPauseQueue(), "move");
+		AddRunningJob(postInfo, resourceClass, false,
+			g_Options->GetUnpackPauseQueue() || g_Options->GetScriptPauseQueue(), "move");
 		MoveController::StartJob(postInfo);
 	}
 	else
 	{
-		UpdatePauseState(g_Options->GetScriptPauseQueue(), "post-process-script");
+		AddRunningJob(postInfo, resourceClass, false, g_Options->GetScriptPauseQueue(), "post-process-script");
 		PostScriptController::StartJob(postInfo);
 	}
 }
@@ -615,10 +776,7 @@ void PrePostProcessor::JobCompleted(DownloadQueue* downloadQueue, PostInfo* post
 		NzbCompleted(downloadQueue, nzbInfo, false);
 	}
 
-	if (nzbInfo == m_curJob)
-	{
-		m_curJob = nullptr;
-	}
+	RemoveRunningJob(nzbInfo);
 	m_jobCount--;
 
 	downloadQueue->Save();
@@ -661,17 +819,128 @@ bool PrePostProcessor::IsNzbFileDownloading(NzbInfo* nzbInfo)
 	return false;
 }
 
-void PrePostProcessor::UpdatePauseState(bool needPause, const char* reason)
+bool PrePostProcessor::CanStartJob(PostInfo* postInfo, EResourceClass resourceClass, bool parJob)
 {
-	if (needPause && !g_Options->GetTempPauseDownload())
+	int maxJobs = resourceClass == rcCpu ? g_Options->GetPostCpuJobs() :
+		resourceClass == rcDisk ? g_Options->GetPostDiskJobs() :
+		g_Options->GetPostScriptJobs();
+
+	return CanStartJob(&m_runningJobs, resourceClass, parJob, JobVolumeId(postInfo, resourceClass, parJob),
+		maxJobs, g_Options->GetPostVolumeJobs());
+}
+
+bool PrePostProcessor::CanStartJob(RunningJobs* runningJobs, EResourceClass resourceClass, bool parJob,
+	int64 volumeId, int maxJobs, int maxVolumeJobs)
+{
+	bool checkVolume = resourceClass != rcScript && maxVolumeJobs > 0;
+
+	int classJobs = 0;
+	int volumeJobs = 0;
+	for (RunningJob& job : runningJobs)
 	{
-		info("Pausing download before %s", reason);
+		if (parJob && job.m_parJob)
+		{
+			// par-checker and par-renamer can serve only one job at a time
+			return false;
+		}
+
+		if (job.m_resourceClass == resourceClass)
+		{
+			classJobs++;
+		}
+
+		if (checkVolume && job.m_resourceClass != rcScript && job.m_volumeId == volumeId)
+		{
+			volumeJobs++;
+		}
 	}
-	else if (!needPause && g_Options->GetTempPauseDownload())
+
+	return classJobs < maxJobs && (!checkVolume || volumeJobs < maxVolumeJobs);
+}
+
+void PrePostProcessor::AddRunningJob(PostInfo* postInfo, EResourceClass resourceClass, bool parJob,
+	bool pauseQueue, const char* reason)
+{
+	if (!postInfo->GetStartTime())
 	{
-		info("Unpausing download after %s", m_pauseReason);
+		postInfo->SetStartTime(Util::CurrentTime());
 	}
-	g_Options->SetTempPauseDownload(needPause);
+
+	m_runningJobs.emplace_back(postInfo->GetNzbInfo(), resourceClass, parJob,
+		JobVolumeId(postInfo, resourceClass, parJob), pauseQueue, reason);
+
+	UpdatePauseState();
+}
+
+/**
+ * Par-jobs work in the download directory, unpack, move and cleanup write
+ * into the final directory, which is on another volume if intermediate
+ * directory is used.
+ */
+int64 PrePostProcessor::JobVolumeId(PostInfo* postInfo, EResourceClass resourceClass, bool parJob)
+{
+	if (resourceClass == rcScript || g_Options->GetPostVolumeJobs() == 0)
+	{
+		return -1;
+	}
+
+	NzbInfo* nzbInfo = postInfo->GetNzbInfo();
+	if (parJob)
+	{
+		return FileSystem::VolumeId(nzbInfo->GetDestDir());
+	}
+
+	bool useInterDir = !Util::EmptyStr(g_Options->GetInterDir()) &&
+		!strncmp(nzbInfo->GetDestDir(), g_Options->GetInterDir(), strlen(g_Options->GetInterDir())) &&
+		nzbInfo->GetDestDir()[strlen(g_Options->GetInterDir())] == PATH_SEPARATOR;
+
+	return FileSystem::VolumeId(!Util::EmptyStr(nzbInfo->GetFinalDir()) ? nzbInfo->GetFinalDir() :
+		useInterDir ? *nzbInfo->BuildFinalDirName() : nzbInfo->GetDestDir());
+}
+
+void PrePostProcessor::RemoveRunningJob(NzbInfo* nzbInfo)
+{
+	m_runningJobs.erase(std::remove_if(m_runningJobs.begin(), m_runningJobs.end(),
+		[nzbInfo](RunningJob& job)
+		{
+			return job.m_nzbInfo == nzbInfo;
+		}),
+		m_runningJobs.end());
+}
+
+/**
+ * Pauses download queue if at least one of running jobs requires it
+ * and unpauses when none of them does anymore.
+ */
+void PrePostProcessor::UpdatePauseState()
+{
+	const char* reason = nullptr;
+	for (RunningJob& job : m_runningJobs)
+	{
+		if (job.m_pauseQueue)
+		{
+			reason = job.m_reason;
+			break;
+		}
+	}
+
+	if (reason && !m_pauseReason)
+	{
+		if (!g_Options->GetTempPauseDownload())
+		{
+			info("Pausing download before %s", reason);
+		}
+		g_Options->SetTempPauseDownload(true);
+	}
+	else if (!reason && m_pauseReason)
+	{
+		if (g_Options->GetTempPauseDownload())
+		{
+			info("Unpausing download after %s", m_pauseReason);
+		}
+		g_Options->SetTempPauseDownload(false);
+	}
+
 	m_pauseReason = reason;
 }
 
@@ -694,45 +963,42 @@ bool PrePostProcessor::PostQueueDelete(DownloadQueue* downloadQueue, IdList* idL
 
 	for (int id : *idList)
 	{
-		for (NzbInfo* nzbInfo: downloadQueue->GetQueue())
+		NzbInfo* nzbInfo = downloadQueue->GetQueue()->Find(id);
+		PostInfo* postInfo = nzbInfo ? nzbInfo->GetPostInfo() : nullptr;
+		if (postInfo)
 		{
-			PostInfo* postInfo = nzbInfo->GetPostInfo();
-			if (postInfo && nzbInfo->GetId() == id)
+			if (postInfo->GetWorking())
 			{
-				if (postInfo->GetWorking())
-				{
-					postInfo->GetNzbInfo()->PrintMessage(Message::mkInfo,
-						"Deleting active post-job %s", postInfo->GetNzbInfo()->GetName());
-					postInfo->SetDeleted(true);
+				postInfo->GetNzbInfo()->PrintMessage(Message::mkInfo,
+					"Deleting active post-job %s", postInfo->GetNzbInfo()->GetName());
+				postInfo->SetDeleted(true);
 #ifndef DISABLE_PARCHECK
-					if (PostInfo::ptLoadingPars <= postInfo->GetStage() && postInfo->GetStage() <= PostInfo::ptRenaming)
-					{
-						if (m_parCoordinator.Cancel())
-						{
-							ok = true;
-						}
-					}
-					else
-#endif
-					if (postInfo->GetPostThread())
+				if (PostInfo::ptLoadingPars <= postInfo->GetStage() && postInfo->GetStage() <= PostInfo::ptRenaming)
+				{
+					if (m_parCoordinator.Cancel())
 					{
-						debug("Terminating %s for %s", (postInfo->GetStage() == PostInfo::ptUnpacking ? "unpack" : "post-process-script"), postInfo->GetNzbInfo()->GetName());
-						postInfo->GetPostThread()->Stop();
 						ok = true;
 					}
-					else
-					{
-						error("Internal error in PrePostProcessor::QueueDelete");
-					}
 				}
 				else
+#endif
+				if (postInfo->GetPostThread())
 				{
-					postInfo->GetNzbInfo()->PrintMessage(Message::mkInfo,
-						"Deleting queued post-job %s", postInfo->GetNzbInfo()->GetName());
-					JobCompleted(downloadQueue, postInfo);
+					debug("Terminating %s for %s", (postInfo->GetStage() == PostInfo::ptUnpacking ? "unpack" : "post-process-script"), postInfo->GetNzbInfo()->GetName());
+					postInfo->GetPostThread()->Stop();
 					ok = true;
 				}
-				break;
+				else
+				{
+					error("Internal error in PrePostProcessor::QueueDelete");
+				}
+			}
+			else
+			{
+				postInfo->GetNzbInfo()->PrintMessage(Message::mkInfo,
+					"Deleting queued post-job %s", postInfo->GetNzbInfo()->GetName());
+				JobCompleted(downloadQueue, postInfo);
+				ok = true;
 			}
 		}
 	}
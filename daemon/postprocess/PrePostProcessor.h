@@ -29,6 +29,31 @@
 class PrePostProcessor : public Thread
 {
 public:
+	enum EResourceClass
+	{
+		rcCpu,
+		rcDisk,
+		rcScript
+	};
+
+	struct RunningJob
+	{
+		NzbInfo* m_nzbInfo;
+		EResourceClass m_resourceClass;
+		bool m_parJob;
+		int64 m_volumeId;
+		bool m_pauseQueue;
+		const char* m_reason;
+		bool m_directUnpack;
+		RunningJob(NzbInfo* nzbInfo, EResourceClass resourceClass, bool parJob, int64 volumeId,
+			bool pauseQueue, const char* reason, bool directUnpack = false) :
+			m_nzbInfo(nzbInfo), m_resourceClass(resourceClass), m_parJob(parJob),
+			m_volumeId(volumeId), m_pauseQueue(pauseQueue), m_reason(reason),
+			m_directUnpack(directUnpack) {}
+	};
+
+	typedef std::vector<RunningJob> RunningJobs;
+
 	PrePostProcessor();
 	virtual void Run();
 	virtual void Stop();
@@ -38,6 +63,9 @@ public:
 		int offset, const char* text);
 	void NzbAdded(DownloadQueue* downloadQueue, NzbInfo* nzbInfo);
 	void NzbDownloaded(DownloadQueue* downloadQueue, NzbInfo* nzbInfo);
+	/* Checks if a job fits into the class limit and the limit of its volume (0 - no volume limit) */
+	static bool CanStartJob(RunningJobs* runningJobs, EResourceClass resourceClass, bool parJob,
+		int64 volumeId, int maxJobs, int maxVolumeJobs);
 
 private:
 	class DownloadQueueObserver: public Observer
@@ -50,22 +78,32 @@ private:
 	ParCoordinator m_parCoordinator;
 	DownloadQueueObserver m_downloadQueueObserver;
 	int m_jobCount = 0;
-	NzbInfo* m_curJob = nullptr;
+	RunningJobs m_runningJobs;
 	const char* m_pauseReason = nullptr;
+	std::set<int> m_waitingDirectUnpacks;
 
 	bool IsNzbFileCompleted(NzbInfo* nzbInfo, bool ignorePausedPars);
 	bool IsNzbFileDownloading(NzbInfo* nzbInfo);
 	void CheckPostQueue();
+	bool CheckPostJob(DownloadQueue* downloadQueue, NzbInfo* nzbInfo);
 	void JobCompleted(DownloadQueue* downloadQueue, PostInfo* postInfo);
 	void StartJob(DownloadQueue* downloadQueue, PostInfo* postInfo);
 	void SanitisePostQueue();
-	void UpdatePauseState(bool needPause, const char* reason);
+	bool CanStartJob(PostInfo* postInfo, EResourceClass resourceClass, bool parJob);
+	void AddRunningJob(PostInfo* postInfo, EResourceClass resourceClass, bool parJob,
+		bool pauseQueue, const char* reason);
+	int64 JobVolumeId(PostInfo* postInfo, EResourceClass resourceClass, bool parJob);
+	void RemoveRunningJob(NzbInfo* nzbInfo);
+	void UpdatePauseState();
 	void NzbFound(DownloadQueue* downloadQueue, NzbInfo* nzbInfo);
 	void NzbDeleted(DownloadQueue* downloadQueue, NzbInfo* nzbInfo);
 	void NzbCompleted(DownloadQueue* downloadQueue, NzbInfo* nzbInfo, bool saveQueue);
+	void CheckDirectUnpack(DownloadQueue* downloadQueue, FileInfo* fileInfo);
+	void StartDirectUnpack(DownloadQueue* downloadQueue, NzbInfo* nzbInfo);
+	void RemoveDirectUnpackJob(NzbInfo* nzbInfo);
 	bool PostQueueDelete(DownloadQueue* downloadQueue, IdList* idList);
 	void DeletePostThread(PostInfo* postInfo);
-	NzbInfo* GetNextJob(DownloadQueue* downloadQueue);
+	RawNzbList GetPostJobs(DownloadQueue* downloadQueue);
 	void DownloadQueueUpdate(Subject* Caller, void* Aspect);
 	void DeleteCleanup(NzbInfo* nzbInfo);
 };
@@ -115,7 +115,11 @@ void UnpackController::Run()
 
 		CreateUnpackDir();
 
-		if (m_hasRarFiles || m_hasNonStdRarFiles)
+		if (m_postInfo->GetNzbInfo()->GetDirectUnpackStatus() == NzbInfo::nsSuccess)
+		{
+			PrintMessage(Message::mkInfo, "Rar-archives of %s were already unpacked during download", *m_name);
+		}
+		else if (m_hasRarFiles || m_hasNonStdRarFiles)
 		{
 			UnpackArchives(upUnrar, false);
 		}
@@ -538,6 +542,10 @@ void UnpackController::Completed()
 	}
 	else
 	{
+		// the files extracted during download were deleted by cleanup,
+		// the next unpack attempt must process all archives
+		m_postInfo->GetNzbInfo()->SetDirectUnpackStatus(NzbInfo::nsFailure);
+
 #ifndef DISABLE_PARCHECK
 		if (!m_unpackOk &&
 			(m_postInfo->GetNzbInfo()->GetParStatus() <= NzbInfo::psSkipped ||
@@ -596,7 +604,9 @@ void UnpackController::CreateUnpackDir()
 		m_finalDirCreated = !FileSystem::DirectoryExists(m_finalDir);
 	}
 
-	const char* destDir = !m_finalDir.Empty() ? *m_finalDir : *m_destDir;
+	// direct unpack has already extracted the rar-archives into the download directory
+	const char* destDir = !m_finalDir.Empty() &&
+		m_postInfo->GetNzbInfo()->GetDirectUnpackStatus() != NzbInfo::nsSuccess ? *m_finalDir : *m_destDir;
 
 	m_unpackDir.Format("%s%c%s", destDir, PATH_SEPARATOR, "_unpack");
 
@@ -27,13 +27,25 @@
 #include "FileSystem.h"
 
 static const char* FORMATVERSION_SIGNATURE = "nzbget diskstate file version ";
+static const char BINARY_SIGNATURE[8] = "nzbgetb";
+static const uint32 BINARY_BYTE_ORDER = 0x01020304;
+static const int64 JOURNAL_MIN_COMPACT_SIZE = 1024 * 1024;
+static const int64 ARCHIVE_MIN_COMPACT_SIZE = 4 * 1024 * 1024;
+static const int MAX_FILE_LOADERS = 8;
+static const int MIN_JOBS_PER_FILE_LOADER = 32;
+static const int FILE_STATES_PER_BATCH = 100;
 
 class StateDiskFile : public DiskFile
 {
 public:
+	/* Redirect output of "PrintLine" into memory buffer */
+	void SetBuffer(StringBuilder* buffer) { m_buffer = buffer; }
 	int64 PrintLine(const char* format, ...) PRINTF_SYNTAX(2);
 	char* ReadLine(char* buffer, int64 size);
 	int ScanLine(const char* format, ...) SCANF_SYNTAX(2);
+
+private:
+	StringBuilder* m_buffer = nullptr;
 };
 
 
@@ -50,7 +62,14 @@ int64 StateDiskFile::PrintLine(const char* format, ...)
 	// replacing terminating <NULL> with <LF>
 	str[len++] = '\n';
 
-	Write(*str, len);
+	if (m_buffer)
+	{
+		m_buffer->Append(str, len);
+	}
+	else
+	{
+		Write(*str, len);
+	}
 
 	return len;
 }
@@ -92,15 +111,184 @@ int StateDiskFile::ScanLine(const char* format, ...)
 }
 
 
+/*
+ * Binary diskstate files are used for article lists and file states, which
+ * can have hundreds of thousands of records. A file consists of a header,
+ * a data block with fixed-width records and a string table. Strings are
+ * referenced from records by their offsets in the string table.
+ * Records use native byte order; files are loaded by mapping them into memory.
+ */
+struct StateBinaryHeader
+{
+	char signature[8];
+	uint32 formatVersion;
+	uint32 byteOrder;
+	uint32 dataSize;
+	uint32 stringsSize;
+	uint32 crc;
+	uint32 reserved;
+};
+
+class StateBinaryWriter
+{
+public:
+	void Reserve(int dataSize, int stringsSize);
+	template <typename T> void Add(const T& record) { Add(&record, sizeof(T)); }
+	void Add(const void* data, int size);
+	uint32 AddString(const char* str);
+	void Write(CharBuffer& content, int formatVersion);
+
+private:
+	std::vector<char> m_data;
+	std::vector<char> m_strings;
+};
+
+class StateBinaryReader
+{
+public:
+	bool Open(const char* filename, CString& errmsg);
+	int GetFileVersion() { return m_fileVersion; }
+	template <typename T> const T* Read(int count = 1) { return count < 0 ? nullptr : (const T*)Read((int64)sizeof(T) * count); }
+	const void* Read(int64 size);
+	const char* GetString(uint32 offset) { return offset < m_stringsSize ? m_strings + offset : nullptr; }
+
+private:
+	MappedFile m_mapping;
+	CharBuffer m_buffer;
+	const char* m_data = nullptr;
+	uint32 m_dataSize = 0;
+	uint32 m_pos = 0;
+	const char* m_strings = nullptr;
+	uint32 m_stringsSize = 0;
+	int m_fileVersion = 0;
+};
+
+
+void StateBinaryWriter::Reserve(int dataSize, int stringsSize)
+{
+	m_data.reserve(dataSize);
+	m_strings.reserve(stringsSize);
+}
+
+void StateBinaryWriter::Add(const void* data, int size)
+{
+	m_data.insert(m_data.end(), (const char*)data, (const char*)data + size);
+}
+
+uint32 StateBinaryWriter::AddString(const char* str)
+{
+	uint32 offset = (uint32)m_strings.size();
+	m_strings.insert(m_strings.end(), str, str + strlen(str) + 1);
+	return offset;
+}
+
+void StateBinaryWriter::Write(CharBuffer& content, int formatVersion)
+{
+	StateBinaryHeader header;
+	memcpy(header.signature, BINARY_SIGNATURE, sizeof(header.signature));
+	header.formatVersion = formatVersion;
+	header.byteOrder = BINARY_BYTE_ORDER;
+	header.dataSize = (uint32)m_data.size();
+	header.stringsSize = (uint32)m_strings.size();
+	header.crc = Util::Crc32m(0xFFFFFFFF, (uchar*)m_data.data(), header.dataSize);
+	header.crc = Util::Crc32m(header.crc, (uchar*)m_strings.data(), header.stringsSize) ^ 0xFFFFFFFF;
+	header.reserved = 0;
+
+	content.Reserve(sizeof(header) + header.dataSize + header.stringsSize);
+	memcpy(content, &header, sizeof(header));
+	memcpy(content + sizeof(header), m_data.data(), header.dataSize);
+	memcpy(content + sizeof(header) + header.dataSize, m_strings.data(), header.stringsSize);
+}
+
+bool StateBinaryReader::Open(const char* filename, CString& errmsg)
+{
+	int64 fileSize = FileSystem::FileSize(filename);
+	const char* content;
+
+	if (m_mapping.Open(filename, fileSize, true))
+	{
+		content = m_mapping.GetData();
+	}
+	else
+	{
+		// mapping isn't possible for empty files and may fail on some file systems
+		if (!FileSystem::LoadFileIntoBuffer(filename, m_buffer, false))
+		{
+			errmsg = FileSystem::GetLastErrorMessage();
+			return false;
+		}
+		fileSize = m_buffer.Size();
+		content = m_buffer;
+	}
+
+	if (fileSize < (int64)sizeof(StateBinaryHeader))
+	{
+		errmsg = "file is truncated";
+		return false;
+	}
+
+	const StateBinaryHeader* header = (const StateBinaryHeader*)content;
+	if (memcmp(header->signature, BINARY_SIGNATURE, sizeof(header->signature)) ||
+		header->byteOrder != BINARY_BYTE_ORDER)
+	{
+		errmsg = "unsupported file format";
+		return false;
+	}
+
+	if ((int64)sizeof(StateBinaryHeader) + header->dataSize + header->stringsSize != fileSize)
+	{
+		errmsg = "file is truncated";
+		return false;
+	}
+
+	m_data = content + sizeof(StateBinaryHeader);
+	m_dataSize = header->dataSize;
+	m_strings = m_data + m_dataSize;
+	m_stringsSize = header->stringsSize;
+	m_fileVersion = header->formatVersion;
+
+	uint32 crc = Util::Crc32m(0xFFFFFFFF, (uchar*)m_data, m_dataSize);
+	crc = Util::Crc32m(crc, (uchar*)m_strings, m_stringsSize) ^ 0xFFFFFFFF;
+	if (crc != header->crc)
+	{
+		errmsg = "checksum mismatch";
+		return false;
+	}
+
+	// all strings must be null-terminated
+	if (m_stringsSize > 0 && m_strings[m_stringsSize - 1] != '\0')
+	{
+		errmsg = "corrupted string table";
+		return false;
+	}
+
+	return true;
+}
+
+const void* StateBinaryReader::Read(int64 size)
+{
+	if (m_pos + size > m_dataSize)
+	{
+		return nullptr;
+	}
+
+	const void* record = m_data + m_pos;
+	m_pos += (uint32)size;
+	return record;
+}
+
+
 class StateFile
 {
 public:
 	StateFile(const char* filename, int formatVersion, bool transactional);
 	void Discard();
 	bool FileExists();
+	bool IsBinary();
 	StateDiskFile* BeginWrite();
 	bool FinishWrite();
 	StateDiskFile* BeginRead();
+	bool BeginRead(StateBinaryReader& reader);
 	int GetFileVersion() { return m_fileVersion; }
 	const char* GetDestFilename() { return m_destFilename; }
 
@@ -152,6 +340,15 @@ bool StateFile::FileExists()
 	return FileSystem::FileExists(m_destFilename) || (m_transactional && FileSystem::FileExists(m_tempFilename));
 }
 
+bool StateFile::IsBinary()
+{
+	char signature[sizeof(BINARY_SIGNATURE)];
+	DiskFile file;
+	return file.Open(m_destFilename, DiskFile::omRead) &&
+		file.Read(signature, sizeof(signature)) == sizeof(signature) &&
+		!memcmp(signature, BINARY_SIGNATURE, sizeof(signature));
+}
+
 StateDiskFile* StateFile::BeginWrite()
 {
 	if (!m_file.Open(m_tempFilename, StateDiskFile::omWrite))
@@ -211,6 +408,25 @@ bool StateFile::FinishWrite()
 	return true;
 }
 
+bool StateFile::BeginRead(StateBinaryReader& reader)
+{
+	CString errmsg;
+	if (!reader.Open(m_destFilename, errmsg))
+	{
+		error("Error reading diskstate: could not load file %s: %s", *m_destFilename, *errmsg);
+		return false;
+	}
+
+	m_fileVersion = reader.GetFileVersion();
+	if (m_fileVersion > m_formatVersion)
+	{
+		error("Could not load diskstate file %s due to file version mismatch", *m_destFilename);
+		return false;
+	}
+
+	return true;
+}
+
 StateDiskFile* StateFile::BeginRead()
 {
 	if (!FileSystem::FileExists(m_destFilename) && FileSystem::FileExists(m_tempFilename))
@@ -246,989 +462,2264 @@ StateDiskFile* StateFile::BeginRead()
 }
 
 
-/* Save Download Queue to Disk.
- * The Disk State consists of file "queue", which contains the order of files,
- * and of one diskstate-file for each file in download queue.
- * This function saves file "queue" and files with NZB-info. It does not
- * save file-infos.
- */
-bool DiskState::SaveDownloadQueue(DownloadQueue* downloadQueue, bool saveHistory)
+void StateWriter::Start()
 {
-	debug("Saving queue and history to disk");
-
-	bool ok = true;
-
 	{
-		StateFile stateFile("queue", 57, true);
-		if (!downloadQueue->GetQueue()->empty())
-		{
-			StateDiskFile* outfile = stateFile.BeginWrite();
-			if (!outfile)
-			{
-				return false;
-			}
+		Guard guard(m_jobsMutex);
+		m_active = true;
+	}
+	Thread::Start();
+}
 
-			// save nzb-infos
-			SaveQueue(downloadQueue->GetQueue(), *outfile);
+void StateWriter::Stop()
+{
+	Thread::Stop();
+	Guard guard(m_jobsMutex);
+	m_jobsCond.NotifyAll();
+}
 
-			// now rename to dest file name
-			ok = stateFile.FinishWrite();
-		}
-		else
-		{
-			stateFile.Discard();
-		}
-	}
+void StateWriter::Run()
+{
+	debug("Entering StateWriter-loop");
 
-	if (saveHistory)
+	while (true)
 	{
-		StateFile stateFile("history", 57, true);
-		if (!downloadQueue->GetHistory()->empty())
+		std::unique_ptr<Job> job;
+
 		{
-			StateDiskFile* outfile = stateFile.BeginWrite();
-			if (!outfile)
+			Guard guard(m_jobsMutex);
+			while (m_jobs.empty() && !IsStopped())
 			{
-				return false;
+				m_jobsCond.Wait(m_jobsMutex);
 			}
 
-			// save history
-			SaveHistory(downloadQueue->GetHistory(), *outfile);
+			if (m_jobs.empty())
+			{
+				// all jobs are done, further jobs are executed by calling threads
+				m_active = false;
+				break;
+			}
 
-			// now rename to dest file name
-			ok &= stateFile.FinishWrite();
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+			m_activeFilename = *job->filename;
 		}
-		else
+
+		bool ok = Execute(job.get());
+
 		{
-			stateFile.Discard();
+			Guard guard(m_jobsMutex);
+			m_failed |= !ok;
+			m_activeFilename.Clear();
+			m_jobsCond.NotifyAll();
 		}
 	}
 
-	return ok;
+	debug("Exiting StateWriter-loop");
 }
 
-bool DiskState::LoadDownloadQueue(DownloadQueue* downloadQueue, Servers* servers)
+void StateWriter::Write(const char* filename, const char* data, int size, bool transactional, bool append, bool afterSuccess)
 {
-	debug("Loading queue from disk");
+	JobList jobs;
+	jobs.push_back(MakeWrite(filename, data, size, transactional, append, afterSuccess));
+	Enqueue(std::move(jobs));
+}
 
-	bool ok = false;
-	int formatVersion = 0;
+void StateWriter::Delete(const char* filename, bool afterSuccess)
+{
+	JobList jobs;
+	jobs.push_back(MakeDelete(filename, afterSuccess));
+	Enqueue(std::move(jobs));
+}
 
+std::unique_ptr<StateWriter::Job> StateWriter::MakeWrite(const char* filename, const char* data, int size,
+	bool transactional, bool append, bool afterSuccess)
+{
+	std::unique_ptr<Job> job = std::make_unique<Job>();
+	job->kind = append ? jkAppend : transactional ? jkReplace : jkWrite;
+	job->filename = filename;
+	job->data.Reserve(size);
+	memcpy(job->data, data, size);
+	job->flush = (transactional || append) && g_Options->GetFlushQueue();
+	job->afterSuccess = afterSuccess;
+	return job;
+}
+
+std::unique_ptr<StateWriter::Job> StateWriter::MakeDelete(const char* filename, bool afterSuccess)
+{
+	std::unique_ptr<Job> job = std::make_unique<Job>();
+	job->kind = jkDelete;
+	job->filename = filename;
+	job->flush = false;
+	job->afterSuccess = afterSuccess;
+	return job;
+}
+
+/*
+ * Jobs of a snapshot are queued together, otherwise the writer could delete the old
+ * journal after the pending snapshot files were dropped but before the new ones
+ * were queued.
+ */
+void StateWriter::Enqueue(JobList jobs)
+{
 	{
-		StateFile stateFile("queue", 57, true);
-		if (stateFile.FileExists())
+		Guard guard(m_jobsMutex);
+		if (m_active)
 		{
-			StateDiskFile* infile = stateFile.BeginRead();
-			if (!infile)
+			for (std::unique_ptr<Job>& job : jobs)
 			{
-				return false;
+				if (job->kind != jkAppend)
+				{
+					const char* filename = job->filename;
+					m_jobs.erase(std::remove_if(m_jobs.begin(), m_jobs.end(),
+						[filename](std::unique_ptr<Job>& pending)
+						{
+							return !strcmp(pending->filename, filename);
+						}),
+						m_jobs.end());
+				}
 			}
 
-			formatVersion = stateFile.GetFileVersion();
-
-			if (formatVersion < 47)
+			for (std::unique_ptr<Job>& job : jobs)
 			{
-				error("Failed to read queue and history data. Only queue and history from NZBGet v13 or newer can be converted by this NZBGet version. "
-					"Old queue and history data still can be converted using NZBGet v16 as an intermediate version.");
-				goto error;
+				m_jobs.push_back(std::move(job));
 			}
+			m_jobsCond.NotifyAll();
+			return;
+		}
+	}
 
-			if (!LoadQueue(downloadQueue->GetQueue(), servers, *infile, formatVersion)) goto error;
+	for (std::unique_ptr<Job>& job : jobs)
+	{
+		bool ok = Execute(job.get());
 
-			if (formatVersion < 57)
-			{
-				if (!LoadHistory(downloadQueue->GetHistory(), servers, *infile, formatVersion)) goto error;
-			}
-		}
+		Guard guard(m_jobsMutex);
+		m_failed |= !ok;
 	}
+}
 
-	if (formatVersion == 0 || formatVersion >= 57)
+bool StateWriter::Execute(Job* job)
+{
+	if (job->afterSuccess)
 	{
-		StateFile stateFile("history", 57, true);
-		if (stateFile.FileExists())
+		Guard guard(m_jobsMutex);
+		if (m_failed)
 		{
-			StateDiskFile* infile = stateFile.BeginRead();
-			if (!infile)
-			{
-				return false;
-			}
-			if (!LoadHistory(downloadQueue->GetHistory(), servers, *infile, stateFile.GetFileVersion())) goto error;
+			debug("Skipping diskstate job for %s due to previous errors", *job->filename);
+			return false;
 		}
 	}
 
-	CleanupQueueDir(downloadQueue);
+	if (job->kind == jkDelete)
+	{
+		FileSystem::DeleteFile(job->filename);
+		return true;
+	}
 
-	if (!LoadAllFileStates(downloadQueue, servers)) goto error;
+	BString<1024> tempFilename("%s%s", *job->filename, job->kind == jkReplace ? ".new" : "");
 
-	ok = true;
+	DiskFile file;
+	if (!file.Open(tempFilename, job->kind == jkAppend ? DiskFile::omAppend : DiskFile::omWrite))
+	{
+		error("Error saving diskstate: Could not create file %s: %s", *tempFilename,
+			*FileSystem::GetLastErrorMessage());
+		return false;
+	}
 
-error:
+	bool written = file.Write(job->data, job->data.Size()) == job->data.Size();
+	for (Record& record : job->records)
+	{
+		int length = record->Length();
+		written = written && file.Write(*record, length) == length;
+	}
 
-	if (!ok)
+	if (!written)
 	{
-		error("Error reading diskstate for download queue and history");
+		error("Error saving diskstate: Could not write file %s: %s", *tempFilename,
+			*FileSystem::GetLastErrorMessage());
+		file.Close();
+		return false;
 	}
 
-	NzbInfo::ResetGenId(true);
-	FileInfo::ResetGenId(true);
+	// flush file content before renaming
+	if (job->flush)
+	{
+		debug("Flushing data for file %s", FileSystem::BaseFileName(tempFilename));
+		file.Flush();
+		CString errmsg;
+		if (!file.Sync(errmsg))
+		{
+			warn("Could not flush file %s into disk: %s", *tempFilename, *errmsg);
+		}
+	}
 
-	CalcFileStats(downloadQueue, formatVersion);
+	file.Close();
 
-	return ok;
+	if (job->kind == jkReplace)
+	{
+		// now rename to dest file name
+		FileSystem::DeleteFile(job->filename);
+		if (!FileSystem::MoveFile(tempFilename, job->filename))
+		{
+			error("Error saving diskstate: Could not rename file %s to %s: %s",
+				*tempFilename, *job->filename, *FileSystem::GetLastErrorMessage());
+			return false;
+		}
+
+		// flush directory buffer after renaming
+		if (job->flush)
+		{
+			debug("Flushing directory for file %s", FileSystem::BaseFileName(job->filename));
+			CString errmsg;
+			if (!FileSystem::FlushDirBuffers(job->filename, errmsg))
+			{
+				warn("Could not flush directory buffers for file %s into disk: %s", *job->filename, *errmsg);
+			}
+		}
+	}
+
+	return true;
 }
 
-void DiskState::SaveQueue(NzbList* queue, StateDiskFile& outfile)
+bool StateWriter::IsPending(const char* filename)
 {
-	debug("Saving nzb list to disk");
+	if (!filename)
+	{
+		return !m_jobs.empty() || m_activeFilename;
+	}
 
-	outfile.PrintLine("%i", (int)queue->size());
-	for (NzbInfo* nzbInfo : queue)
+	if (m_activeFilename && !strcmp(m_activeFilename, filename))
 	{
-		SaveNzbInfo(nzbInfo, outfile);
+		return true;
+	}
+
+	for (std::unique_ptr<Job>& job : m_jobs)
+	{
+		if (!strcmp(job->filename, filename))
+		{
+			return true;
+		}
 	}
+
+	return false;
 }
 
-bool DiskState::LoadQueue(NzbList* queue, Servers* servers, StateDiskFile& infile, int formatVersion)
+void StateWriter::WaitCompleted(const char* filename)
 {
-	debug("Loading nzb list from disk");
-
-	// load nzb-infos
-	int size;
-	if (infile.ScanLine("%i", &size) != 1) goto error;
-	for (int i = 0; i < size; i++)
+	Guard guard(m_jobsMutex);
+	while (IsPending(filename))
 	{
-		std::unique_ptr<NzbInfo> nzbInfo = std::make_unique<NzbInfo>();
-		if (!LoadNzbInfo(nzbInfo.get(), servers, infile, formatVersion)) goto error;
-		queue->push_back(std::move(nzbInfo));
+		m_jobsCond.Wait(m_jobsMutex);
 	}
+}
 
-	return true;
-
-error:
-	error("Error reading nzb list from disk");
-	return false;
+bool StateWriter::ResetFailed()
+{
+	Guard guard(m_jobsMutex);
+	bool failed = m_failed;
+	m_failed = false;
+	return failed;
 }
 
-void DiskState::SaveNzbInfo(NzbInfo* nzbInfo, StateDiskFile& outfile)
+
+void DiskState::StopWriter()
 {
-	outfile.PrintLine("%i", nzbInfo->GetId());
-	outfile.PrintLine("%i", (int)nzbInfo->GetKind());
-	outfile.PrintLine("%s", nzbInfo->GetUrl());
-	outfile.PrintLine("%s", nzbInfo->GetFilename());
-	outfile.PrintLine("%s", nzbInfo->GetDestDir());
-	outfile.PrintLine("%s", nzbInfo->GetFinalDir());
-	outfile.PrintLine("%s", nzbInfo->GetQueuedFilename());
-	outfile.PrintLine("%s", nzbInfo->GetName());
-	outfile.PrintLine("%s", nzbInfo->GetCategory());
-	outfile.PrintLine("%i,%i,%i,%i,%i", (int)nzbInfo->GetPriority(),
-		nzbInfo->GetPostInfo() ? (int)nzbInfo->GetPostInfo()->GetStage() + 1 : 0,
-		(int)nzbInfo->GetDeletePaused(), (int)nzbInfo->GetManyDupeFiles(), nzbInfo->GetFeedId());
-	outfile.PrintLine("%i,%i,%i,%i,%i,%i,%i", (int)nzbInfo->GetParStatus(), (int)nzbInfo->GetUnpackStatus(),
-		(int)nzbInfo->GetMoveStatus(), (int)nzbInfo->GetRenameStatus(), (int)nzbInfo->GetDeleteStatus(),
-		(int)nzbInfo->GetMarkStatus(), (int)nzbInfo->GetUrlStatus());
-	outfile.PrintLine("%i,%i,%i", (int)nzbInfo->GetUnpackCleanedUpDisk(), (int)nzbInfo->GetHealthPaused(),
-		(int)nzbInfo->GetAddUrlPaused());
-	outfile.PrintLine("%i,%i,%i", nzbInfo->GetFileCount(), nzbInfo->GetParkedFileCount(),
-		nzbInfo->GetMessageCount());
-	outfile.PrintLine("%i,%i", (int)nzbInfo->GetMinTime(), (int)nzbInfo->GetMaxTime());
-	outfile.PrintLine("%i,%i,%i,%i", (int)nzbInfo->GetParFull(),
-		nzbInfo->GetPostInfo() ? (int)nzbInfo->GetPostInfo()->GetForceParFull() : 0,
-		nzbInfo->GetPostInfo() ? (int)nzbInfo->GetPostInfo()->GetForceRepair() : 0,
-		nzbInfo->GetExtraParBlocks());
+	m_writer.Stop();
+	while (m_writer.IsRunning())
+	{
+		usleep(10 * 1000);
+	}
+}
 
-	outfile.PrintLine("%u,%u", nzbInfo->GetFullContentHash(), nzbInfo->GetFilteredContentHash());
 
-	uint32 High1, Low1, High2, Low2, High3, Low3;
-	Util::SplitInt64(nzbInfo->GetSize(), &High1, &Low1);
-	Util::SplitInt64(nzbInfo->GetSuccessSize(), &High2, &Low2);
-	Util::SplitInt64(nzbInfo->GetFailedSize(), &High3, &Low3);
-	outfile.PrintLine("%u,%u,%u,%u,%u,%u", High1, Low1, High2, Low2, High3, Low3);
+/* Save Download Queue to Disk.
+ * The Disk State consists of file "queue", which contains the order of files,
+ * and of one diskstate-file for each file in download queue.
+ * This function saves file "queue" and files with NZB-info. It does not
+ * save file-infos.
+ *
+ * Files "queue" and "history" are snapshots. Between snapshots only changed
+ * records are appended to file "journal", which is replayed over the snapshot
+ * on loading. Once the journal grows too big it is compacted into new snapshots.
+ *
+ * If "changedIds" are given only these items and added items are serialized,
+ * otherwise all queue items and with "saveHistory" all history items.
+ *
+ * The caller must hold at least the shared queue lock and must not save concurrently.
+ */
+bool DiskState::SaveDownloadQueue(DownloadQueue* downloadQueue, bool saveHistory, IdList* changedIds)
+{
+	debug("Saving queue and history to disk");
 
-	Util::SplitInt64(nzbInfo->GetParSize(), &High1, &Low1);
-	Util::SplitInt64(nzbInfo->GetParSuccessSize(), &High2, &Low2);
-	Util::SplitInt64(nzbInfo->GetParFailedSize(), &High3, &Low3);
-	outfile.PrintLine("%u,%u,%u,%u,%u,%u", High1, Low1, High2, Low2, High3, Low3);
+	// a failed write may have left the journal not matching the snapshot
+	bool writeFailed = m_writer.ResetFailed();
 
-	outfile.PrintLine("%i,%i,%i", nzbInfo->GetTotalArticles(), nzbInfo->GetSuccessArticles(), nzbInfo->GetFailedArticles());
+	// saved records are known since the first save after loading
+	JournalState queueState;
+	JournalState historyState;
+	SaveQueue(downloadQueue->GetQueue(), queueState,
+		m_journalActive && changedIds ? &m_queueJournal : nullptr, changedIds);
+	SaveHistory(downloadQueue->GetHistory(), historyState,
+		m_journalActive && !saveHistory ? &m_historyJournal : nullptr, changedIds);
 
-	outfile.PrintLine("%s", nzbInfo->GetDupeKey());
-	outfile.PrintLine("%i,%i", (int)nzbInfo->GetDupeMode(), nzbInfo->GetDupeScore());
+	if (m_journalActive && !writeFailed &&
+		m_journalSize <= std::max(JOURNAL_MIN_COMPACT_SIZE, m_snapshotSize / 2))
+	{
+		AppendJournal(queueState, historyState);
+	}
+	else
+	{
+		SaveSnapshot(queueState, historyState);
+	}
 
-	Util::SplitInt64(nzbInfo->GetDownloadedSize(), &High1, &Low1);
-	outfile.PrintLine("%u,%u,%i,%i,%i,%i,%i", High1, Low1, nzbInfo->GetDownloadSec(), nzbInfo->GetPostTotalSec(),
-		nzbInfo->GetParSec(), nzbInfo->GetRepairSec(), nzbInfo->GetUnpackSec());
+	m_queueJournal = std::move(queueState);
+	m_historyJournal = std::move(historyState);
 
-	outfile.PrintLine("%i", (int)nzbInfo->GetCompletedFiles()->size());
-	for (CompletedFile& completedFile : nzbInfo->GetCompletedFiles())
+	SaveArchiveRemovals(downloadQueue->GetArchive());
+
+	return true;
+}
+
+/*
+ * Only the records of changed items are serialized while the caller holds the queue
+ * lock, the snapshot files are assembled from shared records by the state writer thread.
+ */
+void DiskState::SaveSnapshot(JournalState& queueState, JournalState& historyState)
+{
+	debug("Saving queue and history snapshot");
+
+	m_generation++;
+
+	StateWriter::JobList jobs;
+
+	// file "queue" is saved even if the queue is empty, journal is validated against its generation
+	jobs.push_back(MakeSnapshotJob(StateFile("queue", 59, true).GetDestFilename(), queueState));
+
+	// file "history" is saved even if the history is empty, if the program is interrupted
+	// after the new queue was written the journal is still replayed over the old history
+	jobs.push_back(MakeSnapshotJob(StateFile("history", 59, true).GetDestFilename(), historyState));
+
+	// the old journal is deleted only if the snapshot was successfully saved
+	jobs.push_back(StateWriter::MakeDelete(StateFile("journal", 59, false).GetDestFilename(), true));
+
+	// pending jobs of previous snapshot and of its journal are replaced
+	m_writer.Enqueue(std::move(jobs));
+
+	m_snapshotSize = queueState.size + historyState.size;
+	m_journalSize = 0;
+	m_journalActive = true;
+}
+
+std::unique_ptr<StateWriter::Job> DiskState::MakeSnapshotJob(const char* filename, JournalState& journalState)
+{
+	BString<100> header("%s%i\n%i\n%i\n", FORMATVERSION_SIGNATURE, 59, m_generation,
+		(int)journalState.order.size());
+	std::unique_ptr<StateWriter::Job> job = StateWriter::MakeWrite(filename, header, header.Length(),
+		true, false, false);
+
+	job->records.reserve(journalState.order.size());
+	for (int id : journalState.order)
 	{
-		outfile.PrintLine("%i,%i,%u,%s", completedFile.GetId(), (int)completedFile.GetStatus(),
-			completedFile.GetCrc(), completedFile.GetFileName());
+		job->records.push_back(journalState.records[id].data);
 	}
 
-	outfile.PrintLine("%i", (int)nzbInfo->GetParameters()->size());
-	for (NzbParameter& parameter : nzbInfo->GetParameters())
+	return job;
+}
+
+/*
+ * Only the ids of all items are compared to find added, removed and moved items,
+ * see JournalChanges.
+ */
+void DiskState::AppendJournal(JournalState& queueState, JournalState& historyState)
+{
+	debug("Appending changes to queue journal");
+
+	StringBuilder batch;
+	JournalChanges("queue", m_queueJournal, queueState, batch);
+	JournalChanges("history", m_historyJournal, historyState, batch);
+
+	if (batch.Empty())
 	{
-		outfile.PrintLine("%s=%s", parameter.GetName(), parameter.GetValue());
+		return;
 	}
 
-	outfile.PrintLine("%i", (int)nzbInfo->GetScriptStatuses()->size());
-	for (ScriptStatus& scriptStatus : nzbInfo->GetScriptStatuses())
+	StringBuilder content;
+	bool newFile = m_journalSize == 0;
+	if (newFile)
 	{
-		outfile.PrintLine("%i,%s", scriptStatus.GetStatus(), scriptStatus.GetName());
+		content.AppendFmt("%s%i\n%i\n", FORMATVERSION_SIGNATURE, 59, m_generation);
 	}
 
-	SaveServerStats(nzbInfo->GetServerStats(), outfile);
+	// batch is replayed only if it was completely written
+	content.AppendFmt("batch,%i,%u\n", batch.Length(), Util::Crc32((uchar*)(char*)batch, batch.Length()));
+	content.Append(batch, batch.Length());
 
-	// save file-infos
-	int size = 0;
-	for (FileInfo* fileInfo : nzbInfo->GetFileList())
+	// appending must not continue after a failed write, it would extend a journal
+	// which doesn't belong to the snapshot on disk
+	m_writer.Write(StateFile("journal", 59, false).GetDestFilename(), content, content.Length(),
+		false, !newFile, true);
+	m_journalSize += content.Length();
+}
+
+/*
+ * Writes into journal the records changed since previous save. Changed records are
+ * first removed and then inserted at their new positions in ascending order, which
+ * restores the list correctly as long as unchanged records keep their relative order.
+ * Otherwise the complete order is written too.
+ */
+void DiskState::JournalChanges(const char* listName, JournalState& oldState, JournalState& newState,
+	StringBuilder& batch)
+{
+	for (int id : oldState.order)
 	{
-		if (!fileInfo->GetDeleted())
+		JournalState::RecordMap::iterator it = newState.records.find(id);
+		if (it == newState.records.end() || it->second.hash != oldState.records[id].hash)
 		{
-			size++;
+			batch.AppendFmt("-%s,%i\n", listName, id);
 		}
 	}
-	outfile.PrintLine("%i", size);
-	for (FileInfo* fileInfo : nzbInfo->GetFileList())
+
+	std::vector<int> oldUnchanged;
+	for (int id : oldState.order)
 	{
-		if (!fileInfo->GetDeleted())
+		JournalState::RecordMap::iterator it = newState.records.find(id);
+		if (it != newState.records.end() && it->second.hash == oldState.records[id].hash)
 		{
-			outfile.PrintLine("%i,%i,%i", fileInfo->GetId(), (int)fileInfo->GetPaused(),
-				(int)fileInfo->GetExtraPriority());
+			oldUnchanged.push_back(id);
+		}
+	}
+
+	std::vector<int> newUnchanged;
+	int index = 0;
+	for (int id : newState.order)
+	{
+		JournalRecord& record = newState.records[id];
+		JournalState::RecordMap::iterator it = oldState.records.find(id);
+		if (it == oldState.records.end() || it->second.hash != record.hash)
+		{
+			batch.AppendFmt("+%s,%i,%i\n", listName, id, index);
+			batch.Append(*record.data, record.data->Length());
+		}
+		else
+		{
+			newUnchanged.push_back(id);
+		}
+		index++;
+	}
+
+	if (oldUnchanged != newUnchanged)
+	{
+		batch.AppendFmt("=%s,%i\n", listName, (int)newState.order.size());
+		for (int id : newState.order)
+		{
+			batch.AppendFmt("%i\n", id);
 		}
 	}
 }
 
-bool DiskState::LoadNzbInfo(NzbInfo* nzbInfo, Servers* servers, StateDiskFile& infile, int formatVersion)
+/*
+ * Up to queue format 56 the queue file contained data overriding the file infos,
+ * newer queues are complete without file infos which can therefore be loaded
+ * all at once after the queue.
+ */
+static bool IsFileLoadDeferred(int formatVersion)
 {
-	char buf[10240];
+	return formatVersion == 0 || formatVersion >= 56;
+}
 
-	int id;
-	if (infile.ScanLine("%i", &id) != 1) goto error;
-	nzbInfo->SetId(id);
+bool DiskState::LoadDownloadQueue(DownloadQueue* downloadQueue, Servers* servers)
+{
+	debug("Loading queue from disk");
 
-	int kind;
-	if (infile.ScanLine("%i", &kind) != 1) goto error;
-	nzbInfo->SetKind((NzbInfo::EKind)kind);
+	bool ok = false;
+	int formatVersion = 0;
+	int queueGeneration = 0;
+	int historyGeneration = 0;
 
-	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-	nzbInfo->SetUrl(buf);
+	m_writer.WaitCompleted();
+	m_journalActive = false;
 
-	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-	nzbInfo->SetFilename(buf);
+	{
+		StateFile stateFile("queue", 59, true);
+		if (stateFile.FileExists())
+		{
+			StateDiskFile* infile = stateFile.BeginRead();
+			if (!infile)
+			{
+				return false;
+			}
 
-	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-	nzbInfo->SetDestDir(buf);
+			formatVersion = stateFile.GetFileVersion();
 
-	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-	nzbInfo->SetFinalDir(buf);
+			if (formatVersion < 47)
+			{
+				error("Failed to read queue and history data. Only queue and history from NZBGet v13 or newer can be converted by this NZBGet version. "
+					"Old queue and history data still can be converted using NZBGet v16 as an intermediate version.");
+				goto error;
+			}
 
-	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-	nzbInfo->SetQueuedFilename(buf);
+			if (formatVersion >= 58 && infile->ScanLine("%i", &queueGeneration) != 1) goto error;
 
-	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-	if (strlen(buf) > 0)
+			if (!LoadQueue(downloadQueue->GetQueue(), servers, *infile, formatVersion)) goto error;
+
+			if (formatVersion < 57)
+			{
+				if (!LoadHistory(downloadQueue->GetHistory(), servers, *infile, formatVersion)) goto error;
+			}
+		}
+	}
+
+	if (formatVersion == 0 || formatVersion >= 57)
 	{
-		nzbInfo->SetName(buf);
+		StateFile stateFile("history", 59, true);
+		if (stateFile.FileExists())
+		{
+			StateDiskFile* infile = stateFile.BeginRead();
+			if (!infile)
+			{
+				return false;
+			}
+			if (stateFile.GetFileVersion() >= 58 && infile->ScanLine("%i", &historyGeneration) != 1) goto error;
+			if (!LoadHistory(downloadQueue->GetHistory(), servers, *infile, stateFile.GetFileVersion())) goto error;
+		}
 	}
 
-	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-	nzbInfo->SetCategory(buf);
+	m_generation = std::max(queueGeneration, historyGeneration);
+	if (!LoadJournal(downloadQueue, servers, queueGeneration, historyGeneration)) goto error;
+	if (!LoadArchive(downloadQueue)) goto error;
 
-	int priority, postStage, deletePaused, manyDupeFiles, feedId;
-	if (formatVersion >= 54)
+	if (!LoadAllFiles(downloadQueue, IsFileLoadDeferred(formatVersion))) goto error;
+
+	CleanupQueueDir(downloadQueue);
+
+	ok = true;
+
+error:
+
+	if (!ok)
 	{
-		if (infile.ScanLine("%i,%i,%i,%i,%i", &priority, &postStage, &deletePaused, &manyDupeFiles, &feedId) != 5) goto error;
+		error("Error reading diskstate for download queue and history");
 	}
-	else
+
+	NzbInfo::ResetGenId(true);
+	FileInfo::ResetGenId(true);
+
+	CalcFileStats(downloadQueue, formatVersion);
+
+	return ok;
+}
+
+template <typename T>
+void JournalRemove(UniqueDeque<T>* list, int id)
+{
+	if (T* item = list->Find(id))
 	{
-		if (infile.ScanLine("%i,%i,%i,%i", &priority, &postStage, &deletePaused, &manyDupeFiles) != 4) goto error;
-		feedId = 0;
+		list->Remove(item);
 	}
-	nzbInfo->SetPriority(priority);
-	nzbInfo->SetDeletePaused((bool)deletePaused);
-	nzbInfo->SetManyDupeFiles((bool)manyDupeFiles);
-	if (postStage > 0)
+}
+
+template <typename T>
+void JournalInsert(UniqueDeque<T>* list, std::unique_ptr<T> item, int index)
+{
+	list->insert(list->begin() + std::min(std::max(index, 0), (int)list->size()), std::move(item));
+}
+
+template <typename T>
+void JournalReorder(UniqueDeque<T>* list, std::vector<int>& order)
+{
+	std::map<int, int> positions;
+	for (int i = 0; i < (int)order.size(); i++)
 	{
-		nzbInfo->EnterPostProcess();
-		nzbInfo->GetPostInfo()->SetStage((PostInfo::EStage)postStage);
+		positions[order[i]] = i;
 	}
-	nzbInfo->SetFeedId(feedId);
 
-	int parStatus, unpackStatus, moveStatus, renameStatus, deleteStatus, markStatus, urlStatus;
-	if (infile.ScanLine("%i,%i,%i,%i,%i,%i,%i", &parStatus, &unpackStatus, &moveStatus,
-		&renameStatus, &deleteStatus, &markStatus, &urlStatus) != 7) goto error;
-	nzbInfo->SetParStatus((NzbInfo::EParStatus)parStatus);
-	nzbInfo->SetUnpackStatus((NzbInfo::EUnpackStatus)unpackStatus);
-	nzbInfo->SetMoveStatus((NzbInfo::EMoveStatus)moveStatus);
-	nzbInfo->SetRenameStatus((NzbInfo::ERenameStatus)renameStatus);
-	nzbInfo->SetDeleteStatus((NzbInfo::EDeleteStatus)deleteStatus);
-	nzbInfo->SetMarkStatus((NzbInfo::EMarkStatus)markStatus);
-	if (nzbInfo->GetKind() == NzbInfo::nkNzb ||
-		(NzbInfo::EUrlStatus)urlStatus >= NzbInfo::lsFailed ||
-		(NzbInfo::EUrlStatus)urlStatus >= NzbInfo::lsScanSkipped)
+	std::stable_sort(list->begin(), list->end(),
+		[&positions](const std::unique_ptr<T>& item1, const std::unique_ptr<T>& item2)
+		{
+			return positions[item1->GetId()] < positions[item2->GetId()];
+		});
+}
+
+/*
+ * Replays journal over the loaded snapshot. Changes of queue or history are replayed
+ * only if the snapshot file belongs to the same generation as the journal. The queue
+ * is written before the history, after an interruption between them only the history
+ * part of the old journal is still needed. An incomplete batch at the end of journal
+ * is ignored.
+ */
+bool DiskState::LoadJournal(DownloadQueue* downloadQueue, Servers* servers, int queueGeneration, int historyGeneration)
+{
+	StateFile stateFile("journal", 59, false);
+	if (!stateFile.FileExists())
 	{
-		nzbInfo->SetUrlStatus((NzbInfo::EUrlStatus)urlStatus);
+		return true;
+	}
+
+	StateDiskFile* infile = stateFile.BeginRead();
+	if (!infile)
+	{
+		return false;
+	}
+
+	int formatVersion = stateFile.GetFileVersion();
+	int generation;
+	bool replayQueue, replayHistory;
+	if (infile->ScanLine("%i", &generation) != 1) goto error;
+
+	replayQueue = queueGeneration == generation;
+	// older versions didn't save empty history
+	replayHistory = historyGeneration == generation || (historyGeneration == 0 && replayQueue);
+
+	if (!replayQueue && !replayHistory)
+	{
+		warn("Discarding outdated queue journal");
+		m_generation = std::max(m_generation, generation);
+		infile->Close();
+		return true;
 	}
 
-	int unpackCleanedUpDisk, healthPaused, addUrlPaused;
-	if (infile.ScanLine("%i,%i,%i", &unpackCleanedUpDisk, &healthPaused, &addUrlPaused) != 3) goto error;
-	nzbInfo->SetUnpackCleanedUpDisk((bool)unpackCleanedUpDisk);
-	nzbInfo->SetHealthPaused((bool)healthPaused);
-	nzbInfo->SetAddUrlPaused((bool)addUrlPaused);
+	m_generation = std::max(m_generation, generation);
+
+	char line[1024];
+	while (infile->ReadLine(line, sizeof(line)))
+	{
+		int length;
+		uint32 crc;
+		if (sscanf(line, "batch,%i,%u", &length, &crc) != 2 || length <= 0) goto error;
+
+		int64 start = infile->Position();
+		CharBuffer batch(length);
+		if (infile->Read(batch, length) != length ||
+			Util::Crc32((uchar*)(char*)batch, length) != crc)
+		{
+			warn("Ignoring incomplete record in queue journal");
+			break;
+		}
+
+		infile->Seek(start);
+		while (infile->Position() < start + length)
+		{
+			if (!infile->ReadLine(line, sizeof(line))) goto error;
+
+			int id, index, count;
+			if (sscanf(line, "-queue,%i", &id) == 1)
+			{
+				if (replayQueue)
+				{
+					JournalRemove(downloadQueue->GetQueue(), id);
+				}
+			}
+			else if (sscanf(line, "+queue,%i,%i", &id, &index) == 2)
+			{
+				// the record is parsed even if not replayed to find the next one
+				std::unique_ptr<NzbInfo> nzbInfo = std::make_unique<NzbInfo>();
+				if (!LoadNzbInfo(nzbInfo.get(), servers, *infile, formatVersion)) goto error;
+				if (replayQueue)
+				{
+					JournalInsert(downloadQueue->GetQueue(), std::move(nzbInfo), index);
+				}
+			}
+			else if (sscanf(line, "-history,%i", &id) == 1)
+			{
+				if (replayHistory)
+				{
+					JournalRemove(downloadQueue->GetHistory(), id);
+				}
+			}
+			else if (sscanf(line, "+history,%i,%i", &id, &index) == 2)
+			{
+				std::unique_ptr<HistoryInfo> historyInfo = LoadHistoryItem(servers, *infile, formatVersion);
+				if (!historyInfo) goto error;
+				if (replayHistory)
+				{
+					JournalInsert(downloadQueue->GetHistory(), std::move(historyInfo), index);
+				}
+			}
+			else if (sscanf(line, "=queue,%i", &count) == 1 || sscanf(line, "=history,%i", &count) == 1)
+			{
+				std::vector<int> order;
+				for (int i = 0; i < count; i++)
+				{
+					if (infile->ScanLine("%i", &id) != 1) goto error;
+					order.push_back(id);
+				}
+				if (!strncmp(line, "=queue", 6) && replayQueue)
+				{
+					JournalReorder(downloadQueue->GetQueue(), order);
+				}
+				else if (!strncmp(line, "=history", 8) && replayHistory)
+				{
+					JournalReorder(downloadQueue->GetHistory(), order);
+				}
+			}
+			else
+			{
+				goto error;
+			}
+		}
+
+		if (infile->Position() != start + length) goto error;
+	}
+
+	infile->Close();
+	return true;
+
+error:
+	infile->Close();
+	error("Error reading queue journal");
+	return false;
+}
+
+void DiskState::JournalState::Add(int id, StringBuilder& record)
+{
+	JournalRecord& journalRecord = records[id];
+	journalRecord.data = std::make_shared<CString>(record, record.Length());
+	journalRecord.hash = Util::Crc32((uchar*)(char*)record, record.Length());
+	order.push_back(id);
+	size += record.Length();
+}
+
+void DiskState::JournalState::Keep(int id, JournalState& savedState)
+{
+	JournalRecord& journalRecord = records[id];
+	journalRecord = savedState.records[id];
+	order.push_back(id);
+	size += journalRecord.data->Length();
+}
+
+bool DiskState::JournalState::NeedsSave(int id, IdList* changedIds)
+{
+	return records.find(id) == records.end() ||
+		(changedIds && std::find(changedIds->begin(), changedIds->end(), id) != changedIds->end());
+}
+
+/*
+ * With "savedState" only items needing save are serialized, others keep their saved records.
+ */
+void DiskState::SaveQueue(NzbList* queue, JournalState& journalState, JournalState* savedState, IdList* changedIds)
+{
+	debug("Saving nzb list to disk");
+
+	StringBuilder record;
+	StateDiskFile outfile;
+	outfile.SetBuffer(&record);
+	journalState = JournalState();
+
+	for (NzbInfo* nzbInfo : queue)
+	{
+		if (savedState && !savedState->NeedsSave(nzbInfo->GetId(), changedIds))
+		{
+			journalState.Keep(nzbInfo->GetId(), *savedState);
+			continue;
+		}
+
+		// the caller may hold only the shared queue lock, articles are completed meanwhile
+		Guard stateGuard = nzbInfo->GuardDownloadState();
+		record.Clear();
+		SaveNzbInfo(nzbInfo, outfile);
+		journalState.Add(nzbInfo->GetId(), record);
+	}
+}
+
+bool DiskState::LoadQueue(NzbList* queue, Servers* servers, StateDiskFile& infile, int formatVersion)
+{
+	debug("Loading nzb list from disk");
+
+	// load nzb-infos
+	int size;
+	if (infile.ScanLine("%i", &size) != 1) goto error;
+	for (int i = 0; i < size; i++)
+	{
+		std::unique_ptr<NzbInfo> nzbInfo = std::make_unique<NzbInfo>();
+		if (!LoadNzbInfo(nzbInfo.get(), servers, infile, formatVersion)) goto error;
+		queue->push_back(std::move(nzbInfo));
+	}
+
+	return true;
+
+error:
+	error("Error reading nzb list from disk");
+	return false;
+}
+
+void DiskState::SaveNzbInfo(NzbInfo* nzbInfo, StateDiskFile& outfile)
+{
+	outfile.PrintLine("%i", nzbInfo->GetId());
+	outfile.PrintLine("%i", (int)nzbInfo->GetKind());
+	outfile.PrintLine("%s", nzbInfo->GetUrl());
+	outfile.PrintLine("%s", nzbInfo->GetFilename());
+	outfile.PrintLine("%s", nzbInfo->GetDestDir());
+	outfile.PrintLine("%s", nzbInfo->GetFinalDir());
+	outfile.PrintLine("%s", nzbInfo->GetQueuedFilename());
+	outfile.PrintLine("%s", nzbInfo->GetName());
+	outfile.PrintLine("%s", nzbInfo->GetCategory());
+	outfile.PrintLine("%i,%i,%i,%i,%i", (int)nzbInfo->GetPriority(),
+		nzbInfo->GetPostInfo() ? (int)nzbInfo->GetPostInfo()->GetStage() + 1 : 0,
+		(int)nzbInfo->GetDeletePaused(), (int)nzbInfo->GetManyDupeFiles(), nzbInfo->GetFeedId());
+	outfile.PrintLine("%i,%i,%i,%i,%i,%i,%i", (int)nzbInfo->GetParStatus(), (int)nzbInfo->GetUnpackStatus(),
+		(int)nzbInfo->GetMoveStatus(), (int)nzbInfo->GetRenameStatus(), (int)nzbInfo->GetDeleteStatus(),
+		(int)nzbInfo->GetMarkStatus(), (int)nzbInfo->GetUrlStatus());
+	outfile.PrintLine("%i,%i,%i", (int)nzbInfo->GetUnpackCleanedUpDisk(), (int)nzbInfo->GetHealthPaused(),
+		(int)nzbInfo->GetAddUrlPaused());
+	outfile.PrintLine("%i,%i,%i", nzbInfo->GetFileCount(), nzbInfo->GetParkedFileCount(),
+		nzbInfo->GetMessageCount());
+	outfile.PrintLine("%i,%i", (int)nzbInfo->GetMinTime(), (int)nzbInfo->GetMaxTime());
+	outfile.PrintLine("%i,%i,%i,%i", (int)nzbInfo->GetParFull(),
+		nzbInfo->GetPostInfo() ? (int)nzbInfo->GetPostInfo()->GetForceParFull() : 0,
+		nzbInfo->GetPostInfo() ? (int)nzbInfo->GetPostInfo()->GetForceRepair() : 0,
+		nzbInfo->GetExtraParBlocks());
+
+	outfile.PrintLine("%u,%u", nzbInfo->GetFullContentHash(), nzbInfo->GetFilteredContentHash());
+
+	uint32 High1, Low1, High2, Low2, High3, Low3;
+	Util::SplitInt64(nzbInfo->GetSize(), &High1, &Low1);
+	Util::SplitInt64(nzbInfo->GetSuccessSize(), &High2, &Low2);
+	Util::SplitInt64(nzbInfo->GetFailedSize(), &High3, &Low3);
+	outfile.PrintLine("%u,%u,%u,%u,%u,%u", High1, Low1, High2, Low2, High3, Low3);
+
+	Util::SplitInt64(nzbInfo->GetParSize(), &High1, &Low1);
+	Util::SplitInt64(nzbInfo->GetParSuccessSize(), &High2, &Low2);
+	Util::SplitInt64(nzbInfo->GetParFailedSize(), &High3, &Low3);
+	outfile.PrintLine("%u,%u,%u,%u,%u,%u", High1, Low1, High2, Low2, High3, Low3);
+
+	outfile.PrintLine("%i,%i,%i", nzbInfo->GetTotalArticles(), nzbInfo->GetSuccessArticles(), nzbInfo->GetFailedArticles());
+
+	outfile.PrintLine("%s", nzbInfo->GetDupeKey());
+	outfile.PrintLine("%i,%i", (int)nzbInfo->GetDupeMode(), nzbInfo->GetDupeScore());
+
+	Util::SplitInt64(nzbInfo->GetDownloadedSize(), &High1, &Low1);
+	outfile.PrintLine("%u,%u,%i,%i,%i,%i,%i", High1, Low1, nzbInfo->GetDownloadSec(), nzbInfo->GetPostTotalSec(),
+		nzbInfo->GetParSec(), nzbInfo->GetRepairSec(), nzbInfo->GetUnpackSec());
+
+	outfile.PrintLine("%i", (int)nzbInfo->GetCompletedFiles()->size());
+	for (CompletedFile& completedFile : nzbInfo->GetCompletedFiles())
+	{
+		outfile.PrintLine("%i,%i,%u,%s", completedFile.GetId(), (int)completedFile.GetStatus(),
+			completedFile.GetCrc(), completedFile.GetFileName());
+	}
+
+	outfile.PrintLine("%i", (int)nzbInfo->GetParameters()->size());
+	for (NzbParameter& parameter : nzbInfo->GetParameters())
+	{
+		outfile.PrintLine("%s=%s", parameter.GetName(), parameter.GetValue());
+	}
+
+	outfile.PrintLine("%i", (int)nzbInfo->GetScriptStatuses()->size());
+	for (ScriptStatus& scriptStatus : nzbInfo->GetScriptStatuses())
+	{
+		outfile.PrintLine("%i,%s", scriptStatus.GetStatus(), scriptStatus.GetName());
+	}
+
+	SaveServerStats(nzbInfo->GetServerStats(), outfile);
+
+	// save file-infos
+	int size = 0;
+	for (FileInfo* fileInfo : nzbInfo->GetFileList())
+	{
+		if (!fileInfo->GetDeleted())
+		{
+			size++;
+		}
+	}
+	outfile.PrintLine("%i", size);
+	for (FileInfo* fileInfo : nzbInfo->GetFileList())
+	{
+		if (!fileInfo->GetDeleted())
+		{
+			outfile.PrintLine("%i,%i,%i", fileInfo->GetId(), (int)fileInfo->GetPaused(),
+				(int)fileInfo->GetExtraPriority());
+		}
+	}
+}
+
+bool DiskState::LoadNzbInfo(NzbInfo* nzbInfo, Servers* servers, StateDiskFile& infile, int formatVersion)
+{
+	char buf[10240];
+
+	int id;
+	if (infile.ScanLine("%i", &id) != 1) goto error;
+	nzbInfo->SetId(id);
+
+	int kind;
+	if (infile.ScanLine("%i", &kind) != 1) goto error;
+	nzbInfo->SetKind((NzbInfo::EKind)kind);
+
+	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	nzbInfo->SetUrl(buf);
+
+	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	nzbInfo->SetFilename(buf);
+
+	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	nzbInfo->SetDestDir(buf);
+
+	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	nzbInfo->SetFinalDir(buf);
+
+	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	nzbInfo->SetQueuedFilename(buf);
+
+	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	if (strlen(buf) > 0)
+	{
+		nzbInfo->SetName(buf);
+	}
+
+	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	nzbInfo->SetCategory(buf);
+
+	int priority, postStage, deletePaused, manyDupeFiles, feedId;
+	if (formatVersion >= 54)
+	{
+		if (infile.ScanLine("%i,%i,%i,%i,%i", &priority, &postStage, &deletePaused, &manyDupeFiles, &feedId) != 5) goto error;
+	}
+	else
+	{
+		if (infile.ScanLine("%i,%i,%i,%i", &priority, &postStage, &deletePaused, &manyDupeFiles) != 4) goto error;
+		feedId = 0;
+	}
+	nzbInfo->SetPriority(priority);
+	nzbInfo->SetDeletePaused((bool)deletePaused);
+	nzbInfo->SetManyDupeFiles((bool)manyDupeFiles);
+	if (postStage > 0)
+	{
+		nzbInfo->EnterPostProcess();
+		nzbInfo->GetPostInfo()->SetStage((PostInfo::EStage)postStage);
+	}
+	nzbInfo->SetFeedId(feedId);
+
+	int parStatus, unpackStatus, moveStatus, renameStatus, deleteStatus, markStatus, urlStatus;
+	if (infile.ScanLine("%i,%i,%i,%i,%i,%i,%i", &parStatus, &unpackStatus, &moveStatus,
+		&renameStatus, &deleteStatus, &markStatus, &urlStatus) != 7) goto error;
+	nzbInfo->SetParStatus((NzbInfo::EParStatus)parStatus);
+	nzbInfo->SetUnpackStatus((NzbInfo::EUnpackStatus)unpackStatus);
+	nzbInfo->SetMoveStatus((NzbInfo::EMoveStatus)moveStatus);
+	nzbInfo->SetRenameStatus((NzbInfo::ERenameStatus)renameStatus);
+	nzbInfo->SetDeleteStatus((NzbInfo::EDeleteStatus)deleteStatus);
+	nzbInfo->SetMarkStatus((NzbInfo::EMarkStatus)markStatus);
+	if (nzbInfo->GetKind() == NzbInfo::nkNzb ||
+		(NzbInfo::EUrlStatus)urlStatus >= NzbInfo::lsFailed ||
+		(NzbInfo::EUrlStatus)urlStatus >= NzbInfo::lsScanSkipped)
+	{
+		nzbInfo->SetUrlStatus((NzbInfo::EUrlStatus)urlStatus);
+	}
+
+	int unpackCleanedUpDisk, healthPaused, addUrlPaused;
+	if (infile.ScanLine("%i,%i,%i", &unpackCleanedUpDisk, &healthPaused, &addUrlPaused) != 3) goto error;
+	nzbInfo->SetUnpackCleanedUpDisk((bool)unpackCleanedUpDisk);
+	nzbInfo->SetHealthPaused((bool)healthPaused);
+	nzbInfo->SetAddUrlPaused((bool)addUrlPaused);
+
+	int fileCount, parkedFileCount, messageCount;
+	if (formatVersion >= 52)
+	{
+		if (infile.ScanLine("%i,%i,%i", &fileCount, &parkedFileCount, &messageCount) != 3) goto error;
+	}
+	else
+	{
+		if (infile.ScanLine("%i,%i", &fileCount, &parkedFileCount) != 2) goto error;
+		messageCount = 0;
+	}
+	nzbInfo->SetFileCount(fileCount);
+	nzbInfo->SetParkedFileCount(parkedFileCount);
+	nzbInfo->SetMessageCount(messageCount);
+
+	int minTime, maxTime;
+	if (infile.ScanLine("%i,%i", &minTime, &maxTime) != 2) goto error;
+	nzbInfo->SetMinTime((time_t)minTime);
+	nzbInfo->SetMaxTime((time_t)maxTime);
+
+	if (formatVersion >= 51)
+	{
+		int parFull, forceParFull, forceRepair, extraParBlocks = 0;
+		if (formatVersion >= 55)
+		{
+			if (infile.ScanLine("%i,%i,%i,%i", &parFull, &forceParFull, &forceRepair, &extraParBlocks) != 4) goto error;
+		}
+		else
+		{
+			if (infile.ScanLine("%i,%i,%i", &parFull, &forceParFull, &forceRepair) != 3) goto error;
+		}
+		nzbInfo->SetParFull((bool)parFull);
+		nzbInfo->SetExtraParBlocks(extraParBlocks);
+		if (nzbInfo->GetPostInfo())
+		{
+			nzbInfo->GetPostInfo()->SetForceParFull((bool)forceParFull);
+			nzbInfo->GetPostInfo()->SetForceRepair((bool)forceRepair);
+		}
+	}
+
+	uint32 fullContentHash, filteredContentHash;
+	if (infile.ScanLine("%u,%u", &fullContentHash, &filteredContentHash) != 2) goto error;
+	nzbInfo->SetFullContentHash(fullContentHash);
+	nzbInfo->SetFilteredContentHash(filteredContentHash);
+
+	uint32 High1, Low1, High2, Low2, High3, Low3;
+	if (infile.ScanLine("%u,%u,%u,%u,%u,%u", &High1, &Low1, &High2, &Low2, &High3, &Low3) != 6) goto error;
+	nzbInfo->SetSize(Util::JoinInt64(High1, Low1));
+	nzbInfo->SetSuccessSize(Util::JoinInt64(High2, Low2));
+	nzbInfo->SetFailedSize(Util::JoinInt64(High3, Low3));
+	nzbInfo->SetCurrentSuccessSize(nzbInfo->GetSuccessSize());
+	nzbInfo->SetCurrentFailedSize(nzbInfo->GetFailedSize());
+
+	if (infile.ScanLine("%u,%u,%u,%u,%u,%u", &High1, &Low1, &High2, &Low2, &High3, &Low3) != 6) goto error;
+	nzbInfo->SetParSize(Util::JoinInt64(High1, Low1));
+	nzbInfo->SetParSuccessSize(Util::JoinInt64(High2, Low2));
+	nzbInfo->SetParFailedSize(Util::JoinInt64(High3, Low3));
+	nzbInfo->SetParCurrentSuccessSize(nzbInfo->GetParSuccessSize());
+	nzbInfo->SetParCurrentFailedSize(nzbInfo->GetParFailedSize());
+
+	int totalArticles, successArticles, failedArticles;
+	if (infile.ScanLine("%i,%i,%i", &totalArticles, &successArticles, &failedArticles) != 3) goto error;
+	nzbInfo->SetTotalArticles(totalArticles);
+	nzbInfo->SetSuccessArticles(successArticles);
+	nzbInfo->SetFailedArticles(failedArticles);
+	nzbInfo->SetCurrentSuccessArticles(successArticles);
+	nzbInfo->SetCurrentFailedArticles(failedArticles);
+
+	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	nzbInfo->SetDupeKey(buf);
+
+	int dupeMode, dupeScore;
+	if (infile.ScanLine("%i,%i", &dupeMode, &dupeScore) != 2) goto error;
+	nzbInfo->SetDupeMode((EDupeMode)dupeMode);
+	nzbInfo->SetDupeScore(dupeScore);
+
+	if (formatVersion >= 48)
+	{
+		uint32 High1, Low1, downloadSec, postTotalSec, parSec, repairSec, unpackSec;
+		if (infile.ScanLine("%u,%u,%i,%i,%i,%i,%i", &High1, &Low1, &downloadSec, &postTotalSec, &parSec, &repairSec, &unpackSec) != 7) goto error;
+		nzbInfo->SetDownloadedSize(Util::JoinInt64(High1, Low1));
+		nzbInfo->SetDownloadSec(downloadSec);
+		nzbInfo->SetPostTotalSec(postTotalSec);
+		nzbInfo->SetParSec(parSec);
+		nzbInfo->SetRepairSec(repairSec);
+		nzbInfo->SetUnpackSec(unpackSec);
+	}
+
+	if (infile.ScanLine("%i", &fileCount) != 1) goto error;
+	for (int i = 0; i < fileCount; i++)
+	{
+		if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+
+		int id = 0;
+		char* fileName = buf;
+		int status = 0;
+		uint32 crc = 0;
+
+		if (formatVersion >= 49)
+		{
+			if (formatVersion >= 50)
+			{
+				if (sscanf(buf, "%i,%i,%u", &id, &status, &crc) != 3) goto error;
+				fileName = strchr(buf, ',');
+				if (fileName) fileName = strchr(fileName+1, ',');
+				if (fileName) fileName = strchr(fileName+1, ',');
+			}
+			else
+			{
+				if (sscanf(buf, "%i,%u", &status, &crc) != 2) goto error;
+				fileName = strchr(buf + 2, ',');
+			}
+			if (fileName)
+			{
+				fileName++;
+			}
+		}
+
+		nzbInfo->GetCompletedFiles()->emplace_back(id, fileName, (CompletedFile::EStatus)status, crc);
+	}
+
+	int parameterCount;
+	if (infile.ScanLine("%i", &parameterCount) != 1) goto error;
+	for (int i = 0; i < parameterCount; i++)
+	{
+		if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+
+		char* value = strchr(buf, '=');
+		if (value)
+		{
+			*value = '\0';
+			value++;
+			nzbInfo->GetParameters()->SetParameter(buf, value);
+		}
+	}
+
+	int scriptCount;
+	if (infile.ScanLine("%i", &scriptCount) != 1) goto error;
+	for (int i = 0; i < scriptCount; i++)
+	{
+		if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+
+		char* scriptName = strchr(buf, ',');
+		if (scriptName)
+		{
+			scriptName++;
+			int status = atoi(buf);
+			if (status > 1 && formatVersion < 25) status--;
+			nzbInfo->GetScriptStatuses()->emplace_back(scriptName, (ScriptStatus::EStatus)status);
+		}
+	}
+
+	if (!LoadServerStats(nzbInfo->GetServerStats(), servers, infile)) goto error;
+	nzbInfo->GetCurrentServerStats()->ListOp(nzbInfo->GetServerStats(), ServerStatList::soSet);
+
+	if (formatVersion < 52)
+	{
+		int logCount;
+		if (infile.ScanLine("%i", &logCount) != 1) goto error;
+		for (int i = 0; i < logCount; i++)
+		{
+			if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+		}
+	}
+
+	if (infile.ScanLine("%i", &fileCount) != 1) goto error;
+	for (int i = 0; i < fileCount; i++)
+	{
+		uint32 id, paused, time;
+		int extraPriority;
+
+		if (formatVersion >= 56)
+		{
+			if (infile.ScanLine("%i,%i,%i", &id, &paused, &extraPriority) != 3) goto error;
+		}
+		else
+		{
+			if (infile.ScanLine("%i,%i,%i,%i", &id, &paused, &time, &extraPriority) != 4) goto error;
+		}
+
+		std::unique_ptr<FileInfo> fileInfo = std::make_unique<FileInfo>();
+		fileInfo->SetId(id);
+
+		// file infos are loaded later on several threads, see "LoadAllFiles"
+		bool res = IsFileLoadDeferred(formatVersion) || LoadFile(fileInfo.get(), true, false);
+		if (res)
+		{
+			fileInfo->SetPaused(paused);
+			if (formatVersion < 56)
+			{
+				fileInfo->SetTime(time);
+			}
+			fileInfo->SetExtraPriority(extraPriority != 0);
+			fileInfo->SetNzbInfo(nzbInfo);
+			nzbInfo->GetFileList()->Add(std::move(fileInfo));
+		}
+	}
+
+	return true;
+
+error:
+	error("Error reading nzb info from disk");
+	return false;
+}
+
+void DiskState::SaveServerStats(ServerStatList* serverStatList, StateDiskFile& outfile)
+{
+	outfile.PrintLine("%i", (int)serverStatList->size());
+	for (ServerStat& serverStat : serverStatList)
+	{
+		outfile.PrintLine("%i,%i,%i", serverStat.GetServerId(), serverStat.GetSuccessArticles(), serverStat.GetFailedArticles());
+	}
+}
+
+bool DiskState::LoadServerStats(ServerStatList* serverStatList, Servers* servers, StateDiskFile& infile)
+{
+	int statCount;
+	if (infile.ScanLine("%i", &statCount) != 1) goto error;
+	for (int i = 0; i < statCount; i++)
+	{
+		int serverId, successArticles, failedArticles;
+		if (infile.ScanLine("%i,%i,%i", &serverId, &successArticles, &failedArticles) != 3) goto error;
+
+		RestoreServerStat(serverStatList, servers, serverId, successArticles, failedArticles);
+	}
+
+	return true;
+
+error:
+	error("Error reading server stats from disk");
+	return false;
+}
+
+void DiskState::RestoreServerStat(ServerStatList* serverStatList, Servers* servers, int serverId,
+	int successArticles, int failedArticles)
+{
+	if (servers)
+	{
+		// find server (id could change if config file was edited)
+		for (NewsServer* newsServer : servers)
+		{
+			if (newsServer->GetStateId() == serverId)
+			{
+				serverStatList->StatOp(newsServer->GetId(), successArticles, failedArticles, ServerStatList::soSet);
+			}
+		}
+	}
+}
+
+/*
+ * Records of binary diskstate files for article lists (format version 5)
+ */
+struct FileInfoRecord
+{
+	uint32 subject;
+	uint32 filename;
+	int time;
+	uint32 sizeHi;
+	uint32 sizeLo;
+	uint32 missedSizeHi;
+	uint32 missedSizeLo;
+	int parFile;
+	int totalArticles;
+	int missedArticles;
+	int groupCount;
+	int articleCount;
+	// followed by "groupCount" string offsets and "articleCount" of "ArticleRecord"
+};
+
+struct ArticleRecord
+{
+	int partNumber;
+	int size;
+	uint32 messageId;
+};
+
+/*
+ * Records of binary diskstate files for file states (format version 5)
+ */
+struct FileStateRecord
+{
+	int successArticles;
+	int failedArticles;
+	uint32 remainingSizeHi;
+	uint32 remainingSizeLo;
+	uint32 successSizeHi;
+	uint32 successSizeLo;
+	uint32 failedSizeHi;
+	uint32 failedSizeLo;
+	uint32 filename;
+	int serverStatCount;
+	int articleCount;
+	// followed by "serverStatCount" of "ServerStatRecord" and "articleCount" of "ArticleStateRecord"
+};
+
+struct ServerStatRecord
+{
+	int serverId;
+	int successArticles;
+	int failedArticles;
+};
+
+struct ArticleStateRecord
+{
+	int status;
+	uint32 segmentOffsetHi;
+	uint32 segmentOffsetLo;
+	int segmentSize;
+	uint32 crc;
+};
+
+bool DiskState::SaveFile(FileInfo* fileInfo)
+{
+	debug("Saving FileInfo %i to disk", fileInfo->GetId());
+
+	BString<100> filename("%i", fileInfo->GetId());
+	StateFile stateFile(filename, 5, false);
+
+	StateBinaryWriter writer;
+	SaveFileInfo(fileInfo, writer);
+
+	CharBuffer content;
+	writer.Write(content, 5);
+	m_writer.Write(stateFile.GetDestFilename(), content, content.Size(), false, false, false);
+	return true;
+}
+
+void DiskState::SaveFileInfo(FileInfo* fileInfo, StateBinaryWriter& writer)
+{
+	int articleCount = (int)fileInfo->GetArticles()->size();
+	writer.Reserve(sizeof(FileInfoRecord) + sizeof(uint32) * (int)fileInfo->GetGroups()->size() +
+		sizeof(ArticleRecord) * articleCount, articleCount * 64);
+
+	FileInfoRecord record;
+	record.subject = writer.AddString(fileInfo->GetSubject());
+	record.filename = writer.AddString(fileInfo->GetFilename());
+	record.time = (int)fileInfo->GetTime();
+	Util::SplitInt64(fileInfo->GetSize(), &record.sizeHi, &record.sizeLo);
+	Util::SplitInt64(fileInfo->GetMissedSize(), &record.missedSizeHi, &record.missedSizeLo);
+	record.parFile = (int)fileInfo->GetParFile();
+	record.totalArticles = fileInfo->GetTotalArticles();
+	record.missedArticles = fileInfo->GetMissedArticles();
+	record.groupCount = (int)fileInfo->GetGroups()->size();
+	record.articleCount = articleCount;
+	writer.Add(record);
+
+	for (CString& group : fileInfo->GetGroups())
+	{
+		writer.Add(writer.AddString(group));
+	}
+
+	for (ArticleInfo* articleInfo : fileInfo->GetArticles())
+	{
+		ArticleRecord articleRecord;
+		articleRecord.partNumber = articleInfo->GetPartNumber();
+		articleRecord.size = articleInfo->GetSize();
+		articleRecord.messageId = writer.AddString(articleInfo->GetMessageId());
+		writer.Add(articleRecord);
+	}
+}
+
+bool DiskState::LoadArticles(FileInfo* fileInfo)
+{
+	return LoadFile(fileInfo, false, true);
+}
+
+bool DiskState::LoadFile(FileInfo* fileInfo, bool fileSummary, bool articles)
+{
+	debug("Loading FileInfo %i from disk", fileInfo->GetId());
+
+	BString<100> filename("%i", fileInfo->GetId());
+	StateFile stateFile(filename, 5, false);
+	m_writer.WaitCompleted(stateFile.GetDestFilename());
+
+	if (stateFile.IsBinary())
+	{
+		StateBinaryReader reader;
+		if (!stateFile.BeginRead(reader))
+		{
+			return false;
+		}
+
+		if (!LoadFileInfo(fileInfo, reader, fileSummary, articles))
+		{
+			error("Error reading diskstate for file %i", fileInfo->GetId());
+			return false;
+		}
+
+		return true;
+	}
+
+	// text format from older versions, the file is converted to binary format on next save
+	StateDiskFile* infile = stateFile.BeginRead();
+	if (!infile)
+	{
+		return false;
+	}
+
+	return LoadFileInfo(fileInfo, *infile, stateFile.GetFileVersion(), fileSummary, articles);
+}
+
+bool DiskState::LoadFileInfo(FileInfo* fileInfo, StateBinaryReader& reader, bool fileSummary, bool articles)
+{
+	const FileInfoRecord* record = reader.Read<FileInfoRecord>();
+	if (!record)
+	{
+		return false;
+	}
+
+	const uint32* groups = reader.Read<uint32>(record->groupCount);
+	if (!groups)
+	{
+		return false;
+	}
+
+	if (fileSummary)
+	{
+		const char* subject = reader.GetString(record->subject);
+		const char* filename = reader.GetString(record->filename);
+		if (!subject || !filename)
+		{
+			return false;
+		}
+
+		fileInfo->SetSubject(subject);
+		fileInfo->SetFilename(filename);
+		fileInfo->SetTime((time_t)record->time);
+		fileInfo->SetSize(Util::JoinInt64(record->sizeHi, record->sizeLo));
+		fileInfo->SetMissedSize(Util::JoinInt64(record->missedSizeHi, record->missedSizeLo));
+		fileInfo->SetRemainingSize(fileInfo->GetSize() - fileInfo->GetMissedSize());
+		fileInfo->SetParFile((bool)record->parFile);
+		fileInfo->SetTotalArticles(record->totalArticles);
+		fileInfo->SetMissedArticles(record->missedArticles);
+
+		for (int i = 0; i < record->groupCount; i++)
+		{
+			const char* group = reader.GetString(groups[i]);
+			if (!group)
+			{
+				return false;
+			}
+			fileInfo->GetGroups()->push_back(group);
+		}
+	}
+
+	if (articles)
+	{
+		const ArticleRecord* articleRecords = reader.Read<ArticleRecord>(record->articleCount);
+		if (!articleRecords)
+		{
+			return false;
+		}
+
+		ArticleList* articleList = fileInfo->GetArticles();
+		articleList->reserve(articleList->size() + record->articleCount);
+
+		for (int i = 0; i < record->articleCount; i++)
+		{
+			const ArticleRecord& articleRecord = articleRecords[i];
+			const char* messageId = reader.GetString(articleRecord.messageId);
+			if (!messageId)
+			{
+				return false;
+			}
+
+			articleList->Add(articleRecord.partNumber, articleRecord.size, messageId);
+		}
+	}
+
+	return true;
+}
+
+bool DiskState::LoadFileInfo(FileInfo* fileInfo, StateDiskFile& infile, int formatVersion, bool fileSummary, bool articles)
+{
+	char buf[1024];
+
+	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	if (fileSummary) fileInfo->SetSubject(buf);
+
+	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	if (fileSummary) fileInfo->SetFilename(buf);
+
+	if (formatVersion >= 4)
+	{
+		int time;
+		if (infile.ScanLine("%i", &time) != 1) goto error;
+		if (fileSummary) fileInfo->SetTime((time_t)time);
+	}
+
+	uint32 High, Low;
+	if (infile.ScanLine("%u,%u", &High, &Low) != 2) goto error;
+	if (fileSummary) fileInfo->SetSize(Util::JoinInt64(High, Low));
+	if (fileSummary) fileInfo->SetRemainingSize(fileInfo->GetSize());
+
+	if (infile.ScanLine("%u,%u", &High, &Low) != 2) goto error;
+	if (fileSummary) fileInfo->SetMissedSize(Util::JoinInt64(High, Low));
+	if (fileSummary) fileInfo->SetRemainingSize(fileInfo->GetSize() - fileInfo->GetMissedSize());
+
+	int parFile;
+	if (infile.ScanLine("%i", &parFile) != 1) goto error;
+	if (fileSummary) fileInfo->SetParFile((bool)parFile);
+
+	int totalArticles, missedArticles;
+	if (infile.ScanLine("%i,%i", &totalArticles, &missedArticles) != 2) goto error;
+	if (fileSummary) fileInfo->SetTotalArticles(totalArticles);
+	if (fileSummary) fileInfo->SetMissedArticles(missedArticles);
+
+	int size;
+	if (infile.ScanLine("%i", &size) != 1) goto error;
+	for (int i = 0; i < size; i++)
+	{
+		if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+		if (fileSummary) fileInfo->GetGroups()->push_back(buf);
+	}
+
+	if (infile.ScanLine("%i", &size) != 1) goto error;
+
+	if (articles)
+	{
+		for (int i = 0; i < size; i++)
+		{
+			int PartNumber, PartSize;
+			if (infile.ScanLine("%i,%i", &PartNumber, &PartSize) != 2) goto error;
+
+			if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+
+			fileInfo->GetArticles()->Add(PartNumber, PartSize, buf);
+		}
+	}
+
+	return true;
+
+error:
+	error("Error reading diskstate for file %i", fileInfo->GetId());
+	return false;
+}
+
+bool DiskState::SaveFileState(FileInfo* fileInfo, bool completed)
+{
+	debug("Saving FileState %i to disk", fileInfo->GetId());
+
+	BString<100> filename("%i%s", fileInfo->GetId(), completed ? "c" : "s");
+	StateFile stateFile(filename, 5, false);
+
+	StateBinaryWriter writer;
+	SaveFileState(fileInfo, writer, completed);
 
-	int fileCount, parkedFileCount, messageCount;
-	if (formatVersion >= 52)
-	{
-		if (infile.ScanLine("%i,%i,%i", &fileCount, &parkedFileCount, &messageCount) != 3) goto error;
+	CharBuffer content;
+	writer.Write(content, 5);
+	m_writer.Write(stateFile.GetDestFilename(), content, content.Size(), false, false, false);
+	return true;
+}
+
+void DiskState::SaveFileState(FileInfo* fileInfo, StateBinaryWriter& writer, bool completed)
+{
+	int articleCount = (int)fileInfo->GetArticles()->size();
+	int statCount = (int)fileInfo->GetServerStats()->size();
+	writer.Reserve(sizeof(FileStateRecord) + sizeof(ServerStatRecord) * statCount +
+		sizeof(ArticleStateRecord) * articleCount, 1024);
+
+	FileStateRecord record;
+	record.successArticles = fileInfo->GetSuccessArticles();
+	record.failedArticles = fileInfo->GetFailedArticles();
+	Util::SplitInt64(fileInfo->GetRemainingSize(), &record.remainingSizeHi, &record.remainingSizeLo);
+	Util::SplitInt64(fileInfo->GetSuccessSize(), &record.successSizeHi, &record.successSizeLo);
+	Util::SplitInt64(fileInfo->GetFailedSize(), &record.failedSizeHi, &record.failedSizeLo);
+	record.filename = writer.AddString(fileInfo->GetFilename());
+	record.serverStatCount = statCount;
+	record.articleCount = articleCount;
+	writer.Add(record);
+
+	for (ServerStat& serverStat : fileInfo->GetServerStats())
+	{
+		ServerStatRecord statRecord;
+		statRecord.serverId = serverStat.GetServerId();
+		statRecord.successArticles = serverStat.GetSuccessArticles();
+		statRecord.failedArticles = serverStat.GetFailedArticles();
+		writer.Add(statRecord);
 	}
-	else
+
+	for (ArticleInfo* articleInfo : fileInfo->GetArticles())
 	{
-		if (infile.ScanLine("%i,%i", &fileCount, &parkedFileCount) != 2) goto error;
-		messageCount = 0;
+		ArticleStateRecord articleRecord;
+		articleRecord.status = (int)articleInfo->GetStatus();
+		Util::SplitInt64(articleInfo->GetSegmentOffset(), &articleRecord.segmentOffsetHi, &articleRecord.segmentOffsetLo);
+		articleRecord.segmentSize = articleInfo->GetSegmentSize();
+		articleRecord.crc = articleInfo->GetCrc();
+		writer.Add(articleRecord);
 	}
-	nzbInfo->SetFileCount(fileCount);
-	nzbInfo->SetParkedFileCount(parkedFileCount);
-	nzbInfo->SetMessageCount(messageCount);
+}
 
-	int minTime, maxTime;
-	if (infile.ScanLine("%i,%i", &minTime, &maxTime) != 2) goto error;
-	nzbInfo->SetMinTime((time_t)minTime);
-	nzbInfo->SetMaxTime((time_t)maxTime);
+bool DiskState::LoadFileState(FileInfo* fileInfo, Servers* servers, bool completed)
+{
+	return LoadFileState(fileInfo, servers, completed, true);
+}
 
-	if (formatVersion >= 51)
+bool DiskState::LoadFileState(FileInfo* fileInfo, Servers* servers, bool completed, bool articles)
+{
+	debug("Loading FileInfo %i from disk", fileInfo->GetId());
+
+	BString<100> filename("%i%s", fileInfo->GetId(), completed ? "c" : "s");
+	StateFile stateFile(filename, 5, false);
+	m_writer.WaitCompleted(stateFile.GetDestFilename());
+
+	if (stateFile.IsBinary())
 	{
-		int parFull, forceParFull, forceRepair, extraParBlocks = 0;
-		if (formatVersion >= 55)
-		{
-			if (infile.ScanLine("%i,%i,%i,%i", &parFull, &forceParFull, &forceRepair, &extraParBlocks) != 4) goto error;
-		}
-		else
+		StateBinaryReader reader;
+		if (!stateFile.BeginRead(reader))
 		{
-			if (infile.ScanLine("%i,%i,%i", &parFull, &forceParFull, &forceRepair) != 3) goto error;
+			return false;
 		}
-		nzbInfo->SetParFull((bool)parFull);
-		nzbInfo->SetExtraParBlocks(extraParBlocks);
-		if (nzbInfo->GetPostInfo())
+
+		if (!LoadFileState(fileInfo, servers, reader, completed, articles))
 		{
-			nzbInfo->GetPostInfo()->SetForceParFull((bool)forceParFull);
-			nzbInfo->GetPostInfo()->SetForceRepair((bool)forceRepair);
+			error("Error reading diskstate for file %i", fileInfo->GetId());
+			return false;
 		}
+
+		return true;
 	}
 
-	uint32 fullContentHash, filteredContentHash;
-	if (infile.ScanLine("%u,%u", &fullContentHash, &filteredContentHash) != 2) goto error;
-	nzbInfo->SetFullContentHash(fullContentHash);
-	nzbInfo->SetFilteredContentHash(filteredContentHash);
+	// text format from older versions, the file is converted to binary format on next save
+	StateDiskFile* infile = stateFile.BeginRead();
+	if (!infile)
+	{
+		return false;
+	}
 
-	uint32 High1, Low1, High2, Low2, High3, Low3;
-	if (infile.ScanLine("%u,%u,%u,%u,%u,%u", &High1, &Low1, &High2, &Low2, &High3, &Low3) != 6) goto error;
-	nzbInfo->SetSize(Util::JoinInt64(High1, Low1));
-	nzbInfo->SetSuccessSize(Util::JoinInt64(High2, Low2));
-	nzbInfo->SetFailedSize(Util::JoinInt64(High3, Low3));
-	nzbInfo->SetCurrentSuccessSize(nzbInfo->GetSuccessSize());
-	nzbInfo->SetCurrentFailedSize(nzbInfo->GetFailedSize());
+	return LoadFileState(fileInfo, servers, *infile, stateFile.GetFileVersion(), completed, articles);
+}
 
-	if (infile.ScanLine("%u,%u,%u,%u,%u,%u", &High1, &Low1, &High2, &Low2, &High3, &Low3) != 6) goto error;
-	nzbInfo->SetParSize(Util::JoinInt64(High1, Low1));
-	nzbInfo->SetParSuccessSize(Util::JoinInt64(High2, Low2));
-	nzbInfo->SetParFailedSize(Util::JoinInt64(High3, Low3));
-	nzbInfo->SetParCurrentSuccessSize(nzbInfo->GetParSuccessSize());
-	nzbInfo->SetParCurrentFailedSize(nzbInfo->GetParFailedSize());
+bool DiskState::LoadFileState(FileInfo* fileInfo, Servers* servers, StateBinaryReader& reader,
+	bool completed, bool articles)
+{
+	bool hasArticles = !fileInfo->GetArticles()->empty();
 
-	int totalArticles, successArticles, failedArticles;
-	if (infile.ScanLine("%i,%i,%i", &totalArticles, &successArticles, &failedArticles) != 3) goto error;
-	nzbInfo->SetTotalArticles(totalArticles);
-	nzbInfo->SetSuccessArticles(successArticles);
-	nzbInfo->SetFailedArticles(failedArticles);
-	nzbInfo->SetCurrentSuccessArticles(successArticles);
-	nzbInfo->SetCurrentFailedArticles(failedArticles);
+	const FileStateRecord* record = reader.Read<FileStateRecord>();
+	if (!record)
+	{
+		return false;
+	}
 
-	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-	nzbInfo->SetDupeKey(buf);
+	const char* filename = reader.GetString(record->filename);
+	const ServerStatRecord* statRecords = reader.Read<ServerStatRecord>(record->serverStatCount);
+	const ArticleStateRecord* articleRecords = reader.Read<ArticleStateRecord>(record->articleCount);
+	if (!filename || !statRecords || !articleRecords ||
+		(hasArticles && (int)fileInfo->GetArticles()->size() < record->articleCount))
+	{
+		return false;
+	}
 
-	int dupeMode, dupeScore;
-	if (infile.ScanLine("%i,%i", &dupeMode, &dupeScore) != 2) goto error;
-	nzbInfo->SetDupeMode((EDupeMode)dupeMode);
-	nzbInfo->SetDupeScore(dupeScore);
+	fileInfo->SetSuccessArticles(record->successArticles);
+	fileInfo->SetFailedArticles(record->failedArticles);
+	fileInfo->SetRemainingSize(Util::JoinInt64(record->remainingSizeHi, record->remainingSizeLo));
+	fileInfo->SetSuccessSize(Util::JoinInt64(record->successSizeHi, record->successSizeLo));
+	fileInfo->SetFailedSize(Util::JoinInt64(record->failedSizeHi, record->failedSizeLo));
+	fileInfo->SetFilename(filename);
 
-	if (formatVersion >= 48)
+	for (int i = 0; i < record->serverStatCount; i++)
 	{
-		uint32 High1, Low1, downloadSec, postTotalSec, parSec, repairSec, unpackSec;
-		if (infile.ScanLine("%u,%u,%i,%i,%i,%i,%i", &High1, &Low1, &downloadSec, &postTotalSec, &parSec, &repairSec, &unpackSec) != 7) goto error;
-		nzbInfo->SetDownloadedSize(Util::JoinInt64(High1, Low1));
-		nzbInfo->SetDownloadSec(downloadSec);
-		nzbInfo->SetPostTotalSec(postTotalSec);
-		nzbInfo->SetParSec(parSec);
-		nzbInfo->SetRepairSec(repairSec);
-		nzbInfo->SetUnpackSec(unpackSec);
+		const ServerStatRecord& statRecord = statRecords[i];
+		RestoreServerStat(fileInfo->GetServerStats(), servers, statRecord.serverId,
+			statRecord.successArticles, statRecord.failedArticles);
 	}
 
-	if (infile.ScanLine("%i", &fileCount) != 1) goto error;
-	for (int i = 0; i < fileCount; i++)
+	if (articles && !hasArticles)
 	{
-		if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+		fileInfo->GetArticles()->reserve(record->articleCount);
+	}
 
-		int id = 0;
-		char* fileName = buf;
-		int status = 0;
-		uint32 crc = 0;
+	int completedArticles = 0;
+	for (int i = 0; i < record->articleCount; i++)
+	{
+		const ArticleStateRecord& articleRecord = articleRecords[i];
+		ArticleInfo::EStatus status = RestoreArticleStatus(articleRecord.status, completedArticles,
+			record->articleCount, completed);
 
-		if (formatVersion >= 49)
+		if (articles)
 		{
-			if (formatVersion >= 50)
-			{
-				if (sscanf(buf, "%i,%i,%u", &id, &status, &crc) != 3) goto error;
-				fileName = strchr(buf, ',');
-				if (fileName) fileName = strchr(fileName+1, ',');
-				if (fileName) fileName = strchr(fileName+1, ',');
-			}
-			else
-			{
-				if (sscanf(buf, "%i,%u", &status, &crc) != 2) goto error;
-				fileName = strchr(buf + 2, ',');
-			}
-			if (fileName)
+			if (!hasArticles)
 			{
-				fileName++;
+				fileInfo->GetArticles()->emplace_back();
 			}
+			ArticleInfo* articleInfo = &fileInfo->GetArticles()->at(i);
+			articleInfo->SetSegmentOffset(Util::JoinInt64(articleRecord.segmentOffsetHi, articleRecord.segmentOffsetLo));
+			articleInfo->SetSegmentSize(articleRecord.segmentSize);
+			articleInfo->SetCrc(articleRecord.crc);
+			articleInfo->SetStatus(status);
 		}
-
-		nzbInfo->GetCompletedFiles()->emplace_back(id, fileName, (CompletedFile::EStatus)status, crc);
 	}
 
-	int parameterCount;
-	if (infile.ScanLine("%i", &parameterCount) != 1) goto error;
-	for (int i = 0; i < parameterCount; i++)
-	{
-		if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	fileInfo->SetCompletedArticles(completedArticles);
 
-		char* value = strchr(buf, '=');
-		if (value)
-		{
-			*value = '\0';
-			value++;
-			nzbInfo->GetParameters()->SetParameter(buf, value);
-		}
-	}
+	return true;
+}
 
-	int scriptCount;
-	if (infile.ScanLine("%i", &scriptCount) != 1) goto error;
-	for (int i = 0; i < scriptCount; i++)
-	{
-		if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+bool DiskState::LoadFileState(FileInfo* fileInfo, Servers* servers, StateDiskFile& infile, int formatVersion,
+	bool completed, bool articles)
+{
+	bool hasArticles = !fileInfo->GetArticles()->empty();
 
-		char* scriptName = strchr(buf, ',');
-		if (scriptName)
-		{
-			scriptName++;
-			int status = atoi(buf);
-			if (status > 1 && formatVersion < 25) status--;
-			nzbInfo->GetScriptStatuses()->emplace_back(scriptName, (ScriptStatus::EStatus)status);
-		}
-	}
+	int successArticles, failedArticles;
+	if (infile.ScanLine("%i,%i", &successArticles, &failedArticles) != 2) goto error;
+	fileInfo->SetSuccessArticles(successArticles);
+	fileInfo->SetFailedArticles(failedArticles);
 
-	if (!LoadServerStats(nzbInfo->GetServerStats(), servers, infile)) goto error;
-	nzbInfo->GetCurrentServerStats()->ListOp(nzbInfo->GetServerStats(), ServerStatList::soSet);
+	uint32 High1, Low1, High2, Low2, High3, Low3;
+	if (infile.ScanLine("%u,%u,%u,%u,%u,%u", &High1, &Low1, &High2, &Low2, &High3, &Low3) != 6) goto error;
+	fileInfo->SetRemainingSize(Util::JoinInt64(High1, Low1));
+	fileInfo->SetSuccessSize(Util::JoinInt64(High2, Low2));
+	fileInfo->SetFailedSize(Util::JoinInt64(High3, Low3));
 
-	if (formatVersion < 52)
+	if (formatVersion >= 4)
 	{
-		int logCount;
-		if (infile.ScanLine("%i", &logCount) != 1) goto error;
-		for (int i = 0; i < logCount; i++)
-		{
-			if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-		}
+		char buf[1024];
+		if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+		fileInfo->SetFilename(buf);
 	}
 
-	if (infile.ScanLine("%i", &fileCount) != 1) goto error;
-	for (int i = 0; i < fileCount; i++)
+	if (!LoadServerStats(fileInfo->GetServerStats(), servers, infile)) goto error;
+
+	int completedArticles;
+	completedArticles = 0; //clang requires initialization in a separate line (due to goto statements)
+
+	int size;
+	if (infile.ScanLine("%i", &size) != 1) goto error;
+	for (int i = 0; i < size; i++)
 	{
-		uint32 id, paused, time;
-		int extraPriority;
+		int statusInt;
+		uint32 segmentOffset = 0, crc = 0;
+		int segmentSize = 0;
 
-		if (formatVersion >= 56)
+		if (formatVersion >= 2)
 		{
-			if (infile.ScanLine("%i,%i,%i", &id, &paused, &extraPriority) != 3) goto error;
+			if (infile.ScanLine("%i,%u,%i,%u", &statusInt, &segmentOffset, &segmentSize, &crc) != 4) goto error;
 		}
 		else
 		{
-			if (infile.ScanLine("%i,%i,%i,%i", &id, &paused, &time, &extraPriority) != 4) goto error;
+			if (infile.ScanLine("%i", &statusInt) != 1) goto error;
 		}
 
-		std::unique_ptr<FileInfo> fileInfo = std::make_unique<FileInfo>();
-		fileInfo->SetId(id);
+		ArticleInfo::EStatus status = RestoreArticleStatus(statusInt, completedArticles, size, completed);
 
-		bool res = LoadFile(fileInfo.get(), true, false);
-		if (res)
+		if (articles)
 		{
-			fileInfo->SetPaused(paused);
-			if (formatVersion < 56)
+			if (!hasArticles)
 			{
-				fileInfo->SetTime(time);
+				fileInfo->GetArticles()->emplace_back();
 			}
-			fileInfo->SetExtraPriority(extraPriority != 0);
-			fileInfo->SetNzbInfo(nzbInfo);
-			nzbInfo->GetFileList()->Add(std::move(fileInfo));
+			ArticleInfo* pa = &fileInfo->GetArticles()->at(i);
+			if (formatVersion >= 2)
+			{
+				pa->SetSegmentOffset(segmentOffset);
+				pa->SetSegmentSize(segmentSize);
+				pa->SetCrc(crc);
+			}
+			pa->SetStatus(status);
 		}
 	}
 
+	fileInfo->SetCompletedArticles(completedArticles);
+
+	infile.Close();
 	return true;
 
 error:
-	error("Error reading nzb info from disk");
+	infile.Close();
+	error("Error reading diskstate for file %i", fileInfo->GetId());
 	return false;
 }
 
-void DiskState::SaveServerStats(ServerStatList* serverStatList, StateDiskFile& outfile)
+ArticleInfo::EStatus DiskState::RestoreArticleStatus(int statusInt, int& completedArticles, int articleCount, bool completed)
 {
-	outfile.PrintLine("%i", (int)serverStatList->size());
-	for (ServerStat& serverStat : serverStatList)
+	ArticleInfo::EStatus status = (ArticleInfo::EStatus)statusInt;
+
+	if (status == ArticleInfo::aiRunning)
 	{
-		outfile.PrintLine("%i,%i,%i", serverStat.GetServerId(), serverStat.GetSuccessArticles(), serverStat.GetFailedArticles());
+		status = ArticleInfo::aiUndefined;
 	}
-}
 
-bool DiskState::LoadServerStats(ServerStatList* serverStatList, Servers* servers, StateDiskFile& infile)
-{
-	int statCount;
-	if (infile.ScanLine("%i", &statCount) != 1) goto error;
-	for (int i = 0; i < statCount; i++)
+	// don't allow all articles be completed or the file will stuck.
+	// such states should never be saved on disk but just in case.
+	if (completedArticles == articleCount - 1 && !completed)
 	{
-		int serverId, successArticles, failedArticles;
-		if (infile.ScanLine("%i,%i,%i", &serverId, &successArticles, &failedArticles) != 3) goto error;
-
-		if (servers)
-		{
-			// find server (id could change if config file was edited)
-			for (NewsServer* newsServer : servers)
-			{
-				if (newsServer->GetStateId() == serverId)
-				{
-					serverStatList->StatOp(newsServer->GetId(), successArticles, failedArticles, ServerStatList::soSet);
-				}
-			}
-		}
+		status = ArticleInfo::aiUndefined;
+	}
+	if (status != ArticleInfo::aiUndefined)
+	{
+		completedArticles++;
 	}
 
-	return true;
-
-error:
-	error("Error reading server stats from disk");
-	return false;
+	return status;
 }
 
-bool DiskState::SaveFile(FileInfo* fileInfo)
+void DiskState::DiscardFiles(NzbInfo* nzbInfo, bool deleteLog)
 {
-	debug("Saving FileInfo %i to disk", fileInfo->GetId());
-
-	BString<100> filename("%i", fileInfo->GetId());
-	StateFile stateFile(filename, 4, false);
+	for (FileInfo* fileInfo : nzbInfo->GetFileList())
+	{
+		DiscardFile(fileInfo->GetId(), true, true, true);
+	}
 
-	StateDiskFile* outfile = stateFile.BeginWrite();
-	if (!outfile)
+	for (CompletedFile& completedFile : nzbInfo->GetCompletedFiles())
 	{
-		return false;
+		if (completedFile.GetStatus() != CompletedFile::cfSuccess)
+		{
+			DiscardFile(completedFile.GetId(), true, true, true);
+		}
 	}
 
-	return SaveFileInfo(fileInfo, *outfile) && stateFile.FinishWrite();
+	if (deleteLog)
+	{
+		BString<1024> filename;
+		filename.Format("%s%cn%i.log", g_Options->GetQueueDir(), PATH_SEPARATOR, nzbInfo->GetId());
+		FileSystem::DeleteFile(filename);
+	}
 }
 
-bool DiskState::SaveFileInfo(FileInfo* fileInfo, StateDiskFile& outfile)
+void DiskState::SaveDupInfo(DupInfo* dupInfo, StateDiskFile& outfile)
 {
-	outfile.PrintLine("%s", fileInfo->GetSubject());
-	outfile.PrintLine("%s", fileInfo->GetFilename());
+	uint32 High, Low;
+	Util::SplitInt64(dupInfo->GetSize(), &High, &Low);
+	outfile.PrintLine("%i,%u,%u,%u,%u,%i,%i", (int)dupInfo->GetStatus(), High, Low,
+		dupInfo->GetFullContentHash(), dupInfo->GetFilteredContentHash(),
+		dupInfo->GetDupeScore(), (int)dupInfo->GetDupeMode());
+	outfile.PrintLine("%s", dupInfo->GetName());
+	outfile.PrintLine("%s", dupInfo->GetDupeKey());
+}
 
-	outfile.PrintLine("%i", (int)fileInfo->GetTime());
+bool DiskState::LoadDupInfo(DupInfo* dupInfo, StateDiskFile& infile, int formatVersion)
+{
+	char buf[1024];
 
+	int status;
 	uint32 High, Low;
-	Util::SplitInt64(fileInfo->GetSize(), &High, &Low);
-	outfile.PrintLine("%u,%u", High, Low);
-
-	Util::SplitInt64(fileInfo->GetMissedSize(), &High, &Low);
-	outfile.PrintLine("%u,%u", High, Low);
+	uint32 fullContentHash, filteredContentHash = 0;
+	int dupeScore, dupeMode;
+	if (infile.ScanLine("%i,%u,%u,%u,%u,%i,%i", &status, &High, &Low, &fullContentHash, &filteredContentHash, &dupeScore, &dupeMode) != 7) goto error;
 
-	outfile.PrintLine("%i", (int)fileInfo->GetParFile());
-	outfile.PrintLine("%i,%i", fileInfo->GetTotalArticles(), fileInfo->GetMissedArticles());
+	dupInfo->SetStatus((DupInfo::EStatus)status);
+	dupInfo->SetFullContentHash(fullContentHash);
+	dupInfo->SetFilteredContentHash(filteredContentHash);
+	dupInfo->SetSize(Util::JoinInt64(High, Low));
+	dupInfo->SetDupeScore(dupeScore);
+	dupInfo->SetDupeMode((EDupeMode)dupeMode);
 
-	outfile.PrintLine("%i", (int)fileInfo->GetGroups()->size());
-	for (CString& group : fileInfo->GetGroups())
-	{
-		outfile.PrintLine("%s", *group);
-	}
+	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	dupInfo->SetName(buf);
 
-	outfile.PrintLine("%i", (int)fileInfo->GetArticles()->size());
-	for (ArticleInfo* articleInfo : fileInfo->GetArticles())
-	{
-		outfile.PrintLine("%i,%i", articleInfo->GetPartNumber(), articleInfo->GetSize());
-		outfile.PrintLine("%s", articleInfo->GetMessageId());
-	}
+	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
+	dupInfo->SetDupeKey(buf);
 
 	return true;
-}
 
-bool DiskState::LoadArticles(FileInfo* fileInfo)
-{
-	return LoadFile(fileInfo, false, true);
+error:
+	return false;
 }
 
-bool DiskState::LoadFile(FileInfo* fileInfo, bool fileSummary, bool articles)
+void DiskState::SaveHistory(HistoryList* history, JournalState& journalState, JournalState* savedState, IdList* changedIds)
 {
-	debug("Loading FileInfo %i from disk", fileInfo->GetId());
+	debug("Saving history to disk");
 
-	BString<100> filename("%i", fileInfo->GetId());
-	StateFile stateFile(filename, 4, false);
+	StringBuilder record;
+	StateDiskFile outfile;
+	outfile.SetBuffer(&record);
+	journalState = JournalState();
 
-	StateDiskFile* infile = stateFile.BeginRead();
-	if (!infile)
+	for (HistoryInfo* historyInfo : history)
 	{
-		return false;
-	}
+		if (savedState && !savedState->NeedsSave(historyInfo->GetId(), changedIds))
+		{
+			journalState.Keep(historyInfo->GetId(), *savedState);
+			continue;
+		}
 
-	return LoadFileInfo(fileInfo, *infile, stateFile.GetFileVersion(), fileSummary, articles);
+		record.Clear();
+		SaveHistoryItem(historyInfo, outfile);
+		journalState.Add(historyInfo->GetId(), record);
+	}
 }
 
-bool DiskState::LoadFileInfo(FileInfo* fileInfo, StateDiskFile& infile, int formatVersion, bool fileSummary, bool articles)
+void DiskState::SaveHistoryItem(HistoryInfo* historyInfo, StateDiskFile& outfile)
 {
-	char buf[1024];
-
-	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-	if (fileSummary) fileInfo->SetSubject(buf);
+	outfile.PrintLine("%i,%i,%i", historyInfo->GetId(), (int)historyInfo->GetKind(), (int)historyInfo->GetTime());
 
-	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-	if (fileSummary) fileInfo->SetFilename(buf);
-
-	if (formatVersion >= 4)
+	if (historyInfo->GetKind() == HistoryInfo::hkNzb || historyInfo->GetKind() == HistoryInfo::hkUrl)
 	{
-		int time;
-		if (infile.ScanLine("%i", &time) != 1) goto error;
-		if (fileSummary) fileInfo->SetTime((time_t)time);
+		SaveNzbInfo(historyInfo->GetNzbInfo(), outfile);
 	}
+	else if (historyInfo->GetKind() == HistoryInfo::hkDup)
+	{
+		SaveDupInfo(historyInfo->GetDupInfo(), outfile);
+	}
+}
 
-	uint32 High, Low;
-	if (infile.ScanLine("%u,%u", &High, &Low) != 2) goto error;
-	if (fileSummary) fileInfo->SetSize(Util::JoinInt64(High, Low));
-	if (fileSummary) fileInfo->SetRemainingSize(fileInfo->GetSize());
-
-	if (infile.ScanLine("%u,%u", &High, &Low) != 2) goto error;
-	if (fileSummary) fileInfo->SetMissedSize(Util::JoinInt64(High, Low));
-	if (fileSummary) fileInfo->SetRemainingSize(fileInfo->GetSize() - fileInfo->GetMissedSize());
-
-	int parFile;
-	if (infile.ScanLine("%i", &parFile) != 1) goto error;
-	if (fileSummary) fileInfo->SetParFile((bool)parFile);
-
-	int totalArticles, missedArticles;
-	if (infile.ScanLine("%i,%i", &totalArticles, &missedArticles) != 2) goto error;
-	if (fileSummary) fileInfo->SetTotalArticles(totalArticles);
-	if (fileSummary) fileInfo->SetMissedArticles(missedArticles);
+bool DiskState::LoadHistory(HistoryList* history, Servers* servers, StateDiskFile& infile, int formatVersion)
+{
+	debug("Loading history from disk");
 
 	int size;
 	if (infile.ScanLine("%i", &size) != 1) goto error;
 	for (int i = 0; i < size; i++)
 	{
-		if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-		if (fileSummary) fileInfo->GetGroups()->push_back(buf);
-	}
-
-	if (infile.ScanLine("%i", &size) != 1) goto error;
-
-	if (articles)
-	{
-		for (int i = 0; i < size; i++)
-		{
-			int PartNumber, PartSize;
-			if (infile.ScanLine("%i,%i", &PartNumber, &PartSize) != 2) goto error;
-
-			if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-
-			std::unique_ptr<ArticleInfo> articleInfo = std::make_unique<ArticleInfo>();
-			articleInfo->SetPartNumber(PartNumber);
-			articleInfo->SetSize(PartSize);
-			articleInfo->SetMessageId(buf);
-			fileInfo->GetArticles()->push_back(std::move(articleInfo));
-		}
+		std::unique_ptr<HistoryInfo> historyInfo = LoadHistoryItem(servers, infile, formatVersion);
+		if (!historyInfo) goto error;
+		history->push_back(std::move(historyInfo));
 	}
 
 	return true;
 
 error:
-	error("Error reading diskstate for file %i", fileInfo->GetId());
+	error("Error reading diskstate for history");
 	return false;
 }
 
-bool DiskState::SaveFileState(FileInfo* fileInfo, bool completed)
+std::unique_ptr<HistoryInfo> DiskState::LoadHistoryItem(Servers* servers, StateDiskFile& infile, int formatVersion)
 {
-	debug("Saving FileState %i to disk", fileInfo->GetId());
+	std::unique_ptr<HistoryInfo> historyInfo;
+	int id = 0;
+	int kindval = 0;
+	int time;
 
-	BString<100> filename("%i%s", fileInfo->GetId(), completed ? "c" : "s");
-	StateFile stateFile(filename, 4, false);
+	if (infile.ScanLine("%i,%i,%i", &id, &kindval, &time) != 3)
+	{
+		return nullptr;
+	}
 
-	StateDiskFile* outfile = stateFile.BeginWrite();
-	if (!outfile)
+	HistoryInfo::EKind kind = (HistoryInfo::EKind)kindval;
+
+	if (kind == HistoryInfo::hkNzb)
 	{
-		return false;
+		std::unique_ptr<NzbInfo> nzbInfo = std::make_unique<NzbInfo>();
+		if (!LoadNzbInfo(nzbInfo.get(), servers, infile, formatVersion))
+		{
+			return nullptr;
+		}
+		nzbInfo->LeavePostProcess();
+		historyInfo = std::make_unique<HistoryInfo>(std::move(nzbInfo));
+	}
+	else if (kind == HistoryInfo::hkUrl)
+	{
+		std::unique_ptr<NzbInfo> nzbInfo = std::make_unique<NzbInfo>();
+		if (!LoadNzbInfo(nzbInfo.get(), servers, infile, formatVersion))
+		{
+			return nullptr;
+		}
+		historyInfo = std::make_unique<HistoryInfo>(std::move(nzbInfo));
+	}
+	else if (kind == HistoryInfo::hkDup)
+	{
+		std::unique_ptr<DupInfo> dupInfo = std::make_unique<DupInfo>();
+		if (!LoadDupInfo(dupInfo.get(), infile, formatVersion))
+		{
+			return nullptr;
+		}
+		dupInfo->SetId(id);
+		historyInfo = std::make_unique<HistoryInfo>(std::move(dupInfo));
+	}
+	else
+	{
+		return nullptr;
 	}
 
-	return SaveFileState(fileInfo, *outfile, completed);
+	historyInfo->SetTime((time_t)time);
+
+	return historyInfo;
 }
 
-bool DiskState::SaveFileState(FileInfo* fileInfo, StateDiskFile& outfile, bool completed)
+/*
+ * History entries exceeding the number of recent entries are moved into the
+ * append-only file "archive". Each record there has a header with the data needed
+ * to find the entry, on loading only the headers are read (see LoadArchive).
+ * Removals of entries are appended as headers without records. Entries having
+ * parked files or being post-processed aren't archived.
+ */
+std::unique_ptr<ArchiveInfo> DiskState::ArchiveHistory(HistoryInfo* historyInfo)
 {
-	outfile.PrintLine("%i,%i", fileInfo->GetSuccessArticles(), fileInfo->GetFailedArticles());
-
-	uint32 High1, Low1, High2, Low2, High3, Low3;
-	Util::SplitInt64(fileInfo->GetRemainingSize(), &High1, &Low1);
-	Util::SplitInt64(fileInfo->GetSuccessSize(), &High2, &Low2);
-	Util::SplitInt64(fileInfo->GetFailedSize(), &High3, &Low3);
-	outfile.PrintLine("%u,%u,%u,%u,%u,%u", High1, Low1, High2, Low2, High3, Low3);
+	std::unique_ptr<ArchiveInfo> archiveInfo = std::make_unique<ArchiveInfo>(historyInfo->GetId(),
+		historyInfo->GetKind(), historyInfo->GetTime());
 
-	outfile.PrintLine("%s", fileInfo->GetFilename());
+	if (historyInfo->GetKind() == HistoryInfo::hkNzb || historyInfo->GetKind() == HistoryInfo::hkUrl)
+	{
+		NzbInfo* nzbInfo = historyInfo->GetNzbInfo();
+		if (nzbInfo->GetPostInfo() || !nzbInfo->GetFileList()->empty())
+		{
+			return nullptr;
+		}
 
-	SaveServerStats(fileInfo->GetServerStats(), outfile);
+		archiveInfo->SetName(nzbInfo->GetName());
+		archiveInfo->SetDupeKey(nzbInfo->GetDupeKey());
+		archiveInfo->SetFullContentHash(nzbInfo->GetFullContentHash());
+		archiveInfo->SetFilteredContentHash(nzbInfo->GetFilteredContentHash());
 
-	outfile.PrintLine("%i", (int)fileInfo->GetArticles()->size());
-	for (ArticleInfo* articleInfo : fileInfo->GetArticles())
+		int minFileId = 0;
+		int maxFileId = 0;
+		for (CompletedFile& completedFile : nzbInfo->GetCompletedFiles())
+		{
+			minFileId = minFileId == 0 ? completedFile.GetId() : std::min(minFileId, completedFile.GetId());
+			maxFileId = std::max(maxFileId, completedFile.GetId());
+		}
+		archiveInfo->SetFileIds(minFileId, maxFileId);
+	}
+	else if (historyInfo->GetKind() == HistoryInfo::hkDup)
 	{
-		outfile.PrintLine("%i,%u,%i,%u", (int)articleInfo->GetStatus(), (uint32)articleInfo->GetSegmentOffset(),
-			articleInfo->GetSegmentSize(), (uint32)articleInfo->GetCrc());
+		DupInfo* dupInfo = historyInfo->GetDupInfo();
+		archiveInfo->SetName(dupInfo->GetName());
+		archiveInfo->SetDupeKey(dupInfo->GetDupeKey());
+		archiveInfo->SetFullContentHash(dupInfo->GetFullContentHash());
+		archiveInfo->SetFilteredContentHash(dupInfo->GetFilteredContentHash());
+	}
+	else
+	{
+		return nullptr;
 	}
 
-	outfile.Close();
-	return true;
-}
-
-bool DiskState::LoadFileState(FileInfo* fileInfo, Servers* servers, bool completed)
-{
-	debug("Loading FileInfo %i from disk", fileInfo->GetId());
-
-	BString<100> filename("%i%s", fileInfo->GetId(), completed ? "c" : "s");
-	StateFile stateFile(filename, 4, false);
+	StringBuilder record;
+	StateDiskFile outfile;
+	outfile.SetBuffer(&record);
+	SaveHistoryItem(historyInfo, outfile);
 
-	StateDiskFile* infile = stateFile.BeginRead();
-	if (!infile)
+	StringBuilder content;
+	if (m_archiveSize == 0)
 	{
-		return false;
+		content.AppendFmt("%s%i\n", FORMATVERSION_SIGNATURE, 59);
 	}
+	int headerOffset = content.Length();
+	AppendArchiveHeader(content, archiveInfo.get(), record.Length());
+	content.Append(record, record.Length());
+
+	m_writer.Write(StateFile("archive", 59, true).GetDestFilename(), content, content.Length(),
+		false, m_archiveSize > 0, false);
+
+	archiveInfo->SetLocation(m_archiveSize + headerOffset, content.Length() - headerOffset);
+	m_archiveSize += content.Length();
 
-	return LoadFileState(fileInfo, servers, *infile, stateFile.GetFileVersion(), completed);
+	// the new record supersedes the removal of earlier record
+	m_archiveRemoved.erase(std::remove(m_archiveRemoved.begin(), m_archiveRemoved.end(),
+		archiveInfo->GetId()), m_archiveRemoved.end());
+
+	return archiveInfo;
 }
 
-bool DiskState::LoadFileState(FileInfo* fileInfo, Servers* servers, StateDiskFile& infile, int formatVersion, bool completed)
+void DiskState::AppendArchiveHeader(StringBuilder& content, ArchiveInfo* archiveInfo, int recordLength)
 {
-	bool hasArticles = !fileInfo->GetArticles()->empty();
-
-	int successArticles, failedArticles;
-	if (infile.ScanLine("%i,%i", &successArticles, &failedArticles) != 2) goto error;
-	fileInfo->SetSuccessArticles(successArticles);
-	fileInfo->SetFailedArticles(failedArticles);
+	content.AppendFmt("%i,%i,%i,%i,%u,%u,%i,%i\n%s\n%s\n", archiveInfo->GetId(), (int)archiveInfo->GetKind(),
+		(int)archiveInfo->GetTime(), recordLength, archiveInfo->GetFullContentHash(),
+		archiveInfo->GetFilteredContentHash(), archiveInfo->GetMinFileId(), archiveInfo->GetMaxFileId(),
+		archiveInfo->GetName() ? archiveInfo->GetName() : "",
+		archiveInfo->GetDupeKey() ? archiveInfo->GetDupeKey() : "");
+}
 
-	uint32 High1, Low1, High2, Low2, High3, Low3;
-	if (infile.ScanLine("%u,%u,%u,%u,%u,%u", &High1, &Low1, &High2, &Low2, &High3, &Low3) != 6) goto error;
-	fileInfo->SetRemainingSize(Util::JoinInt64(High1, Low1));
-	fileInfo->SetSuccessSize(Util::JoinInt64(High2, Low2));
-	fileInfo->SetFailedSize(Util::JoinInt64(High3, Low3));
+/*
+ * Builds the list of archived entries from the record headers. The last record of
+ * an entry is valid. Entries which are also in history were moved back into history
+ * before the program was interrupted.
+ */
+bool DiskState::LoadArchive(DownloadQueue* downloadQueue)
+{
+	ArchiveList* archive = downloadQueue->GetArchive();
+	archive->clear();
+	m_archiveSize = 0;
+	m_archiveRemoved.clear();
 
-	if (formatVersion >= 4)
+	StateFile stateFile("archive", 59, true);
+	if (!stateFile.FileExists())
 	{
-		char buf[1024];
-		if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-		fileInfo->SetFilename(buf);
+		return true;
 	}
 
-	if (!LoadServerStats(fileInfo->GetServerStats(), servers, infile)) goto error;
+	StateDiskFile* infile = stateFile.BeginRead();
+	if (!infile)
+	{
+		return false;
+	}
 
-	int completedArticles;
-	completedArticles = 0; //clang requires initialization in a separate line (due to goto statements)
+	int64 fileSize = FileSystem::FileSize(stateFile.GetDestFilename());
+	std::map<int, std::unique_ptr<ArchiveInfo>> entries;
+	int64 offset = infile->Position();
+	char name[10240];
+	char dupeKey[10240];
 
-	int size;
-	if (infile.ScanLine("%i", &size) != 1) goto error;
-	for (int i = 0; i < size; i++)
+	while (true)
 	{
-		if (!hasArticles)
+		int id, kind, time, recordLength, minFileId, maxFileId;
+		uint32 fullContentHash, filteredContentHash;
+		if (infile->ScanLine("%i,%i,%i,%i,%u,%u,%i,%i", &id, &kind, &time, &recordLength,
+				&fullContentHash, &filteredContentHash, &minFileId, &maxFileId) != 8 ||
+			!infile->ReadLine(name, sizeof(name)) || !infile->ReadLine(dupeKey, sizeof(dupeKey)))
 		{
-			fileInfo->GetArticles()->push_back(std::make_unique<ArticleInfo>());
+			break;
 		}
-		std::unique_ptr<ArticleInfo>& pa = fileInfo->GetArticles()->at(i);
 
-		int statusInt;
+		int64 recordOffset = infile->Position();
+		if (recordOffset + recordLength > fileSize)
+		{
+			break;
+		}
 
-		if (formatVersion >= 2)
+		if (kind == HistoryInfo::hkUnknown)
 		{
-			uint32 segmentOffset, crc;
-			int segmentSize;
-			if (infile.ScanLine("%i,%u,%i,%u", &statusInt, &segmentOffset, &segmentSize, &crc) != 4) goto error;
-			pa->SetSegmentOffset(segmentOffset);
-			pa->SetSegmentSize(segmentSize);
-			pa->SetCrc(crc);
+			entries.erase(id);
 		}
 		else
 		{
-			if (infile.ScanLine("%i", &statusInt) != 1) goto error;
+			std::unique_ptr<ArchiveInfo> archiveInfo = std::make_unique<ArchiveInfo>(id,
+				(HistoryInfo::EKind)kind, (time_t)time);
+			archiveInfo->SetName(name);
+			archiveInfo->SetDupeKey(dupeKey);
+			archiveInfo->SetFullContentHash(fullContentHash);
+			archiveInfo->SetFilteredContentHash(filteredContentHash);
+			archiveInfo->SetFileIds(minFileId, maxFileId);
+			archiveInfo->SetLocation(offset, (int)(recordOffset + recordLength - offset));
+			entries[id] = std::move(archiveInfo);
 		}
 
-		ArticleInfo::EStatus status = (ArticleInfo::EStatus)statusInt;
+		offset = recordOffset + recordLength;
+		infile->Seek(offset);
+	}
+
+	infile->Close();
 
-		if (status == ArticleInfo::aiRunning)
+	std::vector<std::unique_ptr<ArchiveInfo>> sorted;
+	for (auto& entry : entries)
+	{
+		if (!downloadQueue->GetHistory()->Find(entry.first))
 		{
-			status = ArticleInfo::aiUndefined;
+			sorted.push_back(std::move(entry.second));
 		}
+	}
 
-		// don't allow all articles be completed or the file will stuck.
-		// such states should never be saved on disk but just in case.
-		if (completedArticles == size - 1 && !completed)
-		{
-			status = ArticleInfo::aiUndefined;
-		}
-		if (status != ArticleInfo::aiUndefined)
+	std::sort(sorted.begin(), sorted.end(),
+		[](const std::unique_ptr<ArchiveInfo>& info1, const std::unique_ptr<ArchiveInfo>& info2)
 		{
-			completedArticles++;
-		}
+			return info1->GetTime() > info2->GetTime() ||
+				(info1->GetTime() == info2->GetTime() && info1->GetOffset() > info2->GetOffset());
+		});
 
-		pa->SetStatus(status);
+	for (std::unique_ptr<ArchiveInfo>& archiveInfo : sorted)
+	{
+		archive->push_back(std::move(archiveInfo));
 	}
 
-	fileInfo->SetCompletedArticles(completedArticles);
+	m_archiveSize = fileSize;
 
-	infile.Close();
-	return true;
+	if (offset < fileSize)
+	{
+		// the last record wasn't completely written, new records must not follow it
+		warn("History archive is damaged, rewriting it");
+		RewriteArchive(archive);
+	}
 
-error:
-	infile.Close();
-	error("Error reading diskstate for file %i", fileInfo->GetId());
-	return false;
+	return true;
 }
 
-void DiskState::DiscardFiles(NzbInfo* nzbInfo, bool deleteLog)
+/*
+ * Loads the record at the known position. The positions are changed only
+ * by "CompactHistoryArchive" under the queue lock.
+ */
+std::unique_ptr<HistoryInfo> DiskState::LoadArchivedHistory(ArchiveInfo* archiveInfo, Servers* servers)
 {
-	for (FileInfo* fileInfo : nzbInfo->GetFileList())
+	Guard guard(m_archiveMutex);
+
+	StateFile stateFile("archive", 59, true);
+	m_writer.WaitCompleted(stateFile.GetDestFilename());
+
+	std::unique_ptr<HistoryInfo> historyInfo;
+	StateDiskFile* infile = stateFile.BeginRead();
+	if (infile)
 	{
-		DiscardFile(fileInfo->GetId(), true, true, true);
+		char buf[10240];
+		int id;
+		infile->Seek(archiveInfo->GetOffset());
+		if (infile->ScanLine("%i,", &id) == 1 && id == archiveInfo->GetId() &&
+			infile->ReadLine(buf, sizeof(buf)) && infile->ReadLine(buf, sizeof(buf)))
+		{
+			historyInfo = LoadHistoryItem(servers, *infile, stateFile.GetFileVersion());
+		}
+		infile->Close();
+	}
+
+	if (!historyInfo || historyInfo->GetId() != archiveInfo->GetId() ||
+		historyInfo->GetKind() != archiveInfo->GetKind())
+	{
+		error("Could not load archived history entry %s", archiveInfo->GetName());
+		return nullptr;
 	}
 
-	for (CompletedFile& completedFile : nzbInfo->GetCompletedFiles())
+	return historyInfo;
+}
+
+/*
+ * Removals are written after the history, which has got the entries restored
+ * from the archive. If the program is interrupted in between, the entries exist
+ * in both files and the history is used.
+ */
+void DiskState::SaveArchiveRemovals(ArchiveList* archive)
+{
+	StringBuilder content;
+	for (int id : m_archiveRemoved)
 	{
-		if (completedFile.GetStatus() != CompletedFile::cfSuccess)
+		if (!archive->Find(id))
 		{
-			DiscardFile(completedFile.GetId(), true, true, true);
+			ArchiveInfo removed(id, HistoryInfo::hkUnknown, 0);
+			AppendArchiveHeader(content, &removed, 0);
 		}
 	}
+	m_archiveRemoved.clear();
 
-	if (deleteLog)
+	if (m_archiveSize > 0 && content.Length() > 0)
 	{
-		BString<1024> filename;
-		filename.Format("%s%cn%i.log", g_Options->GetQueueDir(), PATH_SEPARATOR, nzbInfo->GetId());
-		FileSystem::DeleteFile(filename);
+		m_writer.Write(StateFile("archive", 59, true).GetDestFilename(), content, content.Length(),
+			false, true, false);
+		m_archiveSize += content.Length();
 	}
 }
 
-void DiskState::SaveDupInfo(DupInfo* dupInfo, StateDiskFile& outfile)
-{
-	uint32 High, Low;
-	Util::SplitInt64(dupInfo->GetSize(), &High, &Low);
-	outfile.PrintLine("%i,%u,%u,%u,%u,%i,%i", (int)dupInfo->GetStatus(), High, Low,
-		dupInfo->GetFullContentHash(), dupInfo->GetFilteredContentHash(),
-		dupInfo->GetDupeScore(), (int)dupInfo->GetDupeMode());
-	outfile.PrintLine("%s", dupInfo->GetName());
-	outfile.PrintLine("%s", dupInfo->GetDupeKey());
-}
-
-bool DiskState::LoadDupInfo(DupInfo* dupInfo, StateDiskFile& infile, int formatVersion)
+/*
+ * Records of superseded and removed entries remain in the archive until it's rewritten,
+ * that happens once they occupy most of the archive. The archive isn't rewritten while
+ * removals aren't saved, because the history may not have the restored entries yet.
+ */
+void DiskState::CompactHistoryArchive(ArchiveList* archive)
 {
-	char buf[1024];
-
-	int status;
-	uint32 High, Low;
-	uint32 fullContentHash, filteredContentHash = 0;
-	int dupeScore, dupeMode;
-	if (infile.ScanLine("%i,%u,%u,%u,%u,%i,%i", &status, &High, &Low, &fullContentHash, &filteredContentHash, &dupeScore, &dupeMode) != 7) goto error;
-
-	dupInfo->SetStatus((DupInfo::EStatus)status);
-	dupInfo->SetFullContentHash(fullContentHash);
-	dupInfo->SetFilteredContentHash(filteredContentHash);
-	dupInfo->SetSize(Util::JoinInt64(High, Low));
-	dupInfo->SetDupeScore(dupeScore);
-	dupInfo->SetDupeMode((EDupeMode)dupeMode);
+	if (!m_archiveRemoved.empty())
+	{
+		return;
+	}
 
-	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-	dupInfo->SetName(buf);
+	int64 usedSize = 0;
+	for (ArchiveInfo* archiveInfo : archive)
+	{
+		usedSize += archiveInfo->GetSize();
+	}
 
-	if (!infile.ReadLine(buf, sizeof(buf))) goto error;
-	dupInfo->SetDupeKey(buf);
+	StateFile stateFile("archive", 59, true);
 
-	return true;
+	if (archive->empty())
+	{
+		if (m_archiveSize > 0)
+		{
+			m_writer.Delete(stateFile.GetDestFilename(), false);
+			m_archiveSize = 0;
+		}
+		return;
+	}
 
-error:
-	return false;
+	if (m_archiveSize > std::max(ARCHIVE_MIN_COMPACT_SIZE, usedSize * 2))
+	{
+		debug("Compacting history archive");
+		RewriteArchive(archive);
+	}
 }
 
-void DiskState::SaveHistory(HistoryList* history, StateDiskFile& outfile)
+void DiskState::RewriteArchive(ArchiveList* archive)
 {
-	debug("Saving history to disk");
+	StateFile stateFile("archive", 59, true);
 
-	outfile.PrintLine("%i", (int)history->size());
-	for (HistoryInfo* historyInfo : history)
+	if (archive->empty())
 	{
-		outfile.PrintLine("%i,%i,%i", historyInfo->GetId(), (int)historyInfo->GetKind(), (int)historyInfo->GetTime());
-
-		if (historyInfo->GetKind() == HistoryInfo::hkNzb || historyInfo->GetKind() == HistoryInfo::hkUrl)
-		{
-			SaveNzbInfo(historyInfo->GetNzbInfo(), outfile);
-		}
-		else if (historyInfo->GetKind() == HistoryInfo::hkDup)
-		{
-			SaveDupInfo(historyInfo->GetDupInfo(), outfile);
-		}
+		m_writer.Delete(stateFile.GetDestFilename(), false);
+		m_archiveSize = 0;
+		return;
 	}
-}
 
-bool DiskState::LoadHistory(HistoryList* history, Servers* servers, StateDiskFile& infile, int formatVersion)
-{
-	debug("Loading history from disk");
+	Guard guard(m_archiveMutex);
+	m_writer.WaitCompleted(stateFile.GetDestFilename());
 
-	int size;
-	if (infile.ScanLine("%i", &size) != 1) goto error;
-	for (int i = 0; i < size; i++)
+	StateDiskFile* infile = stateFile.BeginRead();
+	if (!infile)
 	{
-		std::unique_ptr<HistoryInfo> historyInfo;
-		HistoryInfo::EKind kind = HistoryInfo::hkNzb;
-		int id = 0;
-		int time;
+		return;
+	}
 
-		int kindval = 0;
-		if (infile.ScanLine("%i,%i,%i", &id, &kindval, &time) != 3) goto error;
-		kind = (HistoryInfo::EKind)kindval;
+	StringBuilder content;
+	content.AppendFmt("%s%i\n", FORMATVERSION_SIGNATURE, 59);
+	std::vector<std::pair<ArchiveInfo*, int64>> offsets;
+	std::vector<ArchiveInfo*> lostEntries;
 
-		if (kind == HistoryInfo::hkNzb)
-		{
-			std::unique_ptr<NzbInfo> nzbInfo = std::make_unique<NzbInfo>();
-			if (!LoadNzbInfo(nzbInfo.get(), servers, infile, formatVersion)) goto error;
-			nzbInfo->LeavePostProcess();
-			historyInfo = std::make_unique<HistoryInfo>(std::move(nzbInfo));
-		}
-		else if (kind == HistoryInfo::hkUrl)
-		{
-			std::unique_ptr<NzbInfo> nzbInfo = std::make_unique<NzbInfo>();
-			if (!LoadNzbInfo(nzbInfo.get(), servers, infile, formatVersion)) goto error;
-			historyInfo = std::make_unique<HistoryInfo>(std::move(nzbInfo));
-		}
-		else if (kind == HistoryInfo::hkDup)
+	for (ArchiveInfo* archiveInfo : archive)
+	{
+		CharBuffer record(archiveInfo->GetSize() + 1);
+		int id;
+		infile->Seek(archiveInfo->GetOffset());
+		bool found = infile->Read(record, archiveInfo->GetSize()) == archiveInfo->GetSize();
+		record[found ? archiveInfo->GetSize() : 0] = '\0';
+		found = found && sscanf(record, "%i,", &id) == 1 && id == archiveInfo->GetId();
+
+		if (!found)
 		{
-			std::unique_ptr<DupInfo> dupInfo = std::make_unique<DupInfo>();
-			if (!LoadDupInfo(dupInfo.get(), infile, formatVersion)) goto error;
-			dupInfo->SetId(id);
-			historyInfo = std::make_unique<HistoryInfo>(std::move(dupInfo));
+			error("Could not find archived history entry %s", archiveInfo->GetName());
+			lostEntries.push_back(archiveInfo);
+			continue;
 		}
 
-		historyInfo->SetTime((time_t)time);
-
-		history->push_back(std::move(historyInfo));
+		offsets.emplace_back(archiveInfo, content.Length());
+		content.Append(record, archiveInfo->GetSize());
 	}
 
-	return true;
+	infile->Close();
 
-error:
-	error("Error reading diskstate for history");
-	return false;
+	m_writer.Write(stateFile.GetDestFilename(), content, content.Length(), true, false, false);
+	m_archiveSize = content.Length();
+
+	for (std::pair<ArchiveInfo*, int64>& offset : offsets)
+	{
+		offset.first->SetLocation(offset.second, offset.first->GetSize());
+	}
+
+	for (ArchiveInfo* archiveInfo : lostEntries)
+	{
+		archive->Remove(archiveInfo);
+	}
 }
 
 /*
@@ -1238,12 +2729,23 @@ void DiskState::DiscardDownloadQueue()
 {
 	debug("Discarding queue");
 
+	m_writer.WaitCompleted();
+
 	BString<1024> fullFilename("%s%c%s", g_Options->GetQueueDir(), PATH_SEPARATOR, "queue");
 	FileSystem::DeleteFile(fullFilename);
 
 	fullFilename.Format("%s%c%s", g_Options->GetQueueDir(), PATH_SEPARATOR, "history");
 	FileSystem::DeleteFile(fullFilename);
 
+	fullFilename.Format("%s%c%s", g_Options->GetQueueDir(), PATH_SEPARATOR, "journal");
+	FileSystem::DeleteFile(fullFilename);
+	m_journalActive = false;
+
+	fullFilename.Format("%s%c%s", g_Options->GetQueueDir(), PATH_SEPARATOR, "archive");
+	FileSystem::DeleteFile(fullFilename);
+	m_archiveSize = 0;
+	m_archiveRemoved.clear();
+
 	DirBrowser dir(g_Options->GetQueueDir());
 	while (const char* filename = dir.Next())
 	{
@@ -1277,8 +2779,11 @@ bool DiskState::DownloadQueueExists()
 {
 	debug("Checking if a saved queue exists on disk");
 
+	m_writer.WaitCompleted();
+
 	return FileSystem::FileExists(BString<1024>("%s%c%s", g_Options->GetQueueDir(), PATH_SEPARATOR, "queue")) ||
-		FileSystem::FileExists(BString<1024>("%s%c%s", g_Options->GetQueueDir(), PATH_SEPARATOR, "history"));
+		FileSystem::FileExists(BString<1024>("%s%c%s", g_Options->GetQueueDir(), PATH_SEPARATOR, "history")) ||
+		FileSystem::FileExists(BString<1024>("%s%c%s", g_Options->GetQueueDir(), PATH_SEPARATOR, "journal"));
 }
 
 void DiskState::DiscardFile(int fileId, bool deleteData, bool deletePartialState, bool deleteCompletedState)
@@ -1289,21 +2794,21 @@ void DiskState::DiscardFile(int fileId, bool deleteData, bool deletePartialState
 	if (deleteData)
 	{
 		fileName.Format("%s%c%i", g_Options->GetQueueDir(), PATH_SEPARATOR, fileId);
-		FileSystem::DeleteFile(fileName);
+		m_writer.Delete(fileName, false);
 	}
 
 	// partial state file
 	if (deletePartialState)
 	{
 		fileName.Format("%s%c%is", g_Options->GetQueueDir(), PATH_SEPARATOR, fileId);
-		FileSystem::DeleteFile(fileName);
+		m_writer.Delete(fileName, false);
 	}
 
 	// completed state file
 	if (deleteCompletedState)
 	{
 		fileName.Format("%s%c%ic", g_Options->GetQueueDir(), PATH_SEPARATOR, fileId);
-		FileSystem::DeleteFile(fileName);
+		m_writer.Delete(fileName, false);
 	}
 }
 
@@ -1326,6 +2831,58 @@ void DiskState::CleanupQueueDir(DownloadQueue* downloadQueue)
 {
 	int deletedFiles = 0;
 
+	std::set<int> fileIds;
+	std::set<int> nzbIds;
+
+	auto addNzb = [&fileIds, &nzbIds](NzbInfo* nzbInfo)
+	{
+		nzbIds.insert(nzbInfo->GetId());
+		for (FileInfo* fileInfo : nzbInfo->GetFileList())
+		{
+			fileIds.insert(fileInfo->GetId());
+		}
+		for (CompletedFile& completedFile : nzbInfo->GetCompletedFiles())
+		{
+			fileIds.insert(completedFile.GetId());
+		}
+	};
+
+	for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
+	{
+		addNzb(nzbInfo);
+	}
+
+	for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
+	{
+		if (historyInfo->GetKind() == HistoryInfo::hkNzb)
+		{
+			addNzb(historyInfo->GetNzbInfo());
+		}
+	}
+
+	// archived entries have only the ranges of their file ids in memory
+	std::vector<std::pair<int, int>> fileRanges;
+	for (ArchiveInfo* archiveInfo : downloadQueue->GetArchive())
+	{
+		nzbIds.insert(archiveInfo->GetId());
+		if (archiveInfo->GetMinFileId() > 0)
+		{
+			fileRanges.emplace_back(archiveInfo->GetMinFileId(), archiveInfo->GetMaxFileId());
+		}
+	}
+	std::sort(fileRanges.begin(), fileRanges.end());
+	for (uint32 i = 1; i < fileRanges.size(); i++)
+	{
+		// each range covers the preceding ones, making the check below a single lookup
+		fileRanges[i].second = std::max(fileRanges[i].second, fileRanges[i - 1].second);
+	}
+
+	auto archivedFile = [&fileRanges](int id)
+	{
+		auto it = std::upper_bound(fileRanges.begin(), fileRanges.end(), std::make_pair(id, INT_MAX));
+		return it != fileRanges.begin() && (it - 1)->second >= id;
+	};
+
 	DirBrowser dir(g_Options->GetQueueDir());
 	while (const char* filename = dir.Next())
 	{
@@ -1336,74 +2893,11 @@ void DiskState::CleanupQueueDir(DownloadQueue* downloadQueue)
 		if ((sscanf(filename, "%i%c", &id, &suffix) == 2 && (suffix == 's' || suffix == 'c')) ||
 			(sscanf(filename, "%i", &id) == 1 && !strchr(filename, '.')))
 		{
-			for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
-			{
-				for (FileInfo* fileInfo : nzbInfo->GetFileList())
-				{
-					if (fileInfo->GetId() == id)
-					{
-						goto next;
-					}
-				}
-
-				for (CompletedFile& completedFile : nzbInfo->GetCompletedFiles())
-				{
-					if (completedFile.GetId() == id)
-					{
-						goto next;
-					}
-				}
-			}
-
-			for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
-			{
-				if (historyInfo->GetKind() == HistoryInfo::hkNzb)
-				{
-					NzbInfo* nzbInfo = historyInfo->GetNzbInfo();
-
-					for (FileInfo* fileInfo : nzbInfo->GetFileList())
-					{
-						if (fileInfo->GetId() == id)
-						{
-							goto next;
-						}
-					}
-
-					for (CompletedFile& completedFile : nzbInfo->GetCompletedFiles())
-					{
-						if (completedFile.GetId() == id)
-						{
-							goto next;
-						}
-					}
-				}
-			}
-
-			del = true;
+			del = fileIds.find(id) == fileIds.end() && !archivedFile(id);
 		}
-
-		if (!del && sscanf(filename, "n%i.log", &id) == 1)
+		else if (sscanf(filename, "n%i.log", &id) == 1)
 		{
-			for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
-			{
-				if (nzbInfo->GetId() == id)
-				{
-					goto next;
-				}
-			}
-
-			for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
-			{
-				if (historyInfo->GetKind() == HistoryInfo::hkNzb)
-				{
-					if (historyInfo->GetNzbInfo()->GetId() == id)
-					{
-						goto next;
-					}
-				}
-			}
-
-			del = true;
+			del = nzbIds.find(id) == nzbIds.end();
 		}
 
 		if (del)
@@ -1413,8 +2907,6 @@ void DiskState::CleanupQueueDir(DownloadQueue* downloadQueue)
 			FileSystem::DeleteFile(fullFilename);
 			deletedFiles++;
 		}
-
-		next:;
 	}
 
 	if (deletedFiles > 0)
@@ -1602,11 +3094,69 @@ void DiskState::CalcFileStats(DownloadQueue* downloadQueue, int formatVersion)
 	}
 }
 
-bool DiskState::LoadAllFileStates(DownloadQueue* downloadQueue, Servers* servers)
+/*
+ * Helper thread loading file infos and file states at startup, see "LoadAllFiles"
+ */
+class FileLoader : public Thread
+{
+public:
+	FileLoader(DiskState* owner, DiskState::FileLoadContext* context) : m_owner(owner), m_context(context) {}
+
+protected:
+	virtual void Run();
+
+private:
+	DiskState* m_owner;
+	DiskState::FileLoadContext* m_context;
+};
+
+void FileLoader::Run()
+{
+	m_owner->ProcessFileLoadJobs(m_context);
+
+	Guard guard(m_context->mutex);
+	m_context->runningLoaders--;
+	m_context->loadersFinished.NotifyAll();
+}
+
+/*
+ * Loads file infos (if "fileSummary" is set) for all files of the queue. The files are
+ * loaded by several threads; the jobs are taken in queue order, files of history come last.
+ * File states are only detected here and loaded later by LoadFileStates. Articles aren't
+ * loaded either, they are read on demand together with the file state when the file is
+ * downloaded.
+ */
+bool DiskState::LoadAllFiles(DownloadQueue* downloadQueue, bool fileSummary)
 {
 	BString<1024> cacheFlagFilename("%s%c%s", g_Options->GetQueueDir(), PATH_SEPARATOR, "acache");
 	bool cacheWasActive = FileSystem::FileExists(cacheFlagFilename);
 
+	FileLoadContext context;
+
+	std::map<int, int> queueFiles; // file id -> job index
+	for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
+	{
+		for (FileInfo* fileInfo : nzbInfo->GetFileList())
+		{
+			queueFiles[fileInfo->GetId()] = (int)context.jobs.size();
+			context.jobs.push_back({fileInfo, fileSummary, 0, true});
+		}
+	}
+
+	if (fileSummary)
+	{
+		for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
+		{
+			if (historyInfo->GetKind() == HistoryInfo::hkNzb)
+			{
+				for (FileInfo* fileInfo : historyInfo->GetNzbInfo()->GetFileList())
+				{
+					context.jobs.push_back({fileInfo, true, 0, true});
+				}
+			}
+		}
+	}
+
 	DirBrowser dir(g_Options->GetQueueDir());
 	while (const char* filename = dir.Next())
 	{
@@ -1616,18 +3166,10 @@ bool DiskState::LoadAllFileStates(DownloadQueue* downloadQueue, Servers* servers
 		{
 			if (suffix == 'c' || (suffix == 's' && g_Options->GetContinuePartial() && !cacheWasActive))
 			{
-				for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
+				std::map<int, int>::iterator it = queueFiles.find(id);
+				if (it != queueFiles.end())
 				{
-					for (FileInfo* fileInfo : nzbInfo->GetFileList())
-					{
-						if (fileInfo->GetId() == id)
-						{
-							if (!LoadFileState(fileInfo, servers, suffix == 'c')) goto error;
-							fileInfo->GetArticles()->clear();
-							fileInfo->SetPartialState(suffix == 'c' ? FileInfo::psCompleted : FileInfo::psPartial);
-							goto next;
-						}
-					}
+					context.jobs[it->second].stateSuffix = suffix;
 				}
 			}
 			else
@@ -1636,13 +3178,146 @@ bool DiskState::LoadAllFileStates(DownloadQueue* downloadQueue, Servers* servers
 				FileSystem::DeleteFile(fullFilename);
 			}
 		}
-		next:;
+	}
+
+	if (!fileSummary)
+	{
+		context.jobs.erase(std::remove_if(context.jobs.begin(), context.jobs.end(),
+			[](FileLoadJob& job) { return job.stateSuffix == 0; }), context.jobs.end());
+	}
+
+	int loaderCount = std::min(std::min(Util::NumberOfCpuCores(), MAX_FILE_LOADERS),
+		(int)context.jobs.size() / MIN_JOBS_PER_FILE_LOADER);
+	// the current thread is also loading
+	loaderCount--;
+
+	context.runningLoaders = std::max(loaderCount, 0);
+	for (int i = 0; i < loaderCount; i++)
+	{
+		FileLoader* loader = new FileLoader(this, &context);
+		loader->SetAutoDestroy(true);
+		loader->Start();
+	}
+
+	ProcessFileLoadJobs(&context);
+
+	{
+		Guard guard(context.mutex);
+		while (context.runningLoaders > 0)
+		{
+			context.loadersFinished.Wait(context.mutex);
+		}
+	}
+
+	m_fileStateJobs.clear();
+	for (FileLoadJob& job : context.jobs)
+	{
+		if (!job.summaryLoaded)
+		{
+			// same as for older formats: files without file info are dropped from queue
+			job.fileInfo->GetNzbInfo()->GetFileList()->Remove(job.fileInfo);
+		}
+		else if (job.stateSuffix)
+		{
+			job.fileInfo->SetPartialState(job.stateSuffix == 'c' ? FileInfo::psCompleted : FileInfo::psPartial);
+			m_fileStateJobs.push_back({job.fileInfo->GetId(), job.stateSuffix == 'c'});
+		}
 	}
 
 	return true;
+}
 
-error:
-	return false;
+void DiskState::ProcessFileLoadJobs(FileLoadContext* context)
+{
+	while (true)
+	{
+		FileLoadJob* job;
+		{
+			Guard guard(context->mutex);
+			if (context->nextJob == (int)context->jobs.size())
+			{
+				return;
+			}
+			job = &context->jobs[context->nextJob++];
+		}
+
+		job->summaryLoaded = !job->summary || LoadFile(job->fileInfo, true, false);
+	}
+}
+
+void FileStateLoader::Run()
+{
+	m_owner->LoadFileStates(m_servers);
+}
+
+void DiskState::StartStateLoader(Servers* servers)
+{
+	if (!m_fileStateJobs.empty())
+	{
+		m_stateLoader.SetServers(servers);
+		m_stateLoader.Start();
+	}
+}
+
+void DiskState::StopStateLoader()
+{
+	m_stateLoader.Stop();
+	while (m_stateLoader.IsRunning())
+	{
+		usleep(10 * 1000);
+	}
+}
+
+/*
+ * Second phase of loading. The progress of partially downloaded files is needed only
+ * for statistics until the files are downloaded. The states are read without holding
+ * the queue lock and are then applied in batches. A file picked for download before
+ * has already got its state together with articles (QueueCoordinator::LoadPartialState).
+ */
+void DiskState::LoadFileStates(Servers* servers)
+{
+	std::vector<FileStateJob> jobs = std::move(m_fileStateJobs);
+	std::vector<std::unique_ptr<FileInfo>> states;
+
+	for (int i = 0; i < (int)jobs.size() && !m_stateLoader.IsStopped(); i++)
+	{
+		FileStateJob& job = jobs[i];
+		std::unique_ptr<FileInfo> fileInfo = std::make_unique<FileInfo>(job.fileId);
+		if (LoadFileState(fileInfo.get(), servers, job.completed, false))
+		{
+			states.push_back(std::move(fileInfo));
+		}
+
+		if ((int)states.size() < FILE_STATES_PER_BATCH && i < (int)jobs.size() - 1)
+		{
+			continue;
+		}
+
+		GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+		std::set<NzbInfo*> changedNzbs;
+		for (std::unique_ptr<FileInfo>& state : states)
+		{
+			FileInfo* queuedInfo = downloadQueue->FindFile(state->GetId());
+			if (queuedInfo && queuedInfo->GetArticles()->empty())
+			{
+				queuedInfo->SetSuccessArticles(state->GetSuccessArticles());
+				queuedInfo->SetFailedArticles(state->GetFailedArticles());
+				queuedInfo->SetCompletedArticles(state->GetCompletedArticles());
+				queuedInfo->SetRemainingSize(state->GetRemainingSize());
+				queuedInfo->SetSuccessSize(state->GetSuccessSize());
+				queuedInfo->SetFailedSize(state->GetFailedSize());
+				queuedInfo->SetFilename(state->GetFilename());
+				queuedInfo->GetServerStats()->ListOp(state->GetServerStats(), ServerStatList::soSet);
+				changedNzbs.insert(queuedInfo->GetNzbInfo());
+			}
+		}
+		states.clear();
+
+		for (NzbInfo* nzbInfo : changedNzbs)
+		{
+			nzbInfo->UpdateCurrentStats();
+		}
+	}
 }
 
 bool DiskState::SaveStats(Servers* servers, ServerVolumes* serverVolumes)
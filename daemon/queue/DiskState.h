@@ -26,15 +26,107 @@
 #include "NewsServer.h"
 #include "StatMeter.h"
 #include "FileSystem.h"
+#include "Thread.h"
 #include "Log.h"
 
 class StateDiskFile;
+class StateBinaryWriter;
+class StateBinaryReader;
+class DiskState;
+
+/*
+ * Writes and deletes diskstate files on a background thread in the order
+ * the jobs were queued. If the thread isn't running jobs are executed
+ * immediately by the calling thread.
+ */
+class StateWriter : public Thread
+{
+public:
+	enum EJobKind
+	{
+		jkWrite,
+		jkReplace,
+		jkAppend,
+		jkDelete
+	};
+
+	typedef std::shared_ptr<CString> Record;
+	typedef std::vector<Record> RecordList;
+
+	/* File content is the data followed by the records, records are shared and not copied */
+	struct Job
+	{
+		EJobKind kind;
+		CString filename;
+		CharBuffer data;
+		RecordList records;
+		bool flush;
+		bool afterSuccess;
+	};
+
+	typedef std::vector<std::unique_ptr<Job>> JobList;
+
+	virtual void Start();
+	virtual void Stop();
+	void Write(const char* filename, const char* data, int size, bool transactional, bool append, bool afterSuccess);
+	void Delete(const char* filename, bool afterSuccess);
+	static std::unique_ptr<Job> MakeWrite(const char* filename, const char* data, int size,
+		bool transactional, bool append, bool afterSuccess);
+	static std::unique_ptr<Job> MakeDelete(const char* filename, bool afterSuccess);
+	/* Queues the jobs at once. Pending jobs for the same files are dropped unless the new
+	 * job appends to the file, the new job overwrites the file anyway. */
+	void Enqueue(JobList jobs);
+	/* Wait until pending jobs for the file (or all jobs if filename is nullptr) are completed */
+	void WaitCompleted(const char* filename = nullptr);
+	/* Returns true if a job has failed since the last call */
+	bool ResetFailed();
+
+protected:
+	virtual void Run();
+
+private:
+	typedef std::deque<std::unique_ptr<Job>> JobQueue;
+
+	JobQueue m_jobs;
+	Mutex m_jobsMutex;
+	ConditionVar m_jobsCond;
+	bool m_active = false;
+	bool m_failed = false;
+	CString m_activeFilename;
+
+	bool Execute(Job* job);
+	bool IsPending(const char* filename);
+};
+
+/*
+ * Loads file states after the queue is loaded, see DiskState::LoadFileStates.
+ */
+class FileStateLoader : public Thread
+{
+public:
+	FileStateLoader(DiskState* owner) : m_owner(owner) {}
+	void SetServers(Servers* servers) { m_servers = servers; }
+
+protected:
+	virtual void Run();
+
+private:
+	DiskState* m_owner;
+	Servers* m_servers = nullptr;
+};
 
 class DiskState
 {
 public:
+	void StartWriter() { m_writer.Start(); }
+	void StopWriter();
+	/* Loads file states of queued files in background after LoadDownloadQueue */
+	void StartStateLoader(Servers* servers);
+	void StopStateLoader();
+	void LoadFileStates(Servers* servers);
 	bool DownloadQueueExists();
-	bool SaveDownloadQueue(DownloadQueue* downloadQueue, bool saveHistory);
+	/* Only records of changed items are serialized if changedIds are given, see AppendJournal */
+	bool SaveDownloadQueue(DownloadQueue* downloadQueue, bool saveHistory, IdList* changedIds = nullptr);
 	bool LoadDownloadQueue(DownloadQueue* downloadQueue, Servers* servers);
 	bool SaveFile(FileInfo* fileInfo);
 	bool LoadFile(FileInfo* fileInfo, bool fileSummary, bool articles);
@@ -53,20 +145,98 @@ public:
 	void DeleteCacheFlag();
 	void AppendNzbMessage(int nzbId, Message::EKind kind, const char* text);
 	void LoadNzbMessages(int nzbId, MessageList* messages);
+	/* Writes history entry into history archive, the caller replaces the entry with the returned one */
+	std::unique_ptr<ArchiveInfo> ArchiveHistory(HistoryInfo* historyInfo);
+	/* Loads archived history entry, the archive isn't changed */
+	std::unique_ptr<HistoryInfo> LoadArchivedHistory(ArchiveInfo* archiveInfo, Servers* servers);
+	/* Records removal of entry from the archive, it's written on the next save of the history */
+	void RemoveArchived(int id) { m_archiveRemoved.push_back(id); }
+	void CompactHistoryArchive(ArchiveList* archive);
 
 private:
-	bool SaveFileInfo(FileInfo* fileInfo, StateDiskFile& outfile);
+	struct JournalRecord
+	{
+		StateWriter::Record data;
+		uint32 hash;
+	};
+
+	/* Saved records of queue or history items, reused for snapshots */
+	struct JournalState
+	{
+		typedef std::map<int, JournalRecord> RecordMap;
+		RecordMap records;
+		std::vector<int> order;
+		int64 size = 0;
+		void Add(int id, StringBuilder& record);
+		void Keep(int id, JournalState& savedState);
+		bool NeedsSave(int id, IdList* changedIds);
+	};
+
+	struct FileLoadJob
+	{
+		FileInfo* fileInfo;
+		bool summary;
+		char stateSuffix;
+		bool summaryLoaded;
+	};
+
+	struct FileLoadContext
+	{
+		std::vector<FileLoadJob> jobs;
+		Mutex mutex;
+		ConditionVar loadersFinished;
+		int nextJob = 0;
+		int runningLoaders = 0;
+	};
+
+	struct FileStateJob
+	{
+		int fileId;
+		bool completed;
+	};
+
+	StateWriter m_writer;
+	FileStateLoader m_stateLoader{this};
+	std::vector<FileStateJob> m_fileStateJobs;
+	JournalState m_queueJournal;
+	JournalState m_historyJournal;
+	bool m_journalActive = false;
+	int64 m_journalSize = 0;
+	int64 m_snapshotSize = 0;
+	int m_generation = 0;
+	int64 m_archiveSize = 0;
+	IdList m_archiveRemoved;
+	Mutex m_archiveMutex;
+
+	void SaveFileInfo(FileInfo* fileInfo, StateBinaryWriter& writer);
+	bool LoadFileInfo(FileInfo* fileInfo, StateBinaryReader& reader, bool fileSummary, bool articles);
 	bool LoadFileInfo(FileInfo* fileInfo, StateDiskFile& outfile, int formatVersion, bool fileSummary, bool articles);
-	bool SaveFileState(FileInfo* fileInfo, StateDiskFile& outfile, bool completed);
-	bool LoadFileState(FileInfo* fileInfo, Servers* servers, StateDiskFile& infile, int formatVersion, bool completed);
-	void SaveQueue(NzbList* queue, StateDiskFile& outfile);
+	void SaveFileState(FileInfo* fileInfo, StateBinaryWriter& writer, bool completed);
+	bool LoadFileState(FileInfo* fileInfo, Servers* servers, bool completed, bool articles);
+	bool LoadFileState(FileInfo* fileInfo, Servers* servers, StateBinaryReader& reader,
+		bool completed, bool articles);
+	bool LoadFileState(FileInfo* fileInfo, Servers* servers, StateDiskFile& infile, int formatVersion,
+		bool completed, bool articles);
+	ArticleInfo::EStatus RestoreArticleStatus(int statusInt, int& completedArticles, int articleCount, bool completed);
+	void SaveSnapshot(JournalState& queueState, JournalState& historyState);
+	std::unique_ptr<StateWriter::Job> MakeSnapshotJob(const char* filename, JournalState& journalState);
+	void AppendJournal(JournalState& queueState, JournalState& historyState);
+	void JournalChanges(const char* listName, JournalState& oldState, JournalState& newState, StringBuilder& batch);
+	bool LoadJournal(DownloadQueue* downloadQueue, Servers* servers, int queueGeneration, int historyGeneration);
+	void SaveQueue(NzbList* queue, JournalState& journalState, JournalState* savedState, IdList* changedIds);
 	bool LoadQueue(NzbList* queue, Servers* servers, StateDiskFile& infile, int formatVersion);
 	void SaveNzbInfo(NzbInfo* nzbInfo, StateDiskFile& outfile);
 	bool LoadNzbInfo(NzbInfo* nzbInfo, Servers* servers, StateDiskFile& infile, int formatVersion);
 	void SaveDupInfo(DupInfo* dupInfo, StateDiskFile& outfile);
 	bool LoadDupInfo(DupInfo* dupInfo, StateDiskFile& infile, int formatVersion);
-	void SaveHistory(HistoryList* history, StateDiskFile& outfile);
+	void SaveHistory(HistoryList* history, JournalState& journalState, JournalState* savedState, IdList* changedIds);
 	bool LoadHistory(HistoryList* history, Servers* servers, StateDiskFile& infile, int formatVersion);
+	void SaveHistoryItem(HistoryInfo* historyInfo, StateDiskFile& outfile);
+	std::unique_ptr<HistoryInfo> LoadHistoryItem(Servers* servers, StateDiskFile& infile, int formatVersion);
+	bool LoadArchive(DownloadQueue* downloadQueue);
+	void AppendArchiveHeader(StringBuilder& content, ArchiveInfo* archiveInfo, int recordLength);
+	void SaveArchiveRemovals(ArchiveList* archive);
+	void RewriteArchive(ArchiveList* archive);
 	bool SaveFeedStatus(Feeds* feeds, StateDiskFile& outfile);
 	bool LoadFeedStatus(Feeds* feeds, StateDiskFile& infile, int formatVersion);
 	bool SaveFeedHistory(FeedHistory* feedHistory, StateDiskFile& outfile);
@@ -76,10 +246,15 @@ private:
 	bool SaveVolumeStat(ServerVolumes* serverVolumes, StateDiskFile& outfile);
 	bool LoadVolumeStat(Servers* servers, ServerVolumes* serverVolumes, StateDiskFile& infile, int formatVersion);
 	void CalcFileStats(DownloadQueue* downloadQueue, int formatVersion);
-	bool LoadAllFileStates(DownloadQueue* downloadQueue, Servers* servers);
+	bool LoadAllFiles(DownloadQueue* downloadQueue, bool fileSummary);
+	void ProcessFileLoadJobs(FileLoadContext* context);
 	void SaveServerStats(ServerStatList* serverStatList, StateDiskFile& outfile);
 	bool LoadServerStats(ServerStatList* serverStatList, Servers* servers, StateDiskFile& infile);
+	void RestoreServerStat(ServerStatList* serverStatList, Servers* servers, int serverId,
+		int successArticles, int failedArticles);
 	void CleanupQueueDir(DownloadQueue* downloadQueue);
+
+	friend class FileLoader;
 };
 
 extern DiskState* g_DiskState;
@@ -26,6 +26,9 @@
 #include "Util.h"
 #include "FileSystem.h"
 
+static const int ARENA_MIN_CHUNK = 256;
+static const int ARENA_MAX_CHUNK = 64 * 1024;
+
 int FileInfo::m_idGen = 0;
 int FileInfo::m_idMax = 0;
 int NzbInfo::m_idGen = 0;
@@ -144,6 +147,17 @@ void ServerStatList::ListOp(ServerStatList* serverStats, EStatOperation statOper
 }
 
 
+NzbInfo::~NzbInfo()
+{
+	// removes the files from the file index of download queue
+	m_fileList.clear();
+}
+
+void NzbInfo::ItemChanged(int id)
+{
+	DownloadQueue::FileListChanged(this, id);
+}
+
 void NzbInfo::SetId(int id)
 {
 	m_id = id;
@@ -171,6 +185,30 @@ int NzbInfo::GenerateId()
 	return ++m_idGen;
 }
 
+void NzbInfo::SetName(const char* name)
+{
+	m_name = name;
+	DownloadQueue::DupeChanged(m_id);
+}
+
+void NzbInfo::SetDupeKey(const char* dupeKey)
+{
+	m_dupeKey = dupeKey ? dupeKey : "";
+	DownloadQueue::DupeChanged(m_id);
+}
+
+void NzbInfo::SetFullContentHash(uint32 fullContentHash)
+{
+	m_fullContentHash = fullContentHash;
+	DownloadQueue::DupeChanged(m_id);
+}
+
+void NzbInfo::SetFilteredContentHash(uint32 filteredContentHash)
+{
+	m_filteredContentHash = filteredContentHash;
+	DownloadQueue::DupeChanged(m_id);
+}
+
 void NzbInfo::SetUrl(const char* url)
 {
 	m_url = url;
@@ -739,6 +777,70 @@ void ArticleInfo::DiscardSegment()
 }
 
 
+ArticleInfo* ArticleList::Add(int partNumber, int size, const char* messageId)
+{
+	emplace_back();
+	ArticleInfo* article = &back();
+	article->m_partNumber = partNumber;
+	article->m_size = size;
+	article->m_messageId = StoreString(messageId);
+	return article;
+}
+
+void ArticleList::SetMessageId(ArticleInfo* article, const char* messageId)
+{
+	article->m_messageId = StoreString(messageId);
+}
+
+const char* ArticleList::StoreString(const char* str)
+{
+	int len = strlen(str) + 1;
+
+	if (m_chunks.empty() || m_chunkUsed + len > m_chunks.back().Size())
+	{
+		// chunks grow with the list to keep the unused tail small for files with few articles
+		int chunkSize = m_chunks.empty() ? ARENA_MIN_CHUNK :
+			std::min(m_chunks.back().Size() * 2, ARENA_MAX_CHUNK);
+		m_chunks.emplace_back(std::max(chunkSize, len));
+		m_chunkUsed = 0;
+	}
+
+	char* dest = m_chunks.back() + m_chunkUsed;
+	memcpy(dest, str, len);
+	m_chunkUsed += len;
+	return dest;
+}
+
+void ArticleList::RemoveEmpty()
+{
+	erase(std::remove_if(begin(), end(),
+		[](ArticleInfo& article)
+		{
+			return article.GetPartNumber() == 0;
+		}),
+		end());
+	shrink_to_fit();
+}
+
+void ArticleList::clear()
+{
+	// release the memory, not only the elements
+	ArticleListBase().swap(*this);
+	m_chunks.clear();
+	m_chunkUsed = 0;
+}
+
+int64 ArticleList::GetMemorySize()
+{
+	int64 size = capacity() * sizeof(ArticleInfo);
+	for (CharBuffer& chunk : m_chunks)
+	{
+		size += chunk.Size();
+	}
+	return size;
+}
+
+
 void FileInfo::SetId(int id)
 {
 	m_id = id;
@@ -802,6 +904,26 @@ CompletedFile::CompletedFile(int id, const char* fileName, EStatus status, uint3
 }
 
 
+ArchiveInfo::ArchiveInfo(int id, HistoryInfo::EKind kind, time_t time) :
+	m_id(id), m_kind(kind), m_time(time)
+{
+	if (NzbInfo::m_idMax < m_id)
+	{
+		NzbInfo::m_idMax = m_id;
+	}
+}
+
+void ArchiveInfo::SetFileIds(int minFileId, int maxFileId)
+{
+	m_minFileId = minFileId;
+	m_maxFileId = maxFileId;
+	if (FileInfo::m_idMax < m_maxFileId)
+	{
+		FileInfo::m_idMax = m_maxFileId;
+	}
+}
+
+
 void DupInfo::SetId(int id)
 {
 	m_id = id;
@@ -811,6 +933,30 @@ void DupInfo::SetId(int id)
 	}
 }
 
+void DupInfo::SetName(const char* name)
+{
+	m_name = name;
+	DownloadQueue::DupeChanged(m_id);
+}
+
+void DupInfo::SetDupeKey(const char* dupeKey)
+{
+	m_dupeKey = dupeKey;
+	DownloadQueue::DupeChanged(m_id);
+}
+
+void DupInfo::SetFullContentHash(uint32 fullContentHash)
+{
+	m_fullContentHash = fullContentHash;
+	DownloadQueue::DupeChanged(m_id);
+}
+
+void DupInfo::SetFilteredContentHash(uint32 filteredContentHash)
+{
+	m_filteredContentHash = filteredContentHash;
+	DownloadQueue::DupeChanged(m_id);
+}
+
 
 HistoryInfo::~HistoryInfo()
 {
@@ -826,7 +972,11 @@ HistoryInfo::~HistoryInfo()
 
 int HistoryInfo::GetId()
 {
-	if ((m_kind == hkNzb || m_kind == hkUrl))
+	if (!m_info)
+	{
+		return m_id;
+	}
+	else if ((m_kind == hkNzb || m_kind == hkUrl))
 	{
 		return ((NzbInfo*)m_info)->GetId();
 	}
@@ -860,6 +1010,7 @@ void DownloadQueue::CalcRemainingSize(int64* remaining, int64* remainingForced)
 
 	for (NzbInfo* nzbInfo : &m_queue)
 	{
+		::Guard stateGuard = nzbInfo->GuardDownloadState();
 		for (FileInfo* fileInfo : nzbInfo->GetFileList())
 		{
 			if (!fileInfo->GetPaused() && !fileInfo->GetDeleted())
@@ -880,3 +1031,64 @@ void DownloadQueue::CalcRemainingSize(int64* remaining, int64* remainingForced)
 		*remainingForced = remainingForcedSize;
 	}
 }
+
+void DownloadQueue::DupeChanged(int id)
+{
+	if (g_DownloadQueue)
+	{
+		g_DownloadQueue->RecordDupeChange(id);
+	}
+}
+
+void DownloadQueue::RecordDupeChange(int id)
+{
+	::Guard guard(m_dupeChangesMutex);
+	if (m_dupeTracking)
+	{
+		m_dupeChanges.insert(id);
+	}
+}
+
+IdList DownloadQueue::TakeDupeChanges()
+{
+	::Guard guard(m_dupeChangesMutex);
+	m_dupeTracking = true;
+	IdList changes(m_dupeChanges.begin(), m_dupeChanges.end());
+	m_dupeChanges.clear();
+	return changes;
+}
+
+FileInfo* DownloadQueue::FindFile(int id)
+{
+	::Guard guard(m_fileIndexMutex);
+
+	// the index contains files of all nzbs, not only of queued ones
+	FileIndex::iterator it = m_fileIndex.find(id);
+	NzbInfo* nzbInfo = it != m_fileIndex.end() ? m_queue.Find(it->second) : nullptr;
+	return nzbInfo ? nzbInfo->GetFileList()->Find(id) : nullptr;
+}
+
+void DownloadQueue::FileListChanged(NzbInfo* nzbInfo, int fileId)
+{
+	if (!g_DownloadQueue)
+	{
+		return;
+	}
+
+	::Guard guard(g_DownloadQueue->m_fileIndexMutex);
+	FileIndex& fileIndex = g_DownloadQueue->m_fileIndex;
+
+	if (nzbInfo->GetFileList()->Find(fileId))
+	{
+		fileIndex[fileId] = nzbInfo->GetId();
+	}
+	else
+	{
+		// a file moved to another nzb may be removed from the old nzb after it was added to the new one
+		FileIndex::iterator it = fileIndex.find(fileId);
+		if (it != fileIndex.end() && it->second == nzbInfo->GetId())
+		{
+			fileIndex.erase(it);
+		}
+	}
+}
@@ -27,10 +27,12 @@
 #include "Observer.h"
 #include "Log.h"
 #include "Thread.h"
+#include "FileSystem.h"
 
 class NzbInfo;
 class DownloadQueue;
 class PostInfo;
+class DirectUnpack;
 
 class ServerStat
 {
@@ -85,7 +87,6 @@ public:
 	void SetPartNumber(int s) { m_partNumber = s; }
 	int GetPartNumber() { return m_partNumber; }
 	const char* GetMessageId() { return m_messageId; }
-	void SetMessageId(const char* messageId) { m_messageId = messageId; }
 	void SetSize(int size) { m_size = size; }
 	int GetSize() { return m_size; }
 	void AttachSegment(std::unique_ptr<SegmentData> content, int64 offset, int size);
@@ -95,26 +96,69 @@ public:
 	int64 GetSegmentOffset() { return m_segmentOffset; }
 	void SetSegmentSize(int segmentSize) { m_segmentSize = segmentSize; }
 	int GetSegmentSize() { return m_segmentSize; }
-	EStatus GetStatus() { return m_status; }
-	void SetStatus(EStatus Status) { m_status = Status; }
+	EStatus GetStatus() { return (EStatus)m_status; }
+	void SetStatus(EStatus Status) { m_status = (uint8)Status; }
 	const char* GetResultFilename() { return m_resultFilename; }
 	void SetResultFilename(const char* resultFilename) { m_resultFilename = resultFilename; }
 	uint32 GetCrc() { return m_crc; }
 	void SetCrc(uint32 crc) { m_crc = crc; }
 
 private:
-	int m_partNumber;
-	CString m_messageId;
-	int m_size = 0;
-	std::unique_ptr<SegmentData> m_segmentContent;
+	// fields are ordered by size to avoid padding
 	int64 m_segmentOffset = 0;
-	int m_segmentSize = 0;
-	EStatus m_status = aiUndefined;
+	const char* m_messageId = "";
+	std::unique_ptr<SegmentData> m_segmentContent;
 	CString m_resultFilename;
+	int m_partNumber = 0;
+	int m_size = 0;
+	int m_segmentSize = 0;
 	uint32 m_crc = 0;
+	uint8 m_status = aiUndefined;
+
+	friend class ArticleList;
+};
+
+typedef std::vector<ArticleInfo> ArticleListBase;
+
+/*
+ * Articles of a file are stored by value in one block, their message-IDs are
+ * stored in a string arena owned by the list. Pointers to articles remain valid
+ * until the list is resized or cleared.
+ */
+class ArticleList : public ArticleListBase
+{
+public:
+	class Iterator
+	{
+	public:
+		Iterator(ArticleListBase::iterator baseIterator) : m_baseIterator(baseIterator) {}
+		ArticleInfo* operator*() { return &*m_baseIterator; }
+		Iterator& operator++() { m_baseIterator++; return *this; }
+		bool operator!=(const Iterator& other) { return m_baseIterator != other.m_baseIterator; }
+	private:
+		ArticleListBase::iterator m_baseIterator;
+	};
+
+	ArticleList() {}
+	ArticleList(ArticleList&& other) = default;
+	ArticleList& operator=(ArticleList&& other) = default;
+	ArticleInfo* Add(int partNumber, int size, const char* messageId);
+	void SetMessageId(ArticleInfo* article, const char* messageId);
+	void RemoveEmpty();
+	void clear();
+	int64 GetMemorySize();
+
+private:
+	typedef std::deque<CharBuffer> Chunks;
+
+	Chunks m_chunks;
+	int m_chunkUsed = 0;
+
+	const char* StoreString(const char* str);
 };
 
-typedef std::vector<std::unique_ptr<ArticleInfo>> ArticleList;
+inline ArticleList::Iterator begin(ArticleList* articles) { return ArticleList::Iterator(articles->begin()); }
+inline ArticleList::Iterator end(ArticleList* articles) { return ArticleList::Iterator(articles->end()); }
 
 class FileInfo
 {
@@ -176,6 +220,12 @@ public:
 	void SetOutputFilename(const char* outputFilename) { m_outputFilename = outputFilename; }
 	bool GetOutputInitialized() { return m_outputInitialized; }
 	void SetOutputInitialized(bool outputInitialized) { m_outputInitialized = outputInitialized; }
+	int64 GetAllocatedSize() { return m_allocatedSize; }
+	void SetAllocatedSize(int64 allocatedSize) { m_allocatedSize = allocatedSize; }
+	bool GetOutputPreallocated() { return m_outputPreallocated; }
+	void SetOutputPreallocated(bool outputPreallocated) { m_outputPreallocated = outputPreallocated; }
+	MappedFile* GetOutputMapping() { return m_outputMapping.get(); }
+	void SetOutputMapping(std::unique_ptr<MappedFile> outputMapping) { m_outputMapping = std::move(outputMapping); }
 	bool GetExtraPriority() { return m_extraPriority; }
 	void SetExtraPriority(bool extraPriority) { m_extraPriority = extraPriority; }
 	int GetActiveDownloads() { return m_activeDownloads; }
@@ -220,6 +270,9 @@ private:
 	bool m_outputInitialized = false;
 	CString m_outputFilename;
 	std::unique_ptr<Mutex> m_outputFileMutex;
+	std::unique_ptr<MappedFile> m_outputMapping;
+	int64 m_allocatedSize = 0;
+	bool m_outputPreallocated = false;
 	bool m_extraPriority = false;
 	int m_activeDownloads = 0;
 	bool m_dupeDeleted = false;
@@ -233,6 +286,7 @@ private:
 	static int m_idMax;
 
 	friend class CompletedFile;
+	friend class ArchiveInfo;
 };
 
 typedef UniqueDeque<FileInfo> FileList;
@@ -329,7 +383,7 @@ enum EDupeMode
 	dmForce
 };
 
-class NzbInfo
+class NzbInfo : private ContainerListener
 {
 public:
 	enum ERenameStatus
@@ -360,6 +414,14 @@ public:
 		usPassword
 	};
 
+	enum EDirectUnpackStatus
+	{
+		nsNone,
+		nsRunning,
+		nsFailure,
+		nsSuccess
+	};
+
 	enum ECleanupStatus
 	{
 		csNone,
@@ -430,7 +492,7 @@ public:
 	const char* GetCategory() { return m_category; }
 	void SetCategory(const char* category) { m_category = category; }
 	const char* GetName() { return m_name; }
-	void SetName(const char* name) { m_name = name; }
+	void SetName(const char* name);
 	int GetFileCount() { return m_fileCount; }
 	void SetFileCount(int fileCount) { m_fileCount = fileCount; }
 	int GetParkedFileCount() { return m_parkedFileCount; }
@@ -491,6 +553,8 @@ public:
 	void SetParStatus(EParStatus parStatus) { m_parStatus = parStatus; }
 	EUnpackStatus GetUnpackStatus() { return m_unpackStatus; }
 	void SetUnpackStatus(EUnpackStatus unpackStatus) { m_unpackStatus = unpackStatus; }
+	EDirectUnpackStatus GetDirectUnpackStatus() { return m_directUnpackStatus; }
+	void SetDirectUnpackStatus(EDirectUnpackStatus directUnpackStatus) { m_directUnpackStatus = directUnpackStatus; }
 	ECleanupStatus GetCleanupStatus() { return m_cleanupStatus; }
 	void SetCleanupStatus(ECleanupStatus cleanupStatus) { m_cleanupStatus = cleanupStatus; }
 	EMoveStatus GetMoveStatus() { return m_moveStatus; }
@@ -531,15 +595,15 @@ public:
 	int CalcHealth();
 	int CalcCriticalHealth(bool allowEstimation);
 	const char* GetDupeKey() { return m_dupeKey; }
-	void SetDupeKey(const char* dupeKey) { m_dupeKey = dupeKey ? dupeKey : ""; }
+	void SetDupeKey(const char* dupeKey);
 	int GetDupeScore() { return m_dupeScore; }
 	void SetDupeScore(int dupeScore) { m_dupeScore = dupeScore; }
 	EDupeMode GetDupeMode() { return m_dupeMode; }
 	void SetDupeMode(EDupeMode dupeMode) { m_dupeMode = dupeMode; }
 	uint32 GetFullContentHash() { return m_fullContentHash; }
-	void SetFullContentHash(uint32 fullContentHash) { m_fullContentHash = fullContentHash; }
+	void SetFullContentHash(uint32 fullContentHash);
 	uint32 GetFilteredContentHash() { return m_filteredContentHash; }
-	void SetFilteredContentHash(uint32 filteredContentHash) { m_filteredContentHash = filteredContentHash; }
+	void SetFilteredContentHash(uint32 filteredContentHash);
 	int64 GetDownloadedSize() { return m_downloadedSize; }
 	void SetDownloadedSize(int64 downloadedSize) { m_downloadedSize = downloadedSize; }
 	int GetDownloadSec() { return m_downloadSec; }
@@ -565,6 +629,8 @@ public:
 	void MoveFileList(NzbInfo* srcNzbInfo);
 	void UpdateMinMaxTime();
 	PostInfo* GetPostInfo() { return m_postInfo.get(); }
+	DirectUnpack* GetDirectUnpack() { return m_directUnpack; }
+	void SetDirectUnpack(DirectUnpack* directUnpack) { m_directUnpack = directUnpack; }
 	void EnterPostProcess();
 	void LeavePostProcess();
 	bool IsDupeSuccess();
@@ -575,12 +641,18 @@ public:
 	void SetMessageCount(int messageCount) { m_messageCount = messageCount; }
 	int GetCachedMessageCount() { return m_cachedMessageCount; }
 	GuardedMessageList GuardCachedMessages() { return GuardedMessageList(&m_messages, &m_logMutex); }
+	void ClearMessages();
+	/* Protects article states and download counters when the queue is locked in shared mode */
+	Guard GuardDownloadState() { return Guard(m_downloadStateMutex); }
 	void UpdateCurrentStats();
 	void UpdateCompletedStats(FileInfo* fileInfo);
 	void UpdateDeletedStats(FileInfo* fileInfo);
 
 	static const int FORCE_PRIORITY = 900;
 
+	NzbInfo() { m_fileList.SetListener(this); }
+	~NzbInfo();
+
 private:
 	int m_id = ++m_idGen;
 	EKind m_kind = nkNzb;
@@ -619,6 +691,7 @@ private:
 	ERenameStatus m_renameStatus = rsNone;
 	EParStatus m_parStatus = psNone;
 	EUnpackStatus m_unpackStatus = usNone;
+	EDirectUnpackStatus m_directUnpackStatus = nsNone;
 	ECleanupStatus m_cleanupStatus = csNone;
 	EMoveStatus m_moveStatus = msNone;
 	EDeleteStatus m_deleteStatus = dsNone;
@@ -647,9 +720,11 @@ private:
 	ServerStatList m_serverStats;
 	ServerStatList m_currentServerStats;
 	Mutex m_logMutex;
+	Mutex m_downloadStateMutex;
 	MessageList m_messages;
 	int m_idMessageGen = 0;
 	std::unique_ptr<PostInfo> m_postInfo;
+	DirectUnpack* m_directUnpack = nullptr;
 	int64 m_downloadedSize = 0;
 	time_t m_downloadStartTime = 0;
 	int m_downloadSec = 0;
@@ -667,9 +742,10 @@ private:
 	static int m_idGen;
 	static int m_idMax;
 
-	void ClearMessages();
+	virtual void ItemChanged(int id);
 
 	friend class DupInfo;
+	friend class ArchiveInfo;
 };
 
 typedef UniqueDeque<NzbInfo> NzbList;
@@ -693,6 +769,7 @@ public:
 	};
 
 	typedef std::vector<CString> ParredFiles;
+	typedef std::vector<CString> VerifiedFiles;
 
 	NzbInfo* GetNzbInfo() { return m_nzbInfo; }
 	void SetNzbInfo(NzbInfo* nzbInfo) { m_nzbInfo = nzbInfo; }
@@ -729,6 +806,7 @@ public:
 	Thread* GetPostThread() { return m_postThread; }
 	void SetPostThread(Thread* postThread) { m_postThread = postThread; }
 	ParredFiles* GetParredFiles() { return &m_parredFiles; }
+	VerifiedFiles* GetVerifiedFiles() { return &m_verifiedFiles; }
 
 private:
 	NzbInfo* m_nzbInfo = nullptr;
@@ -749,6 +827,7 @@ private:
 	time_t m_stageTime = 0;
 	Thread* m_postThread = nullptr;
 	ParredFiles m_parredFiles;
+	VerifiedFiles m_verifiedFiles;
 };
 
 typedef std::vector<int> IdList;
@@ -772,9 +851,9 @@ public:
 	int GetId() { return m_id; }
 	void SetId(int id);
 	const char* GetName() { return m_name; }
-	void SetName(const char* name) { m_name = name; }
+	void SetName(const char* name);
 	const char* GetDupeKey() { return m_dupeKey; }
-	void SetDupeKey(const char* dupeKey) { m_dupeKey = dupeKey; }
+	void SetDupeKey(const char* dupeKey);
 	int GetDupeScore() { return m_dupeScore; }
 	void SetDupeScore(int dupeScore) { m_dupeScore = dupeScore; }
 	EDupeMode GetDupeMode() { return m_dupeMode; }
@@ -782,9 +861,9 @@ public:
 	int64 GetSize() { return m_size; }
 	void SetSize(int64 size) { m_size = size; }
 	uint32 GetFullContentHash() { return m_fullContentHash; }
-	void SetFullContentHash(uint32 fullContentHash) { m_fullContentHash = fullContentHash; }
+	void SetFullContentHash(uint32 fullContentHash);
 	uint32 GetFilteredContentHash() { return m_filteredContentHash; }
-	void SetFilteredContentHash(uint32 filteredContentHash) { m_filteredContentHash = filteredContentHash; }
+	void SetFilteredContentHash(uint32 filteredContentHash);
 	EStatus GetStatus() { return m_status; }
 	void SetStatus(EStatus Status) { m_status = Status; }
 
@@ -819,7 +898,8 @@ public:
 	int GetId();
 	NzbInfo* GetNzbInfo() { return (NzbInfo*)m_info; }
 	DupInfo* GetDupInfo() { return (DupInfo*)m_info; }
-	void DiscardNzbInfo() { m_info = nullptr; }
+	/* The id is kept, the entry can be still removed from history by id */
+	void DiscardNzbInfo() { m_id = GetId(); m_info = nullptr; }
 	time_t GetTime() { return m_time; }
 	void SetTime(time_t time) { m_time = time; }
 	const char* GetName();
@@ -827,14 +907,60 @@ public:
 private:
 	EKind m_kind;
 	void* m_info;
+	int m_id = 0;
 	time_t m_time = 0;
 };
 
 typedef UniqueDeque<HistoryInfo> HistoryList;
 
-typedef GuardedPtr<DownloadQueue> GuardedDownloadQueue;
+/*
+ * Older history entries are kept in the history archive on disk, in memory
+ * remains only what is needed to find them (see DiskState::ArchiveHistory).
+ */
+class ArchiveInfo
+{
+public:
+	ArchiveInfo(int id, HistoryInfo::EKind kind, time_t time);
+	int GetId() { return m_id; }
+	HistoryInfo::EKind GetKind() { return m_kind; }
+	time_t GetTime() { return m_time; }
+	const char* GetName() { return m_name; }
+	void SetName(const char* name) { m_name = name; }
+	const char* GetDupeKey() { return m_dupeKey; }
+	void SetDupeKey(const char* dupeKey) { m_dupeKey = dupeKey; }
+	uint32 GetFullContentHash() { return m_fullContentHash; }
+	void SetFullContentHash(uint32 fullContentHash) { m_fullContentHash = fullContentHash; }
+	uint32 GetFilteredContentHash() { return m_filteredContentHash; }
+	void SetFilteredContentHash(uint32 filteredContentHash) { m_filteredContentHash = filteredContentHash; }
+	/* Position and size of the record in the archive file */
+	int64 GetOffset() { return m_offset; }
+	int GetSize() { return m_size; }
+	void SetLocation(int64 offset, int size) { m_offset = offset; m_size = size; }
+	/* Range of ids of completed files, their states on disk are kept */
+	int GetMinFileId() { return m_minFileId; }
+	int GetMaxFileId() { return m_maxFileId; }
+	void SetFileIds(int minFileId, int maxFileId);
+
+private:
+	int m_id;
+	HistoryInfo::EKind m_kind;
+	time_t m_time;
+	CString m_name;
+	CString m_dupeKey;
+	uint32 m_fullContentHash = 0;
+	uint32 m_filteredContentHash = 0;
+	int64 m_offset = 0;
+	int m_size = 0;
+	int m_minFileId = 0;
+	int m_maxFileId = 0;
+};
+
+typedef UniqueDeque<ArchiveInfo> ArchiveList;
 
-class DownloadQueue : public Subject
+typedef GuardedPtr<DownloadQueue, RwMutex> GuardedDownloadQueue;
+typedef SharedGuardedPtr<DownloadQueue> SharedGuardedDownloadQueue;
+
+class DownloadQueue : public Subject, private ContainerListener
 {
 public:
 	enum EAspectAction
@@ -916,24 +1042,54 @@ public:
 
 	static bool IsLoaded() { return g_Loaded; }
 	static GuardedDownloadQueue Guard() { return GuardedDownloadQueue(g_DownloadQueue, &g_DownloadQueue->m_lockMutex); }
+	/* Shared lock for read-only traversals. Download state of a nzb must be read under its own lock
+	 * (NzbInfo::GuardDownloadState) because articles are completed under the shared lock too. */
+	static SharedGuardedDownloadQueue GuardShared() { return SharedGuardedDownloadQueue(g_DownloadQueue, &g_DownloadQueue->m_lockMutex); }
+	/* Must be called under the exclusive lock */
+	static RwMutex::Stats GetLockStats() { return g_DownloadQueue->m_lockMutex.GetStats(); }
 	NzbList* GetQueue() { return &m_queue; }
 	HistoryList* GetHistory() { return &m_history; }
+	/* Archived history entries, newest first */
+	ArchiveList* GetArchive() { return &m_archive; }
+	/* Finds file in queue; safe to call under the shared lock */
+	FileInfo* FindFile(int id);
+	/* Keeps the file index up to date, called on changes of the file list of a nzb */
+	static void FileListChanged(NzbInfo* nzbInfo, int fileId);
 	virtual bool EditEntry(int ID, EEditAction action, int offset, const char* text) = 0;
 	virtual bool EditList(IdList* idList, NameList* nameList, EMatchMode matchMode, EEditAction action, int offset, const char* text) = 0;
 	virtual void HistoryChanged() = 0;
 	virtual void Save() = 0;
+	/* Saves changes of nzb (in queue or in history) and added, removed or moved items;
+	 * other changed items are saved by later saves */
+	virtual void SaveChanged(int nzbId) = 0;
 	void CalcRemainingSize(int64* remaining, int64* remainingForced);
+	/* Reports change of name, dupe key or content hash of a queue or history item */
+	static void DupeChanged(int id);
+	/* Returns ids of items added to or removed from queue, history or archive and of items reported
+	 * via "DupeChanged" since the previous call; changes are recorded after the first call */
+	IdList TakeDupeChanges();
 
 protected:
-	DownloadQueue() {}
+	DownloadQueue() { m_queue.SetListener(this); m_history.SetListener(this); m_archive.SetListener(this); }
 	static void Init(DownloadQueue* globalInstance) { g_DownloadQueue = globalInstance; }
 	static void Final() { g_DownloadQueue = nullptr; }
 	static void Loaded() { g_Loaded = true; }
 
 private:
+	typedef std::unordered_map<int, int> FileIndex;
+
 	NzbList m_queue;
 	HistoryList m_history;
-	Mutex m_lockMutex;
+	ArchiveList m_archive;
+	RwMutex m_lockMutex;
+	FileIndex m_fileIndex; // file id -> nzb id, see FileListChanged
+	Mutex m_fileIndexMutex;
+	std::set<int> m_dupeChanges;
+	bool m_dupeTracking = false;
+	Mutex m_dupeChangesMutex;
+
+	void RecordDupeChange(int id);
+	virtual void ItemChanged(int id) { RecordDupeChange(id); }
 
 	static DownloadQueue* g_DownloadQueue;
 	static bool g_Loaded;
@@ -27,6 +27,306 @@
 #include "DupeCoordinator.h"
 #include "QueueScript.h"
 
+void DupeCoordinator::DupeIndex::Clear()
+{
+	m_items.clear();
+	m_names.clear();
+	m_dupeKeys.clear();
+	m_fullContentHashes.clear();
+	m_filteredContentHashes.clear();
+}
+
+template <typename Key, typename Map>
+void DupeCoordinator::DupeIndex::AddKey(Map& map, const Key& key, int id)
+{
+	map[key].push_back(id);
+}
+
+template <typename Key, typename Map>
+void DupeCoordinator::DupeIndex::RemoveKey(Map& map, const Key& key, int id)
+{
+	typename Map::iterator it = map.find(key);
+	if (it != map.end())
+	{
+		IdList& ids = it->second;
+		ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+		if (ids.empty())
+		{
+			map.erase(it);
+		}
+	}
+}
+
+void DupeCoordinator::DupeIndex::Add(int id, const char* name, const char* dupeKey,
+	uint32 fullContentHash, uint32 filteredContentHash)
+{
+	Remove(id);
+
+	Item item{name ? name : "", dupeKey ? dupeKey : "", fullContentHash, filteredContentHash};
+
+	AddKey(m_names, item.name, id);
+	if (!item.dupeKey.empty())
+	{
+		AddKey(m_dupeKeys, item.dupeKey, id);
+	}
+	if (fullContentHash > 0)
+	{
+		AddKey(m_fullContentHashes, fullContentHash, id);
+	}
+	if (filteredContentHash > 0)
+	{
+		AddKey(m_filteredContentHashes, filteredContentHash, id);
+	}
+
+	m_items[id] = std::move(item);
+}
+
+void DupeCoordinator::DupeIndex::Remove(int id)
+{
+	Items::iterator it = m_items.find(id);
+	if (it == m_items.end())
+	{
+		return;
+	}
+
+	Item& item = it->second;
+	RemoveKey(m_names, item.name, id);
+	if (!item.dupeKey.empty())
+	{
+		RemoveKey(m_dupeKeys, item.dupeKey, id);
+	}
+	if (item.fullContentHash > 0)
+	{
+		RemoveKey(m_fullContentHashes, item.fullContentHash, id);
+	}
+	if (item.filteredContentHash > 0)
+	{
+		RemoveKey(m_filteredContentHashes, item.filteredContentHash, id);
+	}
+
+	m_items.erase(it);
+}
+
+IdList* DupeCoordinator::DupeIndex::FindString(StringMap& map, const char* key)
+{
+	if (!key)
+	{
+		return nullptr;
+	}
+	StringMap::iterator it = map.find(key);
+	return it != map.end() ? &it->second : nullptr;
+}
+
+IdList* DupeCoordinator::DupeIndex::FindHash(HashMap& map, uint32 key)
+{
+	if (key == 0)
+	{
+		return nullptr;
+	}
+	HashMap::iterator it = map.find(key);
+	return it != map.end() ? &it->second : nullptr;
+}
+
+IdList DupeCoordinator::DupeIndex::Merge(std::vector<IdList*> idLists)
+{
+	IdList ids;
+	for (IdList* idList : idLists)
+	{
+		if (idList)
+		{
+			ids.insert(ids.end(), idList->begin(), idList->end());
+		}
+	}
+
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+	return ids;
+}
+
+IdList DupeCoordinator::DupeIndex::FindName(const char* name)
+{
+	return Merge({FindString(m_names, name)});
+}
+
+IdList DupeCoordinator::DupeIndex::FindNameOrKey(const char* name, const char* dupeKey)
+{
+	return Merge({FindString(m_names, name),
+		!Util::EmptyStr(dupeKey) ? FindString(m_dupeKeys, dupeKey) : nullptr});
+}
+
+IdList DupeCoordinator::DupeIndex::FindContent(uint32 fullContentHash, uint32 filteredContentHash)
+{
+	return Merge({FindHash(m_fullContentHashes, fullContentHash),
+		FindHash(m_filteredContentHashes, filteredContentHash)});
+}
+
+IdList DupeCoordinator::DupeIndex::FindDupes(const char* name, const char* dupeKey,
+	uint32 fullContentHash, uint32 filteredContentHash)
+{
+	return Merge({FindString(m_names, name),
+		!Util::EmptyStr(dupeKey) ? FindString(m_dupeKeys, dupeKey) : nullptr,
+		FindHash(m_fullContentHashes, fullContentHash),
+		FindHash(m_filteredContentHashes, filteredContentHash)});
+}
+
+void DupeCoordinator::UpdateIndex(DownloadQueue* downloadQueue)
+{
+	m_loadedHistory.clear();
+	IdList changedIds = downloadQueue->TakeDupeChanges();
+
+	if (m_indexedQueue != downloadQueue)
+	{
+		// first use: index all items, later only changed items are updated
+		m_queueIndex.Clear();
+		for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
+		{
+			IndexQueueItem(downloadQueue, nzbInfo->GetId());
+		}
+
+		m_historyIndex.Clear();
+		for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
+		{
+			IndexHistoryItem(downloadQueue, historyInfo->GetId());
+		}
+		for (ArchiveInfo* archiveInfo : downloadQueue->GetArchive())
+		{
+			IndexHistoryItem(downloadQueue, archiveInfo->GetId());
+		}
+
+		m_indexedQueue = downloadQueue;
+		return;
+	}
+
+	for (int id : changedIds)
+	{
+		IndexQueueItem(downloadQueue, id);
+		IndexHistoryItem(downloadQueue, id);
+	}
+}
+
+void DupeCoordinator::IndexQueueItem(DownloadQueue* downloadQueue, int id)
+{
+	NzbInfo* nzbInfo = downloadQueue->GetQueue()->Find(id);
+	if (nzbInfo)
+	{
+		m_queueIndex.Add(id, nzbInfo->GetName(), nzbInfo->GetDupeKey(),
+			nzbInfo->GetFullContentHash(), nzbInfo->GetFilteredContentHash());
+	}
+	else
+	{
+		m_queueIndex.Remove(id);
+	}
+}
+
+void DupeCoordinator::IndexHistoryItem(DownloadQueue* downloadQueue, int id)
+{
+	HistoryInfo* historyInfo = downloadQueue->GetHistory()->Find(id);
+	if (historyInfo && historyInfo->GetKind() == HistoryInfo::hkNzb)
+	{
+		NzbInfo* nzbInfo = historyInfo->GetNzbInfo();
+		m_historyIndex.Add(id, nzbInfo->GetName(), nzbInfo->GetDupeKey(),
+			nzbInfo->GetFullContentHash(), nzbInfo->GetFilteredContentHash());
+	}
+	else if (historyInfo && historyInfo->GetKind() == HistoryInfo::hkDup)
+	{
+		DupInfo* dupInfo = historyInfo->GetDupInfo();
+		m_historyIndex.Add(id, dupInfo->GetName(), dupInfo->GetDupeKey(),
+			dupInfo->GetFullContentHash(), dupInfo->GetFilteredContentHash());
+	}
+	else if (ArchiveInfo* archiveInfo = downloadQueue->GetArchive()->Find(id))
+	{
+		m_historyIndex.Add(id, archiveInfo->GetName(), archiveInfo->GetDupeKey(),
+			archiveInfo->GetFullContentHash(), archiveInfo->GetFilteredContentHash());
+	}
+	else
+	{
+		m_historyIndex.Remove(id);
+	}
+}
+
+/*
+ * Recent entries come first, then archived entries, both from newest to oldest
+ */
+IdList DupeCoordinator::HistoryOrder(DownloadQueue* downloadQueue, IdList ids)
+{
+	IdList recentIds;
+	IdList archivedIds;
+	for (int id : ids)
+	{
+		(downloadQueue->GetHistory()->Find(id) ? recentIds : archivedIds).push_back(id);
+	}
+
+	IdList ordered = ListOrder(downloadQueue->GetHistory(), std::move(recentIds));
+	for (int id : ListOrder(downloadQueue->GetArchive(), std::move(archivedIds)))
+	{
+		ordered.push_back(id);
+	}
+
+	return ordered;
+}
+
+/*
+ * Archived entries are loaded for checking and kept until the next update of the index,
+ * entries which are going to be changed must be restored into history with "RestoreHistory"
+ */
+HistoryInfo* DupeCoordinator::FindHistory(DownloadQueue* downloadQueue, int id)
+{
+	HistoryInfo* historyInfo = downloadQueue->GetHistory()->Find(id);
+	if (historyInfo)
+	{
+		return historyInfo;
+	}
+
+	ArchiveInfo* archiveInfo = downloadQueue->GetArchive()->Find(id);
+	if (!archiveInfo || !g_HistoryCoordinator)
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<HistoryInfo> loadedInfo = g_HistoryCoordinator->LoadArchived(archiveInfo);
+	historyInfo = loadedInfo.get();
+	if (loadedInfo)
+	{
+		m_loadedHistory.push_back(std::move(loadedInfo));
+	}
+	return historyInfo;
+}
+
+HistoryInfo* DupeCoordinator::RestoreHistory(DownloadQueue* downloadQueue, HistoryInfo* historyInfo)
+{
+	if (downloadQueue->GetHistory()->Find(historyInfo->GetId()) == historyInfo)
+	{
+		return historyInfo;
+	}
+	return g_HistoryCoordinator->RestoreArchived(downloadQueue, historyInfo->GetId());
+}
+
+template <typename T>
+IdList DupeCoordinator::ListOrder(UniqueDeque<T>* list, IdList ids)
+{
+	if (ids.size() < 2)
+	{
+		return ids;
+	}
+
+	// duplicates are rare, a scan of the list is needed only if there are several candidates
+	IdList ordered;
+	for (std::unique_ptr<T>& item : *list)
+	{
+		if (std::binary_search(ids.begin(), ids.end(), item->GetId()))
+		{
+			ordered.push_back(item->GetId());
+			if (ordered.size() == ids.size())
+			{
+				break;
+			}
+		}
+	}
+
+	return ordered;
+}
+
 bool DupeCoordinator::SameNameOrKey(const char* name1, const char* dupeKey1,
 	const char* name2, const char* dupeKey2)
 {
@@ -53,9 +353,18 @@ void DupeCoordinator::NzbFound(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
 {
 	debug("Checking duplicates for %s", nzbInfo->GetName());
 
+	UpdateIndex(downloadQueue);
+
 	// find duplicates in download queue with exactly same content
-	for (NzbInfo* queuedNzbInfo : downloadQueue->GetQueue())
+	for (int id : ListOrder(downloadQueue->GetQueue(),
+		m_queueIndex.FindContent(nzbInfo->GetFullContentHash(), nzbInfo->GetFilteredContentHash())))
 	{
+		NzbInfo* queuedNzbInfo = downloadQueue->GetQueue()->Find(id);
+		if (!queuedNzbInfo)
+		{
+			continue;
+		}
+
 		bool sameContent = (nzbInfo->GetFullContentHash() > 0 &&
 			nzbInfo->GetFullContentHash() == queuedNzbInfo->GetFullContentHash()) ||
 			(nzbInfo->GetFilteredContentHash() > 0 &&
@@ -98,9 +407,10 @@ void DupeCoordinator::NzbFound(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
 	// take these properties from this item
 	if (Util::EmptyStr(nzbInfo->GetDupeKey()) && nzbInfo->GetDupeScore() == 0)
 	{
-		for (NzbInfo* queuedNzbInfo : downloadQueue->GetQueue())
+		for (int id : ListOrder(downloadQueue->GetQueue(), m_queueIndex.FindName(nzbInfo->GetName())))
 		{
-			if (!strcmp(queuedNzbInfo->GetName(), nzbInfo->GetName()) &&
+			NzbInfo* queuedNzbInfo = downloadQueue->GetQueue()->Find(id);
+			if (queuedNzbInfo && !strcmp(queuedNzbInfo->GetName(), nzbInfo->GetName()) &&
 				(!Util::EmptyStr(queuedNzbInfo->GetDupeKey()) || queuedNzbInfo->GetDupeScore() != 0))
 			{
 				nzbInfo->SetDupeKey(queuedNzbInfo->GetDupeKey());
@@ -113,8 +423,13 @@ void DupeCoordinator::NzbFound(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
 	}
 	if (Util::EmptyStr(nzbInfo->GetDupeKey()) && nzbInfo->GetDupeScore() == 0)
 	{
-		for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
+		for (int id : HistoryOrder(downloadQueue, m_historyIndex.FindName(nzbInfo->GetName())))
 		{
+			HistoryInfo* historyInfo = FindHistory(downloadQueue, id);
+			if (!historyInfo)
+			{
+				continue;
+			}
 			if (historyInfo->GetKind() == HistoryInfo::hkNzb &&
 				!strcmp(historyInfo->GetNzbInfo()->GetName(), nzbInfo->GetName()) &&
 				(!Util::EmptyStr(historyInfo->GetNzbInfo()->GetDupeKey()) || historyInfo->GetNzbInfo()->GetDupeScore() != 0))
@@ -148,8 +463,15 @@ void DupeCoordinator::NzbFound(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
 	// find duplicates in history having exactly same content
 	// also: nzb-files having duplicates marked as good are skipped
 	// also (only in score mode): nzb-files having success-duplicates in dup-history but not having duplicates in recent history are skipped
-	for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
+	for (int id : HistoryOrder(downloadQueue, m_historyIndex.FindDupes(nzbInfo->GetName(), nzbInfo->GetDupeKey(),
+		nzbInfo->GetFullContentHash(), nzbInfo->GetFilteredContentHash())))
 	{
+		HistoryInfo* historyInfo = FindHistory(downloadQueue, id);
+		if (!historyInfo)
+		{
+			continue;
+		}
+
 		if (historyInfo->GetKind() == HistoryInfo::hkNzb &&
 			((nzbInfo->GetFullContentHash() > 0 &&
 			nzbInfo->GetFullContentHash() == historyInfo->GetNzbInfo()->GetFullContentHash()) ||
@@ -205,9 +527,11 @@ void DupeCoordinator::NzbFound(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
 	if (!sameContent && !good && nzbInfo->GetDupeMode() == dmScore)
 	{
 		// nzb-files having success-duplicates in recent history (with different content) are added to history for backup
-		for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
+		for (int id : HistoryOrder(downloadQueue,
+		m_historyIndex.FindNameOrKey(nzbInfo->GetName(), nzbInfo->GetDupeKey())))
 		{
-			if (historyInfo->GetKind() == HistoryInfo::hkNzb &&
+			HistoryInfo* historyInfo = FindHistory(downloadQueue, id);
+			if (historyInfo && historyInfo->GetKind() == HistoryInfo::hkNzb &&
 				historyInfo->GetNzbInfo()->GetDupeMode() != dmForce &&
 				SameNameOrKey(historyInfo->GetNzbInfo()->GetName(), historyInfo->GetNzbInfo()->GetDupeKey(),
 					nzbInfo->GetName(), nzbInfo->GetDupeKey()) &&
@@ -258,11 +582,11 @@ void DupeCoordinator::NzbFound(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
 	if (nzbInfo->GetDupeMode() == dmScore)
 	{
 		// find duplicates in download queue
-		int index = 0;
-		for (NzbList::iterator it = downloadQueue->GetQueue()->begin(); it != downloadQueue->GetQueue()->end(); index++)
+		for (int id : ListOrder(downloadQueue->GetQueue(),
+			m_queueIndex.FindNameOrKey(nzbInfo->GetName(), nzbInfo->GetDupeKey())))
 		{
-			NzbInfo* queuedNzbInfo = (*it++).get();
-			if (queuedNzbInfo != nzbInfo &&
+			NzbInfo* queuedNzbInfo = downloadQueue->GetQueue()->Find(id);
+			if (queuedNzbInfo && queuedNzbInfo != nzbInfo &&
 				queuedNzbInfo->GetKind() == NzbInfo::nkNzb &&
 				queuedNzbInfo->GetDupeMode() != dmForce &&
 				SameNameOrKey(queuedNzbInfo->GetName(), queuedNzbInfo->GetDupeKey(),
@@ -288,7 +612,6 @@ void DupeCoordinator::NzbFound(DownloadQueue* downloadQueue, NzbInfo* nzbInfo)
 					queuedNzbInfo->SetDeleteStatus(NzbInfo::dsDupe);
 					downloadQueue->EditEntry(queuedNzbInfo->GetId(),
 						DownloadQueue::eaGroupDelete, 0, nullptr);
-					it = downloadQueue->GetQueue()->begin() + index;
 				}
 			}
 		}
@@ -315,11 +638,20 @@ void DupeCoordinator::NzbCompleted(DownloadQueue* downloadQueue, NzbInfo* nzbInf
 */
 void DupeCoordinator::ReturnBestDupe(DownloadQueue* downloadQueue, NzbInfo* nzbInfo, const char* nzbName, const char* dupeKey)
 {
+	UpdateIndex(downloadQueue);
+	IdList historyDupes = HistoryOrder(downloadQueue, m_historyIndex.FindNameOrKey(nzbName, dupeKey));
+
 	// check if history (recent or dup) has other success-duplicates or good-duplicates
 	bool dupeFound = false;
 	int historyScore = 0;
-	for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
+	for (int id : historyDupes)
 	{
+		HistoryInfo* historyInfo = FindHistory(downloadQueue, id);
+		if (!historyInfo)
+		{
+			continue;
+		}
+
 		bool goodDupe = false;
 
 		if (historyInfo->GetKind() == HistoryInfo::hkNzb &&
@@ -359,9 +691,10 @@ void DupeCoordinator::ReturnBestDupe(DownloadQueue* downloadQueue, NzbInfo* nzbI
 	// check if duplicates exist in download queue
 	bool queueDupe = false;
 	int queueScore = 0;
-	for (NzbInfo* queuedNzbInfo : downloadQueue->GetQueue())
+	for (int id : ListOrder(downloadQueue->GetQueue(), m_queueIndex.FindNameOrKey(nzbName, dupeKey)))
 	{
-		if (queuedNzbInfo != nzbInfo &&
+		NzbInfo* queuedNzbInfo = downloadQueue->GetQueue()->Find(id);
+		if (queuedNzbInfo && queuedNzbInfo != nzbInfo &&
 			queuedNzbInfo->GetKind() == NzbInfo::nkNzb &&
 			queuedNzbInfo->GetDupeMode() != dmForce &&
 			SameNameOrKey(queuedNzbInfo->GetName(), queuedNzbInfo->GetDupeKey(), nzbName, dupeKey) &&
@@ -375,9 +708,10 @@ void DupeCoordinator::ReturnBestDupe(DownloadQueue* downloadQueue, NzbInfo* nzbI
 	// find dupe-backup with highest score, whose score is also higher than other
 	// success-duplicates and higher than already queued items
 	HistoryInfo* historyDupe = nullptr;
-	for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
+	for (int id : historyDupes)
 	{
-		if (historyInfo->GetKind() == HistoryInfo::hkNzb &&
+		HistoryInfo* historyInfo = FindHistory(downloadQueue, id);
+		if (historyInfo && historyInfo->GetKind() == HistoryInfo::hkNzb &&
 			historyInfo->GetNzbInfo()->GetDupeMode() != dmForce &&
 			historyInfo->GetNzbInfo()->GetDeleteStatus() == NzbInfo::dsDupe &&
 			historyInfo->GetNzbInfo()->CalcHealth() >= historyInfo->GetNzbInfo()->CalcCriticalHealth(true) &&
@@ -395,7 +729,11 @@ void DupeCoordinator::ReturnBestDupe(DownloadQueue* downloadQueue, NzbInfo* nzbI
 	if (historyDupe)
 	{
 		info("Found duplicate %s for %s", historyDupe->GetNzbInfo()->GetName(), nzbName);
-		g_HistoryCoordinator->Redownload(downloadQueue, historyDupe);
+		historyDupe = RestoreHistory(downloadQueue, historyDupe);
+		if (historyDupe)
+		{
+			g_HistoryCoordinator->Redownload(downloadQueue, historyDupe);
+		}
 	}
 }
 
@@ -457,29 +795,29 @@ void DupeCoordinator::HistoryCleanup(DownloadQueue* downloadQueue, HistoryInfo*
 		markHistoryInfo->GetKind() == HistoryInfo::hkDup ? markHistoryInfo->GetDupInfo()->GetName() :
 		nullptr;
 	bool changed = false;
-	int index = 0;
+
+	UpdateIndex(downloadQueue);
+	IdList historyDupes = HistoryOrder(downloadQueue, m_historyIndex.FindNameOrKey(nzbName, dupeKey));
 
 	// traversing in a reverse order to delete items in order they were added to history
 	// (just to produce the log-messages in a more logical order)
-	for (HistoryList::reverse_iterator it = downloadQueue->GetHistory()->rbegin(); it != downloadQueue->GetHistory()->rend(); )
+	for (IdList::reverse_iterator it = historyDupes.rbegin(); it != historyDupes.rend(); it++)
 	{
-		HistoryInfo* historyInfo = (*it).get();
+		HistoryInfo* historyInfo = FindHistory(downloadQueue, *it);
 
-		if (historyInfo->GetKind() == HistoryInfo::hkNzb &&
+		if (historyInfo && historyInfo->GetKind() == HistoryInfo::hkNzb &&
 			historyInfo->GetNzbInfo()->GetDupeMode() != dmForce &&
 			historyInfo->GetNzbInfo()->GetDeleteStatus() == NzbInfo::dsDupe &&
 			historyInfo != markHistoryInfo &&
 			SameNameOrKey(historyInfo->GetNzbInfo()->GetName(), historyInfo->GetNzbInfo()->GetDupeKey(), nzbName, dupeKey))
 		{
-			g_HistoryCoordinator->HistoryHide(downloadQueue, historyInfo, index);
-			index++;
-			it = downloadQueue->GetHistory()->rbegin() + index;
-			changed = true;
-		}
-		else
-		{
-			it++;
-			index++;
+			historyInfo = RestoreHistory(downloadQueue, historyInfo);
+			if (historyInfo)
+			{
+				int rindex = (int)(downloadQueue->GetHistory()->end() - 1 - downloadQueue->GetHistory()->Find(historyInfo));
+				g_HistoryCoordinator->HistoryHide(downloadQueue, historyInfo, rindex);
+				changed = true;
+			}
 		}
 	}
 
@@ -495,10 +833,13 @@ DupeCoordinator::EDupeStatus DupeCoordinator::GetDupeStatus(DownloadQueue* downl
 {
 	EDupeStatus statuses = dsNone;
 
-	// find duplicates in download queue
-	for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
+	UpdateIndex(downloadQueue);
+
+	// find duplicates in download queue (the order of items doesn't matter here)
+	for (int id : m_queueIndex.FindNameOrKey(name, dupeKey))
 	{
-		if (SameNameOrKey(name, dupeKey, nzbInfo->GetName(), nzbInfo->GetDupeKey()))
+		NzbInfo* nzbInfo = downloadQueue->GetQueue()->Find(id);
+		if (nzbInfo && SameNameOrKey(name, dupeKey, nzbInfo->GetName(), nzbInfo->GetDupeKey()))
 		{
 			if (nzbInfo->GetSuccessArticles() + nzbInfo->GetFailedArticles() > 0)
 			{
@@ -512,8 +853,14 @@ DupeCoordinator::EDupeStatus DupeCoordinator::GetDupeStatus(DownloadQueue* downl
 	}
 
 	// find duplicates in history
-	for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
+	for (int id : m_historyIndex.FindNameOrKey(name, dupeKey))
 	{
+		HistoryInfo* historyInfo = FindHistory(downloadQueue, id);
+		if (!historyInfo)
+		{
+			continue;
+		}
+
 		if (historyInfo->GetKind() == HistoryInfo::hkNzb &&
 			SameNameOrKey(name, dupeKey, historyInfo->GetNzbInfo()->GetName(), historyInfo->GetNzbInfo()->GetDupeKey()))
 		{
@@ -560,15 +907,24 @@ RawNzbList DupeCoordinator::ListHistoryDupes(DownloadQueue* downloadQueue, NzbIn
 		return dupeList;
 	}
 
+	UpdateIndex(downloadQueue);
+
 	// find duplicates in history
-	for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
+	for (int id : HistoryOrder(downloadQueue,
+		m_historyIndex.FindNameOrKey(nzbInfo->GetName(), nzbInfo->GetDupeKey())))
 	{
-		if (historyInfo->GetKind() == HistoryInfo::hkNzb &&
+		HistoryInfo* historyInfo = FindHistory(downloadQueue, id);
+		if (historyInfo && historyInfo->GetKind() == HistoryInfo::hkNzb &&
 			historyInfo->GetNzbInfo()->GetDupeMode() != dmForce &&
 			SameNameOrKey(historyInfo->GetNzbInfo()->GetName(), historyInfo->GetNzbInfo()->GetDupeKey(),
 				nzbInfo->GetName(), nzbInfo->GetDupeKey()))
 		{
-			dupeList.push_back(historyInfo->GetNzbInfo());
+			// the caller keeps the list, the entries must be owned by history
+			historyInfo = RestoreHistory(downloadQueue, historyInfo);
+			if (historyInfo)
+			{
+				dupeList.push_back(historyInfo->GetNzbInfo());
+			}
 		}
 	}
 
@@ -43,6 +43,66 @@ public:
 	RawNzbList ListHistoryDupes(DownloadQueue* downloadQueue, NzbInfo* nzbInfo);
 
 private:
+	/*
+	 * Index of queue or history items by name, dupe key and content hashes.
+	 * The index is updated with items reported by "DownloadQueue::TakeDupeChanges".
+	 * Lookups return ids of candidates in no particular order, the caller must
+	 * verify the found items.
+	 */
+	class DupeIndex
+	{
+	public:
+		void Clear();
+		/* adds new item or updates existing one */
+		void Add(int id, const char* name, const char* dupeKey, uint32 fullContentHash, uint32 filteredContentHash);
+		void Remove(int id);
+		IdList FindName(const char* name);
+		IdList FindNameOrKey(const char* name, const char* dupeKey);
+		IdList FindContent(uint32 fullContentHash, uint32 filteredContentHash);
+		/* items with same name or dupe key or with same content */
+		IdList FindDupes(const char* name, const char* dupeKey, uint32 fullContentHash, uint32 filteredContentHash);
+
+	private:
+		struct Item
+		{
+			std::string name;
+			std::string dupeKey;
+			uint32 fullContentHash;
+			uint32 filteredContentHash;
+		};
+
+		typedef std::unordered_map<int, Item> Items;
+		typedef std::unordered_map<std::string, IdList> StringMap;
+		typedef std::unordered_map<uint32, IdList> HashMap;
+
+		Items m_items;
+		StringMap m_names;
+		StringMap m_dupeKeys;
+		HashMap m_fullContentHashes;
+		HashMap m_filteredContentHashes;
+
+		template <typename Key, typename Map> void AddKey(Map& map, const Key& key, int id);
+		template <typename Key, typename Map> void RemoveKey(Map& map, const Key& key, int id);
+		IdList* FindString(StringMap& map, const char* key);
+		IdList* FindHash(HashMap& map, uint32 key);
+		IdList Merge(std::vector<IdList*> idLists);
+	};
+
+	DupeIndex m_queueIndex;
+	DupeIndex m_historyIndex;
+	DownloadQueue* m_indexedQueue = nullptr;
+	std::vector<std::unique_ptr<HistoryInfo>> m_loadedHistory;
+
+	void UpdateIndex(DownloadQueue* downloadQueue);
+	void IndexQueueItem(DownloadQueue* downloadQueue, int id);
+	void IndexHistoryItem(DownloadQueue* downloadQueue, int id);
+	/* sorts ids of found items in the order of the list */
+	template <typename T> IdList ListOrder(UniqueDeque<T>* list, IdList ids);
+	IdList HistoryOrder(DownloadQueue* downloadQueue, IdList ids);
+	/* finds entry in history or loads it from history archive */
+	HistoryInfo* FindHistory(DownloadQueue* downloadQueue, int id);
+	/* moves entry loaded from history archive into history */
+	HistoryInfo* RestoreHistory(DownloadQueue* downloadQueue, HistoryInfo* historyInfo);
 	void ReturnBestDupe(DownloadQueue* downloadQueue, NzbInfo* nzbInfo, const char* nzbName, const char* dupeKey);
 	void HistoryCleanup(DownloadQueue* downloadQueue, HistoryInfo* markHistoryInfo);
 	bool SameNameOrKey(const char* name1, const char* dupeKey1, const char* name2, const char* dupeKey2);
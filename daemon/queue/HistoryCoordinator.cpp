@@ -34,7 +34,7 @@
 #include "ServerPool.h"
 
 /**
- * Removes old entries from (recent) history
+ * Removes old entries from (recent) history and moves older entries into history archive
  */
 void HistoryCoordinator::ServiceWork()
 {
@@ -44,6 +44,20 @@ void HistoryCoordinator::ServiceWork()
 	bool changed = false;
 	int index = 0;
 
+	// expired archived entries are restored to be removed or hidden as the other entries
+	IdList expiredIds;
+	for (ArchiveInfo* archiveInfo : downloadQueue->GetArchive())
+	{
+		if (archiveInfo->GetKind() != HistoryInfo::hkDup && archiveInfo->GetTime() < minTime)
+		{
+			expiredIds.push_back(archiveInfo->GetId());
+		}
+	}
+	for (int id : expiredIds)
+	{
+		changed |= RestoreArchived(downloadQueue, id) != nullptr;
+	}
+
 	// traversing in a reverse order to delete items in order they were added to history
 	// (just to produce the log-messages in a more logical order)
 	for (HistoryList::reverse_iterator it = downloadQueue->GetHistory()->rbegin(); it != downloadQueue->GetHistory()->rend(); )
@@ -78,6 +92,11 @@ void HistoryCoordinator::ServiceWork()
 		}
 	}
 
+	if (g_Options->GetSaveQueue() && g_Options->GetServerMode())
+	{
+		changed |= ArchiveHistory(downloadQueue);
+	}
+
 	if (changed)
 	{
 		downloadQueue->HistoryChanged();
@@ -85,6 +104,86 @@ void HistoryCoordinator::ServiceWork()
 	}
 }
 
+/**
+ * Only the most recent entries are kept in memory, older entries are moved into history archive
+ */
+bool HistoryCoordinator::ArchiveHistory(DownloadQueue* downloadQueue)
+{
+	HistoryList* history = downloadQueue->GetHistory();
+	ArchiveList* archive = downloadQueue->GetArchive();
+	bool archived = false;
+
+	if (g_Options->GetRecentHistory() <= 0)
+	{
+		return false;
+	}
+
+	for (int index = g_Options->GetRecentHistory(); index < (int)history->size(); )
+	{
+		HistoryList::iterator it = history->begin() + index;
+		std::unique_ptr<ArchiveInfo> archiveInfo = g_DiskState->ArchiveHistory(it->get());
+		if (archiveInfo)
+		{
+			// the archive is ordered from newest to oldest as the history
+			time_t time = archiveInfo->GetTime();
+			ArchiveList::iterator pos = std::find_if(archive->begin(), archive->end(),
+				[time](std::unique_ptr<ArchiveInfo>& other)
+				{
+					return other->GetTime() < time;
+				});
+			archive->insert(pos, std::move(archiveInfo));
+			history->erase(it);
+			archived = true;
+		}
+		else
+		{
+			index++;
+		}
+	}
+
+	g_DiskState->CompactHistoryArchive(archive);
+
+	return archived;
+}
+
+/**
+ * Moves archived entry back into history, where it remains until the next service run
+ */
+HistoryInfo* HistoryCoordinator::RestoreArchived(DownloadQueue* downloadQueue, int id)
+{
+	ArchiveInfo* archiveInfo = downloadQueue->GetArchive()->Find(id);
+	if (!archiveInfo)
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<HistoryInfo> historyInfo = LoadArchived(archiveInfo);
+	if (!historyInfo)
+	{
+		return nullptr;
+	}
+
+	HistoryInfo* result = historyInfo.get();
+	g_DiskState->RemoveArchived(id);
+	downloadQueue->GetArchive()->Remove(archiveInfo);
+
+	HistoryList* history = downloadQueue->GetHistory();
+	HistoryList::iterator pos = std::find_if(history->begin(), history->end(),
+		[result](std::unique_ptr<HistoryInfo>& other)
+		{
+			return other->GetTime() < result->GetTime();
+		});
+	history->insert(pos, std::move(historyInfo));
+	downloadQueue->HistoryChanged();
+
+	return result;
+}
+
+std::unique_ptr<HistoryInfo> HistoryCoordinator::LoadArchived(ArchiveInfo* archiveInfo)
+{
+	return g_DiskState->LoadArchivedHistory(archiveInfo, g_ServerPool->GetServers());
+}
+
 void HistoryCoordinator::DeleteDiskFiles(NzbInfo* nzbInfo)
 {
 	if (g_Options->GetSaveQueue() && g_Options->GetServerMode())
@@ -203,7 +302,7 @@ void HistoryCoordinator::HistoryHide(DownloadQueue* downloadQueue, HistoryInfo*
 
 	info("Collection %s removed from history", historyInfo->GetName());
 
-	(*downloadQueue->GetHistory())[downloadQueue->GetHistory()->size() - 1 - rindex] = std::move(newHistoryInfo);
+	downloadQueue->GetHistory()->Replace(downloadQueue->GetHistory()->end() - 1 - rindex, std::move(newHistoryInfo));
 }
 
 void HistoryCoordinator::PrepareEdit(DownloadQueue* downloadQueue, IdList* idList, DownloadQueue::EEditAction action)
@@ -226,77 +325,80 @@ void HistoryCoordinator::PrepareEdit(DownloadQueue* downloadQueue, IdList* idLis
 bool HistoryCoordinator::EditList(DownloadQueue* downloadQueue, IdList* idList, DownloadQueue::EEditAction action, int offset, const char* text)
 {
 	bool ok = false;
+
+	// edited entries and queue scripts need complete data
+	for (int id : *idList)
+	{
+		RestoreArchived(downloadQueue, id);
+	}
+
 	PrepareEdit(downloadQueue, idList, action);
 
 	for (int id : *idList)
 	{
-		for (HistoryList::iterator itHistory = downloadQueue->GetHistory()->begin(); itHistory != downloadQueue->GetHistory()->end(); itHistory++)
+		HistoryInfo* historyInfo = downloadQueue->GetHistory()->Find(id);
+		if (historyInfo)
 		{
-			HistoryInfo* historyInfo = (*itHistory).get();
-			if (historyInfo->GetId() == id)
-			{
-				ok = true;
+			HistoryList::iterator itHistory = downloadQueue->GetHistory()->Find(historyInfo);
+			ok = true;
 
-				switch (action)
-				{
-					case DownloadQueue::eaHistoryDelete:
-					case DownloadQueue::eaHistoryFinalDelete:
-						HistoryDelete(downloadQueue, itHistory, historyInfo, action == DownloadQueue::eaHistoryFinalDelete);
-						break;
-
-					case DownloadQueue::eaHistoryReturn:
-						HistoryReturn(downloadQueue, itHistory, historyInfo);
-						break;
-
-					case DownloadQueue::eaHistoryProcess:
-						HistoryProcess(downloadQueue, itHistory, historyInfo);
-						break;
-
-					case DownloadQueue::eaHistoryRedownload:
-						HistoryRedownload(downloadQueue, itHistory, historyInfo, false);
-						break;
-
-					case DownloadQueue::eaHistoryRetryFailed:
-						HistoryRetry(downloadQueue, itHistory, historyInfo, true, false);
-						break;
-
-					case DownloadQueue::eaHistorySetParameter:
-						ok = HistorySetParameter(historyInfo, text);
-						break;
-
- 					case DownloadQueue::eaHistorySetCategory:
-						ok = HistorySetCategory(historyInfo, text);
-						break;
-
- 					case DownloadQueue::eaHistorySetName:
-						ok = HistorySetName(historyInfo, text);
-						break;
-
-					case DownloadQueue::eaHistorySetDupeKey:
-					case DownloadQueue::eaHistorySetDupeScore:
-					case DownloadQueue::eaHistorySetDupeMode:
-					case DownloadQueue::eaHistorySetDupeBackup:
-						HistorySetDupeParam(historyInfo, action, text);
-						break;
-
-					case DownloadQueue::eaHistoryMarkBad:
-						g_DupeCoordinator->HistoryMark(downloadQueue, historyInfo, NzbInfo::ksBad);
-						break;
-
-					case DownloadQueue::eaHistoryMarkGood:
-						g_DupeCoordinator->HistoryMark(downloadQueue, historyInfo, NzbInfo::ksGood);
-						break;
-
-					case DownloadQueue::eaHistoryMarkSuccess:
-						g_DupeCoordinator->HistoryMark(downloadQueue, historyInfo, NzbInfo::ksSuccess);
-						break;
-
-					default:
-						// nothing, just to avoid compiler warning
-						break;
-				}
-
-				break;
+			switch (action)
+			{
+				case DownloadQueue::eaHistoryDelete:
+				case DownloadQueue::eaHistoryFinalDelete:
+					HistoryDelete(downloadQueue, itHistory, historyInfo, action == DownloadQueue::eaHistoryFinalDelete);
+					break;
+
+				case DownloadQueue::eaHistoryReturn:
+					HistoryReturn(downloadQueue, itHistory, historyInfo);
+					break;
+
+				case DownloadQueue::eaHistoryProcess:
+					HistoryProcess(downloadQueue, itHistory, historyInfo);
+					break;
+
+				case DownloadQueue::eaHistoryRedownload:
+					HistoryRedownload(downloadQueue, itHistory, historyInfo, false);
+					break;
+
+				case DownloadQueue::eaHistoryRetryFailed:
+					HistoryRetry(downloadQueue, itHistory, historyInfo, true, false);
+					break;
+
+				case DownloadQueue::eaHistorySetParameter:
+					ok = HistorySetParameter(historyInfo, text);
+					break;
+
+				case DownloadQueue::eaHistorySetCategory:
+					ok = HistorySetCategory(historyInfo, text);
+					break;
+
+				case DownloadQueue::eaHistorySetName:
+					ok = HistorySetName(historyInfo, text);
+					break;
+
+				case DownloadQueue::eaHistorySetDupeKey:
+				case DownloadQueue::eaHistorySetDupeScore:
+				case DownloadQueue::eaHistorySetDupeMode:
+				case DownloadQueue::eaHistorySetDupeBackup:
+					HistorySetDupeParam(historyInfo, action, text);
+					break;
+
+				case DownloadQueue::eaHistoryMarkBad:
+					g_DupeCoordinator->HistoryMark(downloadQueue, historyInfo, NzbInfo::ksBad);
+					break;
+
+				case DownloadQueue::eaHistoryMarkGood:
+					g_DupeCoordinator->HistoryMark(downloadQueue, historyInfo, NzbInfo::ksGood);
+					break;
+
+				case DownloadQueue::eaHistoryMarkSuccess:
+					g_DupeCoordinator->HistoryMark(downloadQueue, historyInfo, NzbInfo::ksSuccess);
+					break;
+
+				default:
+					// nothing, just to avoid compiler warning
+					break;
 			}
 		}
 	}
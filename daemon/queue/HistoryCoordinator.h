@@ -32,6 +32,10 @@ public:
 	void DeleteDiskFiles(NzbInfo* nzbInfo);
 	void HistoryHide(DownloadQueue* downloadQueue, HistoryInfo* historyInfo, int rindex);
 	void Redownload(DownloadQueue* downloadQueue, HistoryInfo* historyInfo);
+	/* Moves archived entry back into history, returns nullptr if the entry isn't in the archive */
+	HistoryInfo* RestoreArchived(DownloadQueue* downloadQueue, int id);
+	/* Loads archived entry without moving it */
+	std::unique_ptr<HistoryInfo> LoadArchived(ArchiveInfo* archiveInfo);
 
 protected:
 	virtual int ServiceInterval() { return 600000; }
@@ -50,6 +54,7 @@ private:
 	void MoveToQueue(DownloadQueue* downloadQueue, HistoryList::iterator itHistory, HistoryInfo* historyInfo, bool reprocess);
 	void PrepareEdit(DownloadQueue* downloadQueue, IdList* idList, DownloadQueue::EEditAction action);
 	void ResetArticles(FileInfo* fileInfo, bool allFailed, bool resetFailed);
+	bool ArchiveHistory(DownloadQueue* downloadQueue);
 };
 
 extern HistoryCoordinator* g_HistoryCoordinator;
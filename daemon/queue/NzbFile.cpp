@@ -44,17 +44,20 @@ void NzbFile::LogDebugInfo()
 	info(" NZBFile %s", *m_fileName);
 }
 
-void NzbFile::AddArticle(FileInfo* fileInfo, std::unique_ptr<ArticleInfo> articleInfo)
+ArticleInfo* NzbFile::AddArticle(FileInfo* fileInfo, int partNumber, int size)
 {
-	int index = articleInfo->GetPartNumber() - 1;
+	int index = partNumber - 1;
 
-	// make Article-List big enough
+	// make Article-List big enough, missing articles remain with part number 0
 	if (index >= (int)fileInfo->GetArticles()->size())
 	{
 		fileInfo->GetArticles()->resize(index + 1);
 	}
 
-	(*fileInfo->GetArticles())[index] = std::move(articleInfo);
+	ArticleInfo* article = &fileInfo->GetArticles()->at(index);
+	article->SetPartNumber(partNumber);
+	article->SetSize(size);
+	return article;
 }
 
 void NzbFile::AddFileInfo(std::unique_ptr<FileInfo> fileInfo)
@@ -67,14 +70,10 @@ void NzbFile::AddFileInfo(std::unique_ptr<FileInfo> fileInfo)
 	int uncountedArticles = 0;
 	int missedArticles = 0;
 	int totalArticles = (int)fileInfo->GetArticles()->size();
-	int i = 0;
-	for (ArticleList::iterator it = fileInfo->GetArticles()->begin(); it != fileInfo->GetArticles()->end(); )
+	for (ArticleInfo* article : fileInfo->GetArticles())
 	{
-		ArticleInfo* article = (*it).get();
-		if (!article)
+		if (article->GetPartNumber() == 0)
 		{
-			fileInfo->GetArticles()->erase(it);
-			it = fileInfo->GetArticles()->begin() + i;
 			missedArticles++;
 			if (oneSize > 0)
 			{
@@ -92,11 +91,11 @@ void NzbFile::AddFileInfo(std::unique_ptr<FileInfo> fileInfo)
 			{
 				oneSize = article->GetSize();
 			}
-			it++;
-			i++;
 		}
 	}
 
+	fileInfo->GetArticles()->RemoveEmpty();
+
 	if (fileInfo->GetArticles()->empty())
 	{
 		return;
@@ -235,19 +234,25 @@ void NzbFile::ParseSubject(FileInfo* fileInfo, bool TryQuotes)
 
 bool NzbFile::HasDuplicateFilenames()
 {
-	for (FileList::iterator it = m_nzbInfo->GetFileList()->begin(); it != m_nzbInfo->GetFileList()->end(); it++)
+	// Walking the list backwards and counting files which follow the current one
+	// keeps the check linear even for nzbs with many thousands of files.
+	std::unordered_map<std::string, int> laterNames;
+	std::unordered_map<std::string, int> laterNamesSubjects;
+
+	FileList* fileList = m_nzbInfo->GetFileList();
+	for (FileList::reverse_iterator it = fileList->rbegin(); it != fileList->rend(); it++)
 	{
-		FileInfo* fileInfo1 = (*it).get();
-		int dupe = 1;
-		for (FileList::iterator it2 = it + 1; it2 != m_nzbInfo->GetFileList()->end(); it2++)
-		{
-			FileInfo* fileInfo2 = (*it2).get();
-			if (!strcmp(fileInfo1->GetFilename(), fileInfo2->GetFilename()) &&
-				strcmp(fileInfo1->GetSubject(), fileInfo2->GetSubject()))
-			{
-				dupe++;
-			}
-		}
+		FileInfo* fileInfo = (*it).get();
+		std::string name = fileInfo->GetFilename();
+		std::string nameSubject = name;
+		nameSubject.push_back('\0');
+		nameSubject.append(fileInfo->GetSubject());
+
+		int& sameName = laterNames[name];
+		int& sameNameSubject = laterNamesSubjects[nameSubject];
+		int dupe = 1 + sameName - sameNameSubject;
+		sameName++;
+		sameNameSubject++;
 
 		// If more than two files have the same parsed filename but different subjects,
 		// this means, that the parsing was not correct.
@@ -255,7 +260,7 @@ bool NzbFile::HasDuplicateFilenames()
 		// false "duplicate files"-alarm.
 		// It's Ok for just two files to have the same filename, this is
 		// an often case by posting-errors to repost bad files
-		if (dupe > 2 || (dupe == 2 && m_nzbInfo->GetFileList()->size() == 2))
+		if (dupe > 2 || (dupe == 2 && fileList->size() == 2))
 		{
 			return true;
 		}
@@ -578,11 +583,8 @@ bool NzbFile::ParseNzb(IUnknown* nzb)
 
 			if (partNumber > 0)
 			{
-				std::unique_ptr<ArticleInfo> article = std::make_unique<ArticleInfo>();
-				article->SetPartNumber(partNumber);
-				article->SetMessageId(id);
-				article->SetSize(lsize);
-				AddArticle(fileInfo.get(), std::move(article));
+				ArticleInfo* article = AddArticle(fileInfo.get(), partNumber, lsize);
+				fileInfo->GetArticles()->SetMessageId(article, id);
 			}
 		}
 
@@ -593,7 +595,50 @@ bool NzbFile::ParseNzb(IUnknown* nzb)
 
 #else
 
+static const int NZB_READ_BUFFER_SIZE = 256 * 1024;
+
 bool NzbFile::Parse()
+{
+	bool ok = ParseFast();
+	if (!ok)
+	{
+		// the document uses features the built-in tokenizer doesn't handle
+		// (or is malformed): start over with the full XML-parser
+		ResetParser();
+		ok = ParseXml();
+	}
+
+	if (!ok)
+	{
+		m_nzbInfo->AddMessage(Message::mkError, BString<1024>(
+			"Error parsing nzb-file %s", FileSystem::BaseFileName(m_fileName)));
+		return false;
+	}
+
+	if (m_nzbInfo->GetFileList()->empty())
+	{
+		m_nzbInfo->AddMessage(Message::mkError, BString<1024>(
+			"Error parsing nzb-file %s: file has no content", FileSystem::BaseFileName(m_fileName)));
+		return false;
+	}
+
+	ProcessFiles();
+
+	return true;
+}
+
+void NzbFile::ResetParser()
+{
+	m_nzbInfo->GetFileList()->clear();
+	m_nzbInfo->ClearMessages();
+	m_fileInfo.reset();
+	m_article = nullptr;
+	m_tagContent.Clear();
+	m_password.Clear();
+	m_hasPassword = false;
+}
+
+bool NzbFile::ParseXml()
 {
 	xmlSAXHandler SAX_handler = {0};
 	SAX_handler.startElement = reinterpret_cast<startElementSAXFunc>(SAX_StartElement);
@@ -606,28 +651,602 @@ bool NzbFile::Parse()
 
 	int ret = xmlSAXUserParseFile(&SAX_handler, this, m_fileName);
 
-	if (ret != 0)
+	return ret == 0;
+}
+
+class XmlCharClasses
+{
+public:
+	enum EClass
 	{
-		m_nzbInfo->AddMessage(Message::mkError, BString<1024>(
-			"Error parsing nzb-file %s", FileSystem::BaseFileName(m_fileName)));
-		return false;
+		ccSpace = 1,
+		ccName = 2,
+		ccTextDecode = 4, // must be decoded in text
+		ccAttrDecode = 8 // must be decoded in attribute values
+	};
+
+	XmlCharClasses()
+	{
+		for (int ch = 0; ch < 256; ch++)
+		{
+			m_classes[ch] =
+				(ch == ' ' || ch == 10 || ch == 13 || ch == 9 ? ccSpace : 0) |
+				(isalnum(ch) || ch == '_' || ch == ':' || ch == '-' || ch == '.' || ch >= 0x80 ? ccName : 0) |
+				(ch == '&' || ch == '<' || ch == 13 ? ccTextDecode | ccAttrDecode : 0) |
+				(ch == 10 || ch == 9 ? ccAttrDecode : 0);
+		}
 	}
 
-	if (m_nzbInfo->GetFileList()->empty())
+	bool Is(char ch, int cls) const { return m_classes[(uint8)ch] & cls; }
+
+private:
+	uint8 m_classes[256];
+};
+
+static const XmlCharClasses XmlChars;
+
+static bool IsXmlSpace(char ch)
+{
+	return XmlChars.Is(ch, XmlCharClasses::ccSpace);
+}
+
+static char* SkipXmlSpace(char* p)
+{
+	while (IsXmlSpace(*p)) p++;
+	return p;
+}
+
+static bool IsXmlNameChar(char ch)
+{
+	return XmlChars.Is(ch, XmlCharClasses::ccName);
+}
+
+/*
+ * Checks that the data is valid utf-8 without null-characters.
+ * Returns the position up to which the data is valid (a sequence cut by the end
+ * of data is left for the next check) or nullptr if the data is invalid.
+ */
+static char* CheckUtf8(char* p, char* end)
+{
+	while (p < end)
+	{
+		uint8 ch = (uint8)*p;
+		if (ch == 0)
+		{
+			return nullptr;
+		}
+		if (ch < 0x80)
+		{
+			// check eight ascii-characters at once
+			uint64 word;
+			if (end - p >= 8 && (memcpy(&word, p, 8), !(word & 0x8080808080808080ull)) &&
+				!((word - 0x0101010101010101ull) & ~word & 0x8080808080808080ull))
+			{
+				p += 8;
+			}
+			else
+			{
+				p++;
+			}
+			continue;
+		}
+
+		int follow = (ch & 0xE0) == 0xC0 ? 1 : (ch & 0xF0) == 0xE0 ? 2 : (ch & 0xF8) == 0xF0 ? 3 : -1;
+		if (follow < 0 || ch == 0xC0 || ch == 0xC1)
+		{
+			return nullptr;
+		}
+		if (end - p <= follow)
+		{
+			break;
+		}
+		for (int i = 1; i <= follow; i++)
+		{
+			if (((uint8)p[i] & 0xC0) != 0x80)
+			{
+				return nullptr;
+			}
+		}
+		p += follow + 1;
+	}
+	return p;
+}
+
+static char* EncodeUtf8(char* out, uint32 code)
+{
+	if (code < 0x80)
+	{
+		*out++ = (char)code;
+	}
+	else if (code < 0x800)
+	{
+		*out++ = (char)(0xC0 | (code >> 6));
+		*out++ = (char)(0x80 | (code & 0x3F));
+	}
+	else if (code < 0x10000)
+	{
+		*out++ = (char)(0xE0 | (code >> 12));
+		*out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+		*out++ = (char)(0x80 | (code & 0x3F));
+	}
+	else
+	{
+		*out++ = (char)(0xF0 | (code >> 18));
+		*out++ = (char)(0x80 | ((code >> 12) & 0x3F));
+		*out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+		*out++ = (char)(0x80 | (code & 0x3F));
+	}
+	return out;
+}
+
+/*
+ * Decodes character data in place: resolves predefined entities and character
+ * references and normalizes line breaks (and in attribute values also other
+ * white spaces). The decoded text is never longer than the source.
+ * Like the SAX-parser (which doesn't replace entities) it keeps ampersands in
+ * attribute values as character reference "&#38;" to produce identical subjects.
+ * Returns the end of decoded text or nullptr if the text can't be decoded
+ * without the full XML-parser.
+ */
+static char* DecodeXmlText(char* p, char* end, bool attribute)
+{
+	// most strings don't need any decoding
+	int decodeClass = attribute ? XmlCharClasses::ccAttrDecode : XmlCharClasses::ccTextDecode;
+	while (p < end && !XmlChars.Is(*p, decodeClass)) p++;
+
+	char* out = p;
+	while (p < end)
+	{
+		char ch = *p;
+		if (ch == '&')
+		{
+			char* semicolon = (char*)memchr(p, ';', std::min((int)(end - p), 12));
+			if (!semicolon)
+			{
+				return nullptr;
+			}
+			char* name = p + 1;
+			int len = (int)(semicolon - name);
+			if (len == 2 && !strncmp(name, "lt", 2)) *out++ = '<';
+			else if (len == 2 && !strncmp(name, "gt", 2)) *out++ = '>';
+			else if (len == 3 && !strncmp(name, "amp", 3) && attribute) out = (char*)memcpy(out, "&#38;", 5) + 5;
+			else if (len == 3 && !strncmp(name, "amp", 3)) *out++ = '&';
+			else if (len == 4 && !strncmp(name, "quot", 4)) *out++ = '"';
+			else if (len == 4 && !strncmp(name, "apos", 4)) *out++ = '\'';
+			else if (len > 1 && *name == '#')
+			{
+				bool hex = name[1] == 'x';
+				char* digits = name + (hex ? 2 : 1);
+				char* digitsEnd;
+				uint32 code = hex ? (isxdigit(*digits) ? strtoul(digits, &digitsEnd, 16) : 0) :
+					(isdigit(*digits) ? strtoul(digits, &digitsEnd, 10) : 0);
+				if (code == 0 || code > 0x10FFFF || digitsEnd != semicolon)
+				{
+					return nullptr;
+				}
+				out = code == '&' && attribute ? (char*)memcpy(out, "&#38;", 5) + 5 : EncodeUtf8(out, code);
+			}
+			else
+			{
+				// external entity, let the XML-parser report it
+				return nullptr;
+			}
+			p = semicolon + 1;
+		}
+		else if (ch == '<')
+		{
+			return nullptr;
+		}
+		else if (ch == 13)
+		{
+			p++;
+			if (*p != 10)
+			{
+				*out++ = attribute ? ' ' : 10;
+			}
+		}
+		else
+		{
+			*out++ = attribute && IsXmlSpace(ch) ? ' ' : ch;
+			p++;
+		}
+	}
+	return out;
+}
+
+/*
+ * Parses the document without the XML-parser. The file is read in chunks which are
+ * tokenized in place: element names, attributes and text are decoded within the read
+ * buffer and passed to the same handlers the SAX-parser uses, without copying every
+ * string into parser structures first.
+ * Documents using DTD-subsets, foreign encodings or other rare XML-features
+ * are refused, the caller then falls back to the full XML-parser.
+ */
+bool NzbFile::ParseFast()
+{
+	DiskFile file;
+	if (!file.Open(m_fileName, DiskFile::omRead))
 	{
-		m_nzbInfo->AddMessage(Message::mkError, BString<1024>(
-			"Error parsing nzb-file %s: file has no content", FileSystem::BaseFileName(m_fileName)));
 		return false;
 	}
 
-	ProcessFiles();
+	CharBuffer buffer(NZB_READ_BUFFER_SIZE + 1);
+	char* p = buffer; // start of unprocessed data
+	char* end = buffer; // end of data read so far
+	char* checked = buffer; // end of data checked for valid encoding
+	bool eof = false;
+	bool firstChunk = true;
 
+	std::string tagNames;
+	std::vector<int> tagStarts;
+	std::vector<char*> attrBounds;
+	std::vector<const char*> atts;
+	bool rootDone = false;
+
+	while (!eof)
+	{
+		// move unprocessed data to the beginning of the buffer and read the next chunk
+		int rest = (int)(end - p);
+		int checkedRest = (int)(checked - p);
+		if (p > buffer)
+		{
+			memmove(buffer, p, rest);
+		}
+		else if (rest == buffer.Size() - 1)
+		{
+			// the token doesn't fit into the buffer
+			buffer.Reserve(buffer.Size() * 2);
+		}
+		p = buffer;
+		end = p + rest;
+		checked = p + checkedRest;
+
+		int64 len = file.Read(end, buffer.Size() - 1 - rest);
+		eof = len <= 0;
+		end += eof ? 0 : len;
+		*end = '\0';
+
+		if (firstChunk && end - p >= 3 && !strncmp(p, "\xEF\xBB\xBF", 3))
+		{
+			// skip utf-8 byte order mark
+			p += 3;
+			checked = p;
+		}
+		firstChunk = false;
+
+		checked = CheckUtf8(checked, end);
+		if (!checked || (eof && checked < end))
+		{
+			return false;
+		}
+
+		// process all complete tokens in the buffer, an incomplete token at the end
+		// of buffer is processed after the next chunk is read
+		bool needMore = false;
+		while (p < end && !needMore)
+		{
+			if (*p != '<')
+			{
+				char* text = p;
+				char* textEnd = (char*)memchr(p, '<', end - p);
+				if (!textEnd && !eof)
+				{
+					needMore = true;
+					continue;
+				}
+				p = textEnd ? textEnd : end;
+
+				if (tagStarts.empty())
+				{
+					// only white spaces are allowed outside of root element
+					for (; text < p; text++)
+					{
+						if (!IsXmlSpace(*text))
+						{
+							return false;
+						}
+					}
+				}
+				else if (!ParseFastText(text, p))
+				{
+					return false;
+				}
+				continue;
+			}
+
+			if (end - p < 10 && !eof)
+			{
+				// not enough data to recognize the token
+				needMore = true;
+				continue;
+			}
+
+			if (!strncmp(p, "<!--", 4))
+			{
+				char* commentEnd = strstr(p + 4, "-->");
+				if (!commentEnd)
+				{
+					needMore = true;
+					continue;
+				}
+				p = commentEnd + 3;
+			}
+			else if (!strncmp(p, "<![CDATA[", 9))
+			{
+				char* text = p + 9;
+				char* textEnd = strstr(text, "]]>");
+				if (!textEnd)
+				{
+					needMore = true;
+					continue;
+				}
+				if (tagStarts.empty())
+				{
+					return false;
+				}
+				p = textEnd + 3;
+
+				while (text < textEnd && IsXmlSpace(*text)) text++;
+				while (textEnd > text && IsXmlSpace(textEnd[-1])) textEnd--;
+				if (textEnd > text)
+				{
+					Parse_Content(text, (int)(textEnd - text));
+				}
+			}
+			else if (!strncmp(p, "<!DOCTYPE", 9))
+			{
+				if (!tagStarts.empty() || rootDone)
+				{
+					return false;
+				}
+
+				// external DTD is ignored, internal subset can define entities and is refused
+				char* q = p + 9;
+				char quote = 0;
+				for (; q < end && (quote || *q != '>'); q++)
+				{
+					if (quote)
+					{
+						quote = *q == quote ? 0 : quote;
+					}
+					else if (*q == '"' || *q == '\'')
+					{
+						quote = *q;
+					}
+					else if (*q == '[')
+					{
+						return false;
+					}
+				}
+				if (q == end)
+				{
+					needMore = true;
+					continue;
+				}
+				p = q + 1;
+			}
+			else if (p[1] == '?')
+			{
+				char* piEnd = strstr(p + 2, "?>");
+				if (!piEnd)
+				{
+					needMore = true;
+					continue;
+				}
+				*piEnd = '\0';
+
+				if (!strncmp(p, "<?xml", 5) && IsXmlSpace(p[5]))
+				{
+					char* encoding = strstr(p, "encoding");
+					if (encoding)
+					{
+						encoding = SkipXmlSpace(encoding + 8);
+						if (*encoding != '=')
+						{
+							return false;
+						}
+						encoding = SkipXmlSpace(encoding + 1) + 1;
+						if (strncasecmp(encoding, "utf-8", 5) && strncasecmp(encoding, "us-ascii", 8))
+						{
+							return false;
+						}
+					}
+				}
+				p = piEnd + 2;
+			}
+			else if (p[1] == '/')
+			{
+				char* name = p + 2;
+				char* nameEnd = name;
+				while (IsXmlNameChar(*nameEnd)) nameEnd++;
+				char* q = SkipXmlSpace(nameEnd);
+				if (q == end)
+				{
+					needMore = true;
+					continue;
+				}
+				if (*q != '>' || tagStarts.empty())
+				{
+					return false;
+				}
+				*nameEnd = '\0';
+				if (strcmp(name, tagNames.c_str() + tagStarts.back()))
+				{
+					return false;
+				}
+				p = q + 1;
+
+				Parse_EndElement(name);
+				tagNames.resize(tagStarts.back());
+				tagStarts.pop_back();
+				rootDone = tagStarts.empty();
+			}
+			else
+			{
+				char* name = p + 1;
+				if (!(isalpha(*name) || *name == '_' || *name == ':' || (uint8)*name >= 0x80) || rootDone)
+				{
+					return false;
+				}
+
+				char* nameEnd = name;
+				while (IsXmlNameChar(*nameEnd)) nameEnd++;
+
+				// locate attributes first and decode them in place only
+				// after making sure the whole tag is in the buffer
+				char* q = nameEnd;
+				bool selfClosing = false;
+				attrBounds.clear();
+				while (!needMore)
+				{
+					char* attrStart = q;
+					q = SkipXmlSpace(q);
+					if (q == end || (q[0] == '/' && q + 1 == end))
+					{
+						needMore = true;
+						break;
+					}
+					if (*q == '>')
+					{
+						q++;
+						break;
+					}
+					if (q[0] == '/' && q[1] == '>')
+					{
+						selfClosing = true;
+						q += 2;
+						break;
+					}
+					if (q == attrStart)
+					{
+						// attributes must be separated by white spaces
+						return false;
+					}
+
+					char* attrName = q;
+					while (IsXmlNameChar(*q)) q++;
+					char* attrNameEnd = q;
+					q = SkipXmlSpace(q);
+					if (q < end && (attrNameEnd == attrName || *q != '='))
+					{
+						return false;
+					}
+					q = q < end ? SkipXmlSpace(q + 1) : q;
+					if (q == end)
+					{
+						needMore = true;
+						break;
+					}
+
+					char quote = *q;
+					if (quote != '"' && quote != '\'')
+					{
+						return false;
+					}
+					char* value = q + 1;
+					q = (char*)memchr(value, quote, end - value);
+					if (!q)
+					{
+						needMore = true;
+						break;
+					}
+
+					attrBounds.push_back(attrName);
+					attrBounds.push_back(attrNameEnd);
+					attrBounds.push_back(value);
+					attrBounds.push_back(q);
+					q++;
+				}
+				if (needMore)
+				{
+					continue;
+				}
+				p = q;
+
+				atts.clear();
+				for (int i = 0; i < (int)attrBounds.size(); i += 4)
+				{
+					char* valueEnd = DecodeXmlText(attrBounds[i + 2], attrBounds[i + 3], true);
+					if (!valueEnd)
+					{
+						return false;
+					}
+					*attrBounds[i + 1] = '\0';
+					*valueEnd = '\0';
+					atts.push_back(attrBounds[i]);
+					atts.push_back(attrBounds[i + 2]);
+				}
+
+				*nameEnd = '\0';
+				atts.push_back(nullptr);
+
+				Parse_StartElement(name, atts.size() > 1 ? atts.data() : nullptr);
+				if (selfClosing)
+				{
+					Parse_EndElement(name);
+					rootDone = tagStarts.empty();
+				}
+				else
+				{
+					tagStarts.push_back((int)tagNames.size());
+					tagNames.append(name, nameEnd - name + 1);
+				}
+			}
+		}
+
+		if (needMore && eof)
+		{
+			return false;
+		}
+	}
+
+	return rootDone;
+}
+
+/*
+ * The SAX-parser reports references in element content as separate chunks,
+ * which are trimmed individually. Doing the same gives identical results.
+ */
+bool NzbFile::ParseFastText(char* text, char* end)
+{
+	while (text < end)
+	{
+		char* chunkEnd = (char*)memchr(text, '&', end - text);
+		if (chunkEnd == text)
+		{
+			chunkEnd = (char*)memchr(text, ';', std::min((int)(end - text), 12));
+			if (!chunkEnd)
+			{
+				return false;
+			}
+			chunkEnd++;
+		}
+		chunkEnd = chunkEnd ? chunkEnd : end;
+
+		char* chunk = text;
+		char* decodedEnd = DecodeXmlText(chunk, chunkEnd, false);
+		if (!decodedEnd)
+		{
+			return false;
+		}
+		text = chunkEnd;
+
+		while (chunk < decodedEnd && IsXmlSpace(*chunk)) chunk++;
+		while (decodedEnd > chunk && IsXmlSpace(decodedEnd[-1])) decodedEnd--;
+		if (decodedEnd > chunk)
+		{
+			Parse_Content(chunk, (int)(decodedEnd - chunk));
+		}
+	}
 	return true;
 }
 
 void NzbFile::Parse_StartElement(const char *name, const char **atts)
 {
-	BString<1024> tagAttrMessage("Malformed nzb-file, tag <%s> must have attributes", name);
+	auto tagAttrMessage = [name]()
+	{
+		return BString<1024>("Malformed nzb-file, tag <%s> must have attributes", name);
+	};
 
 	m_tagContent.Clear();
 
@@ -638,7 +1257,7 @@ void NzbFile::Parse_StartElement(const char *name, const char **atts)
 
 		if (!atts)
 		{
-			m_nzbInfo->AddMessage(Message::mkWarning, tagAttrMessage);
+			m_nzbInfo->AddMessage(Message::mkWarning, tagAttrMessage());
 			return;
 		}
 
@@ -666,7 +1285,7 @@ void NzbFile::Parse_StartElement(const char *name, const char **atts)
 
 		if (!atts)
 		{
-			m_nzbInfo->AddMessage(Message::mkWarning, tagAttrMessage);
+			m_nzbInfo->AddMessage(Message::mkWarning, tagAttrMessage());
 			return;
 		}
 
@@ -690,18 +1309,14 @@ void NzbFile::Parse_StartElement(const char *name, const char **atts)
 		if (partNumber > 0)
 		{
 			// new segment, add it!
-			std::unique_ptr<ArticleInfo> article = std::make_unique<ArticleInfo>();
-			article->SetPartNumber(partNumber);
-			article->SetSize(lsize);
-			m_article = article.get();
-			AddArticle(m_fileInfo.get(), std::move(article));
+			m_article = AddArticle(m_fileInfo.get(), partNumber, (int)lsize);
 		}
 	}
 	else if (!strcmp("meta", name))
 	{
 		if (!atts)
 		{
-			m_nzbInfo->AddMessage(Message::mkWarning, tagAttrMessage);
+			m_nzbInfo->AddMessage(Message::mkWarning, tagAttrMessage());
 			return;
 		}
 		m_hasPassword = atts[0] && atts[1] && !strcmp("type", atts[0]) && !strcmp("password", atts[1]);
@@ -736,8 +1351,11 @@ void NzbFile::Parse_EndElement(const char *name)
 		}
 
 		// Get the #text part
-		BString<1024> id("<%s>", *m_tagContent);
-		m_article->SetMessageId(id);
+		BString<1024> id;
+		id.Set("<", 1);
+		id.Append(m_tagContent, m_tagContent.Length());
+		id.Append(">", 1);
+		m_fileInfo->GetArticles()->SetMessageId(m_article, id);
 		m_article = nullptr;
 	}
 	else if (!strcmp("meta", name) && m_hasPassword)
@@ -41,7 +41,7 @@ private:
 	CString m_fileName;
 	CString m_password;
 
-	void AddArticle(FileInfo* fileInfo, std::unique_ptr<ArticleInfo> articleInfo);
+	ArticleInfo* AddArticle(FileInfo* fileInfo, int partNumber, int size);
 	void AddFileInfo(std::unique_ptr<FileInfo> fileInfo);
 	void ParseSubject(FileInfo* fileInfo, bool TryQuotes);
 	void BuildFilenames();
@@ -64,6 +64,10 @@ private:
 	static void SAX_characters(NzbFile* file, const char *  xmlstr, int len);
 	static void* SAX_getEntity(NzbFile* file, const char *  name);
 	static void SAX_error(NzbFile* file, const char *msg, ...);
+	bool ParseFast();
+	bool ParseFastText(char* text, char* end);
+	bool ParseXml();
+	void ResetParser();
 	void Parse_StartElement(const char *name, const char **atts);
 	void Parse_EndElement(const char *name);
 	void Parse_Content(const char *buf, int len);
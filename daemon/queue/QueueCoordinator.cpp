@@ -31,6 +31,12 @@
 #include "Decoder.h"
 #include "StatMeter.h"
 
+// how often (microseconds) the disk load is checked
+static const int64 BACKPRESSURE_INTERVAL = 500 * 1000;
+
+// minimum number of download threads when the disk is overloaded
+static const int MIN_THROTTLED_DOWNLOADS = 3;
+
 bool QueueCoordinator::CoordinatorDownloadQueue::EditEntry(
 	int ID, EEditAction action, int offset, const char* text)
 {
@@ -45,12 +51,24 @@ bool QueueCoordinator::CoordinatorDownloadQueue::EditList(
 	m_massEdit = false;
 	if (m_wantSave)
 	{
-		Save();
+		DoSave();
 	}
 	return ret;
 }
 
 void QueueCoordinator::CoordinatorDownloadQueue::Save()
+{
+	m_queueChanged = true;
+	DoSave();
+}
+
+void QueueCoordinator::CoordinatorDownloadQueue::SaveChanged(int nzbId)
+{
+	m_changedIds.push_back(nzbId);
+	DoSave();
+}
+
+void QueueCoordinator::CoordinatorDownloadQueue::DoSave()
 {
 	if (m_massEdit)
 	{
@@ -58,13 +76,46 @@ void QueueCoordinator::CoordinatorDownloadQueue::Save()
 		return;
 	}
 
-	if (g_Options->GetSaveQueue() && g_Options->GetServerMode())
+	m_wantSave = false;
+
+	if (!g_Options->GetSaveQueue() || !g_Options->GetServerMode())
 	{
-		g_DiskState->SaveDownloadQueue(this, m_historyChanged);
+		m_historyChanged = false;
+		m_queueChanged = false;
+		m_changedIds.clear();
+		return;
 	}
 
-	m_wantSave = false;
+	// the caller holds the exclusive queue lock, the records are serialized later
+	// under the shared lock, see SavePending
+	::Guard guard(m_saveMutex);
+	m_savePending = true;
+}
+
+bool QueueCoordinator::CoordinatorDownloadQueue::IsSavePending()
+{
+	::Guard guard(m_saveMutex);
+	return m_savePending;
+}
+
+/*
+ * Must be called under the shared queue lock. Changes are only recorded under the
+ * exclusive lock, the flags can't change here; the mutex prevents concurrent saves.
+ */
+void QueueCoordinator::CoordinatorDownloadQueue::SavePending()
+{
+	::Guard guard(m_saveMutex);
+	if (!m_savePending)
+	{
+		return;
+	}
+
+	g_DiskState->SaveDownloadQueue(this, m_historyChanged, m_queueChanged ? nullptr : &m_changedIds);
+
+	m_savePending = false;
 	m_historyChanged = false;
+	m_queueChanged = false;
+	m_changedIds.clear();
 }
 
 QueueCoordinator::QueueCoordinator()
@@ -161,6 +212,12 @@ void QueueCoordinator::Load()
 		}
 	}
 
+	if (queueLoaded)
+	{
+		// the queue is usable now, progress of partially downloaded files is loaded in background
+		g_DiskState->StartStateLoader(g_ServerPool->GetServers());
+	}
+
 	CoordinatorDownloadQueue::Loaded();
 }
 
@@ -193,7 +250,7 @@ void QueueCoordinator::Run()
 				articeDownloadsRunning = !m_activeDownloads.empty();
 				downloadsChecked = true;
 				m_hasMoreJobs = hasMoreArticles || articeDownloadsRunning;
-				if (hasMoreArticles && !IsStopped() && (int)m_activeDownloads.size() < m_downloadsLimit &&
+				if (hasMoreArticles && !IsStopped() && (int)m_activeDownloads.size() < m_throttledLimit &&
 					(!g_Options->GetTempPauseDownload() || fileInfo->GetExtraPriority()))
 				{
 					StartArticleDownload(fileInfo, articleInfo, connection);
@@ -229,6 +286,13 @@ void QueueCoordinator::Run()
 			}
 		}
 
+		if (!standBy)
+		{
+			ApplyBackpressure();
+		}
+
+		SaveQueueChanges();
+
 		// sleep longer in StandBy
 		int sleepInterval = downloadStarted ? 0 : standBy ? 100 : 5;
 		usleep(sleepInterval * 1000);
@@ -271,6 +335,7 @@ void QueueCoordinator::Run()
 	debug("QueueCoordinator: Downloads are completed");
 
 	SavePartialState();
+	SaveQueueChanges();
 
 	debug("Exiting QueueCoordinator-loop");
 }
@@ -298,6 +363,43 @@ void QueueCoordinator::AdjustDownloadsLimit()
 	}
 
 	m_downloadsLimit = downloadsLimit;
+	m_throttledLimit = downloadsLimit;
+}
+
+/*
+ * Reduces the number of download threads while the disk can't keep up with
+ * writing of downloaded articles and restores it gradually once the disk recovered.
+ */
+void QueueCoordinator::ApplyBackpressure()
+{
+	int64 curTicks = Util::GetCurrentTicks();
+	if (curTicks - m_backpressureTicks < BACKPRESSURE_INTERVAL)
+	{
+		return;
+	}
+	m_backpressureTicks = curTicks;
+
+	g_ArticleCache->CheckDiskLoad();
+
+	int throttledLimit = CalcThrottledLimit(m_throttledLimit, m_downloadsLimit, g_ArticleCache->GetDiskBound());
+	if (throttledLimit != m_throttledLimit)
+	{
+		debug("Adjusting download threads limit due to disk load: %i", throttledLimit);
+		m_throttledLimit = throttledLimit;
+	}
+}
+
+int QueueCoordinator::CalcThrottledLimit(int throttledLimit, int downloadsLimit, bool diskBound)
+{
+	if (diskBound)
+	{
+		return std::min(downloadsLimit, std::max(MIN_THROTTLED_DOWNLOADS, throttledLimit * 3 / 4));
+	}
+	else if (throttledLimit < downloadsLimit)
+	{
+		return std::min(downloadsLimit, throttledLimit + 1 + downloadsLimit / 10);
+	}
+	return throttledLimit;
 }
 
 NzbInfo* QueueCoordinator::AddNzbFileToQueue(std::unique_ptr<NzbInfo> nzbInfo, NzbInfo* urlInfo, bool addFirst)
@@ -327,6 +429,12 @@ NzbInfo* QueueCoordinator::AddNzbFileToQueue(std::unique_ptr<NzbInfo> nzbInfo, N
 		nzbInfo->SetDeletePaused(allPaused);
 	}
 
+	if (urlInfo)
+	{
+		// take over the id of the url item before adding to queue to keep the queue index consistent
+		addedNzb->SetId(urlInfo->GetId());
+	}
+
 	if (deleteStatus == NzbInfo::dsNone)
 	{
 		if (g_Options->GetDupeCheck() && nzbInfo->GetDupeMode() != dmForce)
@@ -352,7 +460,6 @@ NzbInfo* QueueCoordinator::AddNzbFileToQueue(std::unique_ptr<NzbInfo> nzbInfo, N
 
 	if (urlInfo)
 	{
-		addedNzb->SetId(urlInfo->GetId());
 		downloadQueue->GetQueue()->Remove(urlInfo);
 	}
 
@@ -493,6 +600,11 @@ bool QueueCoordinator::GetNextArticle(DownloadQueue* downloadQueue, FileInfo* &f
 		{
 			g_DiskState->LoadArticles(fileInfo);
 			LoadPartialState(fileInfo);
+			if (fileInfo->GetPartialState() != FileInfo::psNone)
+			{
+				// the file state may have been loaded before the background loader reached it
+				fileInfo->GetNzbInfo()->UpdateCurrentStats();
+			}
 		}
 
 		// check if the file has any articles left for download
@@ -558,79 +670,26 @@ void QueueCoordinator::ArticleCompleted(ArticleDownloader* articleDownloader)
 
 	FileInfo* fileInfo = articleDownloader->GetFileInfo();
 	NzbInfo* nzbInfo = fileInfo->GetNzbInfo();
-	ArticleInfo* articleInfo = articleDownloader->GetArticleInfo();
-	bool retry = false;
 	bool fileCompleted = false;
 
+	// A successfully downloaded article changes only the download state of its nzb,
+	// the queue is locked in shared mode then and the nzb is locked for the update.
+	// Failed articles may affect the health of the nzb and a confirmed filename may
+	// lead to dupe-deletion of the file, these changes require the exclusive lock.
+	bool exclusive = articleDownloader->GetStatus() == ArticleDownloader::adFailed ||
+		(articleDownloader->GetStatus() == ArticleDownloader::adFinished &&
+		 !fileInfo->GetFilenameConfirmed() && articleDownloader->GetArticleFilename());
+
+	if (exclusive)
 	{
 		GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
-
-		if (articleDownloader->GetStatus() == ArticleDownloader::adFinished)
-		{
-			articleInfo->SetStatus(ArticleInfo::aiFinished);
-			fileInfo->SetSuccessSize(fileInfo->GetSuccessSize() + articleInfo->GetSize());
-			nzbInfo->SetCurrentSuccessSize(nzbInfo->GetCurrentSuccessSize() + articleInfo->GetSize());
-			nzbInfo->SetParCurrentSuccessSize(nzbInfo->GetParCurrentSuccessSize() + (fileInfo->GetParFile() ? articleInfo->GetSize() : 0));
-			fileInfo->SetSuccessArticles(fileInfo->GetSuccessArticles() + 1);
-			nzbInfo->SetCurrentSuccessArticles(nzbInfo->GetCurrentSuccessArticles() + 1);
-		}
-		else if (articleDownloader->GetStatus() == ArticleDownloader::adFailed)
-		{
-			articleInfo->SetStatus(ArticleInfo::aiFailed);
-			fileInfo->SetFailedSize(fileInfo->GetFailedSize() + articleInfo->GetSize());
-			nzbInfo->SetCurrentFailedSize(nzbInfo->GetCurrentFailedSize() + articleInfo->GetSize());
-			nzbInfo->SetParCurrentFailedSize(nzbInfo->GetParCurrentFailedSize() + (fileInfo->GetParFile() ? articleInfo->GetSize() : 0));
-			fileInfo->SetFailedArticles(fileInfo->GetFailedArticles() + 1);
-			nzbInfo->SetCurrentFailedArticles(nzbInfo->GetCurrentFailedArticles() + 1);
-		}
-		else if (articleDownloader->GetStatus() == ArticleDownloader::adRetry)
-		{
-			articleInfo->SetStatus(ArticleInfo::aiUndefined);
-			retry = true;
-		}
-
-		if (!retry)
-		{
-			fileInfo->SetRemainingSize(fileInfo->GetRemainingSize() - articleInfo->GetSize());
-			nzbInfo->SetRemainingSize(nzbInfo->GetRemainingSize() - articleInfo->GetSize());
-			if (fileInfo->GetPaused())
-			{
-				nzbInfo->SetPausedSize(nzbInfo->GetPausedSize() - articleInfo->GetSize());
-			}
-			fileInfo->SetCompletedArticles(fileInfo->GetCompletedArticles() + 1);
-			fileCompleted = (int)fileInfo->GetArticles()->size() == fileInfo->GetCompletedArticles();
-			fileInfo->GetServerStats()->ListOp(articleDownloader->GetServerStats(), ServerStatList::soAdd);
-			nzbInfo->GetCurrentServerStats()->ListOp(articleDownloader->GetServerStats(), ServerStatList::soAdd);
-			fileInfo->SetPartialChanged(true);
-		}
-
-		if (!fileInfo->GetFilenameConfirmed() &&
-			articleDownloader->GetStatus() == ArticleDownloader::adFinished &&
-			articleDownloader->GetArticleFilename())
-		{
-			fileInfo->SetFilename(articleDownloader->GetArticleFilename());
-			fileInfo->MakeValidFilename();
-			fileInfo->SetFilenameConfirmed(true);
-			if (g_Options->GetDupeCheck() &&
-				nzbInfo->GetDupeMode() != dmForce &&
-				!nzbInfo->GetManyDupeFiles() &&
-				FileSystem::FileExists(nzbInfo->GetDestDir(), fileInfo->GetFilename()))
-			{
-				warn("File \"%s\" seems to be duplicate, cancelling download and deleting file from queue", fileInfo->GetFilename());
-				fileCompleted = false;
-				fileInfo->SetDupeDeleted(true);
-				DeleteQueueEntry(downloadQueue, fileInfo);
-			}
-		}
-
-		nzbInfo->SetDownloadedSize(nzbInfo->GetDownloadedSize() + articleDownloader->GetDownloadedSize());
-
-		CheckHealth(downloadQueue, fileInfo);
-
-		if (nzbInfo->GetParking() && fileInfo->GetActiveDownloads() == 1 && !fileInfo->GetDupeDeleted())
-		{
-			fileCompleted = true;
-		}
+		fileCompleted = UpdateArticleState(downloadQueue, articleDownloader, true);
+	}
+	else
+	{
+		SharedGuardedDownloadQueue downloadQueue = DownloadQueue::GuardShared();
+		Guard stateGuard = nzbInfo->GuardDownloadState();
+		fileCompleted = UpdateArticleState(downloadQueue, articleDownloader, false);
 	}
 
 	bool deleteFileObj = false;
@@ -657,10 +716,94 @@ void QueueCoordinator::ArticleCompleted(ArticleDownloader* articleDownloader)
 
 		if (deleteFileObj)
 		{
+			// nzb may be deleted together with its last file
+			int nzbId = nzbInfo->GetId();
 			DeleteFileInfo(downloadQueue, fileInfo, fileCompleted);
-			downloadQueue->Save();
+			downloadQueue->SaveChanged(nzbId);
+		}
+	}
+}
+
+bool QueueCoordinator::UpdateArticleState(DownloadQueue* downloadQueue, ArticleDownloader* articleDownloader,
+	bool exclusive)
+{
+	FileInfo* fileInfo = articleDownloader->GetFileInfo();
+	NzbInfo* nzbInfo = fileInfo->GetNzbInfo();
+	ArticleInfo* articleInfo = articleDownloader->GetArticleInfo();
+	bool retry = false;
+	bool fileCompleted = false;
+
+	if (articleDownloader->GetStatus() == ArticleDownloader::adFinished)
+	{
+		articleInfo->SetStatus(ArticleInfo::aiFinished);
+		fileInfo->SetSuccessSize(fileInfo->GetSuccessSize() + articleInfo->GetSize());
+		nzbInfo->SetCurrentSuccessSize(nzbInfo->GetCurrentSuccessSize() + articleInfo->GetSize());
+		nzbInfo->SetParCurrentSuccessSize(nzbInfo->GetParCurrentSuccessSize() + (fileInfo->GetParFile() ? articleInfo->GetSize() : 0));
+		fileInfo->SetSuccessArticles(fileInfo->GetSuccessArticles() + 1);
+		nzbInfo->SetCurrentSuccessArticles(nzbInfo->GetCurrentSuccessArticles() + 1);
+	}
+	else if (articleDownloader->GetStatus() == ArticleDownloader::adFailed)
+	{
+		articleInfo->SetStatus(ArticleInfo::aiFailed);
+		fileInfo->SetFailedSize(fileInfo->GetFailedSize() + articleInfo->GetSize());
+		nzbInfo->SetCurrentFailedSize(nzbInfo->GetCurrentFailedSize() + articleInfo->GetSize());
+		nzbInfo->SetParCurrentFailedSize(nzbInfo->GetParCurrentFailedSize() + (fileInfo->GetParFile() ? articleInfo->GetSize() : 0));
+		fileInfo->SetFailedArticles(fileInfo->GetFailedArticles() + 1);
+		nzbInfo->SetCurrentFailedArticles(nzbInfo->GetCurrentFailedArticles() + 1);
+	}
+	else if (articleDownloader->GetStatus() == ArticleDownloader::adRetry)
+	{
+		articleInfo->SetStatus(ArticleInfo::aiUndefined);
+		retry = true;
+	}
+
+	if (!retry)
+	{
+		fileInfo->SetRemainingSize(fileInfo->GetRemainingSize() - articleInfo->GetSize());
+		nzbInfo->SetRemainingSize(nzbInfo->GetRemainingSize() - articleInfo->GetSize());
+		if (fileInfo->GetPaused())
+		{
+			nzbInfo->SetPausedSize(nzbInfo->GetPausedSize() - articleInfo->GetSize());
 		}
+		fileInfo->SetCompletedArticles(fileInfo->GetCompletedArticles() + 1);
+		fileCompleted = (int)fileInfo->GetArticles()->size() == fileInfo->GetCompletedArticles();
+		fileInfo->GetServerStats()->ListOp(articleDownloader->GetServerStats(), ServerStatList::soAdd);
+		nzbInfo->GetCurrentServerStats()->ListOp(articleDownloader->GetServerStats(), ServerStatList::soAdd);
+		fileInfo->SetPartialChanged(true);
+	}
+
+	if (!fileInfo->GetFilenameConfirmed() &&
+		articleDownloader->GetStatus() == ArticleDownloader::adFinished &&
+		articleDownloader->GetArticleFilename())
+	{
+		fileInfo->SetFilename(articleDownloader->GetArticleFilename());
+		fileInfo->MakeValidFilename();
+		fileInfo->SetFilenameConfirmed(true);
+		if (g_Options->GetDupeCheck() &&
+			nzbInfo->GetDupeMode() != dmForce &&
+			!nzbInfo->GetManyDupeFiles() &&
+			FileSystem::FileExists(nzbInfo->GetDestDir(), fileInfo->GetFilename()))
+		{
+			warn("File \"%s\" seems to be duplicate, cancelling download and deleting file from queue", fileInfo->GetFilename());
+			fileCompleted = false;
+			fileInfo->SetDupeDeleted(true);
+			DeleteQueueEntry(downloadQueue, fileInfo);
+		}
+	}
+
+	nzbInfo->SetDownloadedSize(nzbInfo->GetDownloadedSize() + articleDownloader->GetDownloadedSize());
+
+	if (exclusive)
+	{
+		CheckHealth(downloadQueue, fileInfo);
 	}
+
+	if (nzbInfo->GetParking() && fileInfo->GetActiveDownloads() == 1 && !fileInfo->GetDupeDeleted())
+	{
+		fileCompleted = true;
+	}
+
+	return fileCompleted;
 }
 
 void QueueCoordinator::DeleteFileInfo(DownloadQueue* downloadQueue, FileInfo* fileInfo, bool completed)
@@ -740,10 +883,27 @@ void QueueCoordinator::DiscardTempFiles(FileInfo* fileInfo)
 
 	if (g_Options->GetDirectWrite() && fileInfo->GetOutputFilename() && !fileInfo->GetForceDirectWrite())
 	{
+		if (fileInfo->GetOutputMapping())
+		{
+			Guard guard = fileInfo->GuardOutputFile();
+			fileInfo->SetOutputMapping(nullptr);
+		}
 		FileSystem::DeleteFile(fileInfo->GetOutputFilename());
 	}
 }
 
+void QueueCoordinator::SaveQueueChanges()
+{
+	// checked first to not lock the queue on every loop iteration
+	if (!m_downloadQueue.IsSavePending())
+	{
+		return;
+	}
+
+	SharedGuardedDownloadQueue downloadQueue = DownloadQueue::GuardShared();
+	m_downloadQueue.SavePending();
+}
+
 void QueueCoordinator::SavePartialState()
 {
 	if (!(g_Options->GetServerMode() && g_Options->GetSaveQueue() && g_Options->GetContinuePartial()))
@@ -836,6 +996,15 @@ void QueueCoordinator::LogDebugInfo()
 		 (g_Options->GetPausePostProcess() ? "paused" : "active"),
 		 (g_Options->GetPauseScan() ? "paused" : "active"));
 
+	RwMutex::Stats lockStats = DownloadQueue::GetLockStats();
+	info("     Exclusive locks: %i, wait %.1f ms, hold %.1f ms (avg %.3f ms, max %.1f ms)",
+		lockStats.exclusiveCount, lockStats.exclusiveWait / 1000.0, lockStats.exclusiveHold / 1000.0,
+		lockStats.exclusiveCount ? lockStats.exclusiveHold / 1000.0 / lockStats.exclusiveCount : 0.0,
+		lockStats.exclusiveMaxHold / 1000.0);
+	info("     Shared locks: %i, wait %.1f ms, hold %.1f ms (max %.1f ms)",
+		lockStats.sharedCount, lockStats.sharedWait / 1000.0, lockStats.sharedHold / 1000.0,
+		lockStats.sharedMaxHold / 1000.0);
+
 	info("   ---------- QueueCoordinator");
 	info("    Active Downloads: %i, Limit: %i", (int)m_activeDownloads.size(), m_downloadsLimit);
 	for (ArticleDownloader* articleDownloader : m_activeDownloads)
@@ -53,6 +53,11 @@ public:
 	bool MergeQueueEntries(DownloadQueue* downloadQueue, NzbInfo* destNzbInfo, NzbInfo* srcNzbInfo);
 	bool SplitQueueEntries(DownloadQueue* downloadQueue, RawFileList* fileList, const char* name, NzbInfo** newNzbInfo);
 
+	/* Serializes queue changes recorded since the last save, called by the coordinator loop and on shutdown */
+	void SaveQueueChanges();
+	/* Returns the number of download threads allowed for the next interval of disk load check */
+	static int CalcThrottledLimit(int throttledLimit, int downloadsLimit, bool diskBound);
+
 protected:
 	virtual void LogDebugInfo();
 
@@ -65,11 +70,20 @@ private:
 			EEditAction action, int offset, const char* text);
 		virtual void HistoryChanged() { m_historyChanged = true; }
 		virtual void Save();
+		virtual void SaveChanged(int nzbId);
 	private:
 		QueueCoordinator* m_owner;
 		bool m_massEdit = false;
 		bool m_wantSave = false;
 		bool m_historyChanged = false;
+		bool m_queueChanged = false;
+		IdList m_changedIds;
+		bool m_savePending = false;
+		Mutex m_saveMutex;
+
+		void DoSave();
+		bool IsSavePending();
+		void SavePending();
 		friend class QueueCoordinator;
 	};
 
@@ -78,15 +92,19 @@ private:
 	QueueEditor m_queueEditor;
 	bool m_hasMoreJobs = true;
 	int m_downloadsLimit;
+	int m_throttledLimit;
+	int64 m_backpressureTicks = 0;
 	int m_serverConfigGeneration = 0;
 
 	bool GetNextArticle(DownloadQueue* downloadQueue, FileInfo* &fileInfo, ArticleInfo* &articleInfo);
 	void StartArticleDownload(FileInfo* fileInfo, ArticleInfo* articleInfo, NntpConnection* connection);
 	void ArticleCompleted(ArticleDownloader* articleDownloader);
+	bool UpdateArticleState(DownloadQueue* downloadQueue, ArticleDownloader* articleDownloader, bool exclusive);
 	void DeleteFileInfo(DownloadQueue* downloadQueue, FileInfo* fileInfo, bool completed);
 	void CheckHealth(DownloadQueue* downloadQueue, FileInfo* fileInfo);
 	void ResetHangingDownloads();
 	void AdjustDownloadsLimit();
+	void ApplyBackpressure();
 	void Load();
 	void SavePartialState();
 	void LoadPartialState(FileInfo* fileInfo);
@@ -241,15 +241,7 @@ void GroupSorter::AlignSelectedGroups()
 
 FileInfo* QueueEditor::FindFileInfo(int id)
 {
-	for (NzbInfo* nzbInfo : m_downloadQueue->GetQueue())
-	{
-		FileInfo* fileInfo = nzbInfo->GetFileList()->Find(id);
-		if (fileInfo)
-		{
-			return fileInfo;
-		}
-	}
-	return nullptr;
+	return m_downloadQueue->FindFile(id);
 }
 
 /*
@@ -678,12 +670,10 @@ void QueueEditor::PrepareList(ItemList* itemList, IdList* idList,
 		{
 			if (minId <= id && id <= maxId)
 			{
-				for (NzbInfo* nzbInfo : m_downloadQueue->GetQueue())
+				NzbInfo* nzbInfo = m_downloadQueue->GetQueue()->Find(id);
+				if (nzbInfo)
 				{
-					if (id == nzbInfo->GetId())
-					{
-						itemList->emplace_back(nullptr, nzbInfo, offset);
-					}
+					itemList->emplace_back(nullptr, nzbInfo, offset);
 				}
 			}
 		}
@@ -28,6 +28,9 @@
 #include "Util.h"
 #include "FileSystem.h"
 
+// failed watching is retried after this time (seconds), periodic scans continue meanwhile
+static const int WATCH_RETRY_INTERVAL = 60;
+
 Scanner::QueueData::QueueData(const char* filename, const char* nzbName, const char* category,
 	int priority, const char* dupeKey, int dupeScore, EDupeMode dupeMode,
 	NzbParameterList* parameters, bool addTop, bool addPaused, NzbInfo* urlInfo,
@@ -68,6 +71,10 @@ void Scanner::QueueData::SetNzbId(int nzbId)
 	}
 }
 
+Scanner::~Scanner()
+{
+	StopWatching();
+}
 
 void Scanner::InitOptions()
 {
@@ -93,6 +100,11 @@ void Scanner::ServiceWork()
 		bool checkStat = !m_requestedNzbDirScan;
 		m_requestedNzbDirScan = false;
 		m_scanning = true;
+		if (m_watchFd == -1 && g_Options->GetNzbDirInterval() > 0 && Util::CurrentTime() >= m_watchRetryTime)
+		{
+			// start watching before the scan to not miss files added in between
+			StartWatching();
+		}
 		CheckIncomingNzbs(g_Options->GetNzbDir(), "", checkStat);
 		if (!checkStat && m_scanScript)
 		{
@@ -128,6 +140,19 @@ void Scanner::ServiceWork()
 	m_nzbDirInterval += 200;
 }
 
+/**
+ * Called by service coordinator as soon as file system notifications arrive
+ */
+void Scanner::ServiceEvent()
+{
+	Guard guard(m_scanMutex);
+
+	if (m_watchFd > -1)
+	{
+		ProcessWatchEvents();
+	}
+}
+
 /**
 * Check if there are files in directory for incoming nzb-files
 * and add them to download queue
@@ -249,6 +274,217 @@ void Scanner::DropOldFiles()
 		m_fileList.end());
 }
 
+/**
+ * Watching of incoming directory and its subdirectories (categories) via file system
+ * notifications. New files are processed as soon as they are closed after writing or
+ * moved into the directory; there is no need to check if their size stopped changing.
+ * Periodic scans remain active and pick up files the notifications can't report
+ * (for example files created on network shares by other hosts).
+ */
+bool Scanner::StartWatching()
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	m_watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_watchFd == -1)
+	{
+		WatchFailed(g_Options->GetNzbDir());
+		return false;
+	}
+
+	if (!AddWatch(g_Options->GetNzbDir(), ""))
+	{
+		StopWatching();
+		return false;
+	}
+
+	if (m_watchFailed)
+	{
+		detail("Watching directory %s", g_Options->GetNzbDir());
+	}
+	debug("Watching directory %s", g_Options->GetNzbDir());
+	m_watchFailed = false;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void Scanner::StopWatching()
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	if (m_watchFd > -1)
+	{
+		// closing of descriptor removes all watches
+		close(m_watchFd);
+		m_watchFd = -1;
+	}
+	m_watches.clear();
+#endif
+}
+
+bool Scanner::AddWatch(const char* directory, const char* category)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	int wd = inotify_add_watch(m_watchFd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+	if (wd == -1)
+	{
+		WatchFailed(directory);
+		return false;
+	}
+
+	m_watches.erase(wd);
+	m_watches.emplace(wd, WatchData(directory, category));
+
+	DirBrowser dir(directory);
+	while (const char* filename = dir.Next())
+	{
+		if (filename[0] == '.')
+		{
+			// skip hidden directories
+			continue;
+		}
+
+		BString<1024> fullfilename("%s%c%s", directory, PATH_SEPARATOR, filename);
+		if (FileSystem::DirectoryExists(fullfilename))
+		{
+			const char* useCategory = filename;
+			BString<1024> subCategory;
+			if (strlen(category) > 0)
+			{
+				subCategory.Format("%s%c%s", category, PATH_SEPARATOR, filename);
+				useCategory = subCategory;
+			}
+			if (!AddWatch(fullfilename, useCategory))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Watching is retried later; the message is printed only once until watching succeeds
+ */
+void Scanner::WatchFailed(const char* directory)
+{
+	if (!m_watchFailed)
+	{
+		detail("Could not watch directory %s, using periodic scans only: %s",
+			directory, *FileSystem::GetLastErrorMessage());
+	}
+	m_watchFailed = true;
+	m_watchRetryTime = Util::CurrentTime() + WATCH_RETRY_INTERVAL;
+}
+
+void Scanner::ProcessWatchEvents()
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	struct IncomingFile
+	{
+		CString directory;
+		CString category;
+		CString filename;
+	};
+
+	std::vector<IncomingFile> incomingFiles;
+	bool overflow = false;
+	bool restart = false;
+
+	alignas(inotify_event) char buffer[4096];
+	int len;
+	while ((len = (int)read(m_watchFd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char* p = buffer; p < buffer + len; )
+		{
+			inotify_event* event = (inotify_event*)p;
+			p += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				overflow = true;
+				continue;
+			}
+
+			WatchMap::iterator it = m_watches.find(event->wd);
+			if (it == m_watches.end())
+			{
+				continue;
+			}
+
+			if (event->mask & IN_IGNORED)
+			{
+				// directory was deleted
+				restart |= Util::EmptyStr(it->second.GetCategory());
+				m_watches.erase(it);
+				continue;
+			}
+
+			if (event->len == 0 || event->name[0] == '.')
+			{
+				continue;
+			}
+
+			CString directory = it->second.GetDirectory();
+			CString category = it->second.GetCategory();
+
+			if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+			{
+				BString<1024> fullfilename("%s%c%s", *directory, PATH_SEPARATOR, event->name);
+				const char* useCategory = event->name;
+				BString<1024> subCategory;
+				if (strlen(category) > 0)
+				{
+					subCategory.Format("%s%c%s", *category, PATH_SEPARATOR, event->name);
+					useCategory = subCategory;
+				}
+				// on failure all watches are set up again later
+				restart |= !AddWatch(fullfilename, useCategory);
+
+				// files which were already in the directory when the watch was added
+				// are loaded by the periodic scan
+				CheckIncomingNzbs(fullfilename, useCategory, true);
+			}
+			else if (!(event->mask & IN_ISDIR) && (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)))
+			{
+				incomingFiles.push_back({std::move(directory), std::move(category), event->name});
+			}
+		}
+	}
+
+	if (restart)
+	{
+		// will be restarted by a periodic scan
+		StopWatching();
+		m_nzbDirInterval = g_Options->GetNzbDirInterval() * 1000;
+	}
+
+	if (overflow)
+	{
+		// some events were lost, scan the whole directory
+		m_nzbDirInterval = g_Options->GetNzbDirInterval() * 1000;
+	}
+
+	if (g_Options->GetPauseScan())
+	{
+		return;
+	}
+
+	for (IncomingFile& incomingFile : incomingFiles)
+	{
+		BString<1024> fullfilename("%s%c%s", *incomingFile.directory, PATH_SEPARATOR, *incomingFile.filename);
+		if (FileSystem::FileExists(fullfilename) && CanProcessFile(fullfilename, false))
+		{
+			ProcessIncomingFile(incomingFile.directory, incomingFile.filename, fullfilename, incomingFile.category);
+		}
+	}
+#endif
+}
+
 void Scanner::ProcessIncomingFile(const char* directory, const char* baseFilename,
 	const char* fullFilename, const char* category)
 {
@@ -37,6 +37,7 @@ public:
 		asFailed
 	};
 
+	~Scanner();
 	void InitOptions();
 	void ScanNzbDir(bool syncMode);
 	EAddStatus AddExternalFile(const char* nzbName, const char* category, int priority,
@@ -48,6 +49,8 @@ public:
 protected:
 	virtual int ServiceInterval() { return 200; }
 	virtual void ServiceWork();
+	virtual int ServiceEventFd() { return m_watchFd; }
+	virtual void ServiceEvent();
 
 private:
 	class FileData
@@ -106,6 +109,20 @@ private:
 
 	typedef std::deque<QueueData> QueueList;
 
+	class WatchData
+	{
+	public:
+		WatchData(const char* directory, const char* category) :
+			m_directory(directory), m_category(category) {}
+		const char* GetDirectory() { return m_directory; }
+		const char* GetCategory() { return m_category; }
+	private:
+		CString m_directory;
+		CString m_category;
+	};
+
+	typedef std::unordered_map<int, WatchData> WatchMap;
+
 	bool m_requestedNzbDirScan = false;
 	int m_nzbDirInterval = 0;
 	bool m_scanScript = false;
@@ -114,6 +131,10 @@ private:
 	QueueList m_queueList;
 	bool m_scanning = false;
 	Mutex m_scanMutex;
+	int m_watchFd = -1;
+	bool m_watchFailed = false;
+	time_t m_watchRetryTime = 0;
+	WatchMap m_watches;
 
 	void CheckIncomingNzbs(const char* directory, const char* category, bool checkStat);
 	bool AddFileToQueue(const char* filename, const char* nzbName, const char* category,
@@ -123,6 +144,11 @@ private:
 		const char* fullFilename, const char* category);
 	bool CanProcessFile(const char* fullFilename, bool checkStat);
 	void DropOldFiles();
+	bool StartWatching();
+	void StopWatching();
+	bool AddWatch(const char* directory, const char* category);
+	void WatchFailed(const char* directory);
+	void ProcessWatchEvents();
 };
 
 extern Scanner* g_Scanner;
@@ -662,7 +662,7 @@ void ListBinCommand::Execute()
 		int postJobCount = 0;
 		int64 remainingSize;
 		{
-			GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+			SharedGuardedDownloadQueue downloadQueue = DownloadQueue::GuardShared();
 			for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
 			{
 				postJobCount += nzbInfo->GetPostInfo() ? 1 : 0;
@@ -1052,7 +1052,7 @@ void HistoryBinCommand::Execute()
 	CharBuffer buf;
 
 	{
-		GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+		SharedGuardedDownloadQueue downloadQueue = DownloadQueue::GuardShared();
 
 		// Make a data structure and copy all the elements of the list into it
 
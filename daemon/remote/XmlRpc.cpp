@@ -182,10 +182,19 @@ class HistoryXmlCommand: public NzbInfoXmlCommand
 {
 public:
 	virtual void Execute();
+protected:
+	void AppendHistoryItem(HistoryInfo* historyInfo);
 private:
+	void AppendArchiveSummary(ArchiveInfo* archiveInfo);
 	const char* DetectStatus(HistoryInfo* historyInfo);
 };
 
+class HistoryArchiveXmlCommand: public HistoryXmlCommand
+{
+public:
+	virtual void Execute();
+};
+
 class UrlQueueXmlCommand: public XmlCommand
 {
 public:
@@ -645,6 +654,10 @@ std::unique_ptr<XmlCommand> XmlRpcProcessor::CreateCommand(const char* methodNam
 	{
 		command = std::make_unique<HistoryXmlCommand>();
 	}
+	else if (!strcasecmp(methodName, "historyarchive"))
+	{
+		command = std::make_unique<HistoryArchiveXmlCommand>();
+	}
 	else if (!strcasecmp(methodName, "urlqueue"))
 	{
 		command = std::make_unique<UrlQueueXmlCommand>();
@@ -1219,6 +1232,8 @@ void StatusXmlCommand::Execute()
 		"<member><name>ResumeTime</name><value><i4>%i</i4></value></member>\n"
 		"<member><name>FeedActive</name><value><boolean>%s</boolean></value></member>\n"
 		"<member><name>QueueScriptCount</name><value><i4>%i</i4></value></member>\n"
+		"<member><name>DiskBound</name><value><boolean>%s</boolean></value></member>\n"
+		"<member><name>WriteLatency</name><value><i4>%i</i4></value></member>\n"
 		"<member><name>NewsServers</name><value><array><data>\n";
 
 	const char* XML_STATUS_END =
@@ -1268,6 +1283,8 @@ void StatusXmlCommand::Execute()
 		"\"ResumeTime\" : %i,\n"
 		"\"FeedActive\" : %s,\n"
 		"\"QueueScriptCount\" : %i,\n"
+		"\"DiskBound\" : %s,\n"
+		"\"WriteLatency\" : %i,\n"
 		"\"NewsServers\" : [\n";
 
 	const char* JSON_STATUS_END =
@@ -1290,7 +1307,7 @@ void StatusXmlCommand::Execute()
 	int urlCount = 0;
 	int64 remainingSize, forcedSize;
 	{
-		GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+		SharedGuardedDownloadQueue downloadQueue = DownloadQueue::GuardShared();
 		for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
 		{
 			postJobCount += nzbInfo->GetPostInfo() ? 1 : 0;
@@ -1348,6 +1365,8 @@ void StatusXmlCommand::Execute()
 	int resumeTime = g_Options->GetResumeTime();
 	bool feedActive = g_FeedCoordinator->HasActiveDownloads();
 	int queuedScripts = g_QueueScriptCoordinator->GetQueueSize();
+	bool diskBound = g_ArticleCache->GetDiskBound();
+	int writeLatency = g_ArticleCache->GetWriteLatency();
 
 	AppendFmtResponse(IsJson() ? JSON_STATUS_START : XML_STATUS_START,
 		remainingSizeLo, remainingSizeHi, remainingMBytes, forcedSizeLo,
@@ -1359,7 +1378,7 @@ void StatusXmlCommand::Execute()
 		BoolToStr(downloadPaused), BoolToStr(downloadPaused), BoolToStr(downloadPaused),
 		BoolToStr(serverStandBy), BoolToStr(postPaused), BoolToStr(scanPaused), BoolToStr(quotaReached),
 		freeDiskSpaceLo, freeDiskSpaceHi,	freeDiskSpaceMB, serverTime, resumeTime,
-		BoolToStr(feedActive), queuedScripts);
+		BoolToStr(feedActive), queuedScripts, BoolToStr(diskBound), writeLatency);
 
 	int index = 0;
 	for (NewsServer* server : g_ServerPool->GetServers())
@@ -1522,9 +1541,10 @@ void ListFilesXmlCommand::Execute()
 
 	int index = 0;
 
-	GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+	SharedGuardedDownloadQueue downloadQueue = DownloadQueue::GuardShared();
 	for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
 	{
+		Guard stateGuard = nzbInfo->GuardDownloadState();
 		for (FileInfo* fileInfo : nzbInfo->GetFileList())
 		{
 			if ((nzbId > 0 && nzbId == fileInfo->GetNzbInfo()->GetId()) ||
@@ -1935,9 +1955,10 @@ void ListGroupsXmlCommand::Execute()
 
 	int index = 0;
 
-	GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+	SharedGuardedDownloadQueue downloadQueue = DownloadQueue::GuardShared();
 	for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
 	{
+		Guard stateGuard = nzbInfo->GuardDownloadState();
 		uint32 remainingSizeLo, remainingSizeHi, remainingSizeMB;
 		uint32 pausedSizeLo, pausedSizeHi, pausedSizeMB;
 		Util::SplitInt64(nzbInfo->GetRemainingSize(), &remainingSizeHi, &remainingSizeLo);
@@ -2316,9 +2337,10 @@ void PostQueueXmlCommand::Execute()
 
 	int index = 0;
 
-	GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+	SharedGuardedDownloadQueue downloadQueue = DownloadQueue::GuardShared();
 	for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
 	{
+		Guard stateGuard = nzbInfo->GuardDownloadState();
 		PostInfo* postInfo = nzbInfo->GetPostInfo();
 		if (!postInfo)
 		{
@@ -2417,10 +2439,127 @@ void ScanXmlCommand::Execute()
 
 // struct[] history(bool hidden)
 // Parameter "hidden" is optional (new in v12)
+// Recent entries are followed by summaries of archived entries (field "Archived"),
+// the complete archived entries are returned by "historyarchive"
 void HistoryXmlCommand::Execute()
 {
 	AppendResponse(IsJson() ? "[\n" : "<array><data>\n");
 
+	bool dup = false;
+	NextParamAsBool(&dup);
+
+	int index = 0;
+
+	SharedGuardedDownloadQueue guard = DownloadQueue::GuardShared();
+	for (HistoryInfo* historyInfo : guard->GetHistory())
+	{
+		if (historyInfo->GetKind() == HistoryInfo::hkDup && !dup)
+		{
+			continue;
+		}
+
+		AppendCondResponse(",\n", IsJson() && index++ > 0);
+		AppendHistoryItem(historyInfo);
+	}
+
+	for (ArchiveInfo* archiveInfo : guard->GetArchive())
+	{
+		if (archiveInfo->GetKind() == HistoryInfo::hkDup && !dup)
+		{
+			continue;
+		}
+
+		AppendCondResponse(",\n", IsJson() && index++ > 0);
+		AppendArchiveSummary(archiveInfo);
+	}
+
+	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+}
+
+void HistoryXmlCommand::AppendArchiveSummary(ArchiveInfo* archiveInfo)
+{
+	const char* XML_ARCHIVE_ITEM =
+		"<value><struct>\n"
+		"<member><name>ID</name><value><i4>%i</i4></value></member>\n"				// Deprecated, use "NZBID" instead
+		"<member><name>NZBID</name><value><i4>%i</i4></value></member>\n"
+		"<member><name>Kind</name><value><string>%s</string></value></member>\n"
+		"<member><name>Name</name><value><string>%s</string></value></member>\n"
+		"<member><name>HistoryTime</name><value><i4>%i</i4></value></member>\n"
+		"<member><name>DupeKey</name><value><string>%s</string></value></member>\n"
+		"<member><name>FullContentHash</name><value><i4>%u</i4></value></member>\n"
+		"<member><name>FilteredContentHash</name><value><i4>%u</i4></value></member>\n"
+		"<member><name>Archived</name><value><boolean>1</boolean></value></member>\n"
+		"</struct></value>";
+
+	const char* JSON_ARCHIVE_ITEM =
+		"{\n"
+		"\"ID\" : %i,\n"							// Deprecated, use "NZBID" instead
+		"\"NZBID\" : %i,\n"
+		"\"Kind\" : \"%s\",\n"
+		"\"Name\" : \"%s\",\n"
+		"\"HistoryTime\" : %i,\n"
+		"\"DupeKey\" : \"%s\",\n"
+		"\"FullContentHash\" : %u,\n"
+		"\"FilteredContentHash\" : %u,\n"
+		"\"Archived\" : true\n"
+		"}";
+
+	const char* kindName[] = { "UNKNOWN", "NZB", "URL", "DUP" };
+
+	AppendFmtResponse(IsJson() ? JSON_ARCHIVE_ITEM : XML_ARCHIVE_ITEM,
+		archiveInfo->GetId(), archiveInfo->GetId(), kindName[archiveInfo->GetKind()],
+		*EncodeStr(archiveInfo->GetName()), (int)archiveInfo->GetTime(), *EncodeStr(archiveInfo->GetDupeKey()),
+		archiveInfo->GetFullContentHash(), archiveInfo->GetFilteredContentHash());
+}
+
+// struct[] historyarchive(bool hidden, int offset, int limit)
+// Returns a page of entries from history archive, from newest to oldest;
+// only the records of the requested page are read from disk.
+void HistoryArchiveXmlCommand::Execute()
+{
+	bool dup = false;
+	int offset = 0;
+	int limit = 0;
+	if (!NextParamAsBool(&dup) || !NextParamAsInt(&offset) || !NextParamAsInt(&limit) ||
+		offset < 0 || limit <= 0)
+	{
+		BuildErrorResponse(2, "Invalid parameter");
+		return;
+	}
+
+	AppendResponse(IsJson() ? "[\n" : "<array><data>\n");
+
+	int skipped = 0;
+	int index = 0;
+
+	SharedGuardedDownloadQueue guard = DownloadQueue::GuardShared();
+	for (ArchiveInfo* archiveInfo : guard->GetArchive())
+	{
+		if ((archiveInfo->GetKind() == HistoryInfo::hkDup && !dup) || skipped++ < offset)
+		{
+			continue;
+		}
+
+		if (index == limit)
+		{
+			break;
+		}
+
+		std::unique_ptr<HistoryInfo> historyInfo = g_DiskState->LoadArchivedHistory(archiveInfo,
+			g_ServerPool->GetServers());
+		if (historyInfo)
+		{
+			AppendCondResponse(",\n", IsJson() && index > 0);
+			AppendHistoryItem(historyInfo.get());
+		}
+		index++;
+	}
+
+	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+}
+
+void HistoryXmlCommand::AppendHistoryItem(HistoryInfo* historyInfo)
+{
 	const char* XML_HISTORY_ITEM_START =
 		"<value><struct>\n"
 		"<member><name>ID</name><value><i4>%i</i4></value></member>\n"					// Deprecated, use "NZBID" instead
@@ -2480,59 +2619,40 @@ void HistoryXmlCommand::Execute()
 	const char* dupStatusName[] = { "UNKNOWN", "SUCCESS", "FAILURE", "DELETED", "DUPE", "BAD", "GOOD" };
 	const char* dupeModeName[] = { "SCORE", "ALL", "FORCE" };
 
-	bool dup = false;
-	NextParamAsBool(&dup);
+	NzbInfo* nzbInfo = nullptr;
+	const char* status = DetectStatus(historyInfo);
 
-	int index = 0;
-
-	GuardedDownloadQueue guard = DownloadQueue::Guard();
-	for (HistoryInfo* historyInfo : guard->GetHistory())
+	if (historyInfo->GetKind() == HistoryInfo::hkNzb ||
+		historyInfo->GetKind() == HistoryInfo::hkUrl)
 	{
-		if (historyInfo->GetKind() == HistoryInfo::hkDup && !dup)
-		{
-			continue;
-		}
-
-		NzbInfo* nzbInfo = nullptr;
-
-		const char* status = DetectStatus(historyInfo);
-
-		AppendCondResponse(",\n", IsJson() && index++ > 0);
+		nzbInfo = historyInfo->GetNzbInfo();
 
-		if (historyInfo->GetKind() == HistoryInfo::hkNzb ||
-			historyInfo->GetKind() == HistoryInfo::hkUrl)
-		{
-			nzbInfo = historyInfo->GetNzbInfo();
+		AppendFmtResponse(IsJson() ? JSON_HISTORY_ITEM_START : XML_HISTORY_ITEM_START,
+			historyInfo->GetId(), *EncodeStr(historyInfo->GetName()), nzbInfo->GetParkedFileCount(),
+			historyInfo->GetTime(), status);
+	}
+	else if (historyInfo->GetKind() == HistoryInfo::hkDup)
+	{
+		DupInfo* dupInfo = historyInfo->GetDupInfo();
 
-			AppendFmtResponse(IsJson() ? JSON_HISTORY_ITEM_START : XML_HISTORY_ITEM_START,
-				historyInfo->GetId(), *EncodeStr(historyInfo->GetName()), nzbInfo->GetParkedFileCount(),
-				historyInfo->GetTime(), status);
-		}
-		else if (historyInfo->GetKind() == HistoryInfo::hkDup)
-		{
-			DupInfo* dupInfo = historyInfo->GetDupInfo();
-
-			uint32 fileSizeHi, fileSizeLo, fileSizeMB;
-			Util::SplitInt64(dupInfo->GetSize(), &fileSizeHi, &fileSizeLo);
-			fileSizeMB = (int)(dupInfo->GetSize() / 1024 / 1024);
-
-			AppendFmtResponse(IsJson() ? JSON_HISTORY_DUP_ITEM : XML_HISTORY_DUP_ITEM,
-				historyInfo->GetId(), historyInfo->GetId(), "DUP", *EncodeStr(historyInfo->GetName()),
-				historyInfo->GetTime(), fileSizeLo, fileSizeHi, fileSizeMB,
-				*EncodeStr(dupInfo->GetDupeKey()), dupInfo->GetDupeScore(),
-				dupeModeName[dupInfo->GetDupeMode()], dupStatusName[dupInfo->GetStatus()],
-				status);
-		}
+		uint32 fileSizeHi, fileSizeLo, fileSizeMB;
+		Util::SplitInt64(dupInfo->GetSize(), &fileSizeHi, &fileSizeLo);
+		fileSizeMB = (int)(dupInfo->GetSize() / 1024 / 1024);
 
-		if (nzbInfo)
-		{
-			AppendNzbInfoFields(nzbInfo);
-		}
+		AppendFmtResponse(IsJson() ? JSON_HISTORY_DUP_ITEM : XML_HISTORY_DUP_ITEM,
+			historyInfo->GetId(), historyInfo->GetId(), "DUP", *EncodeStr(historyInfo->GetName()),
+			historyInfo->GetTime(), fileSizeLo, fileSizeHi, fileSizeMB,
+			*EncodeStr(dupInfo->GetDupeKey()), dupInfo->GetDupeScore(),
+			dupeModeName[dupInfo->GetDupeMode()], dupStatusName[dupInfo->GetStatus()],
+			status);
+	}
 
-		AppendResponse(IsJson() ? JSON_HISTORY_ITEM_END : XML_HISTORY_ITEM_END);
+	if (nzbInfo)
+	{
+		AppendNzbInfoFields(nzbInfo);
 	}
 
-	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+	AppendResponse(IsJson() ? JSON_HISTORY_ITEM_END : XML_HISTORY_ITEM_END);
 }
 
 const char* HistoryXmlCommand::DetectStatus(HistoryInfo* historyInfo)
@@ -2582,7 +2702,7 @@ void UrlQueueXmlCommand::Execute()
 
 	int index = 0;
 
-	GuardedDownloadQueue downloadQueue = DownloadQueue::Guard();
+	SharedGuardedDownloadQueue downloadQueue = DownloadQueue::GuardShared();
 	for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
 	{
 		if (nzbInfo->GetKind() == NzbInfo::nkUrl)
@@ -57,20 +57,56 @@ template <typename T> RawVectorIterator<T> begin(std::vector<std::unique_ptr<T>>
 template <typename T> RawVectorIterator<T> end(std::vector<std::unique_ptr<T>>* c) { return RawVectorIterator<T>(c->end()); }
 
 
-/* Template class for deque of unique_ptr with useful utility functions */
+/*
+ * Receives ids of items added to or removed from a container. The listener is called
+ * after the index was updated, "Find(id)" tells whether the item was added or removed.
+ */
+class ContainerListener
+{
+public:
+	virtual void ItemChanged(int id) = 0;
+};
+
+/*
+ * Template class for deque of unique_ptr with useful utility functions.
+ * Items are indexed by id for fast lookups with "Find(id)". The index is maintained
+ * by the modifying methods of the class, therefore the id of an item must not change
+ * while the item is in the container and items must not be replaced via iterators
+ * (use "Replace" instead). Reordering of items (sort, swap) doesn't affect the index
+ * and isn't reported to the listener.
+ */
 template <typename T>
 class UniqueDeque : public std::deque<std::unique_ptr<T>>
 {
 public:
+	typedef std::deque<std::unique_ptr<T>> Base;
+	typedef typename Base::iterator iterator;
+	typedef typename Base::const_iterator const_iterator;
+
+	UniqueDeque() {}
+	UniqueDeque(UniqueDeque&& other) : Base(std::move(other)), m_index(std::move(other.m_index)) { other.clear(); }
+	UniqueDeque& operator=(UniqueDeque&& other)
+	{
+		Index oldIndex = std::move(m_index);
+		Base::operator=(std::move(other));
+		m_index = std::move(other.m_index);
+		other.clear();
+		NotifyRemoved(oldIndex);
+		NotifyAll();
+		return *this;
+	}
+
+	void SetListener(ContainerListener* listener) { m_listener = listener; }
+
 	void Add(std::unique_ptr<T> uptr, bool addTop = false)
 	{
 		if (addTop)
 		{
-			this->push_front(std::move(uptr));
+			push_front(std::move(uptr));
 		}
 		else
 		{
-			this->push_back(std::move(uptr));
+			push_back(std::move(uptr));
 		}
 	}
 
@@ -78,17 +114,25 @@ public:
 	{
 		std::unique_ptr<T> uptr;
 
-		typename UniqueDeque::iterator it = Find(p);
+		iterator it = Find(p);
 		if (it != this->end())
 		{
 			uptr = std::move(*it);
-			this->erase(it);
+			UnindexItem(uptr.get());
+			Base::erase(it);
 		}
 
 		return uptr;
 	}
 
-	typename UniqueDeque::iterator Find(T* p)
+	void Replace(iterator pos, std::unique_ptr<T> uptr)
+	{
+		UnindexItem(pos->get());
+		IndexItem(uptr.get());
+		*pos = std::move(uptr);
+	}
+
+	iterator Find(T* p)
 	{
 		return std::find_if(this->begin(), this->end(),
 			[p](std::unique_ptr<T>& uptr)
@@ -99,15 +143,142 @@ public:
 
 	T* Find(int id)
 	{
+		typename Index::iterator it = m_index.find(id);
+		return it != m_index.end() ? it->second : nullptr;
+	}
+
+	void push_back(std::unique_ptr<T>&& uptr)
+	{
+		IndexItem(uptr.get());
+		Base::push_back(std::move(uptr));
+	}
+
+	void push_front(std::unique_ptr<T>&& uptr)
+	{
+		IndexItem(uptr.get());
+		Base::push_front(std::move(uptr));
+	}
+
+	iterator insert(const_iterator pos, std::unique_ptr<T>&& uptr)
+	{
+		IndexItem(uptr.get());
+		return Base::insert(pos, std::move(uptr));
+	}
+
+	iterator erase(const_iterator pos)
+	{
+		bool indexed = UnindexItem(pos->get());
+		iterator it = Base::erase(pos);
+		if (!indexed)
+		{
+			RebuildIndex();
+		}
+		return it;
+	}
+
+	iterator erase(const_iterator first, const_iterator last)
+	{
+		bool indexed = true;
+		for (const_iterator it = first; it != last; it++)
+		{
+			indexed &= UnindexItem(it->get());
+		}
+		iterator it = Base::erase(first, last);
+		if (!indexed)
+		{
+			RebuildIndex();
+		}
+		return it;
+	}
+
+	void pop_front() { erase(this->begin()); }
+	void pop_back() { erase(this->end() - 1); }
+
+	void clear()
+	{
+		Index oldIndex = std::move(m_index);
+		m_index.clear();
+		Base::clear();
+		NotifyRemoved(oldIndex);
+	}
+
+private:
+	typedef std::unordered_map<int, T*> Index;
+
+	Index m_index;
+	ContainerListener* m_listener = nullptr;
+
+	void IndexItem(T* item)
+	{
+		if (item)
+		{
+			m_index[item->GetId()] = item;
+			Notify(item->GetId());
+		}
+	}
+
+	void Notify(int id)
+	{
+		if (m_listener)
+		{
+			m_listener->ItemChanged(id);
+		}
+	}
+
+	void NotifyAll()
+	{
+		for (typename Index::value_type& entry : m_index)
+		{
+			Notify(entry.first);
+		}
+	}
+
+	// listener is notified after the items were removed and can't be found anymore
+	void NotifyRemoved(Index& oldIndex)
+	{
+		for (typename Index::value_type& entry : oldIndex)
+		{
+			Notify(entry.first);
+		}
+	}
+
+	// returns false if the item is unknown (it was moved out of the container)
+	bool UnindexItem(T* item)
+	{
+		if (!item)
+		{
+			return false;
+		}
+
+		typename Index::iterator it = m_index.find(item->GetId());
+		if (it != m_index.end() && it->second == item)
+		{
+			m_index.erase(it);
+			Notify(item->GetId());
+		}
+		return true;
+	}
+
+	void RebuildIndex()
+	{
+		Index oldIndex = std::move(m_index);
+		m_index.clear();
 		for (std::unique_ptr<T>& uptr : *this)
 		{
-			if (uptr->GetId() == id)
+			if (uptr)
 			{
-				return uptr.get();
+				m_index[uptr->GetId()] = uptr.get();
 			}
 		}
 
-		return nullptr;
+		// report items which were moved out of the container
+		for (typename Index::value_type& entry : oldIndex)
+		{
+			if (m_index.find(entry.first) == m_index.end())
+			{
+				Notify(entry.first);
+			}
+		}
 	}
 };
 
@@ -241,9 +241,11 @@ bool FileSystem::SaveBufferIntoFile(const char* filename, const char* buffer, in
 	return writtenBytes == bufLen;
 }
 
-bool FileSystem::AllocateFile(const char* filename, int64 size, bool sparse, CString& errmsg)
+bool FileSystem::AllocateFile(const char* filename, int64 size, bool sparse, CString& errmsg,
+	EAllocMethod* method)
 {
 	errmsg.Clear();
+	EAllocMethod used = amNone;
 	bool ok = false;
 #ifdef WIN32
 	HANDLE hFile = CreateFileW(UtfPathToWidePath(filename), GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_NEW, 0, nullptr);
@@ -266,41 +268,148 @@ bool FileSystem::AllocateFile(const char* filename, int64 size, bool sparse, CSt
 	SetEndOfFile(hFile);
 	CloseHandle(hFile);
 	ok = true;
+	used = sparse ? amSparse : amSetEndOfFile;
 #else
 	// create file
-	FILE* file = fopen(filename, FOPEN_AB);
-	if (!file)
+	int fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0666);
+	if (fd == -1)
 	{
 		errmsg = GetLastErrorMessage();
 		return false;
 	}
-	fclose(file);
 
 	// there are no reliable function to expand file on POSIX, so we must try different approaches,
 	// starting with the fastest one and hoping it will work
-	// 1) set file size using function "truncate" (this is fast, if it works)
-	truncate(filename, size);
-	// check if it worked
-	ok = FileSize(filename) == size;
-	if (!ok)
-	{
-		// 2) truncate did not work, expanding the file by writing to it (that's slow)
-		truncate(filename, 0);
-		file = fopen(filename, FOPEN_AB);
-		if (!file)
+	if (!sparse)
+	{
+		// 1) allocate disk space for the whole file, this produces contiguous files
+		// but is supported only on some file systems
+#ifdef HAVE_FALLOCATE
+		ok = fallocate(fd, 0, 0, size) == 0;
+		used = ok ? amFallocate : amNone;
+#elif defined(HAVE_POSIX_FALLOCATE)
+		// on Linux posix_fallocate falls back to (slow) writing if file system
+		// doesn't support preallocation, we use it only when fallocate is not available
+		int err = posix_fallocate(fd, 0, size);
+		ok = err == 0;
+		used = ok ? amPosixFallocate : amNone;
+		if (!ok)
+		{
+			errno = err;
+		}
+#endif
+
+#if defined(HAVE_FALLOCATE) || defined(HAVE_POSIX_FALLOCATE)
+		if (!ok && (errno == ENOSPC || errno == EFBIG))
 		{
+			// not enough disk space, falling back to a sparse file would only
+			// defer the error until the articles are written
 			errmsg = GetLastErrorMessage();
+			close(fd);
+			// release the space which could have been partially allocated
+			TruncateFile(filename, 0);
+			if (method)
+			{
+				*method = amNone;
+			}
 			return false;
 		}
-		char c = '0';
-		fwrite(&c, 1, size, file);
-		fclose(file);
-		ok = FileSize(filename) == size;
+#endif
+	}
+
+	if (!ok)
+	{
+		// 2) set file size using function "ftruncate" (this is fast, if it works)
+		ok = ftruncate(fd, size) == 0 && FileSize(filename) == size;
+		used = ok ? amSparse : amNone;
 	}
+
+	if (!ok)
+	{
+		// 3) truncate did not work, expanding the file by writing to it (that's slow)
+		ok = ftruncate(fd, 0) == 0;
+		CharBuffer buffer(1024 * 64);
+		memset(buffer, 0, buffer.Size());
+		for (int64 written = 0; ok && written < size; )
+		{
+			int cnt = (int)std::min((int64)buffer.Size(), size - written);
+			ok = write(fd, buffer, cnt) == cnt;
+			written += cnt;
+		}
+		ok = ok && FileSize(filename) == size;
+		used = ok ? amWrite : amNone;
+	}
+
+	if (!ok)
+	{
+		errmsg = GetLastErrorMessage();
+	}
+
+	close(fd);
 #endif
+
+	if (method)
+	{
+		*method = used;
+	}
+
 	return ok;
 }
 
+bool FileSystem::AllocateFileRange(const char* filename, int64 offset, int64 size, CString& errmsg,
+	EAllocMethod* method)
+{
+	errmsg.Clear();
+	EAllocMethod used = amNone;
+	bool ok = false;
+
+#if !defined(WIN32) && (defined(HAVE_FALLOCATE) || defined(HAVE_POSIX_FALLOCATE))
+	int fd = open(filename, O_WRONLY);
+	if (fd == -1)
+	{
+		errmsg = GetLastErrorMessage();
+		return false;
+	}
+
+#ifdef HAVE_FALLOCATE
+	ok = fallocate(fd, 0, offset, size) == 0;
+	used = ok ? amFallocate : amNone;
+#else
+	ok = posix_fallocate(fd, offset, size) == 0;
+	used = ok ? amPosixFallocate : amNone;
+#endif
+
+	if (!ok)
+	{
+		errmsg = GetLastErrorMessage();
+	}
+
+	close(fd);
+#else
+	errmsg = "Preallocation of file ranges is not supported";
+#endif
+
+	if (method)
+	{
+		*method = used;
+	}
+
+	return ok;
+}
+
+const char* FileSystem::AllocMethodName(EAllocMethod method)
+{
+	switch (method)
+	{
+		case amSparse: return "sparse";
+		case amFallocate: return "fallocate";
+		case amPosixFallocate: return "posix_fallocate";
+		case amSetEndOfFile: return "SetEndOfFile";
+		case amWrite: return "write";
+		default: return "none";
+	}
+}
+
 bool FileSystem::TruncateFile(const char* filename, int size)
 {
 #ifdef WIN32
@@ -641,6 +750,42 @@ int64 FileSystem::FreeDiskSize(const char* path)
 	return -1;
 }
 
+/**
+ * Returns an identifier of the volume (disk) the path belongs to
+ * or -1 if it cannot be determined.
+ */
+int64 FileSystem::VolumeId(const char* path)
+{
+#ifdef WIN32
+	char volumePath[MAX_PATH];
+	DWORD serialNumber;
+	if (GetVolumePathName(path, volumePath, sizeof(volumePath)) &&
+		GetVolumeInformation(volumePath, nullptr, 0, &serialNumber, nullptr, nullptr, nullptr, 0))
+	{
+		return serialNumber;
+	}
+#else
+	// the directory may not be created yet, then its nearest existing parent is checked
+	CString checkPath = path;
+	while (true)
+	{
+		struct stat buffer;
+		if (!stat(checkPath, &buffer))
+		{
+			return (int64)buffer.st_dev;
+		}
+
+		char* slash = strrchr((char*)checkPath, PATH_SEPARATOR);
+		if (!slash || slash == checkPath)
+		{
+			break;
+		}
+		*slash = '\0';
+	}
+#endif
+	return -1;
+}
+
 bool FileSystem::RenameBak(const char* filename, const char* bakPart, bool removeOldExtension, CString& newName)
 {
 	BString<1024> changedFilename;
@@ -1186,3 +1331,130 @@ bool DiskFile::Sync(CString& errmsg)
 	return FileSystem::FlushFileBuffers(fileno(m_file), errmsg);
 }
 
+
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char* filename, int64 size, bool readOnly)
+{
+	if (size <= 0 || (uint64)size > (uint64)(size_t)-1)
+	{
+		// the file doesn't fit into address space
+		return false;
+	}
+
+#ifdef WIN32
+	m_file = CreateFileW(FileSystem::UtfPathToWidePath(filename), GENERIC_READ | (readOnly ? 0 : GENERIC_WRITE),
+		FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	m_mapping = CreateFileMappingW(m_file, nullptr, readOnly ? PAGE_READONLY : PAGE_READWRITE,
+		(DWORD)(size >> 32), (DWORD)size, nullptr);
+	if (m_mapping)
+	{
+		m_data = (char*)MapViewOfFile(m_mapping, readOnly ? FILE_MAP_READ : FILE_MAP_WRITE, 0, 0, (SIZE_T)size);
+	}
+#else
+	m_fd = open(filename, readOnly ? O_RDONLY : O_RDWR);
+	if (m_fd == -1)
+	{
+		return false;
+	}
+
+	void* data = mmap(nullptr, (size_t)size, readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	m_data = data != MAP_FAILED ? (char*)data : nullptr;
+#endif
+
+	if (!m_data)
+	{
+		Close();
+		return false;
+	}
+
+	m_size = size;
+	return true;
+}
+
+bool MappedFile::Close()
+{
+	bool ok = true;
+#ifdef WIN32
+	if (m_data)
+	{
+		ok = UnmapViewOfFile(m_data);
+	}
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_data)
+	{
+		ok = munmap(m_data, (size_t)m_size) == 0;
+	}
+	if (m_fd != -1)
+	{
+		close(m_fd);
+		m_fd = -1;
+	}
+#endif
+	m_data = nullptr;
+	m_size = 0;
+	return ok;
+}
+
+bool MappedFile::Flush(int64 offset, int64 size)
+{
+	if (!m_data || offset < 0 || size <= 0 || offset + size > m_size)
+	{
+		return false;
+	}
+
+#ifdef WIN32
+	return FlushViewOfFile(m_data + offset, (SIZE_T)size);
+#else
+	int64 pageSize = sysconf(_SC_PAGESIZE);
+
+	// msync requires page aligned start address
+	int64 syncStart = offset / pageSize * pageSize;
+	bool ok = msync(m_data + syncStart, (size_t)(offset + size - syncStart), MS_ASYNC) == 0;
+
+	// release only pages lying completely within the range; border pages
+	// may be shared with neighbour articles which are still being written
+	int64 adviseStart = (offset + pageSize - 1) / pageSize * pageSize;
+	int64 adviseEnd = (offset + size) / pageSize * pageSize;
+	if (adviseEnd > adviseStart)
+	{
+		madvise(m_data + adviseStart, (size_t)(adviseEnd - adviseStart), MADV_DONTNEED);
+	}
+
+	return ok;
+#endif
+}
+
+void MappedFile::Prefetch(int64 offset, int64 size)
+{
+	if (!m_data || offset < 0 || size <= 0 || offset + size > m_size)
+	{
+		return;
+	}
+
+#ifndef WIN32
+	// madvise requires page aligned start address
+	int64 pageSize = sysconf(_SC_PAGESIZE);
+	int64 adviseStart = offset / pageSize * pageSize;
+	madvise(m_data + adviseStart, (size_t)(offset + size - adviseStart), MADV_WILLNEED);
+#endif
+}
@@ -30,13 +30,29 @@ class WString;
 class FileSystem
 {
 public:
+	enum EAllocMethod
+	{
+		amNone,
+		amSparse, // file expanded without allocating disk space
+		amFallocate,
+		amPosixFallocate,
+		amSetEndOfFile, // Windows, NTFS allocates disk space for non-sparse files
+		amWrite // file expanded by writing zeroes (slow)
+	};
+
 	static CString GetLastErrorMessage();
 	static char* BaseFileName(const char* filename);
 	static bool SameFilename(const char* filename1, const char* filename2);
 	static void NormalizePathSeparators(char* path);
 	static bool LoadFileIntoBuffer(const char* filename, CharBuffer& buffer, bool addTrailingNull);
 	static bool SaveBufferIntoFile(const char* filename, const char* buffer, int bufLen);
-	static bool AllocateFile(const char* filename, int64 size, bool sparse, CString& errmsg);
+	/* Create file of given size; allocation of non-sparse file fails if there is not enough disk space */
+	static bool AllocateFile(const char* filename, int64 size, bool sparse, CString& errmsg,
+		EAllocMethod* method = nullptr);
+	/* Allocate disk space for a range of existing file without changing the file size */
+	static bool AllocateFileRange(const char* filename, int64 offset, int64 size, CString& errmsg,
+		EAllocMethod* method = nullptr);
+	static const char* AllocMethodName(EAllocMethod method);
 	static bool TruncateFile(const char* filename, int size);
 	static CString MakeValidFilename(const char* filename, bool allowSlashes = false);
 	static bool ReservedChar(char ch);
@@ -55,6 +71,7 @@ public:
 	static bool SetCurrentDirectory(const char* dirFilename);
 	static int64 FileSize(const char* filename);
 	static int64 FreeDiskSize(const char* path);
+	static int64 VolumeId(const char* path);
 	static bool DirEmpty(const char* dirFilename);
 	static bool RenameBak(const char* filename, const char* bakPart, bool removeOldExtension, CString& newName);
 #ifndef WIN32
@@ -152,4 +169,32 @@ private:
 	FILE* m_file = nullptr;
 };
 
+/* Maps an existing file into memory for direct read-write access */
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	~MappedFile();
+	bool Open(const char* filename, int64 size, bool readOnly = false);
+	bool Close();
+	bool Active() { return m_data != nullptr; }
+	char* GetData() { return m_data; }
+	int64 GetSize() { return m_size; }
+	/* Schedule writing of dirty pages in given range and release them from process address space */
+	bool Flush(int64 offset, int64 size);
+	/* Ask the system to start reading pages in given range in background */
+	void Prefetch(int64 offset, int64 size);
+
+private:
+	char* m_data = nullptr;
+	int64 m_size = 0;
+#ifdef WIN32
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = nullptr;
+#else
+	int m_fd = -1;
+#endif
+};
+
 #endif
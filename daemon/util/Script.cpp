@@ -324,6 +324,11 @@ int ScriptController::Execute()
 	{
 		PrintMessage(Message::mkError, "Could not open pipe to %s", m_infoName);
 		close(pipein);
+		if (m_writepipe)
+		{
+			fclose(m_writepipe);
+			m_writepipe = nullptr;
+		}
 		return -1;
 	}
 
@@ -381,6 +386,12 @@ int ScriptController::Execute()
 		fclose(m_readpipe);
 	}
 
+	if (m_writepipe)
+	{
+		fclose(m_writepipe);
+		m_writepipe = nullptr;
+	}
+
 	if (m_terminated && m_infoName)
 	{
 		warn("Interrupted %s", m_infoName);
@@ -462,10 +473,18 @@ int ScriptController::StartProcess()
 
 	SetHandleInformation(readPipe, HANDLE_FLAG_INHERIT, 0);
 
+	// pipe to send data to child's stdin (only if requested)
+	HANDLE stdinReadPipe = 0, stdinWritePipe = 0;
+	if (m_needWrite)
+	{
+		CreatePipe(&stdinReadPipe, &stdinWritePipe, &securityAttributes, 0);
+		SetHandleInformation(stdinWritePipe, HANDLE_FLAG_INHERIT, 0);
+	}
+
 	STARTUPINFOW startupInfo = { 0 };
 	startupInfo.cb = sizeof(startupInfo);
 	startupInfo.dwFlags = STARTF_USESTDHANDLES;
-	startupInfo.hStdInput = 0;
+	startupInfo.hStdInput = stdinReadPipe;
 	startupInfo.hStdOutput = writePipe;
 	startupInfo.hStdError = writePipe;
 
@@ -499,6 +518,11 @@ int ScriptController::StartProcess()
 		}
 		CloseHandle(readPipe);
 		CloseHandle(writePipe);
+		if (m_needWrite)
+		{
+			CloseHandle(stdinReadPipe);
+			CloseHandle(stdinWritePipe);
+		}
 		return -1;
 	}
 
@@ -509,6 +533,13 @@ int ScriptController::StartProcess()
 	// close unused "write" end
 	CloseHandle(writePipe);
 
+	if (m_needWrite)
+	{
+		// close unused "read" end of stdin-pipe
+		CloseHandle(stdinReadPipe);
+		m_writepipe = _fdopen(_open_osfhandle((intptr_t)stdinWritePipe, 0), "w");
+	}
+
 	int pipein = _open_osfhandle((intptr_t)readPipe, _O_RDONLY);
 	return pipein;
 
@@ -525,6 +556,16 @@ int ScriptController::StartProcess()
 		return -1;
 	}
 
+	// pipe to send data to child's stdin (only if requested)
+	int pw[2] = { -1, -1 };
+	if (m_needWrite && pipe(pw))
+	{
+		PrintMessage(Message::mkError, "Could not open write pipe: errno %i", errno);
+		close(p[0]);
+		close(p[1]);
+		return -1;
+	}
+
 	std::vector<char*> environmentStrings = m_environmentStrings.GetStrings();
 	char** envdata = environmentStrings.data();
 
@@ -544,6 +585,11 @@ int ScriptController::StartProcess()
 		PrintMessage(Message::mkError, "Could not start %s: errno %i", m_infoName, errno);
 		close(pipein);
 		close(pipeout);
+		if (m_needWrite)
+		{
+			close(pw[0]);
+			close(pw[1]);
+		}
 		return -1;
 	}
 	else if (pid == 0)
@@ -566,6 +612,14 @@ int ScriptController::StartProcess()
 
 		close(pipeout);
 
+		if (m_needWrite)
+		{
+			// make the read end of write pipe to be the same as stdin
+			close(pw[1]);
+			dup2(pw[0], 0);
+			close(pw[0]);
+		}
+
 #ifdef CHILD_WATCHDOG
 		write(1, "\n", 1);
 		fsync(1);
@@ -606,6 +660,13 @@ int ScriptController::StartProcess()
 
 	// close unused "write" end
 	close(pipeout);
+
+	if (m_needWrite)
+	{
+		// close unused "read" end of write pipe
+		close(pw[0]);
+		m_writepipe = fdopen(pw[1], "w");
+	}
 #endif
 
 	return pipein;
@@ -703,6 +764,15 @@ bool ScriptController::ReadLine(char* buf, int bufSize, FILE* stream)
 	return fgets(buf, bufSize, stream);
 }
 
+/*
+* Sends text to stdin of the child process; the process must be started with "SetNeedWrite(true)".
+*/
+bool ScriptController::Write(const char* str)
+{
+	return m_writepipe && fwrite(str, 1, strlen(str), m_writepipe) == strlen(str) &&
+		fflush(m_writepipe) == 0;
+}
+
 void ScriptController::ProcessOutput(char* text)
 {
 	debug("Processing output received from script");
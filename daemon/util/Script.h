@@ -67,9 +67,11 @@ public:
 	void SetEnvVar(const char* name, const char* value);
 	void SetEnvVarSpecial(const char* prefix, const char* name, const char* value);
 	void SetIntEnvVar(const char* name, int value);
+	void SetNeedWrite(bool needWrite) { m_needWrite = needWrite; }
 
 protected:
 	void ProcessOutput(char* text);
+	bool Write(const char* str);
 	virtual bool ReadLine(char* buf, int bufSize, FILE* stream);
 	void PrintMessage(Message::EKind kind, const char* format, ...) PRINTF_SYNTAX(3);
 	virtual void AddMessage(Message::EKind kind, const char* text);
@@ -92,7 +94,9 @@ private:
 	EnvironmentStrings m_environmentStrings;
 	bool m_terminated = false;
 	bool m_detached = false;
+	bool m_needWrite = false;
 	FILE* m_readpipe;
+	FILE* m_writepipe = nullptr;
 #ifdef WIN32
 	HANDLE m_processId = 0;
 	char m_cmdLine[2048];
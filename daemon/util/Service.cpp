@@ -63,7 +63,7 @@ void ServiceCoordinator::Run()
 		}
 
 		curTick += stepMSec;
-		usleep(stepMSec * 1000);
+		WaitEvents(stepMSec);
 	}
 
 	debug("Exiting ServiceCoordinator-loop");
@@ -73,3 +73,56 @@ void ServiceCoordinator::RegisterService(Service* service)
 {
 	m_services.push_back(service);
 }
+
+/*
+ * Sleeps until the next step, meanwhile dispatches events of services which have
+ * descriptors to watch. The descriptors are queried again after each event because
+ * the service may have closed or replaced its descriptor.
+ */
+void ServiceCoordinator::WaitEvents(int timeoutMSec)
+{
+#ifndef WIN32
+	int64 start = Util::GetCurrentTicks();
+	int remaining = timeoutMSec;
+
+	while (remaining > 0 && !IsStopped())
+	{
+		std::vector<pollfd> fds;
+		ServiceList services;
+		for (Service* service : m_services)
+		{
+			int fd = service->ServiceEventFd();
+			if (fd > -1)
+			{
+				fds.push_back({fd, POLLIN, 0});
+				services.push_back(service);
+			}
+		}
+
+		if (fds.empty())
+		{
+			break;
+		}
+
+		if (poll(fds.data(), fds.size(), remaining) > 0)
+		{
+			for (uint32 i = 0; i < fds.size(); i++)
+			{
+				if (fds[i].revents)
+				{
+					services[i]->ServiceEvent();
+				}
+			}
+		}
+
+		remaining = timeoutMSec - (int)((Util::GetCurrentTicks() - start) / 1000);
+	}
+
+	if (remaining > 0 && !IsStopped())
+	{
+		usleep(remaining * 1000);
+	}
+#else
+	usleep(timeoutMSec * 1000);
+#endif
+}
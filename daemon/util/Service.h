@@ -31,6 +31,9 @@ public:
 protected:
 	virtual int ServiceInterval() = 0;
 	virtual void ServiceWork() = 0;
+	/* Descriptor polled between runs, "ServiceEvent" is called as soon as it becomes readable (POSIX only) */
+	virtual int ServiceEventFd() { return -1; }
+	virtual void ServiceEvent() {}
 
 private:
 	int m_lastTick = 0;
@@ -51,6 +54,7 @@ private:
 	ServiceList m_services;
 
 	void RegisterService(Service* service);
+	void WaitEvents(int timeoutMSec);
 
 	friend class Service;
 };
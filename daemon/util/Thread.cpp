@@ -21,6 +21,7 @@
 #include "nzbget.h"
 #include "Log.h"
 #include "Thread.h"
+#include "Util.h"
 
 int Thread::m_threadCount = 1; // take the main program thread into account
 std::unique_ptr<Mutex> Thread::m_threadMutex;
@@ -71,6 +72,136 @@ void Mutex::Unlock()
 }
 
 
+RwMutex::RwMutex()
+{
+#ifdef WIN32
+	InitializeSRWLock(&m_lockObj);
+#else
+	pthread_rwlockattr_t attr;
+	pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+	// a steady stream of readers (web-interface) must not block the download threads
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	pthread_rwlock_init(&m_lockObj, &attr);
+	pthread_rwlockattr_destroy(&attr);
+#endif
+}
+
+RwMutex::~RwMutex()
+{
+#ifndef WIN32
+	pthread_rwlock_destroy(&m_lockObj);
+#endif
+}
+
+void RwMutex::Lock()
+{
+	int64 start = Util::GetCurrentTicks();
+#ifdef WIN32
+	AcquireSRWLockExclusive(&m_lockObj);
+#else
+	pthread_rwlock_wrlock(&m_lockObj);
+#endif
+	m_lockTime = Util::GetCurrentTicks();
+	m_stats.exclusiveCount++;
+	m_stats.exclusiveWait += m_lockTime - start;
+}
+
+void RwMutex::Unlock()
+{
+	int64 hold = Util::GetCurrentTicks() - m_lockTime;
+	m_stats.exclusiveHold += hold;
+	m_stats.exclusiveMaxHold = std::max(m_stats.exclusiveMaxHold, hold);
+#ifdef WIN32
+	ReleaseSRWLockExclusive(&m_lockObj);
+#else
+	pthread_rwlock_unlock(&m_lockObj);
+#endif
+}
+
+void RwMutex::LockShared()
+{
+	int64 start = Util::GetCurrentTicks();
+#ifdef WIN32
+	AcquireSRWLockShared(&m_lockObj);
+#else
+	pthread_rwlock_rdlock(&m_lockObj);
+#endif
+	int64 now = Util::GetCurrentTicks();
+
+	Guard guard(m_statMutex);
+	if (m_readers++ == 0)
+	{
+		m_sharedTime = now;
+	}
+	m_stats.sharedCount++;
+	m_stats.sharedWait += now - start;
+}
+
+void RwMutex::UnlockShared()
+{
+	{
+		Guard guard(m_statMutex);
+		if (--m_readers == 0)
+		{
+			int64 hold = Util::GetCurrentTicks() - m_sharedTime;
+			m_stats.sharedHold += hold;
+			m_stats.sharedMaxHold = std::max(m_stats.sharedMaxHold, hold);
+		}
+	}
+#ifdef WIN32
+	ReleaseSRWLockShared(&m_lockObj);
+#else
+	pthread_rwlock_unlock(&m_lockObj);
+#endif
+}
+
+
+ConditionVar::ConditionVar()
+{
+#ifdef WIN32
+	InitializeConditionVariable(&m_condObj);
+#else
+	pthread_cond_init(&m_condObj, nullptr);
+#endif
+}
+
+ConditionVar::~ConditionVar()
+{
+#ifndef WIN32
+	pthread_cond_destroy(&m_condObj);
+#endif
+}
+
+void ConditionVar::Wait(Mutex& mutex)
+{
+#ifdef WIN32
+	SleepConditionVariableCS(&m_condObj, &mutex.m_mutexObj, INFINITE);
+#else
+	pthread_cond_wait(&m_condObj, &mutex.m_mutexObj);
+#endif
+}
+
+void ConditionVar::NotifyOne()
+{
+#ifdef WIN32
+	WakeConditionVariable(&m_condObj);
+#else
+	pthread_cond_signal(&m_condObj);
+#endif
+}
+
+void ConditionVar::NotifyAll()
+{
+#ifdef WIN32
+	WakeAllConditionVariable(&m_condObj);
+#else
+	pthread_cond_broadcast(&m_condObj);
+#endif
+}
+
+
 void Thread::Init()
 {
 	debug("Initializing global thread data");
@@ -37,6 +37,70 @@ private:
 #else
 	pthread_mutex_t m_mutexObj;
 #endif
+
+	friend class ConditionVar;
+};
+
+class ConditionVar
+{
+public:
+	ConditionVar();
+	ConditionVar(const ConditionVar&) = delete;
+	~ConditionVar();
+	/* Mutex must be locked by caller, it's unlocked during waiting */
+	void Wait(Mutex& mutex);
+	void NotifyOne();
+	void NotifyAll();
+
+private:
+#ifdef WIN32
+	CONDITION_VARIABLE m_condObj;
+#else
+	pthread_cond_t m_condObj;
+#endif
+};
+
+/*
+ * Reader/writer lock: exclusive lock for changes, shared lock for concurrent
+ * read-only access. Not recursive. Hold times are measured, see GetStats.
+ */
+class RwMutex
+{
+public:
+	struct Stats
+	{
+		int exclusiveCount;
+		int64 exclusiveWait;
+		int64 exclusiveHold;
+		int64 exclusiveMaxHold;
+		int sharedCount;
+		int64 sharedWait;
+		// time during which the lock was held by at least one reader
+		int64 sharedHold;
+		int64 sharedMaxHold;
+	};
+
+	RwMutex();
+	RwMutex(const RwMutex&) = delete;
+	~RwMutex();
+	void Lock();
+	void Unlock();
+	void LockShared();
+	void UnlockShared();
+	/* Must be called while holding the exclusive lock */
+	Stats GetStats() { return m_stats; }
+
+private:
+#ifdef WIN32
+	SRWLOCK m_lockObj;
+#else
+	pthread_rwlock_t m_lockObj;
+#endif
+	Mutex m_statMutex;
+	Stats m_stats = {0};
+	int m_readers = 0;
+	int64 m_lockTime = 0;
+	int64 m_sharedTime = 0;
 };
 
 class Guard
@@ -58,11 +122,11 @@ private:
 	void Unlock() { if (m_mutex) { m_mutex->Unlock(); m_mutex = nullptr; } }
 };
 
-template<typename T>
+template<typename T, typename M = Mutex>
 class GuardedPtr
 {
 public:
-	GuardedPtr(T* ptr, Mutex* mutex) : m_ptr(ptr), m_mutex(mutex) { if (m_mutex) m_mutex->Lock(); }
+	GuardedPtr(T* ptr, M* mutex) : m_ptr(ptr), m_mutex(mutex) { if (m_mutex) m_mutex->Lock(); }
 	GuardedPtr(GuardedPtr&& other) : m_ptr(other.m_ptr), m_mutex(other.m_mutex) { other.m_mutex = nullptr; }
 	GuardedPtr(const GuardedPtr& other) = delete;
 	~GuardedPtr() { Unlock(); }
@@ -75,11 +139,33 @@ public:
 
 private:
 	T* m_ptr;
-	Mutex* m_mutex;
+	M* m_mutex;
 
 	void Unlock() { if (m_mutex) { m_mutex->Unlock(); m_mutex = nullptr; } }
 };
 
+template<typename T>
+class SharedGuardedPtr
+{
+public:
+	SharedGuardedPtr(T* ptr, RwMutex* mutex) : m_ptr(ptr), m_mutex(mutex) { if (m_mutex) m_mutex->LockShared(); }
+	SharedGuardedPtr(SharedGuardedPtr&& other) : m_ptr(other.m_ptr), m_mutex(other.m_mutex) { other.m_mutex = nullptr; }
+	SharedGuardedPtr(const SharedGuardedPtr& other) = delete;
+	~SharedGuardedPtr() { Unlock(); }
+	T* operator->() { return m_ptr; }
+	operator T*() { return m_ptr; }
+
+	// for-range loops on SharedGuardedPtr
+	auto begin() { return m_ptr->begin(); }
+	auto end() { return m_ptr->end(); }
+
+private:
+	T* m_ptr;
+	RwMutex* m_mutex;
+
+	void Unlock() { if (m_mutex) { m_mutex->UnlockShared(); m_mutex = nullptr; } }
+};
+
 class Thread
 {
 public:
@@ -81,4 +81,19 @@ u32 ComputeWindowMask(u64 window)
   return result;
 }
 
+// Choose the size of the filter: with 32 bits per CRC value about 3% of
+// the positions without a block still pass the filter. The size is
+// limited to 8 MB, the most common sets stay within the CPU cache.
+void CRCFilter::SetSize(u32 count)
+{
+  u32 size = 65536;
+  while (size < (u64)count * 32 && size < 0x4000000)
+  {
+    size <<= 1;
+  }
+
+  bits.assign(size / 32, 0);
+  mask = size - 1;
+}
+
 } // end namespace Par2
@@ -94,6 +94,36 @@ inline u32 CRCSlideChar(u32 crc, u8 chNew, u8 chOld, const u32 (&windowtable)[25
   return ((crc >> 8) & 0x00ffffffL) ^ ccitttable.table[(u8)crc ^ chNew] ^ windowtable[chOld];
 }
 
+// A compact set of CRC values: one bit per possible value of the low
+// CRC bits. Used to rule out most positions of the sliding window scan
+// before searching the verification hash table. It can report CRCs
+// which are not in the set, but never misses one which is.
+class CRCFilter
+{
+public:
+  CRCFilter(void) : mask(0) {}
+
+  // Choose the size for the number of CRC values to be inserted
+  void SetSize(u32 count);
+
+  void Insert(u32 crc);
+  bool Contains(u32 crc) const;
+
+protected:
+  vector<u32> bits;
+  u32         mask;
+};
+
+inline void CRCFilter::Insert(u32 crc)
+{
+  bits[(crc & mask) >> 5] |= (u32)1 << (crc & 31);
+}
+
+inline bool CRCFilter::Contains(u32 crc) const
+{
+  return (bits[(crc & mask) >> 5] >> (crc & 31)) & 1;
+}
+
 /*
 
   char *buffer;
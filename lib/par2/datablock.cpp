@@ -60,8 +60,12 @@ bool DataBlock::ReadData(u64    position, // Position within the block
     u64    fileoffset = offset + position;
     size_t want       = (size_t)min((u64)size, length - position);
 
-    // Read the data from the file into the buffer
-    if (!diskfile->Read(fileoffset, buffer, want))
+    // Read the data from the file into the buffer, mapped
+    // files are copied directly
+    const u8 *data = diskfile->Data(fileoffset, want);
+    if (data != 0)
+      memcpy(buffer, data, want);
+    else if (!diskfile->Read(fileoffset, buffer, want))
       return false;
 
     // If the read extends beyond the end of the data block,
@@ -80,6 +84,24 @@ bool DataBlock::ReadData(u64    position, // Position within the block
   return true;
 }
 
+const void* DataBlock::GetData(u64 position, size_t size) const
+{
+  assert(diskfile != 0);
+
+  if (position > length || size > length - position)
+    return 0;
+
+  return diskfile->Data(offset + position, size);
+}
+
+void DataBlock::Prefetch(u64 position, size_t size)
+{
+  assert(diskfile != 0);
+
+  if (length > position)
+    diskfile->Prefetch(offset + position, (size_t)min((u64)size, length - position));
+}
+
 // Write some data at a specified position within a datablock
 // from memory to disk
 
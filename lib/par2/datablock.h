@@ -66,6 +66,14 @@ public:
   // Read some of the data from disk into memory.
   bool ReadData(u64 position, size_t size, void *buffer);
 
+  // Get a pointer to the data in the mapped disk file. Returns NULL if the
+  // file is not mapped or the requested range is not completely within
+  // the block; ReadData must be used then.
+  const void* GetData(u64 position, size_t size) const;
+
+  // Start reading data of the block in background
+  void Prefetch(u64 position, size_t size);
+
   // Write some of the data from memory to disk
   bool WriteData(u64 position, size_t size, const void *buffer, size_t &wrote);
 
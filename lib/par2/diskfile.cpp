@@ -47,12 +47,15 @@ DiskFile::DiskFile(void)
   offset = 0;
 
   hFile = INVALID_HANDLE_VALUE;
+  mapping = 0;
 
   exists = false;
 }
 
 DiskFile::~DiskFile(void)
 {
+  Unmap();
+
   if (hFile != INVALID_HANDLE_VALUE)
     ::CloseHandle(hFile);
 }
@@ -252,6 +255,8 @@ bool DiskFile::Read(u64 _offset, void *buffer, size_t length)
 
 void DiskFile::Close(void)
 {
+  Unmap();
+
   if (hFile != INVALID_HANDLE_VALUE)
   {
     ::CloseHandle(hFile);
@@ -372,12 +377,15 @@ DiskFile::DiskFile(void)
   offset = 0;
 
   file = 0;
+  mapping = 0;
 
   exists = false;
 }
 
 DiskFile::~DiskFile(void)
 {
+  Unmap();
+
   if (file != 0)
     fclose(file);
 }
@@ -500,6 +508,11 @@ bool DiskFile::Open(string _filename, u64 _filesize)
     return false;
   }
 
+#ifdef POSIX_FADV_SEQUENTIAL
+  // Files are mostly read from start to end, let the system read ahead further
+  posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
   offset = 0;
   exists = true;
 
@@ -548,6 +561,8 @@ bool DiskFile::Read(u64 _offset, void *buffer, size_t length)
 
 void DiskFile::Close(void)
 {
+  Unmap();
+
   if (file != 0)
   {
     fclose(file);
@@ -727,6 +742,45 @@ bool DiskFile::Open(string _filename)
   return Open(_filename, GetFileSize(_filename));
 }
 
+bool DiskFile::Map(void)
+{
+  assert(IsOpen());
+
+  if (mapping != 0)
+    return true;
+
+  mapping = new MappedFile();
+  if (!mapping->Open(filename.c_str(), filesize, true))
+  {
+    // Empty files and files too large for the address space can't be
+    // mapped, they are read as usual
+    Unmap();
+    return false;
+  }
+
+  return true;
+}
+
+void DiskFile::Unmap(void)
+{
+  delete mapping;
+  mapping = 0;
+}
+
+const u8* DiskFile::Data(u64 _offset, size_t length) const
+{
+  if (mapping == 0 || _offset > filesize || length > filesize - _offset)
+    return 0;
+
+  return (const u8*)mapping->GetData() + _offset;
+}
+
+void DiskFile::Prefetch(u64 _offset, size_t length)
+{
+  if (mapping != 0)
+    mapping->Prefetch(_offset, min((u64)length, filesize - min(_offset, filesize)));
+}
+
 
 
 
@@ -20,6 +20,8 @@
 #ifndef __DISKFILE_H__
 #define __DISKFILE_H__
 
+class MappedFile;
+
 namespace Par2
 {
 
@@ -56,6 +58,18 @@ public:
   // Close the file
   void Close(void);
 
+  // Map the open file into memory (read only). Blocks of a mapped file
+  // can be accessed directly without copying them into a read buffer.
+  bool Map(void);
+  void Unmap(void);
+
+  // Get a pointer to mapped data, or NULL if the file is not mapped or
+  // the range is outside of the file
+  const u8* Data(u64 offset, size_t length) const;
+
+  // Start reading data of the mapped file in background
+  void Prefetch(u64 offset, size_t length);
+
   // Get the size of the file
   u64 FileSize(void) const {return filesize;}
 
@@ -99,6 +113,9 @@ protected:
   // Current offset within the file
   u64    offset;
 
+  // Memory mapping of the file, if any
+  MappedFile *mapping;
+
   // Does the file exist
   bool   exists;
 
@@ -57,9 +57,9 @@ FileCheckSummer::~FileCheckSummer(void)
 // Start reading the file at the beginning
 bool FileCheckSummer::Start(void)
 {
-  currentoffset = readoffset = 0;
+  currentoffset = readoffset = hashoffset = 0;
 
-  tailpointer = outpointer = buffer;
+  tailpointer = outpointer = hashpointer = buffer;
   inpointer = &buffer[blocksize];
 
   // Fill the buffer with new data
@@ -94,8 +94,10 @@ bool FileCheckSummer::Jump(u64 distance)
   currentoffset += distance;
   if (currentoffset >= filesize)
   {
+    UpdateHashes(tailpointer);
+
     currentoffset = filesize;
-    tailpointer = outpointer = buffer;
+    tailpointer = outpointer = hashpointer = buffer;
     memset(buffer, 0, (size_t)blocksize);
     checksum = 0;
 
@@ -106,6 +108,10 @@ bool FileCheckSummer::Jump(u64 distance)
   outpointer += distance;
   assert(outpointer <= tailpointer);
 
+  // The data being discarded must be part of the file hashes
+  UpdateHashes(outpointer);
+  hashpointer = buffer + (hashpointer - outpointer);
+
   // Is there any data left in the buffer that we are keeping
   size_t keep = tailpointer - outpointer;
   if (keep > 0)
@@ -131,6 +137,47 @@ bool FileCheckSummer::Jump(u64 distance)
   return true;
 }
 
+// Step forward until the checksum may be the one of a block
+bool FileCheckSummer::StepToCandidate(const CRCFilter &filter)
+{
+  while (true)
+  {
+    // How far can the window slide before reaching the end of the
+    // buffer or the end of the file, both of which are handled by Step
+    size_t steps = (size_t)min((u64)(&buffer[blocksize] - outpointer), filesize - currentoffset) - 1;
+
+    if (steps == 0)
+    {
+      if (!Step())
+        return false;
+
+      if (currentoffset >= filesize || filter.Contains(checksum))
+        return true;
+
+      continue;
+    }
+
+    const u8 *in = (const u8 *)inpointer;
+    const u8 *out = (const u8 *)outpointer;
+    u32 crc = windowmask ^ checksum;
+    size_t step = 0;
+
+    do
+    {
+      crc = CRCSlideChar(crc, in[step], out[step], windowtable);
+      step++;
+    } while (step < steps && !filter.Contains(windowmask ^ crc));
+
+    inpointer += step;
+    outpointer += step;
+    currentoffset += step;
+    checksum = windowmask ^ crc;
+
+    if (filter.Contains(checksum))
+      return true;
+  }
+}
+
 // Fill the buffer from disk
 
 bool FileCheckSummer::Fill(void)
@@ -148,7 +195,6 @@ bool FileCheckSummer::Fill(void)
     if (!diskfile->Read(readoffset, tailpointer, want))
       return false;
 
-    UpdateHashes(readoffset, tailpointer, want);
     readoffset += want;
     tailpointer += want;
   }
@@ -194,6 +240,18 @@ void FileCheckSummer::UpdateHashes(u64 offset, const void *buffer, size_t length
   }
 }
 
+// Update the file hashes with the data in the buffer up to "pointer"
+void FileCheckSummer::UpdateHashes(const char *pointer)
+{
+  if (pointer > hashpointer)
+  {
+    size_t length = pointer - hashpointer;
+    UpdateHashes(hashoffset, hashpointer, length);
+    hashpointer += length;
+    hashoffset += length;
+  }
+}
+
 // Return the full file hash and the 16k file hash
 void FileCheckSummer::GetFileHashes(MD5Hash &hashfull, MD5Hash &hash16k) const
 {
@@ -219,7 +277,24 @@ void FileCheckSummer::GetFileHashes(MD5Hash &hashfull, MD5Hash &hash16k) const
 MD5Hash FileCheckSummer::Hash(void)
 {
   MD5Context context;
-  context.Update(outpointer, (size_t)blocksize);
+
+  // If the full file hash has reached the scan window, add the window to
+  // it while computing the hash of the window: both run in SIMD lanes.
+  if (hashpointer == outpointer && hashoffset >= 16384 &&
+      &outpointer[blocksize] <= tailpointer && MD5Lanes() > 1)
+  {
+    MD5Context *contexts[2] = {&context, &contextfull};
+    const void *buffers[2] = {outpointer, outpointer};
+    const size_t lengths[2] = {(size_t)blocksize, (size_t)blocksize};
+    MD5UpdateMulti(contexts, buffers, lengths, 2);
+
+    hashpointer += blocksize;
+    hashoffset += blocksize;
+  }
+  else
+  {
+    context.Update(outpointer, (size_t)blocksize);
+  }
 
   MD5Hash hash;
   context.Final(hash);
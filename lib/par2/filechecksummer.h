@@ -54,6 +54,11 @@ public:
   // Step forward one byte
   bool Step(void);
 
+  // Step forward one byte and then on until the checksum is contained in
+  // the filter, so that positions which cannot be the start of a block are
+  // passed in a tight loop
+  bool StepToCandidate(const CRCFilter &filter);
+
   // Return the current checksum
   u32 Checksum(void) const;
 
@@ -101,10 +106,19 @@ protected:
   MD5Context  contextfull;
   MD5Context  context16k;
 
+  // The file hashes are computed as late as possible, so that the data of
+  // the scan window can be added to them together with computing the hash
+  // of the window itself (see Hash)
+  char       *hashpointer;   // position in buffer up to which the file hashes are computed
+  u64         hashoffset;    // file offset up to which the file hashes are computed
+
 protected:
   //void ComputeCurrentCRC(void);
   void UpdateHashes(u64 offset, const void *buffer, size_t length);
 
+  // Compute the file hashes up to the position in buffer
+  void UpdateHashes(const char *pointer);
+
   //// Fill the buffers with more data from disk
   bool Fill(void);
 };
@@ -146,8 +160,10 @@ inline bool FileCheckSummer::Step(void)
   // we have reached the end of the file
   if (++currentoffset >= filesize)
   {
+    UpdateHashes(tailpointer);
+
     currentoffset = filesize;
-    tailpointer = outpointer = buffer;
+    tailpointer = outpointer = hashpointer = buffer;
     memset(buffer, 0, (size_t)blocksize);
     checksum = 0;
 
@@ -167,11 +183,15 @@ inline bool FileCheckSummer::Step(void)
 
   assert(outpointer == &buffer[blocksize]);
 
+  // The data being discarded must be part of the file hashes
+  UpdateHashes(outpointer);
+
   // Copy the data back to the beginning of the buffer
   memmove(buffer, outpointer, (size_t)blocksize);
   inpointer = outpointer;
   outpointer = buffer;
   tailpointer -= blocksize;
+  hashpointer -= blocksize;
 
   // Fill the rest of the buffer
   return Fill();
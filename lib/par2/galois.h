@@ -42,7 +42,7 @@ class GaloisTable
 public:
   typedef valuetype ValueType;
 
-  GaloisTable(void);
+  constexpr GaloisTable(void);
 
   enum
   {
@@ -109,32 +109,16 @@ public:
 protected:
   ValueType value;
 
-  static GaloisTable<bits,generator,valuetype> table;
+  static const GaloisTable<bits,generator,valuetype> table;
 };
 
-#ifdef LONGMULTIPLY
-template <class g> 
-class GaloisLongMultiplyTable
-{
-public:
-  GaloisLongMultiplyTable(void);
-
-  typedef g G;
-
-  enum
-  {
-    Bytes = ((G::Bits + 7) >> 3),
-    Count = ((Bytes * (Bytes+1)) / 2),
-  };
-
-  G tables[Count * 256 * 256];
-};
-#endif
-
-// Construct the log and antilog tables from the generator
+// Construct the log and antilog tables from the generator.
+// The constructor is evaluated by the compiler so that the tables
+// are placed into read-only data and need no initialisation at runtime.
 
 template <const unsigned int bits, const unsigned int generator, typename valuetype>
-inline GaloisTable<bits,generator,valuetype>::GaloisTable(void)
+inline constexpr GaloisTable<bits,generator,valuetype>::GaloisTable(void)
+  : log(), antilog()
 {
   u32 b = 1;
 
@@ -155,7 +139,7 @@ inline GaloisTable<bits,generator,valuetype>::GaloisTable(void)
 // The one and only galois log/antilog table object
 
 template <const unsigned int bits, const unsigned int generator, typename valuetype>
-GaloisTable<bits,generator,valuetype> Galois<bits,generator,valuetype>::table;
+constexpr GaloisTable<bits,generator,valuetype> Galois<bits,generator,valuetype>::table;
 
 
 template <const unsigned int bits, const unsigned int generator, typename valuetype>
@@ -313,28 +297,6 @@ inline valuetype Galois<bits,generator,valuetype>::ALog(void) const
   return table.antilog[value];
 }
 
-#ifdef LONGMULTIPLY
-template <class g> 
-inline GaloisLongMultiplyTable<g>::GaloisLongMultiplyTable(void)
-{
-  G *table = tables;
-
-  for (unsigned int i=0; i<Bytes; i++)
-  {
-    for (unsigned int j=i; j<Bytes; j++)
-    {
-      for (unsigned int ii=0; ii<256; ii++)
-      {
-        for (unsigned int jj=0; jj<256; jj++)
-        {
-          *table++ = G(ii << (8*i)) * G(jj << (8*j));
-        }
-      }
-    }
-  }
-}
-#endif
-
 typedef Galois<8,0x11D,u8> Galois8;
 typedef Galois<16,0x1100B,u16> Galois16;
 
@@ -20,6 +20,11 @@
 #include "nzbget.h"
 #include "par2cmdline.h"
 
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define MD5_SIMD
+#include <immintrin.h>
+#endif
+
 #ifdef _MSC_VER
 #ifdef _DEBUG
 #undef THIS_FILE
@@ -75,6 +80,89 @@ void MD5State::Reset(void)
   state[3] = 0x10325476;
 }
 
+// The 64 steps of the MD5 compression function; "ROUND" and the
+// primitive operations are defined by the scalar and the SIMD code
+#define MD5_ROUNDS \
+  ROUND(F1, a, b, c, d,  0,  7, 0xd76aa478); \
+  ROUND(F1, d, a, b, c,  1, 12, 0xe8c7b756); \
+  ROUND(F1, c, d, a, b, 2, 17, 0x242070db); \
+  ROUND(F1, b, c, d, a,  3, 22, 0xc1bdceee); \
+  \
+  ROUND(F1, a, b, c, d,  4,  7, 0xf57c0faf); \
+  ROUND(F1, d, a, b, c,  5, 12, 0x4787c62a); \
+  ROUND(F1, c, d, a, b,  6, 17, 0xa8304613); \
+  ROUND(F1, b, c, d, a,  7, 22, 0xfd469501); \
+  \
+  ROUND(F1, a, b, c, d,  8,  7, 0x698098d8); \
+  ROUND(F1, d, a, b, c,  9, 12, 0x8b44f7af); \
+  ROUND(F1, c, d, a, b, 10, 17, 0xffff5bb1); \
+  ROUND(F1, b, c, d, a, 11, 22, 0x895cd7be); \
+  \
+  ROUND(F1, a, b, c, d, 12,  7, 0x6b901122); \
+  ROUND(F1, d, a, b, c, 13, 12, 0xfd987193); \
+  ROUND(F1, c, d, a, b, 14, 17, 0xa679438e); \
+  ROUND(F1, b, c, d, a, 15, 22, 0x49b40821); \
+  \
+  ROUND(F2, a, b, c, d,  1,  5, 0xf61e2562); \
+  ROUND(F2, d, a, b, c,  6,  9, 0xc040b340); \
+  ROUND(F2, c, d, a, b, 11, 14, 0x265e5a51); \
+  ROUND(F2, b, c, d, a,  0, 20, 0xe9b6c7aa); \
+  \
+  ROUND(F2, a, b, c, d,  5,  5, 0xd62f105d); \
+  ROUND(F2, d, a, b, c, 10,  9, 0x02441453); \
+  ROUND(F2, c, d, a, b, 15, 14, 0xd8a1e681); \
+  ROUND(F2, b, c, d, a,  4, 20, 0xe7d3fbc8); \
+  \
+  ROUND(F2, a, b, c, d,  9,  5, 0x21e1cde6); \
+  ROUND(F2, d, a, b, c, 14,  9, 0xc33707d6); \
+  ROUND(F2, c, d, a, b,  3, 14, 0xf4d50d87); \
+  ROUND(F2, b, c, d, a,  8, 20, 0x455a14ed); \
+  \
+  ROUND(F2, a, b, c, d, 13,  5, 0xa9e3e905); \
+  ROUND(F2, d, a, b, c,  2,  9, 0xfcefa3f8); \
+  ROUND(F2, c, d, a, b,  7, 14, 0x676f02d9); \
+  ROUND(F2, b, c, d, a, 12, 20, 0x8d2a4c8a); \
+  \
+  ROUND(F3, a, b, c, d,  5,  4, 0xfffa3942); \
+  ROUND(F3, d, a, b, c,  8, 11, 0x8771f681); \
+  ROUND(F3, c, d, a, b, 11, 16, 0x6d9d6122); \
+  ROUND(F3, b, c, d, a, 14, 23, 0xfde5380c); \
+  \
+  ROUND(F3, a, b, c, d,  1,  4, 0xa4beea44); \
+  ROUND(F3, d, a, b, c,  4, 11, 0x4bdecfa9); \
+  ROUND(F3, c, d, a, b,  7, 16, 0xf6bb4b60); \
+  ROUND(F3, b, c, d, a, 10, 23, 0xbebfbc70); \
+  \
+  ROUND(F3, a, b, c, d, 13,  4, 0x289b7ec6); \
+  ROUND(F3, d, a, b, c,  0, 11, 0xeaa127fa); \
+  ROUND(F3, c, d, a, b,  3, 16, 0xd4ef3085); \
+  ROUND(F3, b, c, d, a,  6, 23, 0x04881d05); \
+  \
+  ROUND(F3, a, b, c, d,  9,  4, 0xd9d4d039); \
+  ROUND(F3, d, a, b, c, 12, 11, 0xe6db99e5); \
+  ROUND(F3, c, d, a, b, 15, 16, 0x1fa27cf8); \
+  ROUND(F3, b, c, d, a,  2, 23, 0xc4ac5665); \
+  \
+  ROUND(F4, a, b, c, d,  0,  6, 0xf4292244); \
+  ROUND(F4, d, a, b, c,  7, 10, 0x432aff97); \
+  ROUND(F4, c, d, a, b, 14, 15, 0xab9423a7); \
+  ROUND(F4, b, c, d, a,  5, 21, 0xfc93a039); \
+  \
+  ROUND(F4, a, b, c, d, 12,  6, 0x655b59c3); \
+  ROUND(F4, d, a, b, c,  3, 10, 0x8f0ccc92); \
+  ROUND(F4, c, d, a, b, 10, 15, 0xffeff47d); \
+  ROUND(F4, b, c, d, a, 1, 21, 0x85845dd1); \
+  \
+  ROUND(F4, a, b, c, d,  8,  6, 0x6fa87e4f); \
+  ROUND(F4, d, a, b, c, 15, 10, 0xfe2ce6e0); \
+  ROUND(F4, c, d, a, b,  6, 15, 0xa3014314); \
+  ROUND(F4, b, c, d, a, 13, 21, 0x4e0811a1); \
+  \
+  ROUND(F4, a, b, c, d,  4,  6, 0xf7537e82); \
+  ROUND(F4, d, a, b, c, 11, 10, 0xbd3af235); \
+  ROUND(F4, c, d, a, b,  2, 15, 0x2ad7d2bb); \
+  ROUND(F4, b, c, d, a,  9, 21, 0xeb86d391);
+
 // Update the state using 64 bytes of new data
 void MD5State::UpdateState(const u32 (&block)[16])
 {
@@ -95,90 +183,19 @@ void MD5State::UpdateState(const u32 (&block)[16])
   u32 c = state[2];
   u32 d = state[3];
 
-  ROUND(F1, a, b, c, d,  0,  7, 0xd76aa478);
-  ROUND(F1, d, a, b, c,  1, 12, 0xe8c7b756);
-  ROUND(F1, c, d, a, b, 2, 17, 0x242070db);
-  ROUND(F1, b, c, d, a,  3, 22, 0xc1bdceee);
-  
-  ROUND(F1, a, b, c, d,  4,  7, 0xf57c0faf);
-  ROUND(F1, d, a, b, c,  5, 12, 0x4787c62a);
-  ROUND(F1, c, d, a, b,  6, 17, 0xa8304613);
-  ROUND(F1, b, c, d, a,  7, 22, 0xfd469501);
-  
-  ROUND(F1, a, b, c, d,  8,  7, 0x698098d8);
-  ROUND(F1, d, a, b, c,  9, 12, 0x8b44f7af);
-  ROUND(F1, c, d, a, b, 10, 17, 0xffff5bb1);
-  ROUND(F1, b, c, d, a, 11, 22, 0x895cd7be);
-  
-  ROUND(F1, a, b, c, d, 12,  7, 0x6b901122);
-  ROUND(F1, d, a, b, c, 13, 12, 0xfd987193);
-  ROUND(F1, c, d, a, b, 14, 17, 0xa679438e);
-  ROUND(F1, b, c, d, a, 15, 22, 0x49b40821);
-  
-  ROUND(F2, a, b, c, d,  1,  5, 0xf61e2562);
-  ROUND(F2, d, a, b, c,  6,  9, 0xc040b340);
-  ROUND(F2, c, d, a, b, 11, 14, 0x265e5a51);
-  ROUND(F2, b, c, d, a,  0, 20, 0xe9b6c7aa);
-  
-  ROUND(F2, a, b, c, d,  5,  5, 0xd62f105d);
-  ROUND(F2, d, a, b, c, 10,  9, 0x02441453);
-  ROUND(F2, c, d, a, b, 15, 14, 0xd8a1e681);
-  ROUND(F2, b, c, d, a,  4, 20, 0xe7d3fbc8);
-  
-  ROUND(F2, a, b, c, d,  9,  5, 0x21e1cde6);
-  ROUND(F2, d, a, b, c, 14,  9, 0xc33707d6);
-  ROUND(F2, c, d, a, b,  3, 14, 0xf4d50d87);
-  ROUND(F2, b, c, d, a,  8, 20, 0x455a14ed);
-  
-  ROUND(F2, a, b, c, d, 13,  5, 0xa9e3e905);
-  ROUND(F2, d, a, b, c,  2,  9, 0xfcefa3f8);
-  ROUND(F2, c, d, a, b,  7, 14, 0x676f02d9);
-  ROUND(F2, b, c, d, a, 12, 20, 0x8d2a4c8a);
-  
-  ROUND(F3, a, b, c, d,  5,  4, 0xfffa3942);
-  ROUND(F3, d, a, b, c,  8, 11, 0x8771f681);
-  ROUND(F3, c, d, a, b, 11, 16, 0x6d9d6122);
-  ROUND(F3, b, c, d, a, 14, 23, 0xfde5380c);
-  
-  ROUND(F3, a, b, c, d,  1,  4, 0xa4beea44);
-  ROUND(F3, d, a, b, c,  4, 11, 0x4bdecfa9);
-  ROUND(F3, c, d, a, b,  7, 16, 0xf6bb4b60);
-  ROUND(F3, b, c, d, a, 10, 23, 0xbebfbc70);
-  
-  ROUND(F3, a, b, c, d, 13,  4, 0x289b7ec6);
-  ROUND(F3, d, a, b, c,  0, 11, 0xeaa127fa);
-  ROUND(F3, c, d, a, b,  3, 16, 0xd4ef3085);
-  ROUND(F3, b, c, d, a,  6, 23, 0x04881d05);
-  
-  ROUND(F3, a, b, c, d,  9,  4, 0xd9d4d039);
-  ROUND(F3, d, a, b, c, 12, 11, 0xe6db99e5);
-  ROUND(F3, c, d, a, b, 15, 16, 0x1fa27cf8);
-  ROUND(F3, b, c, d, a,  2, 23, 0xc4ac5665);
-  
-  ROUND(F4, a, b, c, d,  0,  6, 0xf4292244);
-  ROUND(F4, d, a, b, c,  7, 10, 0x432aff97);
-  ROUND(F4, c, d, a, b, 14, 15, 0xab9423a7);
-  ROUND(F4, b, c, d, a,  5, 21, 0xfc93a039);
-  
-  ROUND(F4, a, b, c, d, 12,  6, 0x655b59c3);
-  ROUND(F4, d, a, b, c,  3, 10, 0x8f0ccc92);
-  ROUND(F4, c, d, a, b, 10, 15, 0xffeff47d);
-  ROUND(F4, b, c, d, a, 1, 21, 0x85845dd1);
-  
-  ROUND(F4, a, b, c, d,  8,  6, 0x6fa87e4f);
-  ROUND(F4, d, a, b, c, 15, 10, 0xfe2ce6e0);
-  ROUND(F4, c, d, a, b,  6, 15, 0xa3014314);
-  ROUND(F4, b, c, d, a, 13, 21, 0x4e0811a1);
-  
-  ROUND(F4, a, b, c, d,  4,  6, 0xf7537e82);
-  ROUND(F4, d, a, b, c, 11, 10, 0xbd3af235);
-  ROUND(F4, c, d, a, b,  2, 15, 0x2ad7d2bb);
-  ROUND(F4, b, c, d, a,  9, 21, 0xeb86d391);
+  MD5_ROUNDS;
 
   state[0] += a;
   state[1] += b;
   state[2] += c;
   state[3] += d;
+
+#undef F1
+#undef F2
+#undef F3
+#undef F4
+#undef ROL
+#undef ROUND
 }
 
 MD5Context::MD5Context(void)
@@ -353,4 +370,284 @@ string MD5Context::print(void) const
   return buffer;
 }
 
+#ifdef MD5_SIMD
+// Kernels for the multi-buffer MD5: "state[i]" and "data[i]" belong to lane i,
+// the lanes are updated with "blocks" blocks of 64 bytes each.
+
+// Transpose 16 bytes of 4 lanes so that each vector holds one message word of all lanes
+#define MD5_TRANSPOSE(r0, r1, r2, r3, w0, w1, w2, w3) \
+  { \
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1); \
+    __m128i t1 = _mm_unpacklo_epi32(r2, r3); \
+    __m128i t2 = _mm_unpackhi_epi32(r0, r1); \
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3); \
+    w0 = _mm_unpacklo_epi64(t0, t1); \
+    w1 = _mm_unpackhi_epi64(t0, t1); \
+    w2 = _mm_unpacklo_epi64(t2, t3); \
+    w3 = _mm_unpackhi_epi64(t2, t3); \
+  }
+
+__attribute__((target("sse2")))
+static void UpdateStateSse2(u32 *state[4], const u8 *data[4], size_t blocks)
+{
+#define F1(x,y,z)    _mm_or_si128(_mm_and_si128(x, y), _mm_andnot_si128(x, z))
+#define F2(x,y,z)    _mm_or_si128(_mm_and_si128(x, z), _mm_andnot_si128(z, y))
+#define F3(x,y,z)    _mm_xor_si128(_mm_xor_si128(x, y), z)
+#define F4(x,y,z)    _mm_xor_si128(y, _mm_or_si128(x, _mm_xor_si128(z, ones)))
+#define ROL(x,y)     _mm_or_si128(_mm_slli_epi32(x, y), _mm_srli_epi32(x, 32-y))
+#define ROUND(f,w,x,y,z,k,s,ti) \
+  w = _mm_add_epi32(x, ROL(_mm_add_epi32(_mm_add_epi32(w, f(x,y,z)), _mm_add_epi32(block[k], _mm_set1_epi32((int)ti))), s))
+
+  const __m128i ones = _mm_set1_epi32(-1);
+
+  __m128i a = _mm_setr_epi32(state[0][0], state[1][0], state[2][0], state[3][0]);
+  __m128i b = _mm_setr_epi32(state[0][1], state[1][1], state[2][1], state[3][1]);
+  __m128i c = _mm_setr_epi32(state[0][2], state[1][2], state[2][2], state[3][2]);
+  __m128i d = _mm_setr_epi32(state[0][3], state[1][3], state[2][3], state[3][3]);
+
+  for (size_t offset = 0; offset < blocks * 64; offset += 64)
+  {
+    __m128i block[16];
+    for (int i = 0; i < 4; i++)
+    {
+      MD5_TRANSPOSE(
+        _mm_loadu_si128((const __m128i*)&data[0][offset + 16*i]),
+        _mm_loadu_si128((const __m128i*)&data[1][offset + 16*i]),
+        _mm_loadu_si128((const __m128i*)&data[2][offset + 16*i]),
+        _mm_loadu_si128((const __m128i*)&data[3][offset + 16*i]),
+        block[4*i], block[4*i+1], block[4*i+2], block[4*i+3]);
+    }
+
+    __m128i aa = a;
+    __m128i bb = b;
+    __m128i cc = c;
+    __m128i dd = d;
+
+    MD5_ROUNDS;
+
+    a = _mm_add_epi32(a, aa);
+    b = _mm_add_epi32(b, bb);
+    c = _mm_add_epi32(c, cc);
+    d = _mm_add_epi32(d, dd);
+  }
+
+  u32 out[4][4];
+  _mm_storeu_si128((__m128i*)out[0], a);
+  _mm_storeu_si128((__m128i*)out[1], b);
+  _mm_storeu_si128((__m128i*)out[2], c);
+  _mm_storeu_si128((__m128i*)out[3], d);
+  for (int lane = 0; lane < 4; lane++)
+  {
+    for (int i = 0; i < 4; i++)
+    {
+      state[lane][i] = out[i][lane];
+    }
+  }
+
+#undef F1
+#undef F2
+#undef F3
+#undef F4
+#undef ROL
+#undef ROUND
+}
+
+__attribute__((target("avx2")))
+static void UpdateStateAvx2(u32 *state[8], const u8 *data[8], size_t blocks)
+{
+#define F1(x,y,z)    _mm256_or_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z))
+#define F2(x,y,z)    _mm256_or_si256(_mm256_and_si256(x, z), _mm256_andnot_si256(z, y))
+#define F3(x,y,z)    _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define F4(x,y,z)    _mm256_xor_si256(y, _mm256_or_si256(x, _mm256_xor_si256(z, ones)))
+#define ROL(x,y)     _mm256_or_si256(_mm256_slli_epi32(x, y), _mm256_srli_epi32(x, 32-y))
+#define ROUND(f,w,x,y,z,k,s,ti) \
+  w = _mm256_add_epi32(x, ROL(_mm256_add_epi32(_mm256_add_epi32(w, f(x,y,z)), _mm256_add_epi32(block[k], _mm256_set1_epi32((int)ti))), s))
+
+  const __m256i ones = _mm256_set1_epi32(-1);
+
+  __m256i a = _mm256_setr_epi32(state[0][0], state[1][0], state[2][0], state[3][0],
+    state[4][0], state[5][0], state[6][0], state[7][0]);
+  __m256i b = _mm256_setr_epi32(state[0][1], state[1][1], state[2][1], state[3][1],
+    state[4][1], state[5][1], state[6][1], state[7][1]);
+  __m256i c = _mm256_setr_epi32(state[0][2], state[1][2], state[2][2], state[3][2],
+    state[4][2], state[5][2], state[6][2], state[7][2]);
+  __m256i d = _mm256_setr_epi32(state[0][3], state[1][3], state[2][3], state[3][3],
+    state[4][3], state[5][3], state[6][3], state[7][3]);
+
+  for (size_t offset = 0; offset < blocks * 64; offset += 64)
+  {
+    __m256i block[16];
+    for (int i = 0; i < 4; i++)
+    {
+      __m128i lo[4];
+      __m128i hi[4];
+      MD5_TRANSPOSE(
+        _mm_loadu_si128((const __m128i*)&data[0][offset + 16*i]),
+        _mm_loadu_si128((const __m128i*)&data[1][offset + 16*i]),
+        _mm_loadu_si128((const __m128i*)&data[2][offset + 16*i]),
+        _mm_loadu_si128((const __m128i*)&data[3][offset + 16*i]),
+        lo[0], lo[1], lo[2], lo[3]);
+      MD5_TRANSPOSE(
+        _mm_loadu_si128((const __m128i*)&data[4][offset + 16*i]),
+        _mm_loadu_si128((const __m128i*)&data[5][offset + 16*i]),
+        _mm_loadu_si128((const __m128i*)&data[6][offset + 16*i]),
+        _mm_loadu_si128((const __m128i*)&data[7][offset + 16*i]),
+        hi[0], hi[1], hi[2], hi[3]);
+      for (int j = 0; j < 4; j++)
+      {
+        block[4*i+j] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo[j]), hi[j], 1);
+      }
+    }
+
+    __m256i aa = a;
+    __m256i bb = b;
+    __m256i cc = c;
+    __m256i dd = d;
+
+    MD5_ROUNDS;
+
+    a = _mm256_add_epi32(a, aa);
+    b = _mm256_add_epi32(b, bb);
+    c = _mm256_add_epi32(c, cc);
+    d = _mm256_add_epi32(d, dd);
+  }
+
+  u32 out[4][8];
+  _mm256_storeu_si256((__m256i*)out[0], a);
+  _mm256_storeu_si256((__m256i*)out[1], b);
+  _mm256_storeu_si256((__m256i*)out[2], c);
+  _mm256_storeu_si256((__m256i*)out[3], d);
+  for (int lane = 0; lane < 8; lane++)
+  {
+    for (int i = 0; i < 4; i++)
+    {
+      state[lane][i] = out[i][lane];
+    }
+  }
+
+#undef F1
+#undef F2
+#undef F3
+#undef F4
+#undef ROL
+#undef ROUND
+}
+#endif
+
+bool MD5KernelSupported(MD5Kernel kernel)
+{
+  switch (kernel)
+  {
+#ifdef MD5_SIMD
+  case mkSse2:
+    return __builtin_cpu_supports("sse2");
+  case mkAvx2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  case mkScalar:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static MD5Kernel DetectMD5Kernel(void)
+{
+#ifdef MD5_SIMD
+  __builtin_cpu_init();
+#endif
+  return MD5KernelSupported(mkAvx2) ? mkAvx2 :
+    MD5KernelSupported(mkSse2) ? mkSse2 : mkScalar;
+}
+
+static MD5Kernel md5kernel = DetectMD5Kernel();
+
+MD5Kernel GetMD5Kernel(void)
+{
+  return md5kernel;
+}
+
+void SetMD5Kernel(MD5Kernel kernel)
+{
+  md5kernel = kernel;
+}
+
+int MD5Lanes(void)
+{
+  return md5kernel == mkAvx2 ? 8 : md5kernel == mkSse2 ? 4 : 1;
+}
+
+void MD5UpdateMulti(MD5Context *contexts[], const void *buffers[], const size_t lengths[], int count)
+{
+  int lanes = MD5Lanes();
+
+  for (int first = 0; first < count; first += lanes)
+  {
+    int used = min(lanes, count - first);
+
+    const u8 *data[8];
+    size_t length[8];
+    size_t blocks = ~(size_t)0;
+
+    for (int i = 0; i < used; i++)
+    {
+      MD5Context *context = contexts[first + i];
+      data[i] = (const u8 *)buffers[first + i];
+      length[i] = lengths[first + i];
+
+      // Complete the data already buffered in the context
+      if (context->used > 0)
+      {
+        size_t have = min((size_t)(MD5Context::buffersize - context->used), length[i]);
+        context->Update(data[i], have);
+        data[i] += have;
+        length[i] -= have;
+      }
+
+      blocks = min(blocks, context->used > 0 ? 0 : length[i] / MD5Context::buffersize);
+    }
+
+#ifdef MD5_SIMD
+    // With only one context there is nothing to gain
+    if (used > 1 && blocks > 0)
+    {
+      // Unused lanes work on a copy of the first lane
+      u32 spare[8][4];
+      u32 *state[8];
+      for (int i = 0; i < 8; i++)
+      {
+        state[i] = i < used ? contexts[first + i]->state : spare[i];
+        if (i >= used)
+        {
+          memcpy(spare[i], state[0], sizeof(spare[i]));
+          data[i] = data[0];
+        }
+      }
+
+      if (used > 4)
+      {
+        UpdateStateAvx2(state, data, blocks);
+      }
+      else
+      {
+        UpdateStateSse2(state, data, blocks);
+      }
+
+      for (int i = 0; i < used; i++)
+      {
+        contexts[first + i]->bytes += blocks * MD5Context::buffersize;
+        data[i] += blocks * MD5Context::buffersize;
+        length[i] -= blocks * MD5Context::buffersize;
+      }
+    }
+#endif
+
+    // Process the rest
+    for (int i = 0; i < used; i++)
+    {
+      contexts[first + i]->Update(data[i], length[i]);
+    }
+  }
+}
+
 } // end namespace Par2
@@ -106,6 +106,8 @@ public:
   friend ostream& operator<<(ostream &s, const MD5Context &context);
   string print(void) const;
 
+  friend void MD5UpdateMulti(MD5Context *contexts[], const void *buffers[], const size_t lengths[], int count);
+
 protected:
   enum {buffersize = 64};
   unsigned char block[buffersize];
@@ -114,6 +116,29 @@ protected:
   u64 bytes;
 };
 
+// Multi-buffer MD5: the computation of one hash cannot be vectorised, but
+// independent hashes can run in the lanes of SIMD registers. The fastest
+// kernel supported by the CPU is chosen at startup; all kernels produce
+// identical results.
+enum MD5Kernel
+{
+  mkScalar,   // one context after another
+  mkSse2,     // 4 contexts in 128-bit registers
+  mkAvx2      // 8 contexts in 256-bit registers
+};
+
+bool MD5KernelSupported(MD5Kernel kernel);
+MD5Kernel GetMD5Kernel(void);
+void SetMD5Kernel(MD5Kernel kernel);
+
+// How many contexts the current kernel updates at once
+int MD5Lanes(void);
+
+// Update each of the contexts with data from its own buffer. The contexts
+// are processed together as long as all of them have whole 64 byte blocks
+// of data left, the rest is processed one context after another.
+void MD5UpdateMulti(MD5Context *contexts[], const void *buffers[], const size_t lengths[], int count);
+
 // Compare hash values
 
 inline bool MD5Hash::operator==(const MD5Hash &other) const
@@ -31,6 +31,16 @@ static char THIS_FILE[]=__FILE__;
 namespace Par2
 {
 
+// Maximum number of input blocks processed together by RepairTiles
+#define MAXINPUTGROUPSIZE 16
+// Amount of data RepairTiles keeps in CPU cache (L2)
+#define REPAIRCACHESIZE (256 * 1024)
+// Lower bound for the tile size, smaller tiles spend too much time on
+// setting up multiplication tables
+#define MINREPAIRTILESIZE (4 * 1024)
+// Maximum number of input files kept open during repair
+#define MAXOPENINPUTFILES 32
+
 Par2Repairer::Par2Repairer(void)
 {
   firstpacket = true;
@@ -50,6 +60,7 @@ Par2Repairer::Par2Repairer(void)
   damagedfilecount = 0;
   missingfilecount = 0;
 
+  inputgroupsize = 1;
   inputbuffer = 0;
   outputbuffer = 0;
 
@@ -306,6 +317,8 @@ Result Par2Repairer::Process(const CommandLine &commandline, bool dorepair)
 		  
 		  if (!ProcessData(blockoffset, blocklength))
 		    {
+		      CloseInputFiles();
+
 		      // Delete all of the partly reconstructed files
 		      DeleteIncompleteTargetFiles();
 		      EndRepair();
@@ -316,6 +329,7 @@ Result Par2Repairer::Process(const CommandLine &commandline, bool dorepair)
 		  blockoffset += blocklength;
 		}
 	      
+	      CloseInputFiles();
 	      EndRepair();
 
 	      if (noiselevel > CommandLine::nlSilent)
@@ -1251,15 +1265,11 @@ bool Par2Repairer::VerifySourceFiles(void)
 
   sort(sortedfiles.begin(), sortedfiles.end(), SortSourceFilesByFileName);
 
-  // Start verifying the files
-  sf = sortedfiles.begin();
-  while (sf != sortedfiles.end())
+  // Build the list of files to verify
+  vector<VerifyFileEntry> files;
+  set<string> filenames;
+  for (sf = sortedfiles.begin(); sf != sortedfiles.end(); ++sf)
   {
-    if (cancelled)
-    {
-      return false;
-    }
-
     // Do we have a source file
     Par2RepairerSourceFile *sourcefile = *sf;
 
@@ -1267,7 +1277,7 @@ bool Par2Repairer::VerifySourceFiles(void)
     string filename = sourcefile->TargetFileName();
 
     // Check to see if we have already used this file
-    if (diskFileMap.Find(filename) != 0)
+    if (diskFileMap.Find(filename) != 0 || !filenames.insert(filename).second)
     {
       // The file has already been used!
 
@@ -1276,58 +1286,24 @@ bool Par2Repairer::VerifySourceFiles(void)
       return false;
     }
 
-    DiskFile *diskfile = new DiskFile;
-
-    // Does the target file exist
-    if (diskfile->Open(filename))
-    {
-      // Yes. Record that fact.
-      sourcefile->SetTargetExists(true);
-
-      // Remember that the DiskFile is the target file
-      sourcefile->SetTargetFile(diskfile);
-
-      // Remember that we have processed this file
-      bool success = diskFileMap.Insert(diskfile);
-      assert(success); (void)success;
-      // Do the actual verification
-      if (!VerifyDataFile(diskfile, sourcefile))
-        finalresult = false;
-
-      // We have finished with the file for now
-      diskfile->Close();
-
-      // Find out how much data we have found
-      UpdateVerificationResults();
-    }
-    else
-    {
-      // The file does not exist.
-      delete diskfile;
-
-      if (noiselevel > CommandLine::nlSilent)
-      {
-        string path;
-        string name;
-        DiskFile::SplitFilename(filename, path, name);
-
-        cout << "Target: \"" << name << "\" - missing." << endl;
-	sig_done(name, 0, sourcefile && sourcefile->GetVerificationPacket() ? sourcefile->GetVerificationPacket()->BlockCount() : 0);
-      }
-    }
-
-    ++sf;
+    VerifyFileEntry entry = {filename, sourcefile};
+    files.push_back(entry);
   }
 
+  // Start verifying the files
+  if (!VerifyFiles(files))
+    finalresult = false;
+
   return finalresult;
 }
 
 // Scan any extra files specified on the command line
 bool Par2Repairer::VerifyExtraFiles(const list<CommandLine::ExtraFile> &extrafiles)
 {
-  for (ExtraFileIterator i=extrafiles.begin(); 
-       i!=extrafiles.end() && completefilecount<mainpacket->RecoverableFileCount(); 
-       ++i)
+  // Build the list of files to verify
+  vector<VerifyFileEntry> files;
+  set<string> filenames;
+  for (ExtraFileIterator i=extrafiles.begin(); i!=extrafiles.end(); ++i)
   {
     string filename = i->FileName();
 
@@ -1338,35 +1314,108 @@ bool Par2Repairer::VerifyExtraFiles(const list<CommandLine::ExtraFile> &extrafil
       filename = DiskFile::GetCanonicalPathname(filename);
 
       // Has this file already been dealt with
-      if (diskFileMap.Find(filename) == 0)
+      if (diskFileMap.Find(filename) == 0 && filenames.insert(filename).second)
       {
-        DiskFile *diskfile = new DiskFile;
+        VerifyFileEntry entry = {filename, 0};
+        files.push_back(entry);
+      }
+    }
+  }
 
-        // Does the file exist
-        if (!diskfile->Open(filename))
-        {
-          delete diskfile;
-          continue;
-        }
+  VerifyFiles(files);
+  // Ignore errors
 
-        // Remember that we have processed this file
-        bool success = diskFileMap.Insert(diskfile);
-        assert(success); (void)success;
+  return true;
+}
+
+// Verify the files of the list one after another
+bool Par2Repairer::VerifyFiles(const vector<VerifyFileEntry> &files)
+{
+  bool finalresult = true;
 
-        // Do the actual verification
-        VerifyDataFile(diskfile, 0);
-        // Ignore errors
+  for (vector<VerifyFileEntry>::const_iterator f = files.begin(); f != files.end(); ++f)
+  {
+    if (cancelled)
+    {
+      return false;
+    }
 
-        // We have finished with the file for now
-        diskfile->Close();
+    if (!VerifyFile(*f))
+      finalresult = false;
+  }
 
-        // Find out how much data we have found
-        UpdateVerificationResults();
-      }
+  return finalresult;
+}
+
+// Open and verify one file of the list. Everything shared with other files
+// being verified at the same time is only changed under "verifymutex".
+bool Par2Repairer::VerifyFile(const VerifyFileEntry &entry)
+{
+  if (cancelled)
+  {
+    return false;
+  }
+
+  Par2RepairerSourceFile *sourcefile = entry.sourcefile;
+
+  // Extra files are only scanned until all recoverable files are complete
+  if (!sourcefile)
+  {
+    Guard guard(verifymutex);
+    if (completefilecount >= mainpacket->RecoverableFileCount())
+      return true;
+  }
+
+  DiskFile *diskfile = new DiskFile;
+
+  // Does the file exist
+  if (!diskfile->Open(entry.filename))
+  {
+    // The file does not exist.
+    delete diskfile;
+
+    if (sourcefile && noiselevel > CommandLine::nlSilent)
+    {
+      string path;
+      string name;
+      DiskFile::SplitFilename(entry.filename, path, name);
+
+      cout << "Target: \"" << name << "\" - missing." << endl;
+      sig_done(name, 0, sourcefile->GetVerificationPacket() ? sourcefile->GetVerificationPacket()->BlockCount() : 0);
     }
+
+    return true;
   }
 
-  return true;
+  {
+    Guard guard(verifymutex);
+
+    if (sourcefile)
+    {
+      // Record that the target file exists.
+      sourcefile->SetTargetExists(true);
+
+      // Remember that the DiskFile is the target file
+      sourcefile->SetTargetFile(diskfile);
+    }
+
+    // Remember that we have processed this file
+    bool success = diskFileMap.Insert(diskfile);
+    assert(success); (void)success;
+  }
+
+  // Do the actual verification
+  bool result = VerifyDataFile(diskfile, sourcefile);
+
+  // We have finished with the file for now
+  diskfile->Close();
+
+  // Find out how much data we have found
+  Guard guard(verifymutex);
+  UpdateVerificationResults();
+
+  // Errors in extra files are ignored
+  return result || !sourcefile;
 }
 
 // Attempt to match the data in the DiskFile with the source file
@@ -1410,6 +1459,7 @@ bool Par2Repairer::VerifyDataFile(DiskFile *diskfile, Par2RepairerSourceFile *so
       {
         // We found a perfect match.
 
+        Guard guard(verifymutex);
         sourcefile->SetCompleteFile(diskfile);
 
         // Return the match
@@ -1486,6 +1536,8 @@ bool Par2Repairer::VerifyDataFile(DiskFile *diskfile, Par2RepairerSourceFile *so
       }
     }
 
+    Guard guard(verifymutex);
+
     list<Par2RepairerSourceFile*>::iterator sf = unverifiablesourcefiles.begin();
 
     // Compare the hash values of each source file for a match
@@ -1610,7 +1662,7 @@ bool Par2Repairer::ScanDataFile(DiskFile                *diskfile,    // [in]
       if (oldfraction != newfraction)
       {
         cout << "Scanning: \"" << shortname << "\": " << newfraction/10 << '.' << newfraction%10 << "%\r" << flush;
-	sig_progress(newfraction);
+	sig_scanprogress(name, newfraction);
 
         if (cancelled)
         {
@@ -1621,10 +1673,24 @@ bool Par2Repairer::ScanDataFile(DiskFile                *diskfile,    // [in]
 
     // If we fail to find a match, it might be because it was a duplicate of a block
     // that we have already found.
-    bool duplicate;
+    bool duplicate = false;
+
+    // Look for a match. Found blocks are shared with other files which may be
+    // verified at the same time, so the entries are examined under the lock,
+    // but only if the checksum is in the hash table at all.
+    const VerificationHashEntry *currententry = 0;
+    if (nextentry != 0 || verificationhashtable.Lookup(filechecksummer.Checksum()) != 0)
+    {
+      Guard guard(verifymutex);
 
-    // Look for a match
-    const VerificationHashEntry *currententry = verificationhashtable.FindMatch(nextentry, sourcefile, filechecksummer, duplicate);
+      currententry = verificationhashtable.FindMatch(nextentry, sourcefile, filechecksummer, duplicate);
+
+      if (currententry != 0 && blocksallocated)
+      {
+        // Record the match
+        currententry->SetBlock(diskfile, filechecksummer.Offset());
+      }
+    }
 
     // Did we find a match
     if (currententry != 0)
@@ -1660,12 +1726,6 @@ bool Par2Repairer::ScanDataFile(DiskFile                *diskfile,    // [in]
         }
       }
 
-      if (blocksallocated)
-      {
-        // Record the match
-        currententry->SetBlock(diskfile, filechecksummer.Offset());
-      }
-
       // Update the number of matches found
       count++;
 
@@ -1698,8 +1758,9 @@ bool Par2Repairer::ScanDataFile(DiskFile                *diskfile,    // [in]
         // What entry do we expect next
         nextentry = 0;
 
-        // Advance 1 byte
-        if (!filechecksummer.Step())
+        // Advance 1 byte and past all positions whose checksum
+        // does not belong to any block
+        if (!filechecksummer.StepToCandidate(verificationhashtable.Filter()))
           return false;
       }
     }
@@ -1865,7 +1926,7 @@ bool Par2Repairer::ScanDataFile(DiskFile                *diskfile,    // [in]
     }
   }
   sig_done(name,count, sourcefile && sourcefile->GetVerificationPacket() ? sourcefile->GetVerificationPacket()->BlockCount() : 0);
-  sig_progress(1000);
+  sig_scanprogress(name, 1000);
   return true;
 }
 
@@ -2247,11 +2308,18 @@ bool Par2Repairer::ComputeRSmatrix(void)
 // Allocate memory buffers for reading and writing data to disk.
 bool Par2Repairer::AllocateBuffers(size_t memorylimit)
 {
+  // Read several input blocks at once so that each chunk of the output buffer
+  // is streamed through the cache once per group instead of once per input block.
+  // The input group and the output buffer share the memory limit.
+  inputgroupsize = max(1u, min((u32)MAXINPUTGROUPSIZE, (u32)inputblocks.size()));
+
   // Would single pass processing use too much memory
-  if (blocksize * missingblockcount > memorylimit)
+  if (blocksize * (missingblockcount + inputgroupsize) > memorylimit)
   {
-    // Pick a size that is small enough
-    chunksize = ~3 & (memorylimit / missingblockcount);
+    // Keep the input group not larger than the output buffer, then
+    // pick a chunk size that is small enough for both
+    inputgroupsize = max(1u, min(inputgroupsize, missingblockcount));
+    chunksize = ~3 & (memorylimit / (missingblockcount + inputgroupsize));
   }
   else
   {
@@ -2259,8 +2327,9 @@ bool Par2Repairer::AllocateBuffers(size_t memorylimit)
   }
 
   // Allocate the two buffers
-  inputbuffer = new u8[(size_t)chunksize];
+  inputbuffer = new u8[(size_t)chunksize * inputgroupsize];
   outputbuffer = new u8[(size_t)chunksize * missingblockcount];
+  inputdata.resize(inputgroupsize);
 
   if (inputbuffer == NULL || outputbuffer == NULL)
   {
@@ -2283,34 +2352,38 @@ bool Par2Repairer::ProcessData(u64 blockoffset, size_t blocklength)
   vector<DataBlock*>::iterator copyblock  = copyblocks.begin();
   u32                          inputindex = 0;
 
-  DiskFile *lastopenfile = NULL;
-
   // Are there any blocks which need to be reconstructed
   if (missingblockcount > 0)
   {
+    u32 groupindex = 0;
+    u32 groupcount = 0;
+
     // For each input block
     while (inputblock != inputblocks.end())       
     {
-      // Are we reading from a new file?
-      if (lastopenfile != (*inputblock)->GetDiskFile())
+      if (!OpenInputFile((*inputblock)->GetDiskFile()))
+        return false;
+
+      // Use the data of a mapped file directly and let the system read it
+      // in background while the rest of the group is collected
+      const u8 *inbuf = (const u8*)(*inputblock)->GetData(blockoffset, blocklength);
+      if (inbuf != NULL)
       {
-        // Close the last file
-        if (lastopenfile != NULL)
-        {
-          lastopenfile->Close();
-        }
+        (*inputblock)->Prefetch(blockoffset, blocklength);
+      }
+      else
+      {
+        // Select the next free part of the input buffer
+        u8 *readbuf = &((u8*)inputbuffer)[chunksize * groupcount];
 
-        // Open the new file
-        lastopenfile = (*inputblock)->GetDiskFile();
-        if (!lastopenfile->Open())
-        {
+        // Read data from the current input block
+        if (!(*inputblock)->ReadData(blockoffset, blocklength, readbuf))
           return false;
-        }
+
+        inbuf = readbuf;
       }
 
-      // Read data from the current input block
-      if (!(*inputblock)->ReadData(blockoffset, blocklength, inputbuffer))
-        return false;
+      inputdata[groupcount] = inbuf;
 
       // Have we reached the last source data block
       if (copyblock != copyblocks.end())
@@ -2321,7 +2394,7 @@ bool Par2Repairer::ProcessData(u64 blockoffset, size_t blocklength)
           size_t wrote;
 
           // Write the block back to disk in the new target file
-          if (!(*copyblock)->WriteData(blockoffset, blocklength, inputbuffer, wrote))
+          if (!(*copyblock)->WriteData(blockoffset, blocklength, inbuf, wrote))
             return false;
 
           totalwritten += wrote;
@@ -2329,45 +2402,26 @@ bool Par2Repairer::ProcessData(u64 blockoffset, size_t blocklength)
         ++copyblock;
       }
 
-      if (!RepairData(inputindex, blocklength))
-      {
-      // For each output block
-      for (u32 outputindex=0; outputindex<missingblockcount; outputindex++)
-      {
-        // Select the appropriate part of the output buffer
-        void *outbuf = &((u8*)outputbuffer)[chunksize * outputindex];
-
-        // Process the data
-        rs.Process(blocklength, inputindex, inputbuffer, outputindex, outbuf);
+      ++inputblock;
+      ++inputindex;
+      ++groupcount;
 
-        if (noiselevel > CommandLine::nlQuiet)
+      // Process the group once it is full or all input blocks were read
+      if (groupcount == inputgroupsize || inputblock == inputblocks.end())
+      {
+        if (!RepairData(groupindex, groupcount, blocklength))
         {
-          // Update a progress indicator
-          u32 oldfraction = (u32)(1000 * progress / totaldata);
-          progress += blocklength;
-          u32 newfraction = (u32)(1000 * progress / totaldata);
-
-          if (oldfraction != newfraction)
-          {
-            cout << "Repairing: " << newfraction/10 << '.' << newfraction%10 << "%\r" << flush;
-	    sig_progress(newfraction);
-
-            if (cancelled)
-            {
-              break;
-            }
-          }
+          RepairTiles(groupindex, groupcount, 0, missingblockcount, blocklength);
         }
-      }
+
+        groupindex = inputindex;
+        groupcount = 0;
       }
 
       if (cancelled)
       {
         break;
       }
-
-      ++inputblock;
-      ++inputindex;
     }
   }
   else
@@ -2380,29 +2434,21 @@ bool Par2Repairer::ProcessData(u64 blockoffset, size_t blocklength)
       // Does this block need to be copied
       if ((*copyblock)->IsSet())
       {
-        // Are we reading from a new file?
-        if (lastopenfile != (*inputblock)->GetDiskFile())
-        {
-          // Close the last file
-          if (lastopenfile != NULL)
-          {
-            lastopenfile->Close();
-          }
+        if (!OpenInputFile((*inputblock)->GetDiskFile()))
+          return false;
 
-          // Open the new file
-          lastopenfile = (*inputblock)->GetDiskFile();
-          if (!lastopenfile->Open())
-          {
+        // Read data from the current input block unless it is mapped
+        const void *inbuf = (*inputblock)->GetData(blockoffset, blocklength);
+        if (inbuf == NULL)
+        {
+          if (!(*inputblock)->ReadData(blockoffset, blocklength, inputbuffer))
             return false;
-          }
-        }
 
-        // Read data from the current input block
-        if (!(*inputblock)->ReadData(blockoffset, blocklength, inputbuffer))
-          return false;
+          inbuf = inputbuffer;
+        }
 
         size_t wrote;
-        if (!(*copyblock)->WriteData(blockoffset, blocklength, inputbuffer, wrote))
+        if (!(*copyblock)->WriteData(blockoffset, blocklength, inbuf, wrote))
           return false;
         totalwritten += wrote;
       }
@@ -2436,12 +2482,6 @@ bool Par2Repairer::ProcessData(u64 blockoffset, size_t blocklength)
     }
   }
 
-  // Close the last file
-  if (lastopenfile != NULL)
-  {
-    lastopenfile->Close();
-  }
-
   if (cancelled)
   {
     return false;
@@ -2472,6 +2512,94 @@ bool Par2Repairer::ProcessData(u64 blockoffset, size_t blocklength)
   return true;
 }
 
+bool Par2Repairer::OpenInputFile(DiskFile *diskfile)
+{
+  // Same file as for the previous block?
+  if (!openinputfiles.empty() && openinputfiles.front() == diskfile)
+    return true;
+
+  list<DiskFile*>::iterator openfile = find(openinputfiles.begin(), openinputfiles.end(), diskfile);
+  if (openfile != openinputfiles.end())
+  {
+    openinputfiles.splice(openinputfiles.begin(), openinputfiles, openfile);
+    return true;
+  }
+
+  // Close the least recently used file
+  if (openinputfiles.size() >= MAXOPENINPUTFILES)
+  {
+    openinputfiles.back()->Close();
+    openinputfiles.pop_back();
+  }
+
+  if (!diskfile->IsOpen() && !diskfile->Open())
+    return false;
+
+  // Files which can't be mapped are read into the input buffer
+  diskfile->Map();
+
+  openinputfiles.push_front(diskfile);
+
+  return true;
+}
+
+void Par2Repairer::CloseInputFiles(void)
+{
+  for (list<DiskFile*>::iterator openfile = openinputfiles.begin(); openfile != openinputfiles.end(); ++openfile)
+  {
+    (*openfile)->Close();
+  }
+
+  openinputfiles.clear();
+}
+
+void Par2Repairer::RepairTiles(u32 inputindex, u32 inputcount, u32 outputindex, u32 outputcount, size_t blocklength)
+{
+  // Choose the tile size so that the tiles of all inputs and outputs
+  // fit into the cache together; a multiple of 64 bytes keeps the tiles
+  // aligned to cache lines.
+  size_t tilesize = REPAIRCACHESIZE / (inputcount + outputcount);
+  tilesize = max(tilesize & ~(size_t)63, (size_t)MINREPAIRTILESIZE);
+
+  for (size_t tileoffset = 0; tileoffset < blocklength && !cancelled; tileoffset += tilesize)
+  {
+    size_t tilelength = min(tilesize, blocklength - tileoffset);
+
+    // For each output block
+    for (u32 outputnum = 0; outputnum < outputcount; outputnum++)
+    {
+      // Select the appropriate part of the output buffer
+      void *outbuf = &((u8*)outputbuffer)[chunksize * (outputindex + outputnum) + tileoffset];
+
+      // Apply all inputs of the group to the tile
+      for (u32 inputnum = 0; inputnum < inputcount; inputnum++)
+      {
+        const u8 *inbuf = inputdata[inputnum] + tileoffset;
+        rs.Process(tilelength, inputindex + inputnum, inbuf, outputindex + outputnum, outbuf);
+      }
+    }
+
+    UpdateRepairProgress((u64)tilelength * inputcount * outputcount);
+  }
+}
+
+void Par2Repairer::UpdateRepairProgress(u64 processed)
+{
+  if (noiselevel > CommandLine::nlQuiet)
+  {
+    // Update a progress indicator
+    u32 oldfraction = (u32)(1000 * progress / totaldata);
+    progress += processed;
+    u32 newfraction = (u32)(1000 * progress / totaldata);
+
+    if (oldfraction != newfraction)
+    {
+      cout << "Repairing: " << newfraction/10 << '.' << newfraction%10 << "%\r" << flush;
+      sig_progress(newfraction);
+    }
+  }
+}
+
 // Verify that all of the reconstructed target files are now correct
 bool Par2Repairer::VerifyTargetFiles(void)
 {
@@ -21,9 +21,17 @@
 #define __PAR2REPAIRER_H__
 
 #include "parheaders.h"
+#include "Thread.h"
 
 namespace Par2 {
 
+// A file to be verified by VerifySourceFiles or VerifyExtraFiles
+struct VerifyFileEntry
+{
+  string                  filename;   // The file to verify
+  Par2RepairerSourceFile *sourcefile; // The target source file or 0 for extra files
+};
+
 class Par2Repairer
 {
 public:
@@ -80,6 +88,13 @@ protected:
   // Scan any extra files specified on the command line
   bool VerifyExtraFiles(const list<CommandLine::ExtraFile> &extrafiles);
 
+  // Verify the files of the list one after another. Can be overridden to verify
+  // several files at the same time by calling VerifyFile from multiple threads.
+  virtual bool VerifyFiles(const vector<VerifyFileEntry> &files);
+
+  // Open and verify one file of the list, safe to call from multiple threads
+  bool VerifyFile(const VerifyFileEntry &entry);
+
   // Attempt to match the data in the DiskFile with the source file
   bool VerifyDataFile(DiskFile *diskfile, Par2RepairerSourceFile *sourcefile);
 
@@ -119,6 +134,22 @@ protected:
   // Read source data, process it through the RS matrix and write it to disk.
   bool ProcessData(u64 blockoffset, size_t blocklength);
 
+  // Open (and map) the file of an input block, keeping recently used
+  // files open for the next pass
+  bool OpenInputFile(DiskFile *diskfile);
+
+  // Close all input files kept open by OpenInputFile
+  void CloseInputFiles(void);
+
+  // Process a group of input blocks (see inputdata) against a range
+  // of output blocks. The work is done in tiles small enough to stay in CPU
+  // cache: a tile of an output block is updated from all inputs of the group
+  // before moving on to the next tile.
+  void RepairTiles(u32 inputindex, u32 inputcount, u32 outputindex, u32 outputcount, size_t blocklength);
+
+  // Add the amount of processed data to the progress indicator
+  virtual void UpdateRepairProgress(u64 processed);
+
   // Verify that all of the reconstructed target files are now correct
   bool VerifyTargetFiles(void);
 
@@ -128,6 +159,7 @@ protected:
   // Signals
   virtual void sig_filename(std::string filename) {}
   virtual void sig_progress(int progress) {}
+  virtual void sig_scanprogress(std::string filename, int progress) { sig_progress(progress); }
   virtual void sig_headers(ParHeaders* headers) {}
   virtual void sig_done(std::string filename, int available, int total) {}
 
@@ -137,8 +169,9 @@ protected:
   // Repair ended
   virtual void EndRepair() {}
 
-  // Repair chunk of data (returns "true" if repaired or "false" if default repair-routine should be used)
-  virtual bool RepairData(u32 inputindex, size_t blocklength) { return false; }
+  // Repair chunk of data for a group of input blocks (returns "true" if repaired or
+  // "false" if default repair-routine should be used)
+  virtual bool RepairData(u32 inputindex, u32 inputcount, size_t blocklength) { return false; }
 
 protected:
   ParHeaders* headers;                                 // Headers
@@ -188,7 +221,10 @@ protected:
 
   ReedSolomon<Galois16>     rs;                      // The Reed Solomon matrix.
 
-  void                     *inputbuffer;             // Buffer for reading DataBlocks (chunksize)
+  u32                       inputgroupsize;          // How many DataBlocks are read before processing them
+  void                     *inputbuffer;             // Buffer for reading DataBlocks (chunksize * inputgroupsize)
+  vector<const u8*>         inputdata;               // Data of the current group of DataBlocks (mapped file or inputbuffer)
+  list<DiskFile*>           openinputfiles;          // Open input files, most recently used first
   void                     *outputbuffer;            // Buffer for writing DataBlocks (chunksize * missingblockcount)
 
   u64                       progress;                // How much data has been processed.
@@ -196,6 +232,9 @@ protected:
   u64                       totalsize;               // Total data size
 
   bool                      cancelled;               // repair cancelled
+
+  Mutex                     verifymutex;             // Guards found blocks, file map and results when
+                                                     // several files are verified at the same time
 };
 
 } // end namespace Par2
@@ -20,6 +20,11 @@
 #include "nzbget.h"
 #include "par2cmdline.h"
 
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define GALOIS16_SIMD
+#include <immintrin.h>
+#endif
+
 #ifdef _MSC_VER
 #ifdef _DEBUG
 #undef THIS_FILE
@@ -105,6 +110,25 @@ template <> bool ReedSolomon<Galois8>::SetInput(u32 count)
   return true;
 }
 
+#ifdef LONGMULTIPLY
+// Fills the table with the products of the factor and all values of the byte
+// at bit position "shift". Multiplication distributes over addition (xor), so
+// the product for any byte value is the sum of the products for its bits.
+template <class g>
+static void MakeByteTable(g factor, unsigned int shift, unsigned int table[256])
+{
+  table[0] = 0;
+  for (unsigned int bit = 0; bit < 8; bit++)
+  {
+    unsigned int product = g((typename g::ValueType)(1 << (shift + bit))) * factor;
+    for (unsigned int n = 0; n < (1u << bit); n++)
+    {
+      table[(1 << bit) + n] = table[n] ^ product;
+    }
+  }
+}
+#endif
+
 template <> bool ReedSolomon<Galois8>::Process(size_t size, u32 inputindex, const void *inputbuffer, u32 outputindex, void *outputbuffer)
 {
   // Look up the appropriate element in the RS matrix
@@ -115,27 +139,9 @@ template <> bool ReedSolomon<Galois8>::Process(size_t size, u32 inputindex, cons
     return eSuccess;
 
 #ifdef LONGMULTIPLY
-  // The 8-bit long multiplication tables
-  Galois8 *table = glmt->tables;
-
-  // Split the factor into Low and High bytes
-  unsigned int fl = (factor >> 0) & 0xff;
-
-  // Get the four separate multiplication tables
-  Galois8 *LL = &table[(0*256 + fl) * 256 + 0]; // factor.low  * source.low
-
-  // Combine the four multiplication tables into two
+  // The products of the factor and all byte values
   unsigned int L[256];
-
-  unsigned int *pL = &L[0];
-
-  for (unsigned int i=0; i<256; i++)
-  {
-    *pL = *LL;
-
-    pL++;
-    LL++;
-  }
+  MakeByteTable(factor, 0, L);
 
   // Treat the buffers as arrays of 32-bit unsigned ints.
   u32 *src4 = (u32 *)inputbuffer;
@@ -271,6 +277,165 @@ template <> bool ReedSolomon<Galois16>::SetInput(u32 count)
   return true;
 }
 
+#ifdef GALOIS16_SIMD
+// The product of a 16-bit value and the factor is the sum (xor) of the products
+// of its four nibbles. For each nibble position there are two 16-entry tables
+// holding the low and the high bytes of the products, which are looked up
+// for 16 (or 32) nibbles at once with a byte shuffle.
+static void MakeNibbleTables(Galois16 factor, u8 tables[8][16])
+{
+  for (unsigned int nibble = 0; nibble < 4; nibble++)
+  {
+    // Multiplication distributes over addition (xor), so the product for any
+    // nibble value is the sum of the products for its bits
+    u16 products[16];
+    products[0] = 0;
+    for (unsigned int bit = 0; bit < 4; bit++)
+    {
+      u16 product = Galois16((u16)(1 << (nibble * 4 + bit))) * factor;
+      for (unsigned int n = 0; n < (1u << bit); n++)
+      {
+        products[(1 << bit) + n] = products[n] ^ product;
+      }
+    }
+
+    for (unsigned int n = 0; n < 16; n++)
+    {
+      tables[nibble * 2][n] = (u8)(products[n] & 0xff);
+      tables[nibble * 2 + 1][n] = (u8)(products[n] >> 8);
+    }
+  }
+}
+
+// Processes the data in chunks of 32 bytes; returns the number of processed bytes
+__attribute__((target("ssse3")))
+static size_t ProcessSsse3(size_t size, const u8 *src, u8 *dst, u8 tables[8][16])
+{
+  __m128i t[8];
+  for (int i = 0; i < 8; i++)
+  {
+    t[i] = _mm_loadu_si128((const __m128i*)tables[i]);
+  }
+
+  const __m128i lowbytes = _mm_set1_epi16(0x00ff);
+  const __m128i lownibbles = _mm_set1_epi8(0x0f);
+
+  size_t pos = 0;
+  for (; pos + 32 <= size; pos += 32)
+  {
+    __m128i s0 = _mm_loadu_si128((const __m128i*)(src + pos));
+    __m128i s1 = _mm_loadu_si128((const __m128i*)(src + pos + 16));
+
+    // Separate low and high bytes of the 16-bit values
+    __m128i lo = _mm_packus_epi16(_mm_and_si128(s0, lowbytes), _mm_and_si128(s1, lowbytes));
+    __m128i hi = _mm_packus_epi16(_mm_srli_epi16(s0, 8), _mm_srli_epi16(s1, 8));
+
+    __m128i n0 = _mm_and_si128(lo, lownibbles);
+    __m128i n1 = _mm_and_si128(_mm_srli_epi16(lo, 4), lownibbles);
+    __m128i n2 = _mm_and_si128(hi, lownibbles);
+    __m128i n3 = _mm_and_si128(_mm_srli_epi16(hi, 4), lownibbles);
+
+    __m128i rlo = _mm_xor_si128(
+      _mm_xor_si128(_mm_shuffle_epi8(t[0], n0), _mm_shuffle_epi8(t[2], n1)),
+      _mm_xor_si128(_mm_shuffle_epi8(t[4], n2), _mm_shuffle_epi8(t[6], n3)));
+    __m128i rhi = _mm_xor_si128(
+      _mm_xor_si128(_mm_shuffle_epi8(t[1], n0), _mm_shuffle_epi8(t[3], n1)),
+      _mm_xor_si128(_mm_shuffle_epi8(t[5], n2), _mm_shuffle_epi8(t[7], n3)));
+
+    // Interleave the bytes back into 16-bit values
+    __m128i d0 = _mm_loadu_si128((const __m128i*)(dst + pos));
+    __m128i d1 = _mm_loadu_si128((const __m128i*)(dst + pos + 16));
+    _mm_storeu_si128((__m128i*)(dst + pos), _mm_xor_si128(d0, _mm_unpacklo_epi8(rlo, rhi)));
+    _mm_storeu_si128((__m128i*)(dst + pos + 16), _mm_xor_si128(d1, _mm_unpackhi_epi8(rlo, rhi)));
+  }
+
+  return pos;
+}
+
+// Processes the data in chunks of 64 bytes; returns the number of processed bytes.
+// Pack and unpack instructions work within 128-bit lanes, the result is the same
+// as with ProcessSsse3 applied to each lane.
+__attribute__((target("avx2")))
+static size_t ProcessAvx2(size_t size, const u8 *src, u8 *dst, u8 tables[8][16])
+{
+  __m256i t[8];
+  for (int i = 0; i < 8; i++)
+  {
+    t[i] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)tables[i]));
+  }
+
+  const __m256i lowbytes = _mm256_set1_epi16(0x00ff);
+  const __m256i lownibbles = _mm256_set1_epi8(0x0f);
+
+  size_t pos = 0;
+  for (; pos + 64 <= size; pos += 64)
+  {
+    __m256i s0 = _mm256_loadu_si256((const __m256i*)(src + pos));
+    __m256i s1 = _mm256_loadu_si256((const __m256i*)(src + pos + 32));
+
+    __m256i lo = _mm256_packus_epi16(_mm256_and_si256(s0, lowbytes), _mm256_and_si256(s1, lowbytes));
+    __m256i hi = _mm256_packus_epi16(_mm256_srli_epi16(s0, 8), _mm256_srli_epi16(s1, 8));
+
+    __m256i n0 = _mm256_and_si256(lo, lownibbles);
+    __m256i n1 = _mm256_and_si256(_mm256_srli_epi16(lo, 4), lownibbles);
+    __m256i n2 = _mm256_and_si256(hi, lownibbles);
+    __m256i n3 = _mm256_and_si256(_mm256_srli_epi16(hi, 4), lownibbles);
+
+    __m256i rlo = _mm256_xor_si256(
+      _mm256_xor_si256(_mm256_shuffle_epi8(t[0], n0), _mm256_shuffle_epi8(t[2], n1)),
+      _mm256_xor_si256(_mm256_shuffle_epi8(t[4], n2), _mm256_shuffle_epi8(t[6], n3)));
+    __m256i rhi = _mm256_xor_si256(
+      _mm256_xor_si256(_mm256_shuffle_epi8(t[1], n0), _mm256_shuffle_epi8(t[3], n1)),
+      _mm256_xor_si256(_mm256_shuffle_epi8(t[5], n2), _mm256_shuffle_epi8(t[7], n3)));
+
+    __m256i d0 = _mm256_loadu_si256((const __m256i*)(dst + pos));
+    __m256i d1 = _mm256_loadu_si256((const __m256i*)(dst + pos + 32));
+    _mm256_storeu_si256((__m256i*)(dst + pos), _mm256_xor_si256(d0, _mm256_unpacklo_epi8(rlo, rhi)));
+    _mm256_storeu_si256((__m256i*)(dst + pos + 32), _mm256_xor_si256(d1, _mm256_unpackhi_epi8(rlo, rhi)));
+  }
+
+  return pos;
+}
+#endif
+
+bool Galois16KernelSupported(Galois16Kernel kernel)
+{
+  switch (kernel)
+  {
+#ifdef GALOIS16_SIMD
+  case gkSsse3:
+    return __builtin_cpu_supports("ssse3");
+  case gkAvx2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  case gkScalar:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static Galois16Kernel DetectGalois16Kernel(void)
+{
+#ifdef GALOIS16_SIMD
+  __builtin_cpu_init();
+#endif
+  return Galois16KernelSupported(gkAvx2) ? gkAvx2 :
+    Galois16KernelSupported(gkSsse3) ? gkSsse3 : gkScalar;
+}
+
+static Galois16Kernel galois16kernel = DetectGalois16Kernel();
+
+Galois16Kernel GetGalois16Kernel(void)
+{
+  return galois16kernel;
+}
+
+void SetGalois16Kernel(Galois16Kernel kernel)
+{
+  galois16kernel = kernel;
+}
+
 template <> bool ReedSolomon<Galois16>::Process(size_t size, u32 inputindex, const void *inputbuffer, u32 outputindex, void *outputbuffer)
 {
   // Look up the appropriate element in the RS matrix
@@ -280,56 +445,50 @@ template <> bool ReedSolomon<Galois16>::Process(size_t size, u32 inputindex, con
   if (factor == 0)
     return eSuccess;
 
-#ifdef LONGMULTIPLY
-  // The 8-bit long multiplication tables
-  Galois16 *table = glmt->tables;
+#ifdef GALOIS16_SIMD
+  if (galois16kernel != gkScalar)
+  {
+    u8 tables[8][16];
+    MakeNibbleTables(factor, tables);
 
-  // Split the factor into Low and High bytes
-  unsigned int fl = (factor >> 0) & 0xff;
-  unsigned int fh = (factor >> 8) & 0xff;
+    const u8 *src = (const u8 *)inputbuffer;
+    u8 *dst = (u8 *)outputbuffer;
+
+    size_t done = galois16kernel == gkAvx2 ?
+      ProcessAvx2(size, src, dst, tables) :
+      ProcessSsse3(size, src, dst, tables);
+
+    // Process any left over values at the end of the buffer
+    // (x86 is little endian, the values can be used directly)
+    for (; done + 2 <= size; done += 2)
+    {
+      u16 s = src[done] | (src[done + 1] << 8);
+      u16 d = Galois16(s) * factor;
+      dst[done] ^= (u8)(d & 0xff);
+      dst[done + 1] ^= (u8)(d >> 8);
+    }
 
-  // Get the four separate multiplication tables
-  Galois16 *LL = &table[(0*256 + fl) * 256 + 0]; // factor.low  * source.low
-  Galois16 *LH = &table[(1*256 + fl) * 256 + 0]; // factor.low  * source.high
-  Galois16 *HL = &table[(1*256 + 0) * 256 + fh]; // factor.high * source.low
-  Galois16 *HH = &table[(2*256 + fh) * 256 + 0]; // factor.high * source.high
+    return eSuccess;
+  }
+#endif
 
-  // Combine the four multiplication tables into two
+#ifdef LONGMULTIPLY
+  // The products of the factor and all values of the low and the high byte
   unsigned int L[256];
   unsigned int H[256];
 
 #if __BYTE_ORDER == __LITTLE_ENDIAN
-  unsigned int *pL = &L[0];
-  unsigned int *pH = &H[0];
+  MakeByteTable(factor, 0, L);
+  MakeByteTable(factor, 8, H);
 #else
-  unsigned int *pL = &H[0];
-  unsigned int *pH = &L[0];
-#endif
-
+  MakeByteTable(factor, 0, H);
+  MakeByteTable(factor, 8, L);
   for (unsigned int i=0; i<256; i++)
   {
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-    *pL = *LL + *HL;
-#else
-    unsigned int temp = *LL + *HL;
-    *pL = (temp >> 8) & 0xff | (temp << 8) & 0xff00;
-#endif
-
-    pL++;
-    LL++;
-    HL+=256;
-
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-    *pH = *LH + *HH;
-#else
-    temp = *LH + *HH;
-    *pH = (temp >> 8) & 0xff | (temp << 8) & 0xff00;
-#endif
-
-    pH++;
-    LH++;
-    HH++;
+    L[i] = (L[i] >> 8) & 0xff | (L[i] << 8) & 0xff00;
+    H[i] = (H[i] >> 8) & 0xff | (H[i] << 8) & 0xff00;
   }
+#endif
 
   // Treat the buffers as arrays of 32-bit unsigned ints.
   u32 *src = (u32 *)inputbuffer;
@@ -101,10 +101,6 @@ protected:
   // When the matrices are initialised: values of the form base ^ exponent are
   // stored (where the base values are obtained from database[] and the exponent
   // values are obtained from outputrows[]).
-
-#ifdef LONGMULTIPLY
-  GaloisLongMultiplyTable<g> *glmt;  // A multiplication table used by Process()
-#endif
 };
 
 template<class g>
@@ -128,10 +124,6 @@ inline ReedSolomon<g>::ReedSolomon(void)
   parmissingindex = 0;
 
   leftmatrix = 0;
-
-#ifdef LONGMULTIPLY
-  glmt = new GaloisLongMultiplyTable<g>;
-#endif
 }
 
 template<class g>
@@ -143,14 +135,24 @@ inline ReedSolomon<g>::~ReedSolomon(void)
   delete [] parpresentindex;
   delete [] parmissingindex;
   delete [] leftmatrix;
-
-#ifdef LONGMULTIPLY
-  delete glmt;
-#endif
 }
 
 u32 gcd(u32 a, u32 b);
 
+// Implementations of the multiply-accumulate loop of ReedSolomon<Galois16>::Process
+// (output ^= input * factor). The fastest kernel supported by the CPU is chosen
+// at startup; all kernels produce identical results.
+enum Galois16Kernel
+{
+  gkScalar,   // 8-bit long multiplication tables
+  gkSsse3,    // split-nibble multiplication with 128-bit shuffles
+  gkAvx2      // split-nibble multiplication with 256-bit shuffles
+};
+
+bool Galois16KernelSupported(Galois16Kernel kernel);
+Galois16Kernel GetGalois16Kernel(void);
+void SetGalois16Kernel(Galois16Kernel kernel);
+
 // Record whether the recovery block with the specified
 // exponent values is present or missing.
 template<class g>
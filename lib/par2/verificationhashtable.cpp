@@ -66,6 +66,8 @@ void VerificationHashTable::SetLimit(u32 limit)
   memset(hashtable, 0, hashmask * sizeof(hashtable[0]));
 
   hashmask--;
+
+  filter.SetSize(limit);
 }
 
 // Load data from a verification packet
@@ -96,6 +98,7 @@ void VerificationHashTable::Load(Par2RepairerSourceFile *sourcefile, u64 blocksi
 
     // Insert the entry in the hash table
     entry->Insert(&hashtable[entry->Checksum() & hashmask]);
+    filter.Insert(entry->Checksum());
 
     // Make the previous entry point forwards to this one
     if (preventry)
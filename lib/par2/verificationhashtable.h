@@ -238,6 +238,9 @@ public:
   // Look up based on the block crc
   const VerificationHashEntry* Lookup(u32 crc) const;
 
+  // The set of all block crcs
+  const CRCFilter& Filter(void) const {return filter;}
+
   // Continue lookup based on the block hash
   const VerificationHashEntry* Lookup(const VerificationHashEntry *entry,
                                       const MD5Hash &hash);
@@ -245,12 +248,13 @@ public:
 protected:
   VerificationHashEntry **hashtable;
   unsigned int hashmask;
+  CRCFilter filter;
 };
 
 // Search for an entry with the specified crc
 inline const VerificationHashEntry* VerificationHashTable::Lookup(u32 crc) const
 {
-  if (hashmask)
+  if (hashmask && filter.Contains(crc))
   {
     return VerificationHashEntry::Search(hashtable[crc & hashmask], crc);
   }
@@ -319,7 +323,7 @@ inline const VerificationHashEntry* VerificationHashTable::FindMatch(const Verif
   }
 
   // Look for other possible matches for the checksum
-  const VerificationHashEntry *nextentry = VerificationHashEntry::Search(hashtable[crc & hashmask], crc);
+  const VerificationHashEntry *nextentry = Lookup(crc);
   if (0 == nextentry)
     return 0;
 
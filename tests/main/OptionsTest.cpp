@@ -101,3 +101,21 @@ TEST_CASE("Options: calling extender", "[Options][Quick]")
 	REQUIRE(extender.m_feeds == 1);
 	REQUIRE(extender.m_tasks == 24);
 }
+
+TEST_CASE("Options: parsing verify threads", "[Options][Quick]")
+{
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("ParVerifyThreads=4, /mnt/usb disk=1; /mnt/a=b=2, =3, /mnt/ssd=100, x, /mnt/ssd=");
+
+	Options options(&cmdOpts, nullptr);
+
+	Options::VerifyThreadsList* entries = options.GetParVerifyThreads();
+	REQUIRE(entries->size() == 3);
+	REQUIRE(Util::EmptyStr(entries->at(0).GetDirectory()));
+	REQUIRE(entries->at(0).GetThreads() == 4);
+	REQUIRE(strcmp(entries->at(1).GetDirectory(), "/mnt/usb disk") == 0);
+	REQUIRE(entries->at(1).GetThreads() == 1);
+	REQUIRE(strcmp(entries->at(2).GetDirectory(), "/mnt/a=b") == 0);
+	REQUIRE(entries->at(2).GetThreads() == 2);
+	REQUIRE(options.GetConfigErrors());
+}
@@ -0,0 +1,94 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "nzbget.h"
+
+#include "catch.h"
+
+#include "DirectUnpack.h"
+
+TEST_CASE("Direct unpack: first volumes", "[Unpack][DirectUnpack][Quick]")
+{
+	REQUIRE(DirectUnpack::IsArchiveFilename("archive.rar"));
+	REQUIRE(DirectUnpack::IsArchiveFilename("Archive.RAR"));
+	REQUIRE(DirectUnpack::IsArchiveFilename("archive.part1.rar"));
+	REQUIRE(DirectUnpack::IsArchiveFilename("archive.part001.rar"));
+
+	REQUIRE_FALSE(DirectUnpack::IsArchiveFilename("archive.part2.rar"));
+	REQUIRE_FALSE(DirectUnpack::IsArchiveFilename("archive.part010.rar"));
+	REQUIRE_FALSE(DirectUnpack::IsArchiveFilename("archive.r00"));
+	REQUIRE_FALSE(DirectUnpack::IsArchiveFilename("archive.7z"));
+	REQUIRE_FALSE(DirectUnpack::IsArchiveFilename("archive.rar.par2"));
+}
+
+class DirectUnpackMock : public DirectUnpack
+{
+public:
+	using DirectUnpack::ReadLine;
+};
+
+TEST_CASE("Direct unpack: reading unrar output", "[Unpack][DirectUnpack][Quick]")
+{
+	FILE* stream = tmpfile();
+	REQUIRE(stream != nullptr);
+	fputs("Extracting  file.mkv      5%\b\b\b\b 10%\n", stream);
+	fputs("Insert disk with archive.part02.rar\n[C]ontinue, [Q]uit ", stream);
+	fputs("Extracting from archive.part02.rar\n", stream);
+	rewind(stream);
+
+	DirectUnpackMock directUnpack;
+	char buf[1024];
+
+	// progress updated in place is dropped
+	REQUIRE(directUnpack.ReadLine(buf, sizeof(buf), stream));
+	REQUIRE(std::string(buf) == "Extracting  file.mkv     10%\n");
+
+	REQUIRE(directUnpack.ReadLine(buf, sizeof(buf), stream));
+	REQUIRE(std::string(buf) == "Insert disk with archive.part02.rar\n");
+
+	// the prompt has no line break and is returned as soon as it is complete
+	REQUIRE(directUnpack.ReadLine(buf, sizeof(buf), stream));
+	REQUIRE(std::string(buf) == "[C]ontinue, [Q]uit ");
+
+	REQUIRE(directUnpack.ReadLine(buf, sizeof(buf), stream));
+	REQUIRE(std::string(buf) == "Extracting from archive.part02.rar\n");
+
+	REQUIRE_FALSE(directUnpack.ReadLine(buf, sizeof(buf), stream));
+	fclose(stream);
+}
+
+TEST_CASE("Direct unpack: volume prompt", "[Unpack][DirectUnpack][Quick]")
+{
+	CString volume;
+
+	// prompt on two lines
+	REQUIRE_FALSE(DirectUnpack::ParseVolumePrompt("Unrar: Insert disk with archive.part02.rar", volume));
+	REQUIRE(std::string(volume) == "archive.part02.rar");
+	REQUIRE(DirectUnpack::ParseVolumePrompt("Unrar: [C]ontinue, [Q]uit", volume));
+	REQUIRE(std::string(volume) == "archive.part02.rar");
+
+	// prompt on one line
+	REQUIRE(DirectUnpack::ParseVolumePrompt("Unrar: Insert disk with archive.r00 [C]ontinue, [Q]uit", volume));
+	REQUIRE(std::string(volume) == "archive.r00");
+
+	REQUIRE_FALSE(DirectUnpack::ParseVolumePrompt("Unrar: Extracting  file.mkv  OK", volume));
+	REQUIRE(std::string(volume) == "archive.r00");
+}
@@ -0,0 +1,122 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2015-2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "nzbget.h"
+
+#include "catch.h"
+
+#include "IncrementalParChecker.h"
+#include "TestUtil.h"
+
+TEST_CASE("Incremental par-checker: missing blocks", "[Par][IncrementalParChecker][Quick]")
+{
+	IncrementalParChecker::SegmentList segments;
+
+	// all data present, segments not aligned to blocks and not sorted
+	segments.emplace_back(true, 700, 300);
+	segments.emplace_back(true, 0, 350);
+	segments.emplace_back(true, 350, 350);
+	REQUIRE(IncrementalParChecker::CalcMissingBlocks(&segments, 1000, 100) == 0);
+
+	// the last (short) block is covered by the last segment
+	REQUIRE(IncrementalParChecker::CalcMissingBlocks(&segments, 950, 100) == 0);
+
+	// a failed segment damages every block it touches
+	segments.clear();
+	segments.emplace_back(true, 0, 350);
+	segments.emplace_back(false, 350, 350);
+	segments.emplace_back(true, 700, 300);
+	REQUIRE(IncrementalParChecker::CalcMissingBlocks(&segments, 1000, 100) == 4);
+
+	// a segment missing at the end of file
+	segments.clear();
+	segments.emplace_back(true, 0, 900);
+	REQUIRE(IncrementalParChecker::CalcMissingBlocks(&segments, 950, 100) == 1);
+
+	// nothing downloaded
+	segments.clear();
+	REQUIRE(IncrementalParChecker::CalcMissingBlocks(&segments, 950, 100) == 10);
+}
+
+TEST_CASE("Incremental par-checker: par-set", "[Par][IncrementalParChecker][Quick]")
+{
+	IncrementalParChecker parChecker;
+	REQUIRE(parChecker.Load((TestUtil::TestDataDir() + "/parchecker/testfile.par2").c_str()));
+	REQUIRE(parChecker.GetBlockSize() > 0);
+	REQUIRE(parChecker.GetMissingBlocks() == 0);
+
+	REQUIRE_FALSE(parChecker.AddDataFile("unknown.dat", false, nullptr));
+	REQUIRE(parChecker.AddDataFile("testfile.nfo", true, nullptr));
+	REQUIRE(parChecker.GetMissingBlocks() == 0);
+
+	int64 blockSize = parChecker.GetBlockSize();
+	IncrementalParChecker::SegmentList segments;
+	segments.emplace_back(true, 0, (int)blockSize);
+	segments.emplace_back(false, blockSize, (int)blockSize);
+	segments.emplace_back(true, blockSize * 2, 1024 * 1024);
+	REQUIRE(parChecker.AddDataFile("testfile.dat", false, &segments));
+	REQUIRE(parChecker.GetMissingBlocks() == 1);
+
+	// each file is counted only once
+	REQUIRE(parChecker.AddDataFile("TESTFILE.DAT", false, &segments));
+	REQUIRE(parChecker.GetMissingBlocks() == 1);
+}
+
+TEST_CASE("Incremental par-checker: verify blocks", "[Par][IncrementalParChecker][Slow][TestData]")
+{
+	TestUtil::PrepareWorkingDir("parchecker");
+
+	IncrementalParChecker parChecker;
+	REQUIRE(parChecker.Load((TestUtil::WorkingDir() + "/testfile.par2").c_str()));
+
+	int64 fileSize = 0;
+	REQUIRE(parChecker.GetBlockChecksums("unknown.dat", &fileSize) == nullptr);
+	IncrementalParChecker::BlockChecksums* blockChecksums = parChecker.GetBlockChecksums("testfile.dat", &fileSize);
+	REQUIRE(blockChecksums != nullptr);
+	REQUIRE(fileSize > 0);
+
+	std::string filename = TestUtil::WorkingDir() + "/testfile.dat";
+	REQUIRE(IncrementalParChecker::VerifyBlocks(filename.c_str(), fileSize,
+		parChecker.GetBlockSize(), blockChecksums, nullptr) == 0);
+	REQUIRE(IncrementalParChecker::VerifyBlocks((TestUtil::WorkingDir() + "/missing.dat").c_str(), fileSize,
+		parChecker.GetBlockSize(), blockChecksums, nullptr) == -1);
+
+	FILE* file = fopen(filename.c_str(), FOPEN_RBP);
+	REQUIRE(file != nullptr);
+	fseek(file, 20000, SEEK_SET);
+	fputc(0, file);
+	fclose(file);
+
+	REQUIRE(IncrementalParChecker::VerifyBlocks(filename.c_str(), fileSize,
+		parChecker.GetBlockSize(), blockChecksums, nullptr) == 1);
+
+	// the estimate based on articles is replaced with the verification result
+	REQUIRE(parChecker.AddDataFile("testfile.dat", true, nullptr));
+	REQUIRE(parChecker.AddDataFile("testfile.nfo", true, nullptr));
+	parChecker.DataFileVerified("testfile.dat", 1);
+	parChecker.DataFileVerified("testfile.nfo", 0);
+	REQUIRE(parChecker.GetMissingBlocks() == 1);
+	REQUIRE(parChecker.GetBlockChecksums("testfile.dat", &fileSize) == nullptr);
+
+	IncrementalParChecker::FileList verifiedFiles;
+	parChecker.GetVerifiedFiles(&verifiedFiles);
+	REQUIRE(verifiedFiles.size() == 1);
+	REQUIRE(!strcmp(verifiedFiles[0], "testfile.nfo"));
+}
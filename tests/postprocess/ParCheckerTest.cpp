@@ -25,6 +25,7 @@
 #include "Options.h"
 #include "ParChecker.h"
 #include "TestUtil.h"
+#include "par2cmdline.h"
 
 class ParCheckerMock: public ParChecker
 {
@@ -32,12 +33,17 @@ public:
 	ParCheckerMock();
 	void Execute();
 	void CorruptFile(const char* filename, int offset);
+	void InsertData(const char* filename, int offset, int size);
+	void SetVerifiedFile(const char* verifiedFile) { m_verifiedFile = verifiedFile; }
 
 protected:
 	virtual bool RequestMorePars(int blockNeeded, int* blockFound) { return false; }
 	virtual EFileStatus FindFileCrc(const char* filename, uint32* crc, SegmentList* segments);
+	virtual bool IsVerifiedFile(const char* filename) { return m_verifiedFile && !strcasecmp(m_verifiedFile, filename); }
 
 private:
+	CString m_verifiedFile;
+
 	uint32 CalcFileCrc(const char* filename);
 };
 
@@ -73,6 +79,22 @@ void ParCheckerMock::CorruptFile(const char* filename, int offset)
 	fclose(file);
 }
 
+void ParCheckerMock::InsertData(const char* filename, int offset, int size)
+{
+	std::string fullfilename(TestUtil::WorkingDir() + "/" + filename);
+
+	std::ifstream in(fullfilename.c_str(), std::ios::binary);
+	std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	in.close();
+	REQUIRE((int)data.size() >= offset);
+
+	data.insert(offset, size, 'x');
+
+	std::ofstream out(fullfilename.c_str(), std::ios::binary | std::ios::trunc);
+	out.write(data.data(), data.size());
+	REQUIRE(out.good());
+}
+
 ParCheckerMock::EFileStatus ParCheckerMock::FindFileCrc(const char* filename, uint32* crc, SegmentList* segments)
 {
 	std::ifstream sm((TestUtil::WorkingDir() + "/crc.txt").c_str());
@@ -154,7 +176,63 @@ TEST_CASE("Par-checker: repair successful", "[Par][ParChecker][Slow][TestData]")
 	REQUIRE(parChecker.GetParFull() == true);
 }
 
-TEST_CASE("Par-checker: repair failed", "[Par][ParChecker][Slow][TestData]")
+TEST_CASE("Par-checker: multithreaded repair successful", "[Par][ParChecker][Slow][TestData]")
+{
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("ParRepair=yes");
+	cmdOpts.push_back("ParThreads=3");
+	cmdOpts.push_back("BrokenLog=no");
+	Options options(&cmdOpts, nullptr);
+
+	ParCheckerMock parChecker;
+	parChecker.CorruptFile("testfile.dat", 20000);
+	parChecker.CorruptFile("testfile.dat", 30000);
+	parChecker.CorruptFile("testfile.dat", 40000);
+	parChecker.CorruptFile("testfile.dat", 50000);
+	parChecker.CorruptFile("testfile.dat", 60000);
+	parChecker.Execute();
+
+	REQUIRE(parChecker.GetStatus() == ParChecker::psRepaired);
+	REQUIRE(parChecker.GetParFull() == true);
+}
+
+TEST_CASE("Par-checker: parallel verification", "[Par][ParChecker][Slow][TestData]")
+{
+	TestUtil::PrepareWorkingDir("parchecker");
+	BString<1024> verifyThreads("ParVerifyThreads=1, %s=2", TestUtil::WorkingDir().c_str());
+
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("ParRepair=yes");
+	cmdOpts.push_back("ParQuick=no");
+	cmdOpts.push_back(verifyThreads);
+	cmdOpts.push_back("BrokenLog=no");
+	Options options(&cmdOpts, nullptr);
+
+	ParCheckerMock parChecker;
+	parChecker.CorruptFile("testfile.dat", 20000);
+	parChecker.CorruptFile("testfile.nfo", 100);
+	parChecker.Execute();
+
+	REQUIRE(parChecker.GetStatus() == ParChecker::psRepaired);
+	REQUIRE(parChecker.GetParFull() == true);
+}
+
+TEST_CASE("Par-checker: repair of shifted data", "[Par][ParChecker][Slow][TestData]")
+{
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("ParRepair=yes");
+	cmdOpts.push_back("BrokenLog=no");
+	Options options(&cmdOpts, nullptr);
+
+	// all blocks after the inserted data are found at unaligned positions
+	ParCheckerMock parChecker;
+	parChecker.InsertData("testfile.dat", 20000, 7);
+	parChecker.Execute();
+
+	REQUIRE(parChecker.GetStatus() == ParChecker::psRepaired);
+}
+
+TEST_CASE("Par-checker: repair failed","[Par][ParChecker][Slow][TestData]")
 {
 	Options::CmdOptList cmdOpts;
 	cmdOpts.push_back("ParRepair=no");
@@ -175,6 +253,39 @@ TEST_CASE("Par-checker: repair failed", "[Par][ParChecker][Slow][TestData]")
 	REQUIRE(parChecker.GetParFull() == true);
 }
 
+TEST_CASE("Par-checker: mapped input blocks", "[Par][ParChecker][TestData]")
+{
+	std::string filename = TestUtil::TestDataDir() + "/parchecker/testfile.dat";
+	CharBuffer content;
+	REQUIRE(FileSystem::LoadFileIntoBuffer(filename.c_str(), content, false));
+
+	Par2::DiskFile diskFile;
+	REQUIRE(diskFile.Open(filename));
+	REQUIRE(diskFile.Data(0, 100) == nullptr);
+	REQUIRE(diskFile.Map());
+
+	Par2::u64 fileSize = diskFile.FileSize();
+	REQUIRE(diskFile.Data(0, (size_t)fileSize) != nullptr);
+	REQUIRE(diskFile.Data(fileSize - 10, 11) == nullptr);
+
+	// the last block is shorter than the requested chunk: it must be
+	// read through the buffer with zero padding
+	Par2::DataBlock lastBlock;
+	lastBlock.SetLocation(&diskFile, fileSize - 1000);
+	lastBlock.SetLength(1000);
+	REQUIRE(lastBlock.GetData(0, 1000) == (const void*)(diskFile.Data(fileSize - 1000, 1000)));
+	REQUIRE(lastBlock.GetData(500, 1000) == nullptr);
+
+	char buffer[1000];
+	REQUIRE(lastBlock.ReadData(500, sizeof(buffer), buffer));
+	REQUIRE(!memcmp(buffer, content + (size_t)fileSize - 500, 500));
+	REQUIRE(buffer[500] == 0);
+	REQUIRE(buffer[999] == 0);
+
+	diskFile.Close();
+	REQUIRE(diskFile.Data(0, 100) == nullptr);
+}
+
 TEST_CASE("Par-checker: quick verification repair not needed", "[Par][ParChecker][Slow][TestData]")
 {
 	Options::CmdOptList cmdOpts;
@@ -205,6 +316,22 @@ TEST_CASE("Par-checker: quick verification repair successful", "[Par][ParChecker
 	REQUIRE(parChecker.GetParFull() == false);
 }
 
+TEST_CASE("Par-checker: files verified during download", "[Par][ParChecker][Slow][TestData]")
+{
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("ParRepair=no");
+	Options options(&cmdOpts, nullptr);
+
+	// the damage isn't detected because the file isn't verified again
+	ParCheckerMock parChecker;
+	parChecker.SetVerifiedFile("testfile.dat");
+	parChecker.CorruptFile("testfile.dat", 20000);
+	parChecker.Execute();
+
+	REQUIRE(parChecker.GetStatus() == ParChecker::psRepairNotNeeded);
+	REQUIRE(parChecker.GetParFull() == false);
+}
+
 TEST_CASE("Par-checker: quick full verification repair successful", "[Par][ParChecker][Slow][TestData]")
 {
 	Options::CmdOptList cmdOpts;
@@ -259,3 +386,311 @@ TEST_CASE("Par-checker: ignoring extensions", "[Par][ParChecker][Slow][TestData]
 
 	REQUIRE(parChecker.GetStatus() == expectedStatus);
 }
+
+typedef std::vector<std::vector<char>> BlockList;
+
+// Fills the buffers with the results of Reed-Solomon multiply-accumulate
+// of all inputs against all outputs using the given kernel
+void ProcessRecoveryBlocks(Par2::Galois16Kernel kernel, int inputCount, int outputCount, size_t size,
+	BlockList& inputs, BlockList& outputs)
+{
+	Par2::ReedSolomon<Par2::Galois16> rs;
+	REQUIRE(rs.SetInput(inputCount));
+	REQUIRE(rs.SetOutput(false, 0, outputCount - 1));
+	REQUIRE(rs.Compute(Par2::CommandLine::nlSilent));
+
+	Par2::SetGalois16Kernel(kernel);
+	for (int outputIndex = 0; outputIndex < outputCount; outputIndex++)
+	{
+		memset(outputs[outputIndex].data(), 0, size);
+		for (int inputIndex = 0; inputIndex < inputCount; inputIndex++)
+		{
+			rs.Process(size, inputIndex, inputs[inputIndex].data(), outputIndex, outputs[outputIndex].data());
+		}
+	}
+}
+
+void PrepareBlocks(int inputCount, int outputCount, size_t size,
+	BlockList& inputs, BlockList& outputs)
+{
+	uint32 seed = 12345;
+	for (int i = 0; i < inputCount; i++)
+	{
+		inputs.emplace_back(size);
+		for (size_t k = 0; k < size; k++)
+		{
+			seed = seed * 1103515245 + 12345;
+			inputs.back()[k] = (char)(seed >> 16);
+		}
+	}
+	for (int i = 0; i < outputCount; i++)
+	{
+		outputs.emplace_back(size);
+	}
+}
+
+// Reference multiplication in GF(2^16) with generator 0x1100B
+Par2::u16 GaloisMultiply(Par2::u16 a, Par2::u16 b)
+{
+	uint32 product = 0;
+	uint32 shifted = a;
+	for (; b; b >>= 1)
+	{
+		if (b & 1)
+		{
+			product ^= shifted;
+		}
+		shifted <<= 1;
+		if (shifted & 0x10000)
+		{
+			shifted ^= 0x1100B;
+		}
+	}
+	return (Par2::u16)product;
+}
+
+// Runs the function once and reports its duration and the throughput
+// for the given amount of processed data
+template <typename Func>
+void ReportBenchmark(const char* name, int64 bytes, Func func)
+{
+	int64 start = Util::GetCurrentTicks();
+	func();
+	int64 elapsed = Util::GetCurrentTicks() - start;
+
+	WARN(BString<1024>("%s: %i ms, %i MB/s", name, (int)(elapsed / 1000),
+		(int)(bytes / (elapsed > 0 ? elapsed : 1))).Str());
+}
+
+// Benchmarks the function with each of the kernels supported by the CPU,
+// the default kernel is restored afterwards
+template <typename Kernel, typename Func>
+void BenchmarkKernels(std::initializer_list<Kernel> kernels, const char* const names[],
+	Kernel (*getKernel)(void), void (*setKernel)(Kernel), bool (*kernelSupported)(Kernel),
+	int64 bytes, Func func)
+{
+	Kernel defaultKernel = getKernel();
+
+	for (Kernel kernel : kernels)
+	{
+		if (kernelSupported(kernel))
+		{
+			setKernel(kernel);
+			ReportBenchmark(names[kernel], bytes, [&]{ func(kernel); });
+		}
+	}
+
+	setKernel(defaultKernel);
+}
+
+TEST_CASE("Par-checker: Galois16 tables", "[Par][ParChecker]")
+{
+	int invalidLogs = 0;
+	for (uint32 value = 1; value < 0x10000; value++)
+	{
+		Par2::Galois16 galois((Par2::u16)value);
+		invalidLogs += Par2::Galois16(galois.Log()).ALog() != value;
+	}
+	REQUIRE(invalidLogs == 0);
+
+	uint32 seed = 12345;
+	for (int i = 0; i < 1000; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		Par2::u16 a = (Par2::u16)(seed >> 16);
+		seed = seed * 1103515245 + 12345;
+		Par2::u16 b = (Par2::u16)(seed >> 16);
+		REQUIRE((Par2::u16)(Par2::Galois16(a) * Par2::Galois16(b)) == GaloisMultiply(a, b));
+	}
+}
+
+TEST_CASE("Par-checker: Galois16 kernels", "[Par][ParChecker]")
+{
+	Par2::Galois16Kernel defaultKernel = Par2::GetGalois16Kernel();
+
+	const int inputCount = 8;
+	const int outputCount = 4;
+
+	// sizes not being multiple of SIMD-chunk sizes test processing of left over bytes
+	for (size_t size : {4, 36, 100, 4100})
+	{
+		BlockList inputs, expected, outputs;
+		PrepareBlocks(inputCount, outputCount, size, inputs, expected);
+		PrepareBlocks(0, outputCount, size, inputs, outputs);
+
+		ProcessRecoveryBlocks(Par2::gkScalar, inputCount, outputCount, size, inputs, expected);
+
+		for (Par2::Galois16Kernel kernel : {Par2::gkSsse3, Par2::gkAvx2})
+		{
+			if (Par2::Galois16KernelSupported(kernel))
+			{
+				ProcessRecoveryBlocks(kernel, inputCount, outputCount, size, inputs, outputs);
+				for (int i = 0; i < outputCount; i++)
+				{
+					REQUIRE(outputs[i] == expected[i]);
+				}
+			}
+		}
+	}
+
+	Par2::SetGalois16Kernel(defaultKernel);
+}
+
+TEST_CASE("Par-checker: Galois16 kernels benchmark", "[Par][ParChecker][Benchmark][.]")
+{
+	// geometry of the recovery set from testdata (200 source blocks, 6 recovery blocks)
+	// with the block size scaled up from 636 bytes to 159 KB
+	const int inputCount = 200;
+	const int outputCount = 6;
+	const size_t size = 636 * 256;
+
+	BlockList inputs, outputs;
+	PrepareBlocks(inputCount, outputCount, size, inputs, outputs);
+
+	const char* names[] = {"scalar", "ssse3", "avx2"};
+	BenchmarkKernels({Par2::gkScalar, Par2::gkSsse3, Par2::gkAvx2}, names,
+		Par2::GetGalois16Kernel, Par2::SetGalois16Kernel, Par2::Galois16KernelSupported,
+		(int64)size * inputCount * outputCount,
+		[&](Par2::Galois16Kernel kernel)
+		{
+			ProcessRecoveryBlocks(kernel, inputCount, outputCount, size, inputs, outputs);
+		});
+}
+
+// Hashes each of the blocks with its own context using the given kernel;
+// the contexts already contain "prefix" bytes of each block.
+void HashBlocks(Par2::MD5Kernel kernel, BlockList& blocks, int count, size_t prefix, std::vector<Par2::MD5Hash>& hashes)
+{
+	Par2::SetMD5Kernel(kernel);
+
+	std::vector<Par2::MD5Context> contexts(count);
+	std::vector<Par2::MD5Context*> contextList;
+	std::vector<const void*> bufferList;
+	std::vector<size_t> lengthList;
+	for (int i = 0; i < count; i++)
+	{
+		contexts[i].Update(blocks[i].data(), prefix);
+		contextList.push_back(&contexts[i]);
+		bufferList.push_back(blocks[i].data() + prefix);
+		lengthList.push_back(blocks[i].size() - prefix);
+	}
+
+	Par2::MD5UpdateMulti(contextList.data(), bufferList.data(), lengthList.data(), count);
+
+	hashes.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		contexts[i].Final(hashes[i]);
+	}
+}
+
+TEST_CASE("Par-checker: multi-buffer MD5", "[Par][ParChecker]")
+{
+	Par2::MD5Kernel defaultKernel = Par2::GetMD5Kernel();
+
+	// blocks of different sizes, not being multiple of 64 bytes
+	BlockList blocks;
+	for (size_t size : {3000, 3001, 2990, 4100, 64, 3333, 5000, 2999, 1000})
+	{
+		BlockList block, unused;
+		PrepareBlocks(1, 0, size, block, unused);
+		blocks.push_back(block[0]);
+	}
+
+	std::vector<Par2::MD5Hash> expected, hashes;
+	HashBlocks(Par2::mkScalar, blocks, (int)blocks.size(), 0, expected);
+
+	for (Par2::MD5Kernel kernel : {Par2::mkSse2, Par2::mkAvx2})
+	{
+		if (Par2::MD5KernelSupported(kernel))
+		{
+			for (int count : {2, 3, 4, 8, 9})
+			{
+				for (size_t prefix : {0, 10})
+				{
+					HashBlocks(kernel, blocks, count, prefix, hashes);
+					for (int i = 0; i < count; i++)
+					{
+						REQUIRE(hashes[i] == expected[i]);
+					}
+				}
+			}
+		}
+	}
+
+	Par2::SetMD5Kernel(defaultKernel);
+}
+
+TEST_CASE("Par-checker: multi-buffer MD5 benchmark", "[Par][ParChecker][Benchmark][.]")
+{
+	// 8 blocks of the size used in the Galois16 benchmark, hashed 10 times
+	const int count = 8;
+	const size_t size = 636 * 256;
+	const int rounds = 10;
+
+	BlockList blocks, unused;
+	PrepareBlocks(count, 0, size, blocks, unused);
+	std::vector<Par2::MD5Hash> hashes;
+
+	const char* names[] = {"scalar", "sse2", "avx2"};
+	BenchmarkKernels({Par2::mkScalar, Par2::mkSse2, Par2::mkAvx2}, names,
+		Par2::GetMD5Kernel, Par2::SetMD5Kernel, Par2::MD5KernelSupported,
+		(int64)size * count * rounds,
+		[&](Par2::MD5Kernel kernel)
+		{
+			for (int i = 0; i < rounds; i++)
+			{
+				HashBlocks(kernel, blocks, count, 0, hashes);
+			}
+		});
+}
+
+TEST_CASE("Par-checker: sliding window scan benchmark", "[Par][ParChecker][Benchmark][.]")
+{
+	// scan of 32 MB of data not containing any blocks with 1000 block checksums
+	const Par2::u64 blocksize = 636 * 256;
+	const int size = 32 * 1024 * 1024;
+
+	TestUtil::PrepareWorkingDir("empty");
+	std::string filename(TestUtil::WorkingDir() + "/data.bin");
+	BlockList data, unused;
+	PrepareBlocks(1, 0, size, data, unused);
+	std::ofstream out(filename.c_str(), std::ios::binary);
+	out.write(data[0].data(), size);
+	out.close();
+
+	Par2::CRCFilter filter;
+	filter.SetSize(1000);
+	uint32 seed = 54321;
+	for (int i = 0; i < 1000; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		filter.Insert(seed);
+	}
+
+	Par2::u32 windowtable[256];
+	Par2::GenerateWindowTable(blocksize, windowtable);
+	Par2::u32 windowmask = Par2::ComputeWindowMask(blocksize);
+
+	for (bool bulk : {false, true})
+	{
+		Par2::DiskFile diskfile;
+		REQUIRE(diskfile.Open(filename));
+		Par2::FileCheckSummer checksummer(&diskfile, blocksize, windowtable, windowmask);
+
+		int candidates = 0;
+		bool ok = true;
+		ReportBenchmark(bulk ? "bulk" : "step", size, [&]
+			{
+				ok = checksummer.Start();
+				while (ok && checksummer.Offset() < (Par2::u64)size)
+				{
+					ok = bulk ? checksummer.StepToCandidate(filter) : checksummer.Step();
+					candidates += filter.Contains(checksummer.Checksum());
+				}
+			});
+		REQUIRE(ok);
+
+		WARN(BString<1024>("%s: %i candidates", bulk ? "bulk" : "step", candidates).Str());
+	}
+}
@@ -0,0 +1,58 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "nzbget.h"
+
+#include "catch.h"
+
+#include "PrePostProcessor.h"
+
+TEST_CASE("PrePostProcessor: job class limits", "[PrePostProcessor][Quick]")
+{
+	PrePostProcessor::RunningJobs jobs;
+
+	REQUIRE(PrePostProcessor::CanStartJob(&jobs, PrePostProcessor::rcDisk, false, 1, 1, 0));
+
+	// unpack occupies the disk slot, repair and script can still run
+	jobs.emplace_back(nullptr, PrePostProcessor::rcDisk, false, 1, false, "unpack");
+	REQUIRE_FALSE(PrePostProcessor::CanStartJob(&jobs, PrePostProcessor::rcDisk, false, 2, 1, 0));
+	REQUIRE(PrePostProcessor::CanStartJob(&jobs, PrePostProcessor::rcDisk, false, 2, 2, 0));
+	REQUIRE(PrePostProcessor::CanStartJob(&jobs, PrePostProcessor::rcCpu, true, 1, 1, 0));
+	REQUIRE(PrePostProcessor::CanStartJob(&jobs, PrePostProcessor::rcScript, false, -1, 1, 0));
+
+	// only one par-job at a time whatever the limit
+	jobs.emplace_back(nullptr, PrePostProcessor::rcCpu, true, 1, false, "par-check");
+	REQUIRE_FALSE(PrePostProcessor::CanStartJob(&jobs, PrePostProcessor::rcCpu, true, 2, 4, 0));
+	REQUIRE(PrePostProcessor::CanStartJob(&jobs, PrePostProcessor::rcCpu, false, 2, 4, 0));
+}
+
+TEST_CASE("PrePostProcessor: volume limit", "[PrePostProcessor][Quick]")
+{
+	PrePostProcessor::RunningJobs jobs;
+	jobs.emplace_back(nullptr, PrePostProcessor::rcDisk, false, 1, false, "unpack");
+	jobs.emplace_back(nullptr, PrePostProcessor::rcScript, false, -1, false, "post-process-script");
+
+	// cpu- and disk-jobs on the same volume count together, scripts don't count
+	REQUIRE_FALSE(PrePostProcessor::CanStartJob(&jobs, PrePostProcessor::rcCpu, true, 1, 4, 1));
+	REQUIRE(PrePostProcessor::CanStartJob(&jobs, PrePostProcessor::rcCpu, true, 2, 4, 1));
+	REQUIRE(PrePostProcessor::CanStartJob(&jobs, PrePostProcessor::rcDisk, false, 1, 4, 2));
+	REQUIRE(PrePostProcessor::CanStartJob(&jobs, PrePostProcessor::rcDisk, false, 1, 4, 0));
+	REQUIRE(PrePostProcessor::CanStartJob(&jobs, PrePostProcessor::rcScript, false, -1, 4, 1));
+}
@@ -0,0 +1,648 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "nzbget.h"
+
+#include "catch.h"
+
+#include "DiskState.h"
+#include "Options.h"
+#include "Util.h"
+#include "FileSystem.h"
+#include "TestUtil.h"
+
+std::unique_ptr<FileInfo> MakeFileInfo(int id, int articleCount)
+{
+	std::unique_ptr<FileInfo> fileInfo = std::make_unique<FileInfo>(id);
+	fileInfo->SetSubject("\"test file.part01.rar\" yEnc (1/2)");
+	fileInfo->SetFilename("test file.part01.rar");
+	fileInfo->SetTime(1234567890);
+	fileInfo->SetSize(int64(articleCount) * 700000);
+	fileInfo->SetMissedSize(700000);
+	fileInfo->SetParFile(false);
+	fileInfo->SetTotalArticles(articleCount);
+	fileInfo->SetMissedArticles(1);
+	fileInfo->GetGroups()->push_back("alt.binaries.test");
+	fileInfo->GetGroups()->push_back("alt.binaries.misc");
+
+	for (int i = 0; i < articleCount; i++)
+	{
+		ArticleInfo* articleInfo = fileInfo->GetArticles()->Add(i + 1, 700000 + i,
+			BString<100>("part%i.abcdefgh@news.example.com", i + 1));
+		articleInfo->SetSegmentOffset(int64(i) * 700000);
+		articleInfo->SetSegmentSize(700000 + i);
+		articleInfo->SetCrc(0xA0B0C0D0 + i);
+		articleInfo->SetStatus(i % 3 == 0 ? ArticleInfo::aiFinished : ArticleInfo::aiUndefined);
+	}
+
+	return fileInfo;
+}
+
+void CheckArticles(FileInfo* fileInfo, FileInfo* origInfo)
+{
+	REQUIRE(fileInfo->GetArticles()->size() == origInfo->GetArticles()->size());
+	for (int i = 0; i < (int)fileInfo->GetArticles()->size(); i++)
+	{
+		ArticleInfo* articleInfo = &fileInfo->GetArticles()->at(i);
+		ArticleInfo* origArticle = &origInfo->GetArticles()->at(i);
+		REQUIRE(articleInfo->GetPartNumber() == origArticle->GetPartNumber());
+		REQUIRE(articleInfo->GetSize() == origArticle->GetSize());
+		REQUIRE(std::string(articleInfo->GetMessageId()) == origArticle->GetMessageId());
+	}
+}
+
+TEST_CASE("DiskState: binary file and file state", "[DiskState][Quick]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	CString queueDirOption = CString::FormatStr("QueueDir=%s", TestUtil::WorkingDir().c_str());
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("SaveQueue=no");
+	cmdOpts.push_back(queueDirOption);
+	Options options(&cmdOpts, nullptr);
+	DiskState diskState;
+
+	std::unique_ptr<FileInfo> origInfo = MakeFileInfo(101, 50);
+	// offsets in files over 4 GB
+	origInfo->GetArticles()->at(49).SetSegmentOffset(0x123456789LL);
+	REQUIRE(diskState.SaveFile(origInfo.get()));
+	REQUIRE(diskState.SaveFileState(origInfo.get(), false));
+
+	FileInfo fileInfo(101);
+	REQUIRE(diskState.LoadFile(&fileInfo, true, true));
+	REQUIRE(std::string(fileInfo.GetSubject()) == origInfo->GetSubject());
+	REQUIRE(std::string(fileInfo.GetFilename()) == origInfo->GetFilename());
+	REQUIRE(fileInfo.GetTime() == origInfo->GetTime());
+	REQUIRE(fileInfo.GetSize() == origInfo->GetSize());
+	REQUIRE(fileInfo.GetMissedSize() == origInfo->GetMissedSize());
+	REQUIRE(fileInfo.GetTotalArticles() == 50);
+	REQUIRE(fileInfo.GetGroups()->size() == 2);
+	REQUIRE(std::string(*fileInfo.GetGroups()->at(1)) == "alt.binaries.misc");
+	CheckArticles(&fileInfo, origInfo.get());
+
+	REQUIRE(diskState.LoadFileState(&fileInfo, nullptr, false));
+	REQUIRE(fileInfo.GetCompletedArticles() == 17);
+	ArticleInfo* articleInfo = &fileInfo.GetArticles()->at(3);
+	REQUIRE(articleInfo->GetStatus() == ArticleInfo::aiFinished);
+	REQUIRE(articleInfo->GetSegmentOffset() == 3 * 700000);
+	REQUIRE(articleInfo->GetCrc() == 0xA0B0C0D3);
+	REQUIRE(fileInfo.GetArticles()->at(49).GetSegmentOffset() == 0x123456789LL);
+
+	// corrupted file must be rejected
+	std::string filename(TestUtil::WorkingDir() + "/101");
+	CharBuffer buffer;
+	REQUIRE(FileSystem::LoadFileIntoBuffer(filename.c_str(), buffer, false));
+	buffer[buffer.Size() - 10] ^= 1;
+	REQUIRE(FileSystem::SaveBufferIntoFile(filename.c_str(), buffer, buffer.Size()));
+	FileInfo corruptedInfo(101);
+	REQUIRE_FALSE(diskState.LoadFile(&corruptedInfo, true, true));
+}
+
+void WriteTextFile(FileInfo* fileInfo, const char* filename)
+{
+	FILE* file = fopen(filename, FOPEN_WB);
+	REQUIRE(file != nullptr);
+	uint32 High, Low;
+	fprintf(file, "nzbget diskstate file version 4\n");
+	fprintf(file, "%s\n%s\n%i\n", fileInfo->GetSubject(), fileInfo->GetFilename(), (int)fileInfo->GetTime());
+	Util::SplitInt64(fileInfo->GetSize(), &High, &Low);
+	fprintf(file, "%u,%u\n", High, Low);
+	Util::SplitInt64(fileInfo->GetMissedSize(), &High, &Low);
+	fprintf(file, "%u,%u\n", High, Low);
+	fprintf(file, "%i\n%i,%i\n", (int)fileInfo->GetParFile(), fileInfo->GetTotalArticles(), fileInfo->GetMissedArticles());
+	fprintf(file, "%i\n", (int)fileInfo->GetGroups()->size());
+	for (CString& group : fileInfo->GetGroups())
+	{
+		fprintf(file, "%s\n", *group);
+	}
+	fprintf(file, "%i\n", (int)fileInfo->GetArticles()->size());
+	for (ArticleInfo* articleInfo : fileInfo->GetArticles())
+	{
+		fprintf(file, "%i,%i\n%s\n", articleInfo->GetPartNumber(), articleInfo->GetSize(), articleInfo->GetMessageId());
+	}
+	fclose(file);
+}
+
+TEST_CASE("DiskState: migration from text format", "[DiskState][Quick]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	CString queueDirOption = CString::FormatStr("QueueDir=%s", TestUtil::WorkingDir().c_str());
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("SaveQueue=no");
+	cmdOpts.push_back(queueDirOption);
+	Options options(&cmdOpts, nullptr);
+	DiskState diskState;
+
+	std::unique_ptr<FileInfo> origInfo = MakeFileInfo(102, 20);
+	WriteTextFile(origInfo.get(), (TestUtil::WorkingDir() + "/102").c_str());
+
+	FileInfo fileInfo(102);
+	REQUIRE(diskState.LoadFile(&fileInfo, true, true));
+	REQUIRE(std::string(fileInfo.GetFilename()) == origInfo->GetFilename());
+	CheckArticles(&fileInfo, origInfo.get());
+
+	// saving converts the file into binary format
+	REQUIRE(diskState.SaveFile(&fileInfo));
+	FileInfo convertedInfo(102);
+	REQUIRE(diskState.LoadFile(&convertedInfo, true, true));
+	CheckArticles(&convertedInfo, origInfo.get());
+}
+
+TEST_CASE("DiskState: load/save benchmark", "[DiskState][Benchmark][.]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	CString queueDirOption = CString::FormatStr("QueueDir=%s", TestUtil::WorkingDir().c_str());
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("SaveQueue=no");
+	cmdOpts.push_back(queueDirOption);
+	Options options(&cmdOpts, nullptr);
+	DiskState diskState;
+
+	const int articleCount = 500000;
+	std::unique_ptr<FileInfo> origInfo = MakeFileInfo(103, articleCount);
+	WriteTextFile(origInfo.get(), (TestUtil::WorkingDir() + "/104").c_str());
+
+	int64 start = Util::GetCurrentTicks();
+	REQUIRE(diskState.SaveFile(origInfo.get()));
+	REQUIRE(diskState.SaveFileState(origInfo.get(), false));
+	int64 saveTime = Util::GetCurrentTicks() - start;
+
+	start = Util::GetCurrentTicks();
+	FileInfo fileInfo(103);
+	REQUIRE(diskState.LoadFile(&fileInfo, true, true));
+	int64 loadTime = Util::GetCurrentTicks() - start;
+	REQUIRE(diskState.LoadFileState(&fileInfo, nullptr, false));
+
+	start = Util::GetCurrentTicks();
+	FileInfo textInfo(104);
+	REQUIRE(diskState.LoadFile(&textInfo, true, true));
+	int64 textLoadTime = Util::GetCurrentTicks() - start;
+
+	REQUIRE((int)fileInfo.GetArticles()->size() == articleCount);
+	REQUIRE((int)textInfo.GetArticles()->size() == articleCount);
+
+	WARN(BString<1024>("%i articles: binary save %i ms, binary load %i ms, text load %i ms", articleCount,
+		(int)(saveTime / 1000), (int)(loadTime / 1000), (int)(textLoadTime / 1000)).Str());
+}
+
+class DownloadQueueMock : public DownloadQueue
+{
+public:
+	DownloadQueueMock() { Init(this); }
+	~DownloadQueueMock() { Final(); }
+	virtual bool EditEntry(int ID, EEditAction action, int offset, const char* text) { return false; }
+	virtual bool EditList(IdList* idList, NameList* nameList, EMatchMode matchMode, EEditAction action, int offset, const char* text) { return false; }
+	virtual void HistoryChanged() {}
+	virtual void Save() {}
+	virtual void SaveChanged(int nzbId) {}
+};
+
+std::string QueueNames(DownloadQueue* downloadQueue)
+{
+	std::string names;
+	for (NzbInfo* nzbInfo : downloadQueue->GetQueue())
+	{
+		names += std::string(nzbInfo->GetName()) + ";";
+	}
+	names += "|";
+	for (HistoryInfo* historyInfo : downloadQueue->GetHistory())
+	{
+		names += std::string(historyInfo->GetNzbInfo()->GetName()) + ";";
+	}
+	return names;
+}
+
+std::unique_ptr<NzbInfo> MakeNzbInfo(const char* name)
+{
+	std::unique_ptr<NzbInfo> nzbInfo = std::make_unique<NzbInfo>();
+	nzbInfo->SetName(name);
+	nzbInfo->SetFilename(BString<100>("%s.nzb", name));
+	return nzbInfo;
+}
+
+TEST_CASE("DiskState: queue journal", "[DiskState][Quick]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	CString queueDirOption = CString::FormatStr("QueueDir=%s", TestUtil::WorkingDir().c_str());
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("SaveQueue=no");
+	cmdOpts.push_back(queueDirOption);
+	Options options(&cmdOpts, nullptr);
+	std::string journalFilename(TestUtil::WorkingDir() + "/journal");
+
+	DownloadQueueMock downloadQueue;
+	DiskState diskState;
+
+	downloadQueue.GetQueue()->Add(MakeNzbInfo("one"));
+	downloadQueue.GetQueue()->Add(MakeNzbInfo("two"));
+	downloadQueue.GetQueue()->Add(MakeNzbInfo("three"));
+	downloadQueue.GetHistory()->Add(std::make_unique<HistoryInfo>(MakeNzbInfo("old")));
+	REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, true));
+	REQUIRE_FALSE(FileSystem::FileExists(journalFilename.c_str()));
+
+	// changes go to journal
+	downloadQueue.GetQueue()->at(1)->SetName("two-renamed");
+	std::unique_ptr<NzbInfo> completed = std::move(downloadQueue.GetQueue()->front());
+	downloadQueue.GetQueue()->pop_front();
+	downloadQueue.GetHistory()->Add(std::make_unique<HistoryInfo>(std::move(completed)), true);
+	downloadQueue.GetQueue()->Add(MakeNzbInfo("four"), true);
+	REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, true));
+	REQUIRE(FileSystem::FileExists(journalFilename.c_str()));
+
+	// reordering of unchanged records
+	std::swap(downloadQueue.GetQueue()->at(0), downloadQueue.GetQueue()->at(2));
+	REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, false));
+
+	std::string expected = QueueNames(&downloadQueue);
+	REQUIRE(expected == "three;two-renamed;four;|one;old;");
+
+	{
+		DownloadQueueMock loadedQueue;
+		DiskState loadState;
+		REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+		REQUIRE(QueueNames(&loadedQueue) == expected);
+	}
+
+	// incomplete batch at the end of journal is ignored
+	FILE* file = fopen(journalFilename.c_str(), FOPEN_AB);
+	REQUIRE(file != nullptr);
+	fprintf(file, "batch,1000,12345\n-queue,1\n");
+	fclose(file);
+
+	{
+		DownloadQueueMock loadedQueue;
+		DiskState loadState;
+		REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+		REQUIRE(QueueNames(&loadedQueue) == expected);
+
+		// first save after loading compacts the journal into snapshot
+		REQUIRE(loadState.SaveDownloadQueue(&loadedQueue, true));
+		REQUIRE_FALSE(FileSystem::FileExists(journalFilename.c_str()));
+	}
+
+	{
+		DownloadQueueMock loadedQueue;
+		DiskState loadState;
+		REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+		REQUIRE(QueueNames(&loadedQueue) == expected);
+	}
+}
+
+TEST_CASE("DiskState: journal of changed items", "[DiskState][Quick]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	CString queueDirOption = CString::FormatStr("QueueDir=%s", TestUtil::WorkingDir().c_str());
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("SaveQueue=no");
+	cmdOpts.push_back(queueDirOption);
+	Options options(&cmdOpts, nullptr);
+
+	DownloadQueueMock downloadQueue;
+	DiskState diskState;
+
+	downloadQueue.GetQueue()->Add(MakeNzbInfo("one"));
+	downloadQueue.GetQueue()->Add(MakeNzbInfo("two"));
+	downloadQueue.GetHistory()->Add(std::make_unique<HistoryInfo>(MakeNzbInfo("old")));
+	REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, true));
+
+	// items not listed as changed keep their saved records, added items are saved
+	IdList changedIds;
+	changedIds.push_back(downloadQueue.GetQueue()->at(1)->GetId());
+	downloadQueue.GetQueue()->at(0)->SetName("one-renamed");
+	downloadQueue.GetQueue()->at(1)->SetName("two-renamed");
+	downloadQueue.GetHistory()->front()->GetNzbInfo()->SetName("old-renamed");
+	downloadQueue.GetQueue()->Add(MakeNzbInfo("three"));
+	REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, false, &changedIds));
+
+	{
+		DownloadQueueMock loadedQueue;
+		DiskState loadState;
+		REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+		REQUIRE(QueueNames(&loadedQueue) == "one;two-renamed;three;|old;");
+	}
+
+	// history item listed as changed
+	changedIds.clear();
+	changedIds.push_back(downloadQueue.GetHistory()->front()->GetId());
+	REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, false, &changedIds));
+
+	{
+		DownloadQueueMock loadedQueue;
+		DiskState loadState;
+		REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+		REQUIRE(QueueNames(&loadedQueue) == "one;two-renamed;three;|old-renamed;");
+	}
+}
+
+TEST_CASE("DiskState: interrupted snapshot", "[DiskState][Quick]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	CString queueDirOption = CString::FormatStr("QueueDir=%s", TestUtil::WorkingDir().c_str());
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("SaveQueue=no");
+	cmdOpts.push_back(queueDirOption);
+	Options options(&cmdOpts, nullptr);
+	std::string historyFilename(TestUtil::WorkingDir() + "/history");
+	std::string journalFilename(TestUtil::WorkingDir() + "/journal");
+
+	{
+		DownloadQueueMock downloadQueue;
+		DiskState diskState;
+		downloadQueue.GetQueue()->Add(MakeNzbInfo("one"));
+		downloadQueue.GetQueue()->Add(MakeNzbInfo("two"));
+		downloadQueue.GetHistory()->Add(std::make_unique<HistoryInfo>(MakeNzbInfo("old")));
+		REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, true));
+
+		std::unique_ptr<NzbInfo> completed = std::move(downloadQueue.GetQueue()->front());
+		downloadQueue.GetQueue()->pop_front();
+		downloadQueue.GetHistory()->Add(std::make_unique<HistoryInfo>(std::move(completed)), true);
+		REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, true));
+	}
+
+	REQUIRE(FileSystem::CopyFile(historyFilename.c_str(), (historyFilename + ".bak").c_str()));
+	REQUIRE(FileSystem::CopyFile(journalFilename.c_str(), (journalFilename + ".bak").c_str()));
+
+	{
+		// first save after loading writes new snapshot
+		DownloadQueueMock loadedQueue;
+		DiskState loadState;
+		REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+		REQUIRE(QueueNames(&loadedQueue) == "two;|one;old;");
+		REQUIRE(loadState.SaveDownloadQueue(&loadedQueue, true));
+		REQUIRE_FALSE(FileSystem::FileExists(journalFilename.c_str()));
+	}
+
+	// program interrupted after new queue was written but before new history
+	REQUIRE(FileSystem::MoveFile((historyFilename + ".bak").c_str(), historyFilename.c_str()));
+	REQUIRE(FileSystem::MoveFile((journalFilename + ".bak").c_str(), journalFilename.c_str()));
+
+	{
+		DownloadQueueMock loadedQueue;
+		DiskState loadState;
+		REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+		REQUIRE(QueueNames(&loadedQueue) == "two;|one;old;");
+	}
+}
+
+TEST_CASE("DiskState: background writer", "[DiskState][Quick]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	CString queueDirOption = CString::FormatStr("QueueDir=%s", TestUtil::WorkingDir().c_str());
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("SaveQueue=no");
+	cmdOpts.push_back(queueDirOption);
+	Options options(&cmdOpts, nullptr);
+
+	DownloadQueueMock downloadQueue;
+	DiskState diskState;
+	diskState.StartWriter();
+
+	std::unique_ptr<FileInfo> origInfo = MakeFileInfo(101, 50);
+	downloadQueue.GetQueue()->Add(MakeNzbInfo("one"));
+	for (int i = 0; i < 20; i++)
+	{
+		REQUIRE(diskState.SaveFile(origInfo.get()));
+		REQUIRE(diskState.SaveFileState(origInfo.get(), false));
+		downloadQueue.GetQueue()->front()->SetName(BString<100>("one-%i", i));
+		REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, true));
+	}
+
+	// reading waits for pending writes of the file
+	FileInfo fileInfo(101);
+	REQUIRE(diskState.LoadFile(&fileInfo, true, true));
+	CheckArticles(&fileInfo, origInfo.get());
+
+	diskState.StopWriter();
+
+	DownloadQueueMock loadedQueue;
+	DiskState loadState;
+	REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+	REQUIRE(QueueNames(&loadedQueue) == "one-19;|");
+}
+
+std::unique_ptr<NzbInfo> MakeQueueNzb(DiskState* diskState, const char* name, int firstId, int fileCount,
+	int articleCount)
+{
+	std::unique_ptr<NzbInfo> nzbInfo = MakeNzbInfo(name);
+	for (int i = 0; i < fileCount; i++)
+	{
+		std::unique_ptr<FileInfo> fileInfo = MakeFileInfo(firstId + i, articleCount);
+		fileInfo->SetNzbInfo(nzbInfo.get());
+		REQUIRE(diskState->SaveFile(fileInfo.get()));
+		if (i % 2 == 0)
+		{
+			REQUIRE(diskState->SaveFileState(fileInfo.get(), false));
+		}
+		fileInfo->GetArticles()->clear();
+		nzbInfo->GetFileList()->Add(std::move(fileInfo));
+	}
+	return nzbInfo;
+}
+
+TEST_CASE("DiskState: queue loading with file states", "[DiskState][Quick]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	CString queueDirOption = CString::FormatStr("QueueDir=%s", TestUtil::WorkingDir().c_str());
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("SaveQueue=no");
+	cmdOpts.push_back("ContinuePartial=yes");
+	cmdOpts.push_back(queueDirOption);
+	Options options(&cmdOpts, nullptr);
+
+	DownloadQueueMock downloadQueue;
+	DiskState diskState;
+
+	for (int i = 0; i < 10; i++)
+	{
+		downloadQueue.GetQueue()->Add(MakeQueueNzb(&diskState, BString<100>("nzb%i", i), 100 + i * 10, 10, 50));
+	}
+	downloadQueue.GetHistory()->Add(std::make_unique<HistoryInfo>(MakeQueueNzb(&diskState, "old", 500, 3, 50)));
+	REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, true));
+
+	// file without file info is dropped from queue
+	diskState.DiscardFile(101, true, false, false);
+
+	DownloadQueueMock loadedQueue;
+	DiskState loadState;
+	REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+	REQUIRE(QueueNames(&loadedQueue) == "nzb0;nzb1;nzb2;nzb3;nzb4;nzb5;nzb6;nzb7;nzb8;nzb9;|old;");
+
+	NzbInfo* nzbInfo = loadedQueue.GetQueue()->front().get();
+	REQUIRE(nzbInfo->GetFileList()->size() == 9);
+	REQUIRE(loadedQueue.GetHistory()->front()->GetNzbInfo()->GetFileList()->size() == 3);
+
+	for (NzbInfo* nzbInfo : loadedQueue.GetQueue())
+	{
+		for (FileInfo* fileInfo : nzbInfo->GetFileList())
+		{
+			bool partial = (fileInfo->GetId() - 100) % 2 == 0;
+			REQUIRE(strcmp(fileInfo->GetFilename(), "test file.part01.rar") == 0);
+			REQUIRE(fileInfo->GetTotalArticles() == 50);
+			REQUIRE(fileInfo->GetPartialState() == (partial ? FileInfo::psPartial : FileInfo::psNone));
+			// file states are loaded in second phase
+			REQUIRE(fileInfo->GetCompletedArticles() == 0);
+		}
+	}
+
+	// state loaded on demand together with articles is kept
+	FileInfo* pickedInfo = loadedQueue.GetQueue()->at(1)->GetFileList()->front().get();
+	REQUIRE(loadState.LoadArticles(pickedInfo));
+	REQUIRE(loadState.LoadFileState(pickedInfo, nullptr, false));
+	pickedInfo->SetCompletedArticles(18);
+
+	loadState.LoadFileStates(nullptr);
+
+	for (NzbInfo* nzbInfo : loadedQueue.GetQueue())
+	{
+		for (FileInfo* fileInfo : nzbInfo->GetFileList())
+		{
+			bool partial = (fileInfo->GetId() - 100) % 2 == 0;
+			REQUIRE(fileInfo->GetCompletedArticles() == (fileInfo == pickedInfo ? 18 : partial ? 17 : 0));
+			// articles are loaded on demand
+			REQUIRE(fileInfo->GetArticles()->empty() == (fileInfo != pickedInfo));
+		}
+	}
+}
+
+TEST_CASE("DiskState: queue loading benchmark", "[DiskState][Benchmark][.]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	CString queueDirOption = CString::FormatStr("QueueDir=%s", TestUtil::WorkingDir().c_str());
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("SaveQueue=no");
+	cmdOpts.push_back("ContinuePartial=yes");
+	cmdOpts.push_back(queueDirOption);
+	Options options(&cmdOpts, nullptr);
+
+	const int nzbCount = 200;
+	const int fileCount = 50;
+	const int articleCount = 200;
+
+	{
+		DownloadQueueMock downloadQueue;
+		DiskState diskState;
+		for (int i = 0; i < nzbCount; i++)
+		{
+			downloadQueue.GetQueue()->Add(MakeQueueNzb(&diskState, BString<100>("nzb%i", i),
+				1000 + i * fileCount, fileCount, articleCount));
+		}
+		REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, true));
+	}
+
+	DownloadQueueMock loadedQueue;
+	DiskState loadState;
+	int64 start = Util::GetCurrentTicks();
+	REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+	int64 loadTime = Util::GetCurrentTicks() - start;
+
+	start = Util::GetCurrentTicks();
+	loadState.LoadFileStates(nullptr);
+	int64 stateTime = Util::GetCurrentTicks() - start;
+
+	REQUIRE((int)loadedQueue.GetQueue()->size() == nzbCount);
+
+	WARN(BString<1024>("%i files with %i articles each: queue load %i ms, file states %i ms",
+		nzbCount * fileCount, articleCount, (int)(loadTime / 1000), (int)(stateTime / 1000)).Str());
+}
+
+TEST_CASE("DiskState: history archive", "[DiskState][Quick]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	CString queueDirOption = CString::FormatStr("QueueDir=%s", TestUtil::WorkingDir().c_str());
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("SaveQueue=no");
+	cmdOpts.push_back(queueDirOption);
+	Options options(&cmdOpts, nullptr);
+	std::string archiveFilename(TestUtil::WorkingDir() + "/archive");
+
+	DownloadQueueMock downloadQueue;
+	DiskState diskState;
+
+	std::unique_ptr<NzbInfo> nzbInfo = MakeNzbInfo("old");
+	nzbInfo->SetDupeKey("old-key");
+	nzbInfo->GetParameters()->SetParameter("*Unpack:", "yes");
+	int oldId = nzbInfo->GetId();
+	downloadQueue.GetHistory()->Add(std::make_unique<HistoryInfo>(MakeNzbInfo("recent")));
+	downloadQueue.GetHistory()->Add(std::make_unique<HistoryInfo>(MakeNzbInfo("older")));
+	downloadQueue.GetHistory()->Add(std::make_unique<HistoryInfo>(std::move(nzbInfo)));
+
+	// archived entries are replaced with their headers
+	for (int i = 0; i < 2; i++)
+	{
+		std::unique_ptr<ArchiveInfo> archiveInfo = diskState.ArchiveHistory(downloadQueue.GetHistory()->back().get());
+		REQUIRE(archiveInfo != nullptr);
+		downloadQueue.GetArchive()->Add(std::move(archiveInfo), true);
+		downloadQueue.GetHistory()->pop_back();
+	}
+	REQUIRE(std::string(downloadQueue.GetArchive()->Find(oldId)->GetDupeKey()) == "old-key");
+	REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, true));
+
+	{
+		DownloadQueueMock loadedQueue;
+		DiskState loadState;
+		REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+		REQUIRE(QueueNames(&loadedQueue) == "|recent;");
+		REQUIRE(loadedQueue.GetArchive()->size() == 2);
+		ArchiveInfo* archiveInfo = loadedQueue.GetArchive()->Find(oldId);
+		REQUIRE(std::string(archiveInfo->GetName()) == "old");
+		REQUIRE(std::string(archiveInfo->GetDupeKey()) == "old-key");
+
+		std::unique_ptr<HistoryInfo> archivedInfo = loadState.LoadArchivedHistory(archiveInfo, nullptr);
+		REQUIRE(archivedInfo != nullptr);
+		REQUIRE(std::string(archivedInfo->GetNzbInfo()->GetParameters()->Find("*Unpack:", false)->GetValue()) == "yes");
+	}
+
+	// restored entry is removed from the archive on the next save
+	ArchiveInfo* archiveInfo = downloadQueue.GetArchive()->Find(oldId);
+	std::unique_ptr<HistoryInfo> historyInfo = diskState.LoadArchivedHistory(archiveInfo, nullptr);
+	REQUIRE(historyInfo != nullptr);
+	diskState.RemoveArchived(oldId);
+	downloadQueue.GetArchive()->Remove(archiveInfo);
+	downloadQueue.GetHistory()->Add(std::move(historyInfo));
+	REQUIRE(diskState.SaveDownloadQueue(&downloadQueue, true));
+
+	{
+		DownloadQueueMock loadedQueue;
+		DiskState loadState;
+		REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+		REQUIRE(QueueNames(&loadedQueue) == "|recent;old;");
+		REQUIRE(loadedQueue.GetArchive()->size() == 1);
+		REQUIRE(std::string(loadedQueue.GetArchive()->front()->GetName()) == "older");
+	}
+
+	// incompletely written record is discarded
+	{
+		DiskFile file;
+		REQUIRE(file.Open(archiveFilename.c_str(), DiskFile::omAppend));
+		file.Print("%i,%i,0,1000,0,0,0,0\nname\n\n", oldId + 10, (int)HistoryInfo::hkNzb);
+		file.Close();
+
+		DownloadQueueMock loadedQueue;
+		DiskState loadState;
+		REQUIRE(loadState.LoadDownloadQueue(&loadedQueue, nullptr));
+		REQUIRE(loadedQueue.GetArchive()->size() == 1);
+		REQUIRE(loadState.LoadArchivedHistory(loadedQueue.GetArchive()->front().get(), nullptr) != nullptr);
+	}
+
+	// empty archive is deleted
+	REQUIRE(FileSystem::FileExists(archiveFilename.c_str()));
+	downloadQueue.GetArchive()->clear();
+	diskState.CompactHistoryArchive(downloadQueue.GetArchive());
+	REQUIRE_FALSE(FileSystem::FileExists(archiveFilename.c_str()));
+}
@@ -0,0 +1,175 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "nzbget.h"
+
+#include "catch.h"
+
+#include "DownloadInfo.h"
+#include "Util.h"
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+TEST_CASE("ArticleList: message-ID arena", "[ArticleList][Quick]")
+{
+	FileInfo fileInfo;
+	ArticleList* articles = fileInfo.GetArticles();
+
+	for (int i = 0; i < 1000; i++)
+	{
+		articles->Add(i + 1, 1000 + i, BString<100>("<part%i.abcdefgh@news.example.com>", i + 1));
+	}
+
+	// long message-ID doesn't fit into a chunk
+	CString longId;
+	longId.Reserve(100000);
+	memset((char*)longId, 'x', 100000);
+	((char*)longId)[100000] = '\0';
+	articles->SetMessageId(&articles->at(10), longId);
+
+	REQUIRE(articles->size() == 1000);
+	REQUIRE(std::string(articles->at(0).GetMessageId()) == "<part1.abcdefgh@news.example.com>");
+	REQUIRE(std::string(articles->at(999).GetMessageId()) == "<part1000.abcdefgh@news.example.com>");
+	REQUIRE(strlen(articles->at(10).GetMessageId()) == 100000);
+	REQUIRE(articles->at(999).GetSize() == 1999);
+
+	int partNumber = 0;
+	for (ArticleInfo* article : articles)
+	{
+		REQUIRE(article->GetPartNumber() == ++partNumber);
+	}
+
+	articles->at(5).SetPartNumber(0);
+	articles->RemoveEmpty();
+	REQUIRE(articles->size() == 999);
+	REQUIRE(articles->at(5).GetPartNumber() == 7);
+
+	articles->clear();
+	REQUIRE(articles->empty());
+	REQUIRE(articles->GetMemorySize() == 0);
+}
+
+TEST_CASE("ArticleList: memory benchmark", "[ArticleList][Benchmark][.]")
+{
+	const int fileCount = 10000;
+	const int articleCount = 100;
+	const int segmentCount = fileCount * articleCount;
+
+#ifdef __GLIBC__
+	struct mallinfo2 heapBefore = mallinfo2();
+#endif
+
+	std::vector<std::unique_ptr<FileInfo>> files;
+	int64 listSize = 0;
+	for (int f = 0; f < fileCount; f++)
+	{
+		std::unique_ptr<FileInfo> fileInfo = std::make_unique<FileInfo>(f + 1);
+		fileInfo->GetArticles()->reserve(articleCount);
+		for (int i = 0; i < articleCount; i++)
+		{
+			fileInfo->GetArticles()->Add(i + 1, 700000 + i,
+				BString<100>("part%i.abcdefgh%i@news.example.com", i + 1, f));
+		}
+		listSize += fileInfo->GetArticles()->GetMemorySize();
+		files.push_back(std::move(fileInfo));
+	}
+
+	printf("  %i segments: article size %i bytes, article list %.1f bytes per segment\n",
+		segmentCount, (int)sizeof(ArticleInfo), (double)listSize / segmentCount);
+
+#ifdef __GLIBC__
+	struct mallinfo2 heapAfter = mallinfo2();
+	printf("  heap %.1f bytes per segment (including file infos)\n",
+		(double)(heapAfter.uordblks - heapBefore.uordblks) / segmentCount);
+#endif
+
+	int64 start = Util::GetCurrentTicks();
+	int undefined = 0;
+	for (int i = 0; i < 20; i++)
+	{
+		for (std::unique_ptr<FileInfo>& fileInfo : files)
+		{
+			for (ArticleInfo* article : fileInfo->GetArticles())
+			{
+				undefined += article->GetStatus() == ArticleInfo::aiUndefined ? 1 : 0;
+			}
+		}
+	}
+	printf("  status scan of %i segments: %i ms\n", segmentCount * 20,
+		(int)((Util::GetCurrentTicks() - start) / 1000));
+
+	REQUIRE(undefined == segmentCount * 20);
+}
+
+class FileIndexQueueMock : public DownloadQueue
+{
+public:
+	FileIndexQueueMock() { Init(this); }
+	~FileIndexQueueMock() { Final(); }
+	virtual bool EditEntry(int ID, EEditAction action, int offset, const char* text) { return false; }
+	virtual bool EditList(IdList* idList, NameList* nameList, EMatchMode matchMode, EEditAction action, int offset, const char* text) { return false; }
+	virtual void HistoryChanged() {}
+	virtual void Save() {}
+	virtual void SaveChanged(int nzbId) {}
+};
+
+TEST_CASE("DownloadQueue: find file", "[DownloadQueue][Quick]")
+{
+	FileIndexQueueMock downloadQueue;
+
+	std::unique_ptr<NzbInfo> nzbInfo1 = std::make_unique<NzbInfo>();
+	std::unique_ptr<FileInfo> fileInfo1 = std::make_unique<FileInfo>();
+	FileInfo* file1 = fileInfo1.get();
+	nzbInfo1->GetFileList()->Add(std::move(fileInfo1));
+	NzbInfo* nzb1 = nzbInfo1.get();
+
+	// files of nzbs not in queue aren't found
+	REQUIRE(downloadQueue.FindFile(file1->GetId()) == nullptr);
+	downloadQueue.GetQueue()->Add(std::move(nzbInfo1));
+	REQUIRE(downloadQueue.FindFile(file1->GetId()) == file1);
+
+	// file added to a queued nzb
+	std::unique_ptr<FileInfo> fileInfo2 = std::make_unique<FileInfo>();
+	FileInfo* file2 = fileInfo2.get();
+	nzb1->GetFileList()->Add(std::move(fileInfo2));
+	REQUIRE(downloadQueue.FindFile(file2->GetId()) == file2);
+
+	// file moved to another nzb
+	downloadQueue.GetQueue()->Add(std::make_unique<NzbInfo>());
+	NzbInfo* nzb2 = downloadQueue.GetQueue()->back().get();
+	nzb2->GetFileList()->Add(nzb1->GetFileList()->Remove(file2));
+	REQUIRE(downloadQueue.FindFile(file2->GetId()) == file2);
+	REQUIRE(nzb1->GetFileList()->Find(file2->GetId()) == nullptr);
+
+	// file list moved to another nzb, the old files of that nzb are deleted
+	int fileId1 = file1->GetId();
+	int fileId2 = file2->GetId();
+	nzb2->MoveFileList(nzb1);
+	REQUIRE(downloadQueue.FindFile(fileId1) == file1);
+	REQUIRE(downloadQueue.FindFile(fileId2) == nullptr);
+
+	// nzb deleted together with its files
+	downloadQueue.GetQueue()->Remove(nzb2);
+	REQUIRE(downloadQueue.FindFile(fileId1) == nullptr);
+	REQUIRE(downloadQueue.FindFile(12345678) == nullptr);
+}
@@ -0,0 +1,119 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "nzbget.h"
+
+#include "catch.h"
+
+#include "DupeCoordinator.h"
+
+class DupeQueueMock : public DownloadQueue
+{
+public:
+	DupeQueueMock() { Init(this); }
+	~DupeQueueMock() { Final(); }
+	virtual bool EditEntry(int ID, EEditAction action, int offset, const char* text) { return false; }
+	virtual bool EditList(IdList* idList, NameList* nameList, EMatchMode matchMode, EEditAction action, int offset, const char* text) { return false; }
+	virtual void HistoryChanged() {}
+	virtual void Save() {}
+	virtual void SaveChanged(int nzbId) {}
+};
+
+NzbInfo* AddNzb(DownloadQueue* downloadQueue, const char* name, bool addTop = false)
+{
+	std::unique_ptr<NzbInfo> nzbInfo = std::make_unique<NzbInfo>();
+	nzbInfo->SetName(name);
+	NzbInfo* result = nzbInfo.get();
+	downloadQueue->GetQueue()->Add(std::move(nzbInfo), addTop);
+	return result;
+}
+
+std::string HistoryDupes(DupeCoordinator* dupeCoordinator, DownloadQueue* downloadQueue, const char* name)
+{
+	NzbInfo nzbInfo;
+	nzbInfo.SetName(name);
+
+	std::string ids;
+	for (NzbInfo* dupeInfo : dupeCoordinator->ListHistoryDupes(downloadQueue, &nzbInfo))
+	{
+		ids += std::to_string(dupeInfo->GetId()) + ";";
+	}
+	return ids;
+}
+
+TEST_CASE("DupeCoordinator: queue dupes after add, edit and delete", "[DupeCoordinator][Quick]")
+{
+	DupeQueueMock downloadQueue;
+	DupeCoordinator dupeCoordinator;
+
+	NzbInfo* one = AddNzb(&downloadQueue, "one");
+	REQUIRE(dupeCoordinator.GetDupeStatus(&downloadQueue, "one", "") == DupeCoordinator::dsQueued);
+	REQUIRE(dupeCoordinator.GetDupeStatus(&downloadQueue, "two", "") == DupeCoordinator::dsNone);
+
+	// added after the index was built
+	NzbInfo* two = AddNzb(&downloadQueue, "two");
+	REQUIRE(dupeCoordinator.GetDupeStatus(&downloadQueue, "two", "") == DupeCoordinator::dsQueued);
+
+	// edited without saving the queue
+	two->SetName("three");
+	one->SetDupeKey("key");
+	REQUIRE(dupeCoordinator.GetDupeStatus(&downloadQueue, "two", "") == DupeCoordinator::dsNone);
+	REQUIRE(dupeCoordinator.GetDupeStatus(&downloadQueue, "three", "") == DupeCoordinator::dsQueued);
+	REQUIRE(dupeCoordinator.GetDupeStatus(&downloadQueue, "other", "key") == DupeCoordinator::dsQueued);
+
+	// deleted
+	downloadQueue.GetQueue()->Remove(one);
+	REQUIRE(dupeCoordinator.GetDupeStatus(&downloadQueue, "other", "key") == DupeCoordinator::dsNone);
+	REQUIRE(dupeCoordinator.GetDupeStatus(&downloadQueue, "three", "") == DupeCoordinator::dsQueued);
+
+	downloadQueue.GetQueue()->clear();
+	REQUIRE(dupeCoordinator.GetDupeStatus(&downloadQueue, "three", "") == DupeCoordinator::dsNone);
+}
+
+TEST_CASE("DupeCoordinator: history dupes after add, edit and delete", "[DupeCoordinator][Quick]")
+{
+	DupeQueueMock downloadQueue;
+	DupeCoordinator dupeCoordinator;
+	HistoryList* history = downloadQueue.GetHistory();
+
+	NzbInfo* one = AddNzb(&downloadQueue, "one");
+	REQUIRE(HistoryDupes(&dupeCoordinator, &downloadQueue, "one") == "");
+
+	// moved from queue to history
+	history->Add(std::make_unique<HistoryInfo>(downloadQueue.GetQueue()->Remove(one)), true);
+	std::string oneId = std::to_string(one->GetId()) + ";";
+	REQUIRE(HistoryDupes(&dupeCoordinator, &downloadQueue, "one") == oneId);
+
+	// newer items are found first, as they are in the history list
+	NzbInfo* newOne = AddNzb(&downloadQueue, "one");
+	history->Add(std::make_unique<HistoryInfo>(downloadQueue.GetQueue()->Remove(newOne)), true);
+	std::string newOneId = std::to_string(newOne->GetId()) + ";";
+	REQUIRE(HistoryDupes(&dupeCoordinator, &downloadQueue, "one") == newOneId + oneId);
+
+	// edited without saving the history
+	newOne->SetName("two");
+	REQUIRE(HistoryDupes(&dupeCoordinator, &downloadQueue, "one") == oneId);
+	REQUIRE(HistoryDupes(&dupeCoordinator, &downloadQueue, "two") == newOneId);
+
+	// deleted
+	history->erase(history->begin());
+	REQUIRE(HistoryDupes(&dupeCoordinator, &downloadQueue, "two") == "");
+	REQUIRE(HistoryDupes(&dupeCoordinator, &downloadQueue, "one") == oneId);
+}
@@ -25,6 +25,7 @@
 #include "NzbFile.h"
 #include "Options.h"
 #include "TestUtil.h"
+#include "Util.h"
 
 void TestNzb(std::string testFilename)
 {
@@ -69,4 +70,52 @@ TEST_CASE("Nzb parser", "[NzbFile][TestData]")
 
 	TestNzb("dotless");
 	TestNzb("plain");
+	TestNzb("entities");
+}
+
+void WriteSyntheticNzb(const char* filename, int fileCount, int segmentCount)
+{
+	FILE* file = fopen(filename, FOPEN_WB);
+	REQUIRE(file != nullptr);
+	fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<!DOCTYPE nzb PUBLIC \"-//newzBin//DTD NZB 1.1//EN\" \"http://www.newzbin.com/DTD/nzb/nzb-1.1.dtd\">\n"
+		"<nzb xmlns=\"http://www.newzbin.com/DTD/2003/nzb\">\n"
+		"<head>\n<meta type=\"password\">secret</meta>\n</head>\n");
+	for (int i = 0; i < fileCount; i++)
+	{
+		fprintf(file, "<file poster=\"poster &lt;poster@example.com&gt;\" date=\"1453000000\" "
+			"subject=\"[%i/%i] - &quot;archive.part%03i.rar&quot; yEnc (1/%i)\">\n"
+			"<groups>\n<group>alt.binaries.test</group>\n</groups>\n<segments>\n",
+			i + 1, fileCount, i + 1, segmentCount);
+		for (int k = 0; k < segmentCount; k++)
+		{
+			fprintf(file, "<segment bytes=\"768000\" number=\"%i\">part%iof%i.Ab1Cd2Ef3Gh4Ij5@news.example.com</segment>\n",
+				k + 1, k + 1 + i * segmentCount, fileCount * segmentCount);
+		}
+		fprintf(file, "</segments>\n</file>\n");
+	}
+	fprintf(file, "</nzb>\n");
+	fclose(file);
+}
+
+TEST_CASE("Nzb parser benchmark", "[NzbFile][Benchmark][.]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	Options::CmdOptList cmdOpts;
+	cmdOpts.push_back("SaveQueue=no");
+	Options options(&cmdOpts, nullptr);
+
+	std::string nzbFilename(TestUtil::WorkingDir() + "/synthetic.nzb");
+	WriteSyntheticNzb(nzbFilename.c_str(), 1000, 200);
+
+	int64 start = Util::GetCurrentTicks();
+	NzbFile nzbFile(nzbFilename.c_str(), "");
+	REQUIRE(nzbFile.Parse());
+	int64 parseTime = Util::GetCurrentTicks() - start;
+
+	std::unique_ptr<NzbInfo> nzbInfo = nzbFile.DetachNzbInfo();
+	REQUIRE(nzbInfo->GetFileCount() == 1000);
+	REQUIRE(nzbInfo->GetTotalArticles() == 200000);
+
+	WARN(BString<1024>("1000 files with 200 segments each: parse %i ms", (int)(parseTime / 1000)).Str());
 }
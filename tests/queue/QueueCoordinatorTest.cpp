@@ -0,0 +1,69 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "nzbget.h"
+
+#include "catch.h"
+
+#include "QueueCoordinator.h"
+#include "ArticleWriter.h"
+
+TEST_CASE("Backpressure: disk load", "[Backpressure][Quick]")
+{
+	// idle disk
+	REQUIRE_FALSE(ArticleCache::EvaluateDiskBound(false, 0, 0));
+
+	// entering disk bound state
+	REQUIRE(ArticleCache::EvaluateDiskBound(false, 80, 0));
+	REQUIRE(ArticleCache::EvaluateDiskBound(false, 0, 200 * 1000));
+
+	// between the thresholds the state is kept
+	REQUIRE_FALSE(ArticleCache::EvaluateDiskBound(false, 70, 150 * 1000));
+	REQUIRE(ArticleCache::EvaluateDiskBound(true, 70, 50 * 1000));
+	REQUIRE(ArticleCache::EvaluateDiskBound(true, 10, 150 * 1000));
+
+	// leaving disk bound state
+	REQUIRE_FALSE(ArticleCache::EvaluateDiskBound(true, 59, 99 * 1000));
+}
+
+TEST_CASE("Backpressure: download threads", "[Backpressure][Quick]")
+{
+	// reducing by a quarter down to the minimum
+	REQUIRE(QueueCoordinator::CalcThrottledLimit(40, 40, true) == 30);
+	REQUIRE(QueueCoordinator::CalcThrottledLimit(30, 40, true) == 22);
+	REQUIRE(QueueCoordinator::CalcThrottledLimit(4, 40, true) == 3);
+	REQUIRE(QueueCoordinator::CalcThrottledLimit(3, 40, true) == 3);
+
+	// the minimum never exceeds the configured limit
+	REQUIRE(QueueCoordinator::CalcThrottledLimit(2, 2, true) == 2);
+
+	// restoring gradually up to the configured limit
+	REQUIRE(QueueCoordinator::CalcThrottledLimit(3, 40, false) == 8);
+	REQUIRE(QueueCoordinator::CalcThrottledLimit(38, 40, false) == 40);
+	REQUIRE(QueueCoordinator::CalcThrottledLimit(40, 40, false) == 40);
+
+	// sustained high write latency throttles down to the minimum
+	int limit = 40;
+	for (int i = 0; i < 20; i++)
+	{
+		limit = QueueCoordinator::CalcThrottledLimit(limit, 40, ArticleCache::EvaluateDiskBound(false, 0, 300 * 1000));
+	}
+	REQUIRE(limit == 3);
+}
@@ -0,0 +1,121 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2015-2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "nzbget.h"
+
+#include "catch.h"
+
+#include "Container.h"
+
+class IdItem
+{
+public:
+	IdItem(int id) : m_id(id) {}
+	int GetId() { return m_id; }
+
+private:
+	int m_id;
+};
+
+typedef UniqueDeque<IdItem> IdItemList;
+
+TEST_CASE("UniqueDeque: id index", "[Container][Quick]")
+{
+	IdItemList list;
+	for (int i = 1; i <= 10; i++)
+	{
+		list.Add(std::make_unique<IdItem>(i), i % 2 == 0);
+	}
+
+	REQUIRE(list.Find(5)->GetId() == 5);
+	REQUIRE(list.Find(11) == nullptr);
+
+	// reordering doesn't affect the index
+	std::swap(list.front(), list.back());
+	REQUIRE(list.Find(1)->GetId() == 1);
+
+	std::unique_ptr<IdItem> removed = list.Remove(list.Find(3));
+	REQUIRE(removed->GetId() == 3);
+	REQUIRE(list.Find(3) == nullptr);
+
+	list.erase(list.Find(list.Find(4)));
+	REQUIRE(list.Find(4) == nullptr);
+
+	// moving an item to other position (the erased element is empty)
+	IdItemList::iterator it = list.Find(list.Find(6));
+	std::unique_ptr<IdItem> moved = std::move(*it);
+	list.erase(it);
+	REQUIRE(list.Find(6) == nullptr);
+	list.insert(list.begin(), std::move(moved));
+	REQUIRE(list.Find(6) == list.front().get());
+	REQUIRE(list.Find(7)->GetId() == 7);
+
+	list.Replace(list.Find(list.Find(7)), std::make_unique<IdItem>(17));
+	REQUIRE(list.Find(7) == nullptr);
+	REQUIRE(list.Find(17)->GetId() == 17);
+
+	IdItemList otherList;
+	otherList = std::move(list);
+	REQUIRE(list.Find(17) == nullptr);
+	REQUIRE(otherList.Find(17)->GetId() == 17);
+	REQUIRE(otherList.size() == 8);
+
+	otherList.pop_front();
+	REQUIRE(otherList.Find(6) == nullptr);
+	otherList.clear();
+	REQUIRE(otherList.Find(1) == nullptr);
+}
+
+class PresenceListener : public ContainerListener
+{
+public:
+	PresenceListener(IdItemList* list) : m_list(list) {}
+	virtual void ItemChanged(int id) { m_present[id] = m_list->Find(id) != nullptr; }
+	std::map<int, bool> m_present;
+
+private:
+	IdItemList* m_list;
+};
+
+TEST_CASE("UniqueDeque: listener", "[Container][Quick]")
+{
+	IdItemList list;
+	PresenceListener listener(&list);
+	list.SetListener(&listener);
+
+	list.Add(std::make_unique<IdItem>(1));
+	list.Add(std::make_unique<IdItem>(2));
+	REQUIRE(listener.m_present[1]);
+	REQUIRE(listener.m_present[2]);
+
+	list.Remove(list.Find(1));
+	REQUIRE_FALSE(listener.m_present[1]);
+
+	// listener is called after the items were removed
+	list.clear();
+	REQUIRE_FALSE(listener.m_present[2]);
+
+	list.Add(std::make_unique<IdItem>(3));
+	IdItemList otherList;
+	otherList.Add(std::make_unique<IdItem>(4));
+	list = std::move(otherList);
+	REQUIRE_FALSE(listener.m_present[3]);
+	REQUIRE(listener.m_present[4]);
+}
@@ -23,6 +23,7 @@
 #include "catch.h"
 
 #include "FileSystem.h"
+#include "TestUtil.h"
 
 #ifdef WIN32
 TEST_CASE("FileSystem: MakeCanonicalPath", "[FileSystem][Quick]")
@@ -37,3 +38,98 @@ TEST_CASE("FileSystem: MakeCanonicalPath", "[FileSystem][Quick]")
 	REQUIRE(!strcmp(FileSystem::MakeCanonicalPath("\\\\server\\Program Files\\NZBGet\\scripts\\email\\..\\..\\"), "\\\\server\\Program Files\\NZBGet\\"));
 }
 #endif
+
+TEST_CASE("FileSystem: MappedFile", "[FileSystem][Quick]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	std::string filename(TestUtil::WorkingDir() + "/mapped.out");
+
+	CString errmsg;
+	REQUIRE(FileSystem::AllocateFile(filename.c_str(), 100000, true, errmsg));
+
+	{
+		MappedFile mappedFile;
+		REQUIRE(mappedFile.Open(filename.c_str(), 100000));
+		REQUIRE(mappedFile.Active());
+		memset(mappedFile.GetData() + 5000, 'a', 20000);
+		REQUIRE(mappedFile.Flush(5000, 20000));
+		memset(mappedFile.GetData() + 99990, 'b', 10);
+		REQUIRE(mappedFile.Flush(99990, 10));
+		REQUIRE_FALSE(mappedFile.Flush(99990, 11));
+		REQUIRE(mappedFile.Close());
+		REQUIRE_FALSE(mappedFile.Active());
+	}
+
+	REQUIRE(FileSystem::FileSize(filename.c_str()) == 100000);
+
+	CharBuffer buffer;
+	REQUIRE(FileSystem::LoadFileIntoBuffer(filename.c_str(), buffer, false));
+	REQUIRE(buffer[4999] == 0);
+	REQUIRE(buffer[5000] == 'a');
+	REQUIRE(buffer[24999] == 'a');
+	REQUIRE(buffer[25000] == 0);
+	REQUIRE(buffer[99999] == 'b');
+
+	MappedFile missingFile;
+	REQUIRE_FALSE(missingFile.Open((TestUtil::WorkingDir() + "/missing.out").c_str(), 100000));
+	REQUIRE_FALSE(missingFile.Active());
+}
+
+TEST_CASE("FileSystem: VolumeId of not yet created directory", "[FileSystem][Quick]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	std::string finalDir(TestUtil::WorkingDir() + "/dest/name");
+
+	REQUIRE(FileSystem::VolumeId(TestUtil::WorkingDir().c_str()) != -1);
+	REQUIRE(FileSystem::VolumeId(finalDir.c_str()) == FileSystem::VolumeId(TestUtil::WorkingDir().c_str()));
+}
+
+TEST_CASE("FileSystem: AllocateFile", "[FileSystem][Quick]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	std::string sparseFilename(TestUtil::WorkingDir() + "/sparse.out");
+	std::string fullFilename(TestUtil::WorkingDir() + "/full.out");
+
+	CString errmsg;
+	FileSystem::EAllocMethod method = FileSystem::amNone;
+
+	REQUIRE(FileSystem::AllocateFile(sparseFilename.c_str(), 1000000, true, errmsg, &method));
+	REQUIRE(FileSystem::FileSize(sparseFilename.c_str()) == 1000000);
+	REQUIRE(method != FileSystem::amNone);
+
+	REQUIRE(FileSystem::AllocateFile(fullFilename.c_str(), 1000000, false, errmsg, &method));
+	REQUIRE(FileSystem::FileSize(fullFilename.c_str()) == 1000000);
+	REQUIRE(method != FileSystem::amNone);
+
+	// allocating a range must never change the file size
+	FileSystem::AllocateFileRange(sparseFilename.c_str(), 500000, 250000, errmsg, &method);
+	REQUIRE(FileSystem::FileSize(sparseFilename.c_str()) == 1000000);
+
+	CharBuffer buffer;
+	REQUIRE(FileSystem::LoadFileIntoBuffer(fullFilename.c_str(), buffer, false));
+	REQUIRE(buffer.Size() == 1000000);
+	REQUIRE(std::count(*buffer, *buffer + buffer.Size(), 0) == 1000000);
+}
+
+TEST_CASE("FileSystem: AllocateFile on full disk", "[FileSystem][Quick]")
+{
+	TestUtil::PrepareWorkingDir("nzbfile");
+	std::string filename(TestUtil::WorkingDir() + "/huge.out");
+
+	CString errmsg;
+	FileSystem::EAllocMethod method = FileSystem::amNone;
+	int64 size = FileSystem::FreeDiskSize(TestUtil::WorkingDir().c_str()) + 1024 * 1024 * 1024;
+
+	// the file must never be reported as allocated, either the allocation fails
+	// or (on file systems without preallocation support) a sparse file is created
+	bool ok = FileSystem::AllocateFile(filename.c_str(), size, false, errmsg, &method);
+	if (ok)
+	{
+		REQUIRE(method == FileSystem::amSparse);
+	}
+	else
+	{
+		REQUIRE(method == FileSystem::amNone);
+		REQUIRE(FileSystem::FileSize(filename.c_str()) == 0);
+	}
+}
@@ -0,0 +1,111 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "nzbget.h"
+
+#include "catch.h"
+
+#include "Service.h"
+#include "Util.h"
+
+#ifndef WIN32
+class EventServiceMock : public Service
+{
+public:
+	EventServiceMock() { Reopen(); }
+	~EventServiceMock() { close(m_pipe[0]); close(m_pipe[1]); }
+	void Notify();
+	int GetEvents() { Guard guard(m_eventsMutex); return m_events; }
+
+protected:
+	virtual int ServiceInterval() { return 60000; }
+	virtual void ServiceWork() {}
+	virtual int ServiceEventFd() { return m_pipe[0]; }
+	virtual void ServiceEvent();
+
+private:
+	int m_pipe[2] = {-1, -1};
+	int m_events = 0;
+	Mutex m_eventsMutex;
+
+	void Reopen();
+};
+
+void EventServiceMock::Reopen()
+{
+	if (m_pipe[0] > -1)
+	{
+		close(m_pipe[0]);
+		close(m_pipe[1]);
+	}
+	REQUIRE(pipe(m_pipe) == 0);
+}
+
+void EventServiceMock::Notify()
+{
+	Guard guard(m_eventsMutex);
+	REQUIRE(write(m_pipe[1], "x", 1) == 1);
+}
+
+void EventServiceMock::ServiceEvent()
+{
+	// the service replaces its descriptor, as scanner does when it restarts watching
+	Guard guard(m_eventsMutex);
+	Reopen();
+	m_events++;
+}
+
+bool WaitEvents(EventServiceMock* service, int count)
+{
+	for (int64 start = Util::GetCurrentTicks(); Util::GetCurrentTicks() - start < 2000000; )
+	{
+		if (service->GetEvents() >= count)
+		{
+			return true;
+		}
+		usleep(1000);
+	}
+	return false;
+}
+
+TEST_CASE("ServiceCoordinator: events before interval expires", "[Service][Quick]")
+{
+	ServiceCoordinator* oldCoordinator = g_ServiceCoordinator;
+	ServiceCoordinator serviceCoordinator;
+	g_ServiceCoordinator = &serviceCoordinator;
+	EventServiceMock service;
+	g_ServiceCoordinator = oldCoordinator;
+
+	serviceCoordinator.Start();
+
+	service.Notify();
+	REQUIRE(WaitEvents(&service, 1));
+
+	// the new descriptor is polled too
+	service.Notify();
+	REQUIRE(WaitEvents(&service, 2));
+
+	serviceCoordinator.Stop();
+	while (serviceCoordinator.IsRunning())
+	{
+		usleep(1000);
+	}
+}
+#endif
@@ -0,0 +1,142 @@
+/*
+ *  This file is part of nzbget. See <http://nzbget.net>.
+ *
+ *  Copyright (C) 2015-2016 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "nzbget.h"
+
+#include "catch.h"
+
+#include "Thread.h"
+#include "Util.h"
+
+template <typename M>
+class LockThread : public Thread
+{
+public:
+	LockThread(M* mutex, bool shared, int count, int holdTime) :
+		m_mutex(mutex), m_shared(shared), m_count(count), m_holdTime(holdTime) {}
+
+protected:
+	virtual void Run();
+
+private:
+	M* m_mutex;
+	bool m_shared;
+	int m_count;
+	int m_holdTime;
+};
+
+template <>
+void LockThread<Mutex>::Run()
+{
+	for (int i = 0; i < m_count; i++)
+	{
+		Guard guard(m_mutex);
+		usleep(m_holdTime);
+	}
+}
+
+template <>
+void LockThread<RwMutex>::Run()
+{
+	for (int i = 0; i < m_count; i++)
+	{
+		if (m_shared)
+		{
+			SharedGuardedPtr<RwMutex> guard(m_mutex, m_mutex);
+			usleep(m_holdTime);
+		}
+		else
+		{
+			GuardedPtr<RwMutex, RwMutex> guard(m_mutex, m_mutex);
+			usleep(m_holdTime);
+		}
+	}
+}
+
+template <typename M>
+int RunLockThreads(M* mutex, int readers, int count, int holdTime)
+{
+	int64 start = Util::GetCurrentTicks();
+
+	std::vector<std::unique_ptr<LockThread<M>>> threads;
+	for (int i = 0; i < readers; i++)
+	{
+		threads.push_back(std::make_unique<LockThread<M>>(mutex, true, count, holdTime));
+	}
+	// one writer
+	threads.push_back(std::make_unique<LockThread<M>>(mutex, false, count, 10));
+
+	for (std::unique_ptr<LockThread<M>>& thread : threads)
+	{
+		thread->Start();
+	}
+
+	for (std::unique_ptr<LockThread<M>>& thread : threads)
+	{
+		while (thread->IsRunning())
+		{
+			usleep(1000);
+		}
+	}
+
+	return (int)((Util::GetCurrentTicks() - start) / 1000);
+}
+
+TEST_CASE("RwMutex: shared and exclusive locks", "[Thread][Quick]")
+{
+	RwMutex mutex;
+
+	RunLockThreads(&mutex, 3, 20, 100);
+
+	mutex.Lock();
+	RwMutex::Stats stats = mutex.GetStats();
+	mutex.Unlock();
+
+	REQUIRE(stats.sharedCount == 60);
+	// including the lock for reading stats
+	REQUIRE(stats.exclusiveCount == 21);
+	REQUIRE(stats.sharedHold > 0);
+	REQUIRE(stats.sharedMaxHold <= stats.sharedHold);
+	REQUIRE(stats.exclusiveMaxHold <= stats.exclusiveHold);
+}
+
+TEST_CASE("RwMutex: concurrent readers benchmark", "[Thread][Benchmark][.]")
+{
+	const int readers = 4;
+	const int count = 200;
+	const int holdTime = 2000;
+
+	Mutex mutex;
+	int mutexTime = RunLockThreads(&mutex, readers, count, holdTime);
+
+	RwMutex rwMutex;
+	int rwMutexTime = RunLockThreads(&rwMutex, readers, count, holdTime);
+
+	rwMutex.Lock();
+	RwMutex::Stats stats = rwMutex.GetStats();
+	rwMutex.Unlock();
+
+	printf("  %i readers holding lock for %i us, one writer: mutex %i ms, rw-mutex %i ms\n",
+		readers, holdTime, mutexTime, rwMutexTime);
+	printf("  writer: avg wait %.3f ms, avg hold %.3f ms; shared hold %.1f ms (max %.1f ms)\n",
+		stats.exclusiveWait / 1000.0 / stats.exclusiveCount, stats.exclusiveHold / 1000.0 / stats.exclusiveCount,
+		stats.sharedHold / 1000.0, stats.sharedMaxHold / 1000.0);
+}
@@ -42,6 +42,8 @@ var History = (new function($)
 	var curFilter = 'ALL';
 	var activeTab = false;
 	var showDup = false;
+	var archived = {};
+	var ARCHIVE_PAGE_SIZE = 100;
 
 	this.init = function(options)
 	{
@@ -110,11 +112,91 @@ var History = (new function($)
 
 	function loaded(curHistory)
 	{
-		history = curHistory;
+		if (missingArchived(curHistory))
+		{
+			loadArchived(curHistory, 0);
+			return;
+		}
+
+		mergeArchived(curHistory);
 		prepare();
 		RPC.next();
 	}
 
+	// Method "history" returns only summaries of archived entries. The complete entries
+	// are loaded page by page via "historyarchive"; they don't change while they are
+	// archived and are therefore loaded only once.
+
+	function missingArchived(curHistory)
+	{
+		for (var i=0; i < curHistory.length; i++)
+		{
+			var hist = curHistory[i];
+			if (hist.Archived && archived[hist.ID] === undefined)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	function loadArchived(curHistory, offset)
+	{
+		RPC.call('historyarchive', [showDup, offset, ARCHIVE_PAGE_SIZE], function(page)
+			{
+				for (var i=0; i < page.length; i++)
+				{
+					archived[page[i].ID] = page[i];
+				}
+
+				// new entries are archived at the beginning, mostly one page is enough
+				if (page.length === ARCHIVE_PAGE_SIZE && missingArchived(curHistory))
+				{
+					loadArchived(curHistory, offset + ARCHIVE_PAGE_SIZE);
+					return;
+				}
+
+				// entries which couldn't be loaded aren't requested again
+				for (var i=0; i < curHistory.length; i++)
+				{
+					var hist = curHistory[i];
+					if (hist.Archived && archived[hist.ID] === undefined)
+					{
+						archived[hist.ID] = null;
+					}
+				}
+
+				mergeArchived(curHistory);
+				prepare();
+				RPC.next();
+			});
+	}
+
+	function mergeArchived(curHistory)
+	{
+		history = [];
+		var curArchived = {};
+		for (var i=0; i < curHistory.length; i++)
+		{
+			var hist = curHistory[i];
+			if (!hist.Archived)
+			{
+				history.push(hist);
+			}
+			else
+			{
+				if (archived[hist.ID])
+				{
+					history.push(archived[hist.ID]);
+				}
+				curArchived[hist.ID] = archived[hist.ID];
+			}
+		}
+
+		// entries moved back into history are loaded again when archived next time
+		archived = curArchived;
+	}
+
 	function prepare()
 	{
 		for (var j=0, jl=history.length; j < jl; j++)